@@ -105,8 +105,7 @@ valent_contact_cache_add_contacts (ValentContactStore  *store,
   g_assert (contacts != NULL);
   g_assert (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
 
-  for (const GSList *iter = contacts; iter; iter = iter->next)
-    additions = g_slist_append (additions, g_object_ref (iter->data));
+  additions = g_slist_copy_deep (contacts, (GCopyFunc)g_object_ref, NULL);
 
   task = g_task_new (store, cancellable, callback, user_data);
   g_task_set_source_tag (task, valent_contact_cache_add_contacts);
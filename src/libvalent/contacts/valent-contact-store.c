@@ -9,6 +9,7 @@
 
 #include "valent-contact-store.h"
 #include "valent-eds.h"
+#include "valent-object-private.h"
 
 
 /**
@@ -64,58 +65,22 @@ static guint signals[N_SIGNALS] = { 0, };
 /*
  * Signal Emission Helpers
  */
-typedef struct
-{
-  GRecMutex  mutex;
-  GWeakRef   store;
-  char      *uid;
-  EContact  *contact;
-} SignalEmission;
-
-static gboolean
-valent_contact_store_contact_added_main (gpointer data)
+static void
+valent_contact_store_contact_added_main (ValentObject *object,
+                                         gpointer      user_data)
 {
-  SignalEmission *emission = data;
-  g_autoptr (ValentContactStore) store = NULL;
-
   g_assert (VALENT_IS_MAIN_THREAD ());
 
-  g_rec_mutex_lock (&emission->mutex);
-  if ((store = g_weak_ref_get (&emission->store)) != NULL)
-    g_signal_emit (G_OBJECT (store),
-                   signals [CONTACT_ADDED], 0,
-                   emission->contact);
-
-  g_weak_ref_clear (&emission->store);
-  g_clear_object (&emission->contact);
-  g_rec_mutex_unlock (&emission->mutex);
-  g_rec_mutex_clear (&emission->mutex);
-  g_clear_pointer (&emission, g_free);
-
-  return G_SOURCE_REMOVE;
+  g_signal_emit (G_OBJECT (object), signals [CONTACT_ADDED], 0, user_data);
 }
 
-static gboolean
-valent_contact_store_contact_removed_main (gpointer data)
+static void
+valent_contact_store_contact_removed_main (ValentObject *object,
+                                           gpointer      user_data)
 {
-  SignalEmission *emission = data;
-  g_autoptr (ValentContactStore) store = NULL;
-
   g_assert (VALENT_IS_MAIN_THREAD ());
 
-  g_rec_mutex_lock (&emission->mutex);
-  if ((store = g_weak_ref_get (&emission->store)) != NULL)
-    g_signal_emit (G_OBJECT (store),
-                   signals [CONTACT_REMOVED], 0,
-                   emission->uid);
-
-  g_weak_ref_clear (&emission->store);
-  g_clear_pointer (&emission->uid, g_free);
-  g_rec_mutex_unlock (&emission->mutex);
-  g_rec_mutex_clear (&emission->mutex);
-  g_clear_pointer (&emission, g_free);
-
-  return G_SOURCE_REMOVE;
+  g_signal_emit (G_OBJECT (object), signals [CONTACT_REMOVED], 0, user_data);
 }
 
 /* LCOV_EXCL_START */
@@ -390,8 +355,6 @@ void
 valent_contact_store_contact_added (ValentContactStore *store,
                                     EContact           *contact)
 {
-  SignalEmission *emission;
-
   g_return_if_fail (VALENT_IS_CONTACT_STORE (store));
 
   if G_LIKELY (VALENT_IS_MAIN_THREAD ())
@@ -400,14 +363,10 @@ valent_contact_store_contact_added (ValentContactStore *store,
       return;
     }
 
-  emission = g_new0 (SignalEmission, 1);
-  g_rec_mutex_init (&emission->mutex);
-  g_rec_mutex_lock (&emission->mutex);
-  g_weak_ref_init (&emission->store, store);
-  emission->contact = g_object_ref (contact);
-  g_rec_mutex_unlock (&emission->mutex);
-
-  g_timeout_add (0, valent_contact_store_contact_added_main, emission);
+  valent_object_invoke_main (VALENT_OBJECT (store),
+                             valent_contact_store_contact_added_main,
+                             g_object_ref (contact),
+                             g_object_unref);
 }
 
 /**
@@ -427,8 +386,6 @@ void
 valent_contact_store_contact_removed (ValentContactStore *store,
                                       const char         *uid)
 {
-  SignalEmission *emission;
-
   g_return_if_fail (VALENT_IS_CONTACT_STORE (store));
 
   if G_LIKELY (VALENT_IS_MAIN_THREAD ())
@@ -437,14 +394,10 @@ valent_contact_store_contact_removed (ValentContactStore *store,
       return;
     }
 
-  emission = g_new0 (SignalEmission, 1);
-  g_rec_mutex_init (&emission->mutex);
-  g_rec_mutex_lock (&emission->mutex);
-  g_weak_ref_init (&emission->store, store);
-  emission->uid = g_strdup (uid);
-  g_rec_mutex_unlock (&emission->mutex);
-
-  g_timeout_add (0, valent_contact_store_contact_removed_main, emission);
+  valent_object_invoke_main (VALENT_OBJECT (store),
+                             valent_contact_store_contact_removed_main,
+                             g_strdup (uid),
+                             g_free);
 }
 
 /**
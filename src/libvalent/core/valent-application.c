@@ -10,6 +10,7 @@
 #include "valent-application.h"
 #include "valent-application-plugin.h"
 #include "valent-component-private.h"
+#include "valent-counters-private.h"
 #include "valent-debug.h"
 #include "valent-global.h"
 
@@ -30,11 +31,77 @@ struct _ValentApplication
 
   GHashTable    *plugins;
   ValentContext *plugins_context;
+  unsigned int   debug_id;
 };
 
 G_DEFINE_FINAL_TYPE (ValentApplication, valent_application, G_TYPE_APPLICATION)
 
 
+/*
+ * ca.andyholmes.Valent.Debug Interface
+ */
+static const GDBusArgInfo * const get_counters_out[] = {
+  &((const GDBusArgInfo){
+    -1,
+    "counters",
+    "a{sv}",
+    NULL
+  }),
+  NULL,
+};
+
+static const GDBusMethodInfo * const debug_methods[] = {
+  &((const GDBusMethodInfo){
+    -1,
+    "GetCounters",
+    NULL,
+    (GDBusArgInfo **)&get_counters_out,
+    NULL
+  }),
+  NULL,
+};
+
+static const GDBusInterfaceInfo debug_info = {
+  -1,
+  "ca.andyholmes.Valent.Debug",
+  (GDBusMethodInfo **)&debug_methods,
+  NULL,
+  NULL,
+  NULL
+};
+
+static void
+valent_application_debug_method_call (GDBusConnection       *connection,
+                                      const char            *sender,
+                                      const char            *object_path,
+                                      const char            *interface_name,
+                                      const char            *method_name,
+                                      GVariant              *parameters,
+                                      GDBusMethodInvocation *invocation,
+                                      gpointer               user_data)
+{
+  if (g_str_equal (method_name, "GetCounters"))
+    {
+      g_dbus_method_invocation_return_value (invocation,
+                                             g_variant_new ("(@a{sv})",
+                                                            valent_counters_snapshot ()));
+      return;
+    }
+
+  g_dbus_method_invocation_return_error (invocation,
+                                         G_DBUS_ERROR,
+                                         G_DBUS_ERROR_UNKNOWN_METHOD,
+                                         "Unknown method \"%s\"",
+                                         method_name);
+}
+
+static const GDBusInterfaceVTable debug_vtable = {
+  valent_application_debug_method_call,
+  NULL,
+  NULL,
+};
+
+
 /*
  * PeasEngine
  */
@@ -255,6 +322,16 @@ valent_application_dbus_register (GApplication     *application,
   if (!klass->dbus_register (application, connection, object_path, error))
     return FALSE;
 
+  self->debug_id = g_dbus_connection_register_object (connection,
+                                                      object_path,
+                                                      (GDBusInterfaceInfo *)&debug_info,
+                                                      &debug_vtable,
+                                                      NULL, NULL,
+                                                      error);
+
+  if (self->debug_id == 0)
+    return FALSE;
+
   g_hash_table_iter_init (&iter, self->plugins);
 
   while (g_hash_table_iter_next (&iter, NULL, (void **)&plugin))
@@ -294,6 +371,12 @@ valent_application_dbus_unregister (GApplication    *application,
                                                  object_path);
     }
 
+  if (self->debug_id != 0)
+    {
+      g_dbus_connection_unregister_object (connection, self->debug_id);
+      self->debug_id = 0;
+    }
+
   /* Chain-up last */
   klass->dbus_unregister (application, connection, object_path);
 }
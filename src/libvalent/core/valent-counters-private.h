@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include <glib.h>
+
+#include "valent-version.h"
+
+G_BEGIN_DECLS
+
+/*< private >
+ * ValentCounter:
+ * @VALENT_COUNTER_PACKETS_IN: packets read from a stream
+ * @VALENT_COUNTER_PACKETS_OUT: packets written to a stream
+ * @VALENT_COUNTER_PACKET_BYTES_IN: bytes of packets read
+ * @VALENT_COUNTER_PACKET_BYTES_OUT: bytes of packets written
+ * @VALENT_COUNTER_PAYLOAD_BYTES_IN: bytes of payloads downloaded
+ * @VALENT_COUNTER_PAYLOAD_BYTES_OUT: bytes of payloads uploaded
+ * @VALENT_COUNTER_WRITE_QUEUE: packets waiting to be written by channels
+ * @VALENT_COUNTER_WRITE_LATENCY: microseconds the last packet spent queued
+ * @VALENT_COUNTER_SLOW_HANDLERS: packets handled on the main thread that
+ *   exceeded the device's `handler-budget`
+ * @VALENT_COUNTER_FIRST_IDENTITY: microseconds from process start until the
+ *   first identity was exchanged with a device
+ *
+ * Built-in runtime counters.
+ */
+typedef enum
+{
+  VALENT_COUNTER_PACKETS_IN,
+  VALENT_COUNTER_PACKETS_OUT,
+  VALENT_COUNTER_PACKET_BYTES_IN,
+  VALENT_COUNTER_PACKET_BYTES_OUT,
+  VALENT_COUNTER_PAYLOAD_BYTES_IN,
+  VALENT_COUNTER_PAYLOAD_BYTES_OUT,
+  VALENT_COUNTER_WRITE_QUEUE,
+  VALENT_COUNTER_WRITE_LATENCY,
+  VALENT_COUNTER_SLOW_HANDLERS,
+  VALENT_COUNTER_FIRST_IDENTITY,
+  VALENT_N_COUNTERS,
+} ValentCounter;
+
+/*< private >
+ * VALENT_DISPATCH_N_BUCKETS:
+ *
+ * The number of buckets in a packet dispatch histogram. Each bucket counts
+ * handlers that returned in less than 100µs, 1ms, 10ms, 100ms and 1s, with the
+ * last bucket counting the remainder.
+ */
+#define VALENT_DISPATCH_N_BUCKETS 6
+
+_VALENT_EXTERN
+const char * valent_counter_get_name        (ValentCounter  counter);
+_VALENT_EXTERN
+const char * valent_counter_get_description (ValentCounter  counter);
+_VALENT_EXTERN
+int64_t      valent_counter_get             (ValentCounter  counter);
+_VALENT_EXTERN
+void         valent_counter_add             (ValentCounter  counter,
+                                             int64_t        value);
+_VALENT_EXTERN
+void         valent_counter_set             (ValentCounter  counter,
+                                             int64_t        value);
+_VALENT_EXTERN
+void         valent_counter_mark            (ValentCounter  counter);
+_VALENT_EXTERN
+void         valent_counter_add_packet      (const char    *type,
+                                             gboolean       outgoing,
+                                             size_t         size);
+_VALENT_EXTERN
+void         valent_counter_add_dispatch    (const char    *device_id,
+                                             const char    *type,
+                                             int64_t        usec);
+_VALENT_EXTERN
+GVariant   * valent_counters_snapshot       (void);
+
+G_END_DECLS
@@ -0,0 +1,427 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#define G_LOG_DOMAIN "valent-counters"
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "valent-counters-private.h"
+
+
+/*
+ * Counters are updated with atomic operations from any thread, and read by the
+ * tracing thread (for sysprof) and D-Bus (for snapshots). Packet counts by type
+ * are kept in a table that only takes the write lock when a new type is seen.
+ */
+static const struct
+{
+  const char *name;
+  const char *description;
+} counter_info[VALENT_N_COUNTERS] = {
+  [VALENT_COUNTER_PACKETS_IN]        = { "packets-in",        "Packets received"              },
+  [VALENT_COUNTER_PACKETS_OUT]       = { "packets-out",       "Packets sent"                  },
+  [VALENT_COUNTER_PACKET_BYTES_IN]   = { "packet-bytes-in",   "Bytes of packets received"     },
+  [VALENT_COUNTER_PACKET_BYTES_OUT]  = { "packet-bytes-out",  "Bytes of packets sent"         },
+  [VALENT_COUNTER_PAYLOAD_BYTES_IN]  = { "payload-bytes-in",  "Bytes of payloads downloaded"  },
+  [VALENT_COUNTER_PAYLOAD_BYTES_OUT] = { "payload-bytes-out", "Bytes of payloads uploaded"    },
+  [VALENT_COUNTER_WRITE_QUEUE]       = { "write-queue",       "Packets queued for writing"    },
+  [VALENT_COUNTER_WRITE_LATENCY]     = { "write-latency",     "Write queue latency (usec)"    },
+  [VALENT_COUNTER_SLOW_HANDLERS]     = { "slow-handlers",     "Handlers over budget"          },
+  [VALENT_COUNTER_FIRST_IDENTITY]    = { "first-identity",    "Time to first identity (usec)" },
+};
+
+static gssize counters[VALENT_N_COUNTERS] = { 0, };
+static int64_t process_start = 0;
+
+typedef struct
+{
+  gssize in;
+  gssize out;
+} PacketCounter;
+
+static GRWLock     packet_lock;
+static GHashTable *packet_counters = NULL;
+
+typedef struct
+{
+  gssize count;
+  gssize total;
+  gssize max;
+  gssize histogram[VALENT_DISPATCH_N_BUCKETS];
+} DispatchCounter;
+
+static GRWLock     dispatch_lock;
+static GHashTable *dispatch_counters = NULL;
+
+
+/*
+ * The time the library was loaded stands in for the time the process started
+ */
+#ifndef __has_attribute
+# define __has_attribute(x) 0  /* Compatibility with non-clang compilers. */
+#endif
+#if __has_attribute(constructor)
+static void __attribute__((constructor))
+valent_counters_ctor (void)
+{
+  process_start = g_get_monotonic_time ();
+}
+#else
+# error Your platform/compiler is missing constructor support
+#endif
+
+
+/**
+ * valent_counter_get_name:
+ * @counter: a `ValentCounter`
+ *
+ * Get the name of @counter, as used in snapshots.
+ *
+ * Returns: (transfer none): the counter name
+ */
+const char *
+valent_counter_get_name (ValentCounter counter)
+{
+  g_return_val_if_fail (counter < VALENT_N_COUNTERS, NULL);
+
+  return counter_info[counter].name;
+}
+
+/**
+ * valent_counter_get_description:
+ * @counter: a `ValentCounter`
+ *
+ * Get a short description of @counter.
+ *
+ * Returns: (transfer none): the counter description
+ */
+const char *
+valent_counter_get_description (ValentCounter counter)
+{
+  g_return_val_if_fail (counter < VALENT_N_COUNTERS, NULL);
+
+  return counter_info[counter].description;
+}
+
+/**
+ * valent_counter_get:
+ * @counter: a `ValentCounter`
+ *
+ * Get the current value of @counter.
+ *
+ * Returns: the counter value
+ */
+int64_t
+valent_counter_get (ValentCounter counter)
+{
+  g_return_val_if_fail (counter < VALENT_N_COUNTERS, 0);
+
+  return (int64_t)g_atomic_pointer_get (&counters[counter]);
+}
+
+/**
+ * valent_counter_add:
+ * @counter: a `ValentCounter`
+ * @value: the value to add
+ *
+ * Add @value to @counter. @value may be negative.
+ */
+void
+valent_counter_add (ValentCounter counter,
+                    int64_t       value)
+{
+  g_return_if_fail (counter < VALENT_N_COUNTERS);
+
+  g_atomic_pointer_add (&counters[counter], value);
+}
+
+/**
+ * valent_counter_set:
+ * @counter: a `ValentCounter`
+ * @value: the new value
+ *
+ * Set @counter to @value.
+ */
+void
+valent_counter_set (ValentCounter counter,
+                    int64_t       value)
+{
+  g_return_if_fail (counter < VALENT_N_COUNTERS);
+
+  g_atomic_pointer_set (&counters[counter], (gssize)value);
+}
+
+/**
+ * valent_counter_mark:
+ * @counter: a `ValentCounter`
+ *
+ * Set @counter to the microseconds elapsed since the process started, unless it
+ * has already been set.
+ */
+void
+valent_counter_mark (ValentCounter counter)
+{
+  int64_t elapsed;
+
+  g_return_if_fail (counter < VALENT_N_COUNTERS);
+
+  elapsed = MAX (g_get_monotonic_time () - process_start, 1);
+  g_atomic_pointer_compare_and_exchange (&counters[counter],
+                                         (gssize)0,
+                                         (gssize)elapsed);
+}
+
+/**
+ * valent_counter_add_packet:
+ * @type: a KDE Connect packet type
+ * @outgoing: %TRUE if the packet was sent
+ * @size: the serialized size of the packet
+ *
+ * Count a packet of @type that was sent or received.
+ */
+void
+valent_counter_add_packet (const char *type,
+                           gboolean    outgoing,
+                           size_t      size)
+{
+  PacketCounter *counter = NULL;
+
+  g_return_if_fail (type != NULL);
+
+  if (outgoing)
+    {
+      g_atomic_pointer_add (&counters[VALENT_COUNTER_PACKETS_OUT], 1);
+      g_atomic_pointer_add (&counters[VALENT_COUNTER_PACKET_BYTES_OUT], size);
+    }
+  else
+    {
+      g_atomic_pointer_add (&counters[VALENT_COUNTER_PACKETS_IN], 1);
+      g_atomic_pointer_add (&counters[VALENT_COUNTER_PACKET_BYTES_IN], size);
+    }
+
+  g_rw_lock_reader_lock (&packet_lock);
+  if G_LIKELY (packet_counters != NULL)
+    counter = g_hash_table_lookup (packet_counters, type);
+  g_rw_lock_reader_unlock (&packet_lock);
+
+  if G_UNLIKELY (counter == NULL)
+    {
+      g_rw_lock_writer_lock (&packet_lock);
+      if (packet_counters == NULL)
+        packet_counters = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                 g_free, g_free);
+
+      if ((counter = g_hash_table_lookup (packet_counters, type)) == NULL)
+        {
+          counter = g_new0 (PacketCounter, 1);
+          g_hash_table_insert (packet_counters, g_strdup (type), counter);
+        }
+      g_rw_lock_writer_unlock (&packet_lock);
+    }
+
+  /* Entries are never removed, so the counter outlives the lock */
+  if (outgoing)
+    g_atomic_pointer_add (&counter->out, 1);
+  else
+    g_atomic_pointer_add (&counter->in, 1);
+}
+
+static DispatchCounter *
+dispatch_counter_lookup (const char *device_id,
+                         const char *type)
+{
+  GHashTable *types = NULL;
+
+  if (dispatch_counters == NULL)
+    return NULL;
+
+  if ((types = g_hash_table_lookup (dispatch_counters, device_id)) == NULL)
+    return NULL;
+
+  return g_hash_table_lookup (types, type);
+}
+
+/**
+ * valent_counter_add_dispatch:
+ * @device_id: a device ID
+ * @type: a KDE Connect packet type
+ * @usec: the time taken, in microseconds
+ *
+ * Record the time a plugin took to handle a packet of @type, received from the
+ * device with @device_id.
+ */
+void
+valent_counter_add_dispatch (const char *device_id,
+                             const char *type,
+                             int64_t     usec)
+{
+  DispatchCounter *counter = NULL;
+  unsigned int bucket = 0;
+  gssize max;
+
+  g_return_if_fail (device_id != NULL);
+  g_return_if_fail (type != NULL);
+
+  g_rw_lock_reader_lock (&dispatch_lock);
+  counter = dispatch_counter_lookup (device_id, type);
+  g_rw_lock_reader_unlock (&dispatch_lock);
+
+  if G_UNLIKELY (counter == NULL)
+    {
+      GHashTable *types = NULL;
+
+      g_rw_lock_writer_lock (&dispatch_lock);
+      if (dispatch_counters == NULL)
+        dispatch_counters = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                   g_free,
+                                                   (GDestroyNotify)g_hash_table_unref);
+
+      if ((types = g_hash_table_lookup (dispatch_counters, device_id)) == NULL)
+        {
+          types = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, g_free);
+          g_hash_table_insert (dispatch_counters, g_strdup (device_id), types);
+        }
+
+      if ((counter = g_hash_table_lookup (types, type)) == NULL)
+        {
+          counter = g_new0 (DispatchCounter, 1);
+          g_hash_table_insert (types, g_strdup (type), counter);
+        }
+      g_rw_lock_writer_unlock (&dispatch_lock);
+    }
+
+  for (int64_t limit = 100;
+       bucket < VALENT_DISPATCH_N_BUCKETS - 1 && usec >= limit;
+       limit *= 10)
+    bucket++;
+
+  /* Entries are never removed, so the counter outlives the lock */
+  g_atomic_pointer_add (&counter->count, 1);
+  g_atomic_pointer_add (&counter->total, usec);
+  g_atomic_pointer_add (&counter->histogram[bucket], 1);
+
+  do
+    max = (gssize)g_atomic_pointer_get (&counter->max);
+  while (usec > max &&
+         !g_atomic_pointer_compare_and_exchange (&counter->max, max, (gssize)usec));
+}
+
+static GVariant *
+dispatch_counters_snapshot (void)
+{
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  const char *device_id;
+  GHashTable *types;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{s(tttat)}}"));
+
+  if (dispatch_counters == NULL)
+    return g_variant_builder_end (&builder);
+
+  g_hash_table_iter_init (&iter, dispatch_counters);
+
+  while (g_hash_table_iter_next (&iter, (void **)&device_id, (void **)&types))
+    {
+      GHashTableIter types_iter;
+      const char *type;
+      DispatchCounter *counter;
+
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("{sa{s(tttat)}}"));
+      g_variant_builder_add (&builder, "s", device_id);
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("a{s(tttat)}"));
+
+      g_hash_table_iter_init (&types_iter, types);
+
+      while (g_hash_table_iter_next (&types_iter, (void **)&type, (void **)&counter))
+        {
+          uint64_t histogram[VALENT_DISPATCH_N_BUCKETS];
+
+          for (unsigned int i = 0; i < VALENT_DISPATCH_N_BUCKETS; i++)
+            histogram[i] = (uint64_t)g_atomic_pointer_get (&counter->histogram[i]);
+
+          g_variant_builder_add (&builder, "{s(tttat)}",
+                                 type,
+                                 (uint64_t)g_atomic_pointer_get (&counter->count),
+                                 (uint64_t)g_atomic_pointer_get (&counter->total),
+                                 (uint64_t)g_atomic_pointer_get (&counter->max),
+                                 g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64,
+                                                            histogram,
+                                                            VALENT_DISPATCH_N_BUCKETS,
+                                                            sizeof (uint64_t)));
+        }
+
+      g_variant_builder_close (&builder);
+      g_variant_builder_close (&builder);
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * valent_counters_snapshot:
+ *
+ * Get a snapshot of the current counter values.
+ *
+ * The result is a floating `a{sv}` dictionary, holding an int64 for each
+ * counter by name, and the packet counts by type as `packets` with the type
+ * `a{s(xx)}` (received, sent).
+ *
+ * Packet handler timings are included as `dispatch` with the type
+ * `a{sa{s(tttat)}}`, holding the count, total and maximum time in microseconds
+ * and a histogram (see %VALENT_DISPATCH_N_BUCKETS) for each packet type, by
+ * device ID.
+ *
+ * Returns: (transfer floating): a `GVariant`
+ */
+GVariant *
+valent_counters_snapshot (void)
+{
+  GVariantBuilder builder;
+  GVariantBuilder packets;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+
+  for (unsigned int i = 0; i < VALENT_N_COUNTERS; i++)
+    {
+      g_variant_builder_add (&builder, "{sv}",
+                             counter_info[i].name,
+                             g_variant_new_int64 (valent_counter_get (i)));
+    }
+
+  g_variant_builder_init (&packets, G_VARIANT_TYPE ("a{s(xx)}"));
+
+  g_rw_lock_reader_lock (&packet_lock);
+  if (packet_counters != NULL)
+    {
+      GHashTableIter iter;
+      const char *type;
+      PacketCounter *counter;
+
+      g_hash_table_iter_init (&iter, packet_counters);
+
+      while (g_hash_table_iter_next (&iter, (void **)&type, (void **)&counter))
+        {
+          g_variant_builder_add (&packets, "{s(xx)}",
+                                 type,
+                                 (int64_t)g_atomic_pointer_get (&counter->in),
+                                 (int64_t)g_atomic_pointer_get (&counter->out));
+        }
+    }
+  g_rw_lock_reader_unlock (&packet_lock);
+
+  g_variant_builder_add (&builder, "{sv}",
+                         "packets",
+                         g_variant_builder_end (&packets));
+
+  g_rw_lock_reader_lock (&dispatch_lock);
+  g_variant_builder_add (&builder, "{sv}",
+                         "dispatch",
+                         dispatch_counters_snapshot ());
+  g_rw_lock_reader_unlock (&dispatch_lock);
+
+  return g_variant_builder_end (&builder);
+}
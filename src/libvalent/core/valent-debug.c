@@ -19,15 +19,21 @@
 # include <sysprof-capture.h>
 #endif /* HAVE_SYSPROF */
 
+#include "valent-counters-private.h"
 #include "valent-debug.h"
 
 
 /* LCOV_EXCL_START */
 
 #ifdef HAVE_SYSPROF
+#define TRACE_BUFFER_SIZE    (512)
+#define TRACE_BUFFER_MASK    (TRACE_BUFFER_SIZE - 1)
+#define TRACE_FLUSH_INTERVAL (250 * G_TIME_SPAN_MILLISECOND)
+
 G_LOCK_DEFINE_STATIC (sysprof_mutex);
 
 static SysprofCaptureWriter *sysprof = NULL;
+static unsigned int          sysprof_counter_base = 0;
 
 static inline int
 current_cpu (void)
@@ -38,26 +44,271 @@ current_cpu (void)
   return 0;
 #endif /* HAVE_SCHED_GETCPU */
 }
-#endif /* HAVE_SYSPROF */
+
+/*
+ * Trace events are recorded in a ring buffer owned by each thread, so that
+ * tracing doesn't serialize the threads being traced. A single thread drains
+ * the buffers into the capture writer periodically.
+ *
+ * Each buffer has one producer (the owning thread) and one consumer (the flush
+ * thread), so only the indices need to be atomic. Events are dropped if the
+ * buffer is full. Buffers are recycled when a thread exits, and never freed.
+ */
+typedef struct
+{
+  int64_t         time;
+  int64_t         duration;
+  const char     *strfunc;
+  int             cpu;
+  GLogLevelFlags  log_level;
+  char            log_domain[32];
+  char            message[128];
+} TraceEvent;
+
+typedef struct _TraceBuffer TraceBuffer;
+
+struct _TraceBuffer
+{
+  TraceBuffer  *next;
+  int           in_use;
+  unsigned int  head;
+  unsigned int  tail;
+  unsigned int  dropped;
+  TraceEvent    events[TRACE_BUFFER_SIZE];
+};
+
+static TraceBuffer *trace_buffers = NULL;
+static GThread     *trace_thread = NULL;
+static GMutex       trace_mutex;
+static GCond        trace_cond;
+static gboolean     trace_running = FALSE;
 
 static void
-valent_trace_log (const char     *log_domain,
-                  GLogLevelFlags  log_level,
-                  const char     *message)
+trace_buffer_release (gpointer data)
 {
-#ifdef HAVE_SYSPROF
-  G_LOCK (sysprof_mutex);
-  if G_LIKELY (sysprof)
+  TraceBuffer *buffer = data;
+
+  g_atomic_int_set (&buffer->in_use, FALSE);
+}
+
+static GPrivate trace_buffer_key = G_PRIVATE_INIT (trace_buffer_release);
+
+static TraceBuffer *
+trace_buffer_get (void)
+{
+  TraceBuffer *buffer;
+
+  buffer = g_private_get (&trace_buffer_key);
+
+  if G_LIKELY (buffer != NULL)
+    return buffer;
+
+  /* Reuse a buffer released by an exited thread, or push a new one */
+  buffer = g_atomic_pointer_get (&trace_buffers);
+
+  while (buffer != NULL &&
+         !g_atomic_int_compare_and_exchange (&buffer->in_use, FALSE, TRUE))
+    buffer = buffer->next;
+
+  if (buffer == NULL)
+    {
+      buffer = g_new0 (TraceBuffer, 1);
+      buffer->in_use = TRUE;
+
+      do
+        buffer->next = g_atomic_pointer_get (&trace_buffers);
+      while (!g_atomic_pointer_compare_and_exchange (&trace_buffers,
+                                                     buffer->next,
+                                                     buffer));
+    }
+
+  g_private_set (&trace_buffer_key, buffer);
+
+  return buffer;
+}
+
+static inline TraceEvent *
+trace_buffer_reserve (TraceBuffer *buffer)
+{
+  unsigned int head = g_atomic_int_get (&buffer->head);
+
+  if G_UNLIKELY (head - g_atomic_int_get (&buffer->tail) >= TRACE_BUFFER_SIZE)
+    {
+      g_atomic_int_inc (&buffer->dropped);
+      return NULL;
+    }
+
+  return &buffer->events[head & TRACE_BUFFER_MASK];
+}
+
+static inline void
+trace_buffer_commit (TraceBuffer *buffer)
+{
+  g_atomic_int_inc (&buffer->head);
+}
+
+/* Called with sysprof_mutex held */
+static void
+trace_buffer_flush (TraceBuffer *buffer)
+{
+  unsigned int head = g_atomic_int_get (&buffer->head);
+  unsigned int tail = g_atomic_int_get (&buffer->tail);
+  unsigned int dropped;
+
+  for (; tail != head; tail++)
+    {
+      TraceEvent *event = &buffer->events[tail & TRACE_BUFFER_MASK];
+
+      if (event->strfunc != NULL)
+        {
+          sysprof_capture_writer_add_mark (sysprof,
+                                           event->time,
+                                           event->cpu,
+                                           getpid (),
+                                           event->duration,
+                                           "tracing",
+                                           "function",
+                                           event->strfunc);
+        }
+      else
+        {
+          sysprof_capture_writer_add_log (sysprof,
+                                          event->time,
+                                          event->cpu,
+                                          getpid (),
+                                          event->log_level,
+                                          event->log_domain,
+                                          event->message);
+        }
+    }
+
+  g_atomic_int_set (&buffer->tail, tail);
+
+  if ((dropped = g_atomic_int_exchange (&buffer->dropped, 0)) > 0)
     {
+      g_autofree char *message = NULL;
+
+      message = g_strdup_printf ("Dropped %u trace events", dropped);
       sysprof_capture_writer_add_log (sysprof,
                                       SYSPROF_CAPTURE_CURRENT_TIME,
-                                      current_cpu (),
+                                      -1,
                                       getpid (),
-                                      log_level,
-                                      log_domain,
+                                      G_LOG_LEVEL_WARNING,
+                                      "valent-debug",
                                       message);
     }
+}
+
+/* Called with sysprof_mutex held */
+static void
+valent_trace_define_counters (void)
+{
+  SysprofCaptureCounter counters[VALENT_N_COUNTERS] = { 0, };
+
+  sysprof_counter_base = sysprof_capture_writer_request_counter (sysprof,
+                                                                 VALENT_N_COUNTERS);
+
+  for (unsigned int i = 0; i < VALENT_N_COUNTERS; i++)
+    {
+      g_strlcpy (counters[i].category, "Valent", sizeof (counters[i].category));
+      g_strlcpy (counters[i].name,
+                 valent_counter_get_name (i),
+                 sizeof (counters[i].name));
+      g_strlcpy (counters[i].description,
+                 valent_counter_get_description (i),
+                 sizeof (counters[i].description));
+      counters[i].id = sysprof_counter_base + i;
+      counters[i].type = SYSPROF_CAPTURE_COUNTER_INT64;
+      counters[i].value.v64 = valent_counter_get (i);
+    }
+
+  sysprof_capture_writer_define_counters (sysprof,
+                                          SYSPROF_CAPTURE_CURRENT_TIME,
+                                          -1,
+                                          getpid (),
+                                          counters,
+                                          VALENT_N_COUNTERS);
+}
+
+static void
+valent_trace_flush (void)
+{
+  G_LOCK (sysprof_mutex);
+  if G_LIKELY (sysprof)
+    {
+      unsigned int ids[VALENT_N_COUNTERS];
+      SysprofCaptureCounterValue values[VALENT_N_COUNTERS];
+      TraceBuffer *buffer;
+
+      buffer = g_atomic_pointer_get (&trace_buffers);
+
+      for (; buffer != NULL; buffer = buffer->next)
+        trace_buffer_flush (buffer);
+
+      for (unsigned int i = 0; i < VALENT_N_COUNTERS; i++)
+        {
+          ids[i] = sysprof_counter_base + i;
+          values[i].v64 = valent_counter_get (i);
+        }
+
+      sysprof_capture_writer_set_counters (sysprof,
+                                           SYSPROF_CAPTURE_CURRENT_TIME,
+                                           -1,
+                                           getpid (),
+                                           ids,
+                                           values,
+                                           VALENT_N_COUNTERS);
+    }
   G_UNLOCK (sysprof_mutex);
+}
+
+static gpointer
+valent_trace_flush_thread (gpointer data)
+{
+  g_mutex_lock (&trace_mutex);
+  while (trace_running)
+    {
+      int64_t end_time = g_get_monotonic_time () + TRACE_FLUSH_INTERVAL;
+
+      g_cond_wait_until (&trace_cond, &trace_mutex, end_time);
+      g_mutex_unlock (&trace_mutex);
+
+      valent_trace_flush ();
+
+      g_mutex_lock (&trace_mutex);
+    }
+  g_mutex_unlock (&trace_mutex);
+
+  return NULL;
+}
+#endif /* HAVE_SYSPROF */
+
+static void
+valent_trace_log (const char     *log_domain,
+                  GLogLevelFlags  log_level,
+                  const char     *message)
+{
+#ifdef HAVE_SYSPROF
+  TraceBuffer *buffer;
+  TraceEvent *event;
+
+  if G_UNLIKELY (g_atomic_pointer_get (&sysprof) == NULL)
+    return;
+
+  buffer = trace_buffer_get ();
+
+  if ((event = trace_buffer_reserve (buffer)) == NULL)
+    return;
+
+  event->time = SYSPROF_CAPTURE_CURRENT_TIME;
+  event->duration = 0;
+  event->strfunc = NULL;
+  event->cpu = current_cpu ();
+  event->log_level = log_level;
+  g_strlcpy (event->log_domain, log_domain ? log_domain : "", sizeof (event->log_domain));
+  g_strlcpy (event->message, message, sizeof (event->message));
+
+  trace_buffer_commit (buffer);
 #endif /* HAVE_SYSPROF */
 }
 
@@ -67,27 +318,30 @@ valent_trace_mark (const char *strfunc,
                    int64_t     end_time_usec)
 {
 #ifdef HAVE_SYSPROF
-  G_LOCK (sysprof_mutex);
-  if G_LIKELY (sysprof)
-    {
-      /* In case our clock is not reliable */
-      if (end_time_usec < begin_time_usec)
-        end_time_usec = begin_time_usec;
-
-      sysprof_capture_writer_add_mark (sysprof,
-                                       begin_time_usec * 1000L,
-                                       current_cpu (),
-                                       getpid (),
-                                       (end_time_usec - begin_time_usec) * 1000L,
-                                       "tracing",
-                                       "function",
-                                       strfunc);
-    }
-  G_UNLOCK (sysprof_mutex);
+  TraceBuffer *buffer;
+  TraceEvent *event;
+
+  if G_UNLIKELY (g_atomic_pointer_get (&sysprof) == NULL)
+    return;
+
+  buffer = trace_buffer_get ();
+
+  if ((event = trace_buffer_reserve (buffer)) == NULL)
+    return;
+
+  /* In case our clock is not reliable */
+  if (end_time_usec < begin_time_usec)
+    end_time_usec = begin_time_usec;
+
+  event->time = begin_time_usec * 1000L;
+  event->duration = (end_time_usec - begin_time_usec) * 1000L;
+  event->strfunc = strfunc;
+  event->cpu = current_cpu ();
+
+  trace_buffer_commit (buffer);
 #endif /* HAVE_SYSPROF */
 }
 
-
 G_LOCK_DEFINE_STATIC (log_mutex);
 
 typedef const char * (*ValentLogLevelStrFunc) (GLogLevelFlags log_level);
@@ -195,7 +449,7 @@ valent_log_handler (const char     *log_domain,
  * If %VALENT_DEBUG_ENABLE is defined, debugging messages only useful for
  * development will be printed to the log.
  *
- * If %VALENT_TRACE_ENABLE is defined, tracing will be performed at the log
+ * If %VALENT_ENABLE_TRACE is defined, tracing will be performed at the log
  * level %VALENT_LOG_LEVEL_TRACE. These will be passed to sysprof for profiling,
  * if available.
  *
@@ -217,16 +471,29 @@ valent_debug_init (void)
     }
   G_UNLOCK (log_mutex);
 
-#if defined(VALENT_TRACE_ENABLE) && defined(HAVE_SYSPROF)
+#if defined(VALENT_ENABLE_TRACE) && defined(HAVE_SYSPROF)
   G_LOCK (sysprof_mutex);
   if (sysprof == NULL)
     {
       signal (SIGPIPE, SIG_IGN);
       sysprof_clock_init ();
       sysprof = sysprof_capture_writer_new_from_env (0);
+
+      if (sysprof != NULL)
+        valent_trace_define_counters ();
     }
   G_UNLOCK (sysprof_mutex);
-#endif /* VALENT_ENABLETRACE && HAVE_SYSPROF */
+
+  g_mutex_lock (&trace_mutex);
+  if (trace_thread == NULL && sysprof != NULL)
+    {
+      trace_running = TRUE;
+      trace_thread = g_thread_new ("valent-trace",
+                                   valent_trace_flush_thread,
+                                   NULL);
+    }
+  g_mutex_unlock (&trace_mutex);
+#endif /* VALENT_ENABLE_TRACE && HAVE_SYSPROF */
 }
 
 /**
@@ -250,7 +517,16 @@ valent_debug_clear (void)
     }
   G_UNLOCK (log_mutex);
 
-#if defined(VALENT_TRACE_ENABLE) && defined(HAVE_SYSPROF)
+#if defined(VALENT_ENABLE_TRACE) && defined(HAVE_SYSPROF)
+  g_mutex_lock (&trace_mutex);
+  trace_running = FALSE;
+  g_cond_signal (&trace_cond);
+  g_mutex_unlock (&trace_mutex);
+  g_clear_pointer (&trace_thread, g_thread_join);
+
+  /* Drain any events recorded since the last flush */
+  valent_trace_flush ();
+
   G_LOCK (sysprof_mutex);
   if (sysprof != NULL)
     {
@@ -258,7 +534,7 @@ valent_debug_clear (void)
       g_clear_pointer (&sysprof, sysprof_capture_writer_unref);
     }
   G_UNLOCK (sysprof_mutex);
-#endif /* VALENT_ENABLETRACE && HAVE_SYSPROF */
+#endif /* VALENT_ENABLE_TRACE && HAVE_SYSPROF */
 }
 
 /* LCOV_EXCL_STOP */
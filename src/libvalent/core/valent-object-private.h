@@ -0,0 +1,27 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include "valent-object.h"
+
+G_BEGIN_DECLS
+
+/*< private >
+ * ValentObjectFunc:
+ * @object: a `ValentObject`
+ * @user_data: user supplied data
+ *
+ * A function called by valent_object_invoke_main().
+ */
+typedef void (*ValentObjectFunc) (ValentObject *object,
+                                  gpointer      user_data);
+
+_VALENT_EXTERN
+void   valent_object_invoke_main (ValentObject     *object,
+                                  ValentObjectFunc  func,
+                                  gpointer          user_data,
+                                  GDestroyNotify    destroy_notify);
+
+G_END_DECLS
+
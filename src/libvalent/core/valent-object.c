@@ -8,6 +8,7 @@
 
 #include "valent-macros.h"
 #include "valent-object.h"
+#include "valent-object-private.h"
 
 /**
  * ValentObject:
@@ -94,43 +95,159 @@ valent_object_private_unlock (ValentObjectPrivate *priv)
 }
 
 /*
- * GObject.Object::notify
+ * Main Thread Dispatch
+ *
+ * Emissions from other threads are pushed onto a lock-free stack, which is
+ * drained in FIFO order by a single source on the main context. Duplicate
+ * GObject::notify emissions for the same object and property are coalesced
+ * within each dispatch.
  */
-typedef struct
+typedef struct _DispatchItem DispatchItem;
+
+struct _DispatchItem
 {
-  GRecMutex   mutex;
-  GWeakRef    object;
-  GParamSpec *pspec;
-  char       *property_name;
-} NotifyEmission;
+  DispatchItem     *next;
+  GWeakRef          target;
+  GObject          *object;
+  GParamSpec       *pspec;
+  ValentObjectFunc  func;
+  gpointer          user_data;
+  GDestroyNotify    destroy_notify;
+};
+
+static DispatchItem *dispatch_head = NULL;
+static GSource *dispatch_source = NULL;
+
+static void
+dispatch_item_free (gpointer data)
+{
+  DispatchItem *item = data;
+
+  if (item->destroy_notify != NULL)
+    g_clear_pointer (&item->user_data, item->destroy_notify);
+
+  g_weak_ref_clear (&item->target);
+  g_clear_object (&item->object);
+  g_clear_pointer (&item->pspec, g_param_spec_unref);
+  g_free (item);
+}
+
+static guint
+dispatch_item_hash (gconstpointer data)
+{
+  const DispatchItem *item = data;
+
+  return g_direct_hash (item->object) ^ g_direct_hash (item->pspec);
+}
 
 static gboolean
-valent_object_notify_main (gpointer data)
+dispatch_item_equal (gconstpointer a,
+                     gconstpointer b)
 {
-  NotifyEmission *emission = data;
-  g_autoptr (GObject) object = NULL;
+  const DispatchItem *item_a = a;
+  const DispatchItem *item_b = b;
+
+  return item_a->object == item_b->object && item_a->pspec == item_b->pspec;
+}
 
-  g_assert (emission != NULL);
+static void
+dispatch_push (DispatchItem *item)
+{
+  DispatchItem *head;
 
-  g_rec_mutex_lock (&emission->mutex);
-  if ((object = g_weak_ref_get (&emission->object)) != NULL)
+  do
     {
-      if (emission->pspec != NULL)
-        g_object_notify_by_pspec (object, emission->pspec);
-      else
-        g_object_notify (object, emission->property_name);
+      head = g_atomic_pointer_get (&dispatch_head);
+      item->next = head;
     }
+  while (!g_atomic_pointer_compare_and_exchange (&dispatch_head, head, item));
+
+  /* Only the first push into an empty queue needs to wake the main context */
+  if (head == NULL)
+    g_main_context_wakeup (NULL);
+}
 
-  g_weak_ref_clear (&emission->object);
-  g_clear_pointer (&emission->property_name, g_free);
-  g_clear_pointer (&emission->pspec, g_param_spec_unref);
-  g_rec_mutex_unlock (&emission->mutex);
-  g_rec_mutex_clear (&emission->mutex);
-  g_clear_pointer (&emission, g_free);
+static gboolean
+valent_object_dispatch_source_prepare (GSource *source,
+                                       int     *timeout)
+{
+  *timeout = -1;
+
+  return g_atomic_pointer_get (&dispatch_head) != NULL;
+}
 
-  return G_SOURCE_REMOVE;
+static gboolean
+valent_object_dispatch_source_check (GSource *source)
+{
+  return g_atomic_pointer_get (&dispatch_head) != NULL;
 }
 
+static gboolean
+valent_object_dispatch_source_dispatch (GSource     *source,
+                                        GSourceFunc  callback,
+                                        gpointer     user_data)
+{
+  g_autoptr (GHashTable) notified = NULL;
+  DispatchItem *items = NULL;
+  DispatchItem *head;
+
+  /* Take the whole stack at once, then reverse it into emission order */
+  head = g_atomic_pointer_exchange (&dispatch_head, NULL);
+
+  while (head != NULL)
+    {
+      DispatchItem *next = head->next;
+
+      head->next = items;
+      items = head;
+      head = next;
+    }
+
+  while (items != NULL)
+    {
+      DispatchItem *item = items;
+
+      items = item->next;
+      item->next = NULL;
+
+      if ((item->object = g_weak_ref_get (&item->target)) == NULL)
+        {
+          dispatch_item_free (item);
+          continue;
+        }
+
+      if (item->func != NULL)
+        {
+          item->func (VALENT_OBJECT (item->object), item->user_data);
+          dispatch_item_free (item);
+        }
+      else
+        {
+          if (notified == NULL)
+            {
+              notified = g_hash_table_new_full (dispatch_item_hash,
+                                                dispatch_item_equal,
+                                                dispatch_item_free,
+                                                NULL);
+            }
+
+          /* The property was already notified in this dispatch */
+          if (!g_hash_table_add (notified, item))
+            continue;
+
+          g_object_notify_by_pspec (item->object, item->pspec);
+        }
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs dispatch_source_funcs = {
+  .prepare = valent_object_dispatch_source_prepare,
+  .check = valent_object_dispatch_source_check,
+  .dispatch = valent_object_dispatch_source_dispatch,
+};
+
 /*
  * ValentObject
  */
@@ -307,6 +424,12 @@ valent_object_class_init (ValentObjectClass *klass)
   g_source_set_static_name (finalizer_source, "[valent-object-finalizer]");
   g_source_set_priority (finalizer_source, G_MAXINT);
   g_source_attach (finalizer_source, NULL);
+
+  /* Setup the dispatcher in main thread to receive off-thread emissions */
+  dispatch_source = g_source_new (&dispatch_source_funcs, sizeof (GSource));
+  g_source_set_static_name (dispatch_source, "[valent-object-dispatch]");
+  g_source_set_priority (dispatch_source, G_PRIORITY_DEFAULT);
+  g_source_attach (dispatch_source, NULL);
 }
 
 static void
@@ -521,7 +644,7 @@ void
 valent_object_notify (ValentObject *object,
                       const char   *property_name)
 {
-  NotifyEmission *emission = NULL;
+  GParamSpec *pspec;
 
   g_return_if_fail (VALENT_IS_OBJECT (object));
   g_return_if_fail (property_name != NULL);
@@ -532,17 +655,19 @@ valent_object_notify (ValentObject *object,
       return;
     }
 
-  emission = g_new0 (NotifyEmission, 1);
-  g_rec_mutex_init (&emission->mutex);
-  g_rec_mutex_lock (&emission->mutex);
-  g_weak_ref_init (&emission->object, object);
-  emission->property_name = g_strdup (property_name);
-  g_rec_mutex_unlock (&emission->mutex);
-
-  g_idle_add_full (G_PRIORITY_DEFAULT,
-                   valent_object_notify_main,
-                   g_steal_pointer (&emission),
-                   NULL);
+  pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (object),
+                                        property_name);
+
+  if G_UNLIKELY (pspec == NULL)
+    {
+      g_critical ("%s: object class \"%s\" has no property named \"%s\"",
+                  G_STRFUNC,
+                  G_OBJECT_TYPE_NAME (object),
+                  property_name);
+      return;
+    }
+
+  valent_object_notify_by_pspec (object, pspec);
 }
 
 /**
@@ -553,7 +678,9 @@ valent_object_notify (ValentObject *object,
  * Emit [signal@GObject.Object::notify] on @object, on the main thread.
  *
  * Like [method@GObject.Object.notify_by_pspec] if the caller is in the main
- * thread, otherwise the invocation is deferred to the main thread.
+ * thread, otherwise the invocation is deferred to the main thread. Deferred
+ * emissions for the same property are coalesced, if they are dispatched in the
+ * same main loop iteration.
  *
  * Since: 1.0
  */
@@ -561,7 +688,7 @@ void
 valent_object_notify_by_pspec (ValentObject *object,
                                GParamSpec   *pspec)
 {
-  NotifyEmission *emission = NULL;
+  DispatchItem *item = NULL;
 
   g_return_if_fail (VALENT_IS_OBJECT (object));
   g_return_if_fail (G_IS_PARAM_SPEC (pspec));
@@ -572,15 +699,53 @@ valent_object_notify_by_pspec (ValentObject *object,
       return;
     }
 
-  emission = g_new0 (NotifyEmission, 1);
-  g_rec_mutex_init (&emission->mutex);
-  g_rec_mutex_lock (&emission->mutex);
-  g_weak_ref_init (&emission->object, object);
-  emission->pspec = g_param_spec_ref (pspec);
-  g_rec_mutex_unlock (&emission->mutex);
-
-  g_idle_add_full (G_PRIORITY_DEFAULT,
-                   valent_object_notify_main,
-                   g_steal_pointer (&emission),
-                   NULL);
+  item = g_new0 (DispatchItem, 1);
+  g_weak_ref_init (&item->target, object);
+  item->pspec = g_param_spec_ref (pspec);
+  dispatch_push (g_steal_pointer (&item));
+}
+
+/*< private >
+ * valent_object_invoke_main:
+ * @object: a `ValentObject`
+ * @func: (scope async): a `ValentObjectFunc`
+ * @user_data: (closure): user supplied data
+ * @destroy_notify: (nullable): a `GDestroyNotify` for @user_data
+ *
+ * Invoke @func for @object, on the main thread.
+ *
+ * If the caller is in the main thread, @func is invoked immediately. Otherwise
+ * the invocation is queued in order with other deferred emissions and @func is
+ * only invoked if @object is still alive when they are dispatched.
+ *
+ * This is intended for implementations that need to emit signals from a
+ * thread, such as stores backed by a worker thread.
+ */
+void
+valent_object_invoke_main (ValentObject     *object,
+                           ValentObjectFunc  func,
+                           gpointer          user_data,
+                           GDestroyNotify    destroy_notify)
+{
+  DispatchItem *item = NULL;
+
+  g_return_if_fail (VALENT_IS_OBJECT (object));
+  g_return_if_fail (func != NULL);
+
+  if G_LIKELY (VALENT_IS_MAIN_THREAD ())
+    {
+      func (object, user_data);
+
+      if (destroy_notify != NULL)
+        destroy_notify (user_data);
+
+      return;
+    }
+
+  item = g_new0 (DispatchItem, 1);
+  g_weak_ref_init (&item->target, object);
+  item->func = func;
+  item->user_data = user_data;
+  item->destroy_notify = destroy_notify;
+  dispatch_push (g_steal_pointer (&item));
 }
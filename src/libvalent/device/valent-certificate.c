@@ -22,6 +22,46 @@
 #define SHA256_STR_LEN 96
 
 
+/*
+ * valent_certificate_get_key_type:
+ * @bits: (out): location for the key size
+ * @digest: (out): location for the signature digest
+ *
+ * Get the key algorithm for new certificates.
+ *
+ * RSA is used by default, for compatibility with all KDE Connect clients. The
+ * `VALENT_CERTIFICATE_KEY_TYPE` environment variable may be set to `ecdsa`
+ * (P-256) or `ed25519`, which are much faster to generate and handshake with,
+ * but may be rejected by older clients.
+ */
+static gnutls_pk_algorithm_t
+valent_certificate_get_key_type (unsigned int              *bits,
+                                 gnutls_digest_algorithm_t *digest)
+{
+  const char *key_type = g_getenv ("VALENT_CERTIFICATE_KEY_TYPE");
+
+  if (g_strcmp0 (key_type, "ecdsa") == 0)
+    {
+      *bits = GNUTLS_CURVE_TO_BITS (GNUTLS_ECC_CURVE_SECP256R1);
+      *digest = GNUTLS_DIG_SHA256;
+      return GNUTLS_PK_ECDSA;
+    }
+
+  if (g_strcmp0 (key_type, "ed25519") == 0)
+    {
+      *bits = GNUTLS_CURVE_TO_BITS (GNUTLS_ECC_CURVE_ED25519);
+      *digest = GNUTLS_DIG_UNKNOWN;
+      return GNUTLS_PK_EDDSA_ED25519;
+    }
+
+  if (key_type != NULL && g_strcmp0 (key_type, "rsa") != 0)
+    g_warning ("%s(): unknown key type \"%s\"; using RSA", G_STRFUNC, key_type);
+
+  *bits = DEFAULT_KEY_SIZE;
+  *digest = GNUTLS_DIG_SHA256;
+  return GNUTLS_PK_RSA;
+}
+
 /**
  * valent_certificate_generate:
  * @cert_path: (type filename): file path to the certificate
@@ -45,8 +85,11 @@ valent_certificate_generate (const char  *cert_path,
   g_autofree char *dn = NULL;
   gnutls_x509_privkey_t privkey = NULL;
   gnutls_x509_crt_t crt = NULL;
+  gnutls_pk_algorithm_t key_type;
+  gnutls_digest_algorithm_t digest;
   gnutls_datum_t out;
   time_t timestamp;
+  unsigned int bits;
   unsigned int serial;
   int rc;
   gboolean ret = FALSE;
@@ -56,10 +99,12 @@ valent_certificate_generate (const char  *cert_path,
   /*
    * Private Key
    */
+  key_type = valent_certificate_get_key_type (&bits, &digest);
+
   if ((rc = gnutls_x509_privkey_init (&privkey)) != GNUTLS_E_SUCCESS ||
       (rc = gnutls_x509_privkey_generate (privkey,
-                                          GNUTLS_PK_RSA,
-                                          DEFAULT_KEY_SIZE,
+                                          key_type,
+                                          bits,
                                           0)) != GNUTLS_E_SUCCESS ||
       (rc = gnutls_x509_privkey_export2 (privkey,
                                          GNUTLS_X509_FMT_PEM,
@@ -132,7 +177,7 @@ valent_certificate_generate (const char  *cert_path,
     }
 
   /* Sign and export the certificate */
-  if ((rc = gnutls_x509_crt_sign2 (crt, crt, privkey, GNUTLS_DIG_SHA256, 0)) != GNUTLS_E_SUCCESS ||
+  if ((rc = gnutls_x509_crt_sign2 (crt, crt, privkey, digest, 0)) != GNUTLS_E_SUCCESS ||
       (rc = gnutls_x509_crt_export2 (crt, GNUTLS_X509_FMT_PEM, &out)) != GNUTLS_E_SUCCESS)
     {
       g_set_error (error,
@@ -252,6 +297,9 @@ valent_certificate_new_finish (GAsyncResult  *result,
  * If either generating or loading the certificate fails, %NULL will be returned
  * with @error set.
  *
+ * New keys are RSA, unless the `VALENT_CERTIFICATE_KEY_TYPE` environment
+ * variable is set to `ecdsa` or `ed25519`.
+ *
  * Returns: (transfer full) (nullable): a #GTlsCertificate
  *
  * Since: 1.0
@@ -283,154 +331,83 @@ valent_certificate_new_sync (const char  *path,
   return g_tls_certificate_new_from_files (cert_path, key_path, error);
 }
 
-/**
- * valent_certificate_get_common_name:
- * @certificate: a #GTlsCertificate
- *
- * Get the common name from @certificate, which by convention in KDE Connect is
- * the single source of truth for a device's ID.
- *
- * Returns: (transfer none) (nullable): the certificate ID
- *
- * Since: 1.0
- */
-const char *
-valent_certificate_get_common_name (GTlsCertificate *certificate)
+typedef struct
 {
-  g_autoptr (GByteArray) certificate_der = NULL;
-  gnutls_x509_crt_t crt;
-  gnutls_datum_t crt_der;
-  char buf[64] = { 0, };
-  size_t buf_size = 64;
-  const char *device_id;
-  int rc;
-
-  g_return_val_if_fail (G_IS_TLS_CERTIFICATE (certificate), NULL);
-
-  /* Check */
-  device_id = g_object_get_data (G_OBJECT (certificate),
-                                 "valent-certificate-cn");
-
-  if G_LIKELY (device_id != NULL)
-    return device_id;
-
-  /* Extract the common name */
-  g_object_get (certificate, "certificate", &certificate_der, NULL);
-  crt_der.data = certificate_der->data;
-  crt_der.size = certificate_der->len;
+  char       *common_name;
+  char       *fingerprint;
+  GByteArray *public_key;
+} CertificateData;
 
-  if ((rc = gnutls_x509_crt_init (&crt)) != GNUTLS_E_SUCCESS ||
-      (rc = gnutls_x509_crt_import (crt, &crt_der, 0)) != GNUTLS_E_SUCCESS ||
-      (rc = gnutls_x509_crt_get_dn_by_oid (crt,
-                                           GNUTLS_OID_X520_COMMON_NAME,
-                                           0,
-                                           0,
-                                           &buf,
-                                           &buf_size)) != GNUTLS_E_SUCCESS)
-    {
-      g_warning ("%s(): %s", G_STRFUNC, gnutls_strerror (rc));
-      gnutls_x509_crt_deinit (crt);
-
-      return NULL;
-    }
-
-  gnutls_x509_crt_deinit (crt);
-
-  /* Intern the id as private data */
-  g_object_set_data_full (G_OBJECT (certificate),
-                          "valent-certificate-cn",
-                          g_strndup (buf, buf_size),
-                          g_free);
+static void
+certificate_data_free (gpointer data)
+{
+  CertificateData *self = data;
 
-  return g_object_get_data (G_OBJECT (certificate), "valent-certificate-cn");
+  g_clear_pointer (&self->common_name, g_free);
+  g_clear_pointer (&self->fingerprint, g_free);
+  g_clear_pointer (&self->public_key, g_byte_array_unref);
+  g_free (self);
 }
 
-/**
- * valent_certificate_get_fingerprint:
+G_DEFINE_QUARK (valent-certificate-data, certificate_data)
+
+/*
+ * valent_certificate_ensure_data:
  * @certificate: a #GTlsCertificate
  *
- * Get a SHA256 fingerprint hash of @certificate.
+ * Get the values derived from @certificate, parsing it on the first call.
  *
- * Returns: (transfer none): a SHA256 hash
+ * The results are attached to @certificate for the lifetime of the object.
+ * The fingerprint is always available, while the common name and public key
+ * are %NULL if they could not be parsed.
  *
- * Since: 1.0
+ * Returns: (transfer none): the certificate data
  */
-const char *
-valent_certificate_get_fingerprint (GTlsCertificate *certificate)
+static CertificateData *
+valent_certificate_ensure_data (GTlsCertificate *certificate)
 {
   g_autoptr (GByteArray) certificate_der = NULL;
   g_autoptr (GChecksum) checksum = NULL;
+  CertificateData *data = NULL;
+  gnutls_x509_crt_t crt = NULL;
+  gnutls_pubkey_t crt_pk = NULL;
+  gnutls_datum_t crt_der;
   const char *check;
-  const char *fingerprint;
-  char buf[SHA256_STR_LEN] = { 0, };
+  char fp_buf[SHA256_STR_LEN] = { 0, };
+  char cn_buf[64] = { 0, };
+  size_t cn_size = sizeof (cn_buf);
+  size_t pk_size = 0;
   unsigned int i = 0;
   unsigned int o = 0;
+  int rc;
 
-  g_return_val_if_fail (G_IS_TLS_CERTIFICATE (certificate), NULL);
-
-  fingerprint = g_object_get_data (G_OBJECT (certificate),
-                                   "valent-certificate-fp");
+  data = g_object_get_qdata (G_OBJECT (certificate), certificate_data_quark ());
 
-  if G_LIKELY (fingerprint != NULL)
-    return fingerprint;
+  if G_LIKELY (data != NULL)
+    return data;
 
+  data = g_new0 (CertificateData, 1);
   g_object_get (certificate, "certificate", &certificate_der, NULL);
+
+  /* Fingerprint */
   checksum = g_checksum_new (G_CHECKSUM_SHA256);
   g_checksum_update (checksum, certificate_der->data, certificate_der->len);
-
   check = g_checksum_get_string (checksum);
 
   while (i < SHA256_HEX_LEN)
     {
-      buf[o++] = check[i++];
-      buf[o++] = check[i++];
-      buf[o++] = ':';
+      fp_buf[o++] = check[i++];
+      fp_buf[o++] = check[i++];
+      fp_buf[o++] = ':';
     }
-  buf[SHA256_STR_LEN - 1] = '\0';
+  fp_buf[SHA256_STR_LEN - 1] = '\0';
 
-  /* Intern the hash as private data */
-  g_object_set_data_full (G_OBJECT (certificate),
-                          "valent-certificate-fp",
-                          g_strdup (buf),
-                          g_free);
+  data->fingerprint = g_strdup (fp_buf);
 
-  return g_object_get_data (G_OBJECT (certificate), "valent-certificate-fp");
-}
-
-/**
- * valent_certificate_get_public_key:
- * @certificate: a #GTlsCertificate
- *
- * Get the public key of @certificate.
- *
- * Returns: (transfer none): a DER-encoded publickey
- *
- * Since: 1.0
- */
-GByteArray *
-valent_certificate_get_public_key (GTlsCertificate *certificate)
-{
-  g_autoptr (GByteArray) certificate_der = NULL;
-  g_autoptr (GByteArray) pubkey = NULL;
-  size_t size;
-  gnutls_x509_crt_t crt = NULL;
-  gnutls_datum_t crt_der;
-  gnutls_pubkey_t crt_pk = NULL;
-  int rc;
-
-  g_return_val_if_fail (G_IS_TLS_CERTIFICATE (certificate), NULL);
-
-  pubkey = g_object_get_data (G_OBJECT (certificate),
-                              "valent-certificate-pk");
-
-  if (pubkey != NULL)
-    return g_steal_pointer (&pubkey);
-
-  g_object_get (certificate, "certificate", &certificate_der, NULL);
+  /* Load the certificate */
   crt_der.data = certificate_der->data;
   crt_der.size = certificate_der->len;
 
-  /* Load the certificate */
   if ((rc = gnutls_x509_crt_init (&crt)) != GNUTLS_E_SUCCESS ||
       (rc = gnutls_x509_crt_import (crt, &crt_der, GNUTLS_X509_FMT_DER)) != GNUTLS_E_SUCCESS)
     {
@@ -438,7 +415,20 @@ valent_certificate_get_public_key (GTlsCertificate *certificate)
       VALENT_GOTO (out);
     }
 
-  /* Load the public key */
+  /* Common Name */
+  rc = gnutls_x509_crt_get_dn_by_oid (crt,
+                                      GNUTLS_OID_X520_COMMON_NAME,
+                                      0,
+                                      0,
+                                      &cn_buf,
+                                      &cn_size);
+
+  if (rc == GNUTLS_E_SUCCESS)
+    data->common_name = g_strndup (cn_buf, cn_size);
+  else
+    g_warning ("%s(): %s", G_STRFUNC, gnutls_strerror (rc));
+
+  /* Public Key */
   if ((rc = gnutls_pubkey_init (&crt_pk)) != GNUTLS_E_SUCCESS ||
       (rc = gnutls_pubkey_import_x509 (crt_pk, crt, 0)) != GNUTLS_E_SUCCESS)
     {
@@ -446,25 +436,20 @@ valent_certificate_get_public_key (GTlsCertificate *certificate)
       VALENT_GOTO (out);
     }
 
-  /* Read the public key */
-  rc = gnutls_pubkey_export (crt_pk, GNUTLS_X509_FMT_DER, NULL, &size);
+  rc = gnutls_pubkey_export (crt_pk, GNUTLS_X509_FMT_DER, NULL, &pk_size);
 
   if (rc == GNUTLS_E_SUCCESS || rc == GNUTLS_E_SHORT_MEMORY_BUFFER)
     {
-      pubkey = g_byte_array_sized_new (size);
-      pubkey->len = size;
+      g_autoptr (GByteArray) pubkey = NULL;
+
+      pubkey = g_byte_array_sized_new (pk_size);
+      pubkey->len = pk_size;
       rc = gnutls_pubkey_export (crt_pk,
                                  GNUTLS_X509_FMT_DER,
-                                 pubkey->data, &size);
+                                 pubkey->data, &pk_size);
 
-      /* Intern the DER as private data */
       if (rc == GNUTLS_E_SUCCESS)
-        {
-          g_object_set_data_full (G_OBJECT (certificate),
-                                  "valent-certificate-pk",
-                                  g_steal_pointer (&pubkey),
-                                  (GDestroyNotify)g_byte_array_unref);
-        }
+        data->public_key = g_steal_pointer (&pubkey);
       else
         g_warning ("%s(): %s", G_STRFUNC, gnutls_strerror (rc));
     }
@@ -475,6 +460,86 @@ valent_certificate_get_public_key (GTlsCertificate *certificate)
     gnutls_x509_crt_deinit (crt);
     gnutls_pubkey_deinit (crt_pk);
 
-  return g_object_get_data (G_OBJECT (certificate), "valent-certificate-pk");
+  /* Another thread may have parsed the certificate first */
+  if (!g_object_replace_qdata (G_OBJECT (certificate),
+                               certificate_data_quark (),
+                               NULL,
+                               data,
+                               certificate_data_free,
+                               NULL))
+    {
+      certificate_data_free (data);
+      data = g_object_get_qdata (G_OBJECT (certificate),
+                                 certificate_data_quark ());
+    }
+
+  return data;
+}
+
+/**
+ * valent_certificate_get_common_name:
+ * @certificate: a #GTlsCertificate
+ *
+ * Get the common name from @certificate, which by convention in KDE Connect is
+ * the single source of truth for a device's ID.
+ *
+ * Returns: (transfer none) (nullable): the certificate ID
+ *
+ * Since: 1.0
+ */
+const char *
+valent_certificate_get_common_name (GTlsCertificate *certificate)
+{
+  CertificateData *data;
+
+  g_return_val_if_fail (G_IS_TLS_CERTIFICATE (certificate), NULL);
+
+  data = valent_certificate_ensure_data (certificate);
+
+  return data->common_name;
+}
+
+/**
+ * valent_certificate_get_fingerprint:
+ * @certificate: a #GTlsCertificate
+ *
+ * Get a SHA256 fingerprint hash of @certificate.
+ *
+ * Returns: (transfer none): a SHA256 hash
+ *
+ * Since: 1.0
+ */
+const char *
+valent_certificate_get_fingerprint (GTlsCertificate *certificate)
+{
+  CertificateData *data;
+
+  g_return_val_if_fail (G_IS_TLS_CERTIFICATE (certificate), NULL);
+
+  data = valent_certificate_ensure_data (certificate);
+
+  return data->fingerprint;
+}
+
+/**
+ * valent_certificate_get_public_key:
+ * @certificate: a #GTlsCertificate
+ *
+ * Get the public key of @certificate.
+ *
+ * Returns: (transfer none): a DER-encoded publickey
+ *
+ * Since: 1.0
+ */
+GByteArray *
+valent_certificate_get_public_key (GTlsCertificate *certificate)
+{
+  CertificateData *data;
+
+  g_return_val_if_fail (G_IS_TLS_CERTIFICATE (certificate), NULL);
+
+  data = valent_certificate_ensure_data (certificate);
+
+  return data->public_key;
 }
 
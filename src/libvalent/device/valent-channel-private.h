@@ -0,0 +1,16 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include "valent-channel.h"
+
+G_BEGIN_DECLS
+
+_VALENT_EXTERN
+int64_t   valent_channel_get_priority  (ValentChannel       *channel);
+_VALENT_EXTERN
+void      valent_channel_set_priority  (ValentChannel       *channel,
+                                        int64_t              priority);
+
+G_END_DECLS
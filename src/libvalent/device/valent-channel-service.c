@@ -12,6 +12,7 @@
 
 #include "valent-certificate.h"
 #include "valent-channel.h"
+#include "valent-channel-private.h"
 #include "valent-channel-service.h"
 #include "valent-packet.h"
 
@@ -31,7 +32,20 @@
  *
  * ## `.plugin` File
  *
- * Channel services have no special fields in the `.plugin` file.
+ * Implementations may define the following extra fields in the `.plugin` file:
+ *
+ * - `X-ChannelServicePriority`
+ *
+ *     An integer indicating the transport preference of channels created by
+ *     the service, where a lower value is preferred. When a device is connected
+ *     by several channels, it sends packets with the most preferred one.
+ *
+ * - `X-ChannelServicePayloadCompression`
+ *
+ *     A list of compression methods separated by semi-colons, advertised in
+ *     the `payloadCompression` field of the identity packet. This should only
+ *     be set for transports slow enough to benefit, such as Bluetooth.
+ *     Currently only `gzip` is supported by [class@Valent.DeviceTransfer].
  *
  * Since: 1.0
  */
@@ -237,11 +251,13 @@ valent_channel_service_real_build_identity (ValentChannelService *service)
 {
   ValentChannelServicePrivate *priv = valent_channel_service_get_instance_private (service);
   PeasEngine *engine;
+  g_autoptr (PeasPluginInfo) plugin_info = NULL;
   g_autoptr (JsonBuilder) builder = NULL;
   g_autoptr (GHashTable) incoming = NULL;
   g_autoptr (GHashTable) outgoing = NULL;
   GHashTableIter in_iter, out_iter;
   const char *capability = NULL;
+  const char *compression = NULL;
   unsigned int n_plugins = 0;
 
   g_assert (VALENT_IS_CHANNEL_SERVICE (service));
@@ -307,6 +323,31 @@ valent_channel_service_real_build_identity (ValentChannelService *service)
 
   json_builder_end_array (builder);
 
+  /* Payload Compression (see ValentDeviceTransfer) */
+  g_object_get (service, "plugin-info", &plugin_info, NULL);
+
+  if (plugin_info != NULL)
+    compression = peas_plugin_info_get_external_data (plugin_info,
+                                                      "ChannelServicePayloadCompression");
+
+  if (compression != NULL)
+    {
+      g_auto (GStrv) methods = NULL;
+
+      methods = g_strsplit (compression, ";", -1);
+
+      json_builder_set_member_name (builder, "payloadCompression");
+      json_builder_begin_array (builder);
+
+      for (unsigned int i = 0; methods[i] != NULL; i++)
+        {
+          if (*methods[i] != '\0')
+            json_builder_add_string_value (builder, methods[i]);
+        }
+
+      json_builder_end_array (builder);
+    }
+
   /* End Body, Packet */
   json_builder_end_object (builder);
   json_builder_end_object (builder);
@@ -741,11 +782,21 @@ void
 valent_channel_service_channel (ValentChannelService *service,
                                 ValentChannel        *channel)
 {
+  g_autoptr (PeasPluginInfo) plugin_info = NULL;
   ChannelEmission *emission;
+  const char *priority;
 
   g_return_if_fail (VALENT_IS_CHANNEL_SERVICE (service));
   g_return_if_fail (VALENT_IS_CHANNEL (channel));
 
+  /* Tag the channel with the transport priority of the service */
+  g_object_get (service, "plugin-info", &plugin_info, NULL);
+
+  if (plugin_info != NULL &&
+      (priority = peas_plugin_info_get_external_data (plugin_info,
+                                                      "ChannelServicePriority")) != NULL)
+    valent_channel_set_priority (channel, g_ascii_strtoll (priority, NULL, 10));
+
   if G_LIKELY (VALENT_IS_MAIN_THREAD ())
     {
       g_signal_emit (G_OBJECT (service), signals [CHANNEL], 0, channel);
@@ -11,7 +11,9 @@
 #include <json-glib/json-glib.h>
 #include <libvalent-core.h>
 
+#include "../core/valent-counters-private.h"
 #include "valent-channel.h"
+#include "valent-channel-private.h"
 #include "valent-packet.h"
 
 
@@ -51,6 +53,7 @@ typedef struct
   GIOStream        *base_stream;
   JsonNode         *identity;
   JsonNode         *peer_identity;
+  int64_t           priority;
 
   /* Packet Buffer */
   GDataInputStream *input_buffer;
@@ -733,6 +736,9 @@ valent_channel_read_packet_task (GTask        *task,
   if ((packet = valent_packet_deserialize (line, &error)) == NULL)
     return g_task_return_error (task, error);
 
+  valent_counter_add_packet (valent_packet_get_type (packet),
+                             FALSE,
+                             strlen (line) + 1);
   g_task_return_pointer (task, packet, (GDestroyNotify)json_node_unref);
 }
 
@@ -799,6 +805,21 @@ valent_channel_read_packet_finish (ValentChannel  *channel,
   VALENT_RETURN (ret);
 }
 
+typedef struct
+{
+  JsonNode *packet;
+  int64_t   queued;
+} WritePacketData;
+
+static void
+write_packet_data_free (gpointer data)
+{
+  WritePacketData *write = data;
+
+  g_clear_pointer (&write->packet, json_node_unref);
+  g_free (write);
+}
+
 static gboolean
 valent_channel_write_packet_func (gpointer data)
 {
@@ -806,23 +827,27 @@ valent_channel_write_packet_func (gpointer data)
   ValentChannel *self = g_task_get_source_object (task);
   ValentChannelPrivate *priv = valent_channel_get_instance_private (self);
   g_autoptr (GOutputStream) stream = NULL;
-  JsonNode *packet = NULL;
+  WritePacketData *write = NULL;
   GCancellable *cancellable = NULL;
   GError *error = NULL;
 
   g_assert (G_IS_TASK (task));
   g_assert (VALENT_IS_CHANNEL (self));
 
+  write = g_task_get_task_data (task);
+  valent_counter_add (VALENT_COUNTER_WRITE_QUEUE, -1);
+  valent_counter_set (VALENT_COUNTER_WRITE_LATENCY,
+                      g_get_monotonic_time () - write->queued);
+
   if (valent_channel_return_error_if_closed (self, task))
     return G_SOURCE_REMOVE;
 
   stream = g_object_ref (g_io_stream_get_output_stream (priv->base_stream));
   valent_object_unlock (VALENT_OBJECT (self));
 
-  packet = g_task_get_task_data (task);
   cancellable = g_task_get_cancellable (task);
 
-  if (valent_packet_to_stream (stream, packet, cancellable, &error))
+  if (valent_packet_to_stream (stream, write->packet, cancellable, &error))
     g_task_return_boolean (task, TRUE);
   else
     g_task_return_error (task, error);
@@ -856,6 +881,7 @@ valent_channel_write_packet (ValentChannel       *channel,
 {
   ValentChannelPrivate *priv = valent_channel_get_instance_private (channel);
   g_autoptr (GTask) task = NULL;
+  WritePacketData *write = NULL;
 
   VALENT_ENTRY;
 
@@ -863,15 +889,18 @@ valent_channel_write_packet (ValentChannel       *channel,
   g_return_if_fail (VALENT_IS_PACKET (packet));
   g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
 
+  write = g_new0 (WritePacketData, 1);
+  write->packet = json_node_ref (packet);
+  write->queued = g_get_monotonic_time ();
+
   task = g_task_new (channel, cancellable, callback, user_data);
   g_task_set_source_tag (task, valent_channel_write_packet);
-  g_task_set_task_data (task,
-                        json_node_ref (packet),
-                        (GDestroyNotify)json_node_unref);
+  g_task_set_task_data (task, write, write_packet_data_free);
 
   if (valent_channel_return_error_if_closed (channel, task))
     VALENT_EXIT;
 
+  valent_counter_add (VALENT_COUNTER_WRITE_QUEUE, 1);
   g_main_context_invoke_full (g_main_loop_get_context (priv->output_buffer),
                               g_task_get_priority (task),
                               valent_channel_write_packet_func,
@@ -1175,3 +1204,51 @@ valent_channel_upload_finish (ValentChannel  *channel,
   VALENT_RETURN (ret);
 }
 
+/*< private >
+ * valent_channel_get_priority:
+ * @channel: a #ValentChannel
+ *
+ * Get the transport priority of @channel.
+ *
+ * A device connected by several channels sends packets with the one that has
+ * the lowest value. This is set from the `X-ChannelServicePriority` field of
+ * the service that created @channel, and defaults to `0`.
+ *
+ * Returns: the transport priority
+ */
+int64_t
+valent_channel_get_priority (ValentChannel *channel)
+{
+  ValentChannelPrivate *priv = valent_channel_get_instance_private (channel);
+  int64_t ret;
+
+  g_return_val_if_fail (VALENT_IS_CHANNEL (channel), 0);
+
+  valent_object_lock (VALENT_OBJECT (channel));
+  ret = priv->priority;
+  valent_object_unlock (VALENT_OBJECT (channel));
+
+  return ret;
+}
+
+/*< private >
+ * valent_channel_set_priority:
+ * @channel: a #ValentChannel
+ * @priority: a transport priority
+ *
+ * Set the transport priority of @channel.
+ *
+ * See valent_channel_get_priority().
+ */
+void
+valent_channel_set_priority (ValentChannel *channel,
+                             int64_t        priority)
+{
+  ValentChannelPrivate *priv = valent_channel_get_instance_private (channel);
+
+  g_return_if_fail (VALENT_IS_CHANNEL (channel));
+
+  valent_object_lock (VALENT_OBJECT (channel));
+  priv->priority = priority;
+  valent_object_unlock (VALENT_OBJECT (channel));
+}
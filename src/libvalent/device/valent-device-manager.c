@@ -5,10 +5,16 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 #include <libvalent-core.h>
 
 #include "../core/valent-component-private.h"
+#include "../core/valent-counters-private.h"
 #include "valent-certificate.h"
 #include "valent-channel.h"
 #include "valent-channel-service.h"
@@ -19,6 +25,8 @@
 #include "valent-packet.h"
 
 #define DEVICE_UNPAIRED_MAX (10)
+#define DEVICE_JOURNAL_MAX  (64)
+#define DEVICE_RESTORE_MAX  (64)
 
 
 /**
@@ -49,6 +57,11 @@ struct _ValentDeviceManager
   GHashTable               *plugins;
   ValentContext            *plugins_context;
   JsonNode                 *state;
+  int                       journal_fd;
+  unsigned int              journal_len;
+  gboolean                  loading;
+  GPtrArray                *restore;
+  unsigned int              restore_id;
 
   GDBusObjectManagerServer *dbus;
   GHashTable               *exported;
@@ -59,6 +72,10 @@ static void           valent_device_manager_add_device    (ValentDeviceManager *
 static void           valent_device_manager_remove_device (ValentDeviceManager *manager,
                                                            ValentDevice        *device);
 static ValentDevice * valent_device_manager_ensure_device (ValentDeviceManager *manager,
+                                                           JsonNode            *identity,
+                                                           gboolean             dormant);
+static void           valent_device_manager_append_state  (ValentDeviceManager *manager,
+                                                           const char          *device_id,
                                                            JsonNode            *identity);
 
 static void   g_list_model_iface_init     (GListModelInterface *iface);
@@ -302,7 +319,9 @@ on_channel (ValentChannelService *service,
       VALENT_EXIT;
     }
 
-  if ((device = valent_device_manager_ensure_device (self, identity)) == NULL)
+  valent_counter_mark (VALENT_COUNTER_FIRST_IDENTITY);
+
+  if ((device = valent_device_manager_ensure_device (self, identity, FALSE)) == NULL)
     VALENT_EXIT;
 
   if (!valent_device_manager_check_device (self, device))
@@ -460,12 +479,37 @@ valent_device_manager_remove_device_main (gpointer data)
   return G_SOURCE_REMOVE;
 }
 
+/*
+ * Compare the bodies of two identity packets, ignoring the packet ID, which
+ * is a timestamp that changes with every connection.
+ */
+static gboolean
+valent_device_manager_identity_equal (JsonNode *identity1,
+                                      JsonNode *identity2)
+{
+  JsonNode *body1 = NULL;
+  JsonNode *body2 = NULL;
+
+  if (!JSON_NODE_HOLDS_OBJECT (identity1) || !JSON_NODE_HOLDS_OBJECT (identity2))
+    return FALSE;
+
+  body1 = json_object_get_member (json_node_get_object (identity1), "body");
+  body2 = json_object_get_member (json_node_get_object (identity2), "body");
+
+  if (body1 == NULL || body2 == NULL)
+    return FALSE;
+
+  return json_node_equal (body1, body2);
+}
+
 static void
 on_device_state (ValentDevice        *device,
                  GParamSpec          *pspec,
                  ValentDeviceManager *self)
 {
   ValentDeviceState state = valent_device_get_state (device);
+  JsonObject *devices = json_node_get_object (self->state);
+  const char *device_id = valent_device_get_id (device);
 
   /* Devices that become connected and paired are remembered */
   if ((state & VALENT_DEVICE_STATE_CONNECTED) != 0 &&
@@ -473,23 +517,39 @@ on_device_state (ValentDevice        *device,
     {
       g_autoptr (ValentChannel) channel = NULL;
       JsonNode *identity = NULL;
+      JsonNode *current = NULL;
 
       if ((channel = valent_device_ref_channel (device)) == NULL)
         return;
 
       identity = valent_channel_get_peer_identity (channel);
+      current = json_object_get_member (devices, device_id);
 
-      json_object_set_object_member (json_node_get_object (self->state),
-                                     valent_device_get_id (device),
-                                     json_node_dup_object (identity));
+      if (current == NULL ||
+          !valent_device_manager_identity_equal (current, identity))
+        {
+          json_object_set_object_member (devices,
+                                         device_id,
+                                         json_node_dup_object (identity));
+          valent_device_manager_append_state (self, device_id, identity);
+        }
     }
 
-  /* Devices that become disconnected and unpaired are forgotten */
+  /* Devices that become disconnected and unpaired are forgotten. While the
+   * state is loading, a null member records that the device was forgotten. */
   if ((state & VALENT_DEVICE_STATE_CONNECTED) == 0 &&
       (state & VALENT_DEVICE_STATE_PAIRED) == 0)
     {
-      json_object_remove_member (json_node_get_object (self->state),
-                                 valent_device_get_id (device));
+      if (self->loading)
+        {
+          json_object_set_null_member (devices, device_id);
+        }
+      else if (json_object_has_member (devices, device_id))
+        {
+          json_object_remove_member (devices, device_id);
+          valent_device_manager_append_state (self, device_id, NULL);
+        }
+
       valent_device_manager_remove_device (self, device);
     }
 }
@@ -575,7 +635,8 @@ valent_device_manager_remove_device (ValentDeviceManager *manager,
 
 static ValentDevice *
 valent_device_manager_ensure_device (ValentDeviceManager *manager,
-                                     JsonNode            *identity)
+                                     JsonNode            *identity,
+                                     gboolean             dormant)
 {
   const char *device_id;
 
@@ -595,7 +656,11 @@ valent_device_manager_ensure_device (ValentDeviceManager *manager,
       g_autoptr (ValentDevice) device = NULL;
 
       context = valent_context_new (manager->context, "device", device_id);
-      device = valent_device_new_full (identity, context);
+
+      if (dormant)
+        device = valent_device_new_dormant (identity, context);
+      else
+        device = valent_device_new_full (identity, context);
 
       valent_device_manager_add_device (manager, device);
     }
@@ -603,61 +668,416 @@ valent_device_manager_ensure_device (ValentDeviceManager *manager,
   return valent_device_manager_lookup (manager, device_id);
 }
 
+/*
+ * State
+ *
+ * The known devices are stored as a snapshot (`devices.json`) and an
+ * append-only journal (`devices.journal`) of changes since the snapshot was
+ * written. Each record is a single line holding the device ID and either the
+ * identity packet, or nothing if the device was forgotten.
+ *
+ * Records are synced to disk as they are appended, and the journal is folded
+ * into the snapshot when it grows past %DEVICE_JOURNAL_MAX records, or when
+ * the manager is shutdown. If the manager is shutdown before the state has
+ * loaded, the changes made in the meantime are only appended to the journal.
+ */
 static void
-valent_device_manager_load_state (ValentDeviceManager *self)
+valent_device_manager_save_state (ValentDeviceManager *self)
 {
+  g_autoptr (JsonGenerator) generator = NULL;
+  g_autoptr (GFile) file = NULL;
+  g_autofree char *data = NULL;
+  size_t length = 0;
+  g_autoptr (GError) error = NULL;
+
+  g_assert (VALENT_IS_DEVICE_MANAGER (self));
+
+  /* The state is incomplete until it has been loaded */
+  if (self->state == NULL || self->loading)
+    return;
+
+  generator = g_object_new (JSON_TYPE_GENERATOR,
+                            "pretty", TRUE,
+                            "root",   self->state,
+                            NULL);
+  data = json_generator_to_data (generator, &length);
+
+  file = valent_context_get_cache_file (self->context, "devices.json");
+
+  if (!g_file_set_contents_full (g_file_peek_path (file),
+                                 data,
+                                 length,
+                                 (G_FILE_SET_CONTENTS_CONSISTENT |
+                                  G_FILE_SET_CONTENTS_DURABLE),
+                                 0600,
+                                 &error))
+    {
+      g_warning ("%s(): %s", G_STRFUNC, error->message);
+      return;
+    }
+
+  /* The snapshot is durable, so the journal can be discarded */
+  if (self->journal_fd != -1)
+    {
+      if (ftruncate (self->journal_fd, 0) == -1)
+        {
+          g_warning ("%s(): %s", G_STRFUNC, g_strerror (errno));
+          return;
+        }
+
+      self->journal_len = 0;
+    }
+}
+
+static void
+valent_device_manager_append_state (ValentDeviceManager *self,
+                                    const char          *device_id,
+                                    JsonNode            *identity)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) record = NULL;
+  g_autofree char *json = NULL;
+  g_autofree char *line = NULL;
+  size_t length = 0;
+  size_t written = 0;
+
+  g_assert (VALENT_IS_DEVICE_MANAGER (self));
+  g_assert (device_id != NULL);
+
+  if (self->journal_fd == -1)
+    return;
+
+  builder = json_builder_new ();
+  json_builder_begin_object (builder);
+  json_builder_set_member_name (builder, "deviceId");
+  json_builder_add_string_value (builder, device_id);
+
+  if (identity != NULL)
+    {
+      json_builder_set_member_name (builder, "identity");
+      json_builder_add_value (builder, json_node_ref (identity));
+    }
+
+  json_builder_end_object (builder);
+  record = json_builder_get_root (builder);
+
+  json = json_to_string (record, FALSE);
+  line = g_strconcat (json, "\n", NULL);
+  length = strlen (line);
+
+  while (written < length)
+    {
+      ssize_t ret = write (self->journal_fd, line + written, length - written);
+
+      if (ret == -1)
+        {
+          if (errno == EINTR)
+            continue;
+
+          g_warning ("%s(): %s", G_STRFUNC, g_strerror (errno));
+          return;
+        }
+
+      written += ret;
+    }
+
+  if (fdatasync (self->journal_fd) == -1)
+    g_warning ("%s(): %s", G_STRFUNC, g_strerror (errno));
+
+  if (++self->journal_len >= DEVICE_JOURNAL_MAX)
+    valent_device_manager_save_state (self);
+}
+
+/*
+ * Apply each record in @contents to @devices, returning %FALSE if a record is
+ * damaged. Only the last record can be partially written, so replay stops at
+ * the first damaged record.
+ */
+static gboolean
+valent_device_manager_replay_state (JsonObject   *devices,
+                                    const char   *contents,
+                                    unsigned int *n_records)
+{
+  g_auto (GStrv) lines = NULL;
+
+  lines = g_strsplit (contents, "\n", -1);
+
+  for (unsigned int i = 0; lines[i] != NULL; i++)
+    {
+      g_autoptr (JsonNode) record = NULL;
+      JsonObject *object;
+      JsonNode *identity;
+      const char *device_id;
+
+      if (*lines[i] == '\0')
+        continue;
+
+      record = json_from_string (lines[i], NULL);
+
+      if (record == NULL || !JSON_NODE_HOLDS_OBJECT (record))
+        return FALSE;
+
+      object = json_node_get_object (record);
+      device_id = json_object_get_string_member_with_default (object,
+                                                              "deviceId",
+                                                              NULL);
+
+      if (device_id == NULL)
+        return FALSE;
+
+      identity = json_object_get_member (object, "identity");
+
+      if (identity != NULL && JSON_NODE_HOLDS_OBJECT (identity))
+        json_object_set_object_member (devices,
+                                       device_id,
+                                       json_node_dup_object (identity));
+      else
+        json_object_remove_member (devices, device_id);
+
+      *n_records += 1;
+    }
+
+  return TRUE;
+}
+
+typedef struct
+{
+  char         *state_path;
+  char         *journal_path;
+  JsonNode     *state;
+  int           journal_fd;
+  unsigned int  n_records;
+  gboolean      compact;
+} LoadState;
+
+static void
+load_state_free (gpointer data)
+{
+  LoadState *load = data;
+
+  g_clear_pointer (&load->state_path, g_free);
+  g_clear_pointer (&load->journal_path, g_free);
+  g_clear_pointer (&load->state, json_node_unref);
+  g_clear_fd (&load->journal_fd, NULL);
+  g_free (load);
+}
+
+static void
+valent_device_manager_load_state_task (GTask        *task,
+                                       gpointer      source_object,
+                                       gpointer      task_data,
+                                       GCancellable *cancellable)
+{
+  LoadState *load = task_data;
+  g_autoptr (JsonParser) parser = NULL;
+  g_autofree char *contents = NULL;
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  /* Try to load the state file */
+  parser = json_parser_new ();
+
+  if (json_parser_load_from_file (parser, load->state_path, NULL))
+    load->state = json_parser_steal_root (parser);
+
+  if (load->state == NULL || !JSON_NODE_HOLDS_OBJECT (load->state))
+    {
+      g_clear_pointer (&load->state, json_node_unref);
+      load->state = json_node_new (JSON_NODE_OBJECT);
+      json_node_take_object (load->state, json_object_new ());
+    }
+
+  /* Replay any changes written since the last snapshot */
+  if (g_file_get_contents (load->journal_path, &contents, NULL, NULL))
+    {
+      load->compact = !valent_device_manager_replay_state (json_node_get_object (load->state),
+                                                           contents,
+                                                           &load->n_records);
+    }
+
+  load->journal_fd = g_open (load->journal_path,
+                             O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                             0600);
+
+  if (load->journal_fd == -1)
+    g_warning ("%s(): %s", G_STRFUNC, g_strerror (errno));
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static gboolean
+valent_device_manager_restore_devices (gpointer data)
+{
+  ValentDeviceManager *self = VALENT_DEVICE_MANAGER (data);
+  JsonObject *devices = json_node_get_object (self->state);
+  unsigned int n_restored = 0;
+
+  /* Load devices in batches, deferring their plugins until they connect */
+  while (self->restore->len > 0 && n_restored++ < DEVICE_RESTORE_MAX)
+    {
+      g_autoptr (JsonNode) identity = NULL;
+      const char *device_id;
+
+      identity = g_ptr_array_steal_index (self->restore, self->restore->len - 1);
+
+      /* Skip devices forgotten since the state was loaded */
+      if (!valent_packet_get_string (identity, "deviceId", &device_id) ||
+          !json_object_has_member (devices, device_id))
+        continue;
+
+      valent_device_manager_ensure_device (self, identity, TRUE);
+    }
+
+  if (self->restore->len > 0)
+    return G_SOURCE_CONTINUE;
+
+  self->restore_id = 0;
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+valent_device_manager_load_state_cb (GObject      *object,
+                                     GAsyncResult *result,
+                                     gpointer      user_data)
+{
+  ValentDeviceManager *self = VALENT_DEVICE_MANAGER (object);
+  LoadState *load = g_task_get_task_data (G_TASK (result));
+  g_autoptr (JsonNode) changes = NULL;
   JsonObjectIter iter;
   const char *device_id;
   JsonNode *identity;
+  g_autoptr (GError) error = NULL;
 
-  g_assert (VALENT_IS_DEVICE_MANAGER (self));
-
-  if (self->state == NULL)
+  if (!g_task_propagate_boolean (G_TASK (result), &error))
     {
-      g_autoptr (JsonParser) parser = NULL;
-      g_autoptr (GFile) file = NULL;
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("%s(): %s", G_STRFUNC, error->message);
+
+      return;
+    }
+
+  /* Changes made while the state was loading take precedence */
+  changes = g_steal_pointer (&self->state);
+  self->state = g_steal_pointer (&load->state);
+  self->journal_fd = g_steal_fd (&load->journal_fd);
+  self->journal_len = load->n_records;
+  self->loading = FALSE;
 
-      file = valent_context_get_cache_file (self->context, "devices.json");
+  if (load->compact || self->journal_len >= DEVICE_JOURNAL_MAX)
+    valent_device_manager_save_state (self);
 
-      /* Try to load the state file */
-      parser = json_parser_new ();
+  json_object_iter_init (&iter, json_node_get_object (changes));
 
-      if (json_parser_load_from_file (parser, g_file_peek_path (file), NULL))
-        self->state = json_parser_steal_root (parser);
+  while (json_object_iter_next (&iter, &device_id, &identity))
+    {
+      JsonObject *devices = json_node_get_object (self->state);
 
-      if (self->state == NULL || !JSON_NODE_HOLDS_OBJECT (self->state))
+      if (JSON_NODE_HOLDS_NULL (identity))
         {
-          g_clear_pointer (&self->state, json_node_unref);
-          self->state = json_node_new (JSON_NODE_OBJECT);
-          json_node_take_object (self->state, json_object_new ());
+          json_object_remove_member (devices, device_id);
+          valent_device_manager_append_state (self, device_id, NULL);
+        }
+      else
+        {
+          json_object_set_object_member (devices,
+                                         device_id,
+                                         json_node_dup_object (identity));
+          valent_device_manager_append_state (self, device_id, identity);
         }
     }
 
-  /* Load devices */
+  /* Restore remembered devices from idle callbacks, so channels that connect
+   * in the meantime are not kept waiting */
   json_object_iter_init (&iter, json_node_get_object (self->state));
 
   while (json_object_iter_next (&iter, &device_id, &identity))
-    valent_device_manager_ensure_device (self, identity);
+    g_ptr_array_add (self->restore, json_node_ref (identity));
+
+  if (self->restore->len > 0 && self->restore_id == 0)
+    {
+      self->restore_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+                                          valent_device_manager_restore_devices,
+                                          g_object_ref (self),
+                                          g_object_unref);
+    }
 }
 
+/*
+ * Append the changes made while the state was loading to the journal, so they
+ * are replayed on top of the snapshot the next time it is loaded.
+ */
 static void
-valent_device_manager_save_state (ValentDeviceManager *self)
+valent_device_manager_journal_changes (ValentDeviceManager *self)
 {
-  g_autoptr (JsonGenerator) generator = NULL;
+  g_autoptr (GFile) journal = NULL;
+  JsonObjectIter iter;
+  const char *device_id;
+  JsonNode *identity;
+
+  g_assert (VALENT_IS_DEVICE_MANAGER (self));
+  g_assert (self->loading);
+
+  journal = valent_context_get_cache_file (self->context, "devices.journal");
+  self->journal_fd = g_open (g_file_peek_path (journal),
+                             O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                             0600);
+
+  if (self->journal_fd == -1)
+    {
+      g_warning ("%s(): %s", G_STRFUNC, g_strerror (errno));
+      return;
+    }
+
+  json_object_iter_init (&iter, json_node_get_object (self->state));
+
+  while (json_object_iter_next (&iter, &device_id, &identity))
+    {
+      if (JSON_NODE_HOLDS_NULL (identity))
+        identity = NULL;
+
+      valent_device_manager_append_state (self, device_id, identity);
+    }
+}
+
+/*
+ * Start loading the device state in a thread. Until it completes, the state
+ * holds only the changes made in the meantime, which are merged on top, or
+ * journaled if the manager is shutdown first.
+ */
+static void
+valent_device_manager_load_state (ValentDeviceManager *self)
+{
+  g_autoptr (GTask) task = NULL;
   g_autoptr (GFile) file = NULL;
-  g_autoptr (GError) error = NULL;
+  g_autoptr (GFile) journal = NULL;
+  LoadState *load;
 
   g_assert (VALENT_IS_DEVICE_MANAGER (self));
 
-  generator = g_object_new (JSON_TYPE_GENERATOR,
-                            "pretty", TRUE,
-                            "root",   self->state,
-                            NULL);
+  if (self->state != NULL)
+    return;
 
   file = valent_context_get_cache_file (self->context, "devices.json");
-
-  if (!json_generator_to_file (generator, g_file_peek_path (file), &error))
-    g_warning ("%s(): %s", G_STRFUNC, error->message);
+  journal = valent_context_get_cache_file (self->context, "devices.journal");
+
+  load = g_new0 (LoadState, 1);
+  load->state_path = g_file_get_path (file);
+  load->journal_path = g_file_get_path (journal);
+  load->journal_fd = -1;
+
+  self->state = json_node_new (JSON_NODE_OBJECT);
+  json_node_take_object (self->state, json_object_new ());
+  self->loading = TRUE;
+
+  task = g_task_new (self,
+                     self->cancellable,
+                     valent_device_manager_load_state_cb,
+                     NULL);
+  g_task_set_source_tag (task, valent_device_manager_load_state);
+  g_task_set_task_data (task, load, load_state_free);
+  g_task_run_in_thread (task, valent_device_manager_load_state_task);
 }
 
 /*
@@ -786,7 +1206,17 @@ valent_device_manager_shutdown (ValentApplicationPlugin *plugin)
   g_ptr_array_remove_range (self->devices, 0, n_devices);
   g_list_model_items_changed (G_LIST_MODEL (self), 0, n_devices, 0);
 
-  valent_device_manager_save_state (self);
+  g_clear_handle_id (&self->restore_id, g_source_remove);
+  g_ptr_array_set_size (self->restore, 0);
+
+  if (self->loading)
+    valent_device_manager_journal_changes (self);
+  else
+    valent_device_manager_save_state (self);
+
+  self->loading = FALSE;
+  g_clear_pointer (&self->state, json_node_unref);
+  g_clear_fd (&self->journal_fd, NULL);
   g_clear_object (&self->settings);
 
   /* Remove actions from the `app` group, if available */
@@ -826,9 +1256,8 @@ valent_device_manager_startup (ValentApplicationPlugin *plugin)
                    G_SETTINGS_BIND_DEFAULT);
   name = g_settings_get_string (self->settings, "name");
   valent_device_manager_set_name (self, name);
-  valent_device_manager_load_state (self);
 
-  /* Setup services */
+  /* Setup services first, so they are listening as soon as possible */
   engine = valent_get_plugin_engine ();
   n_plugins = g_list_model_get_n_items (G_LIST_MODEL (engine));
 
@@ -854,6 +1283,9 @@ valent_device_manager_startup (ValentApplicationPlugin *plugin)
                            self,
                            0);
 
+  /* Load remembered devices while the services start */
+  valent_device_manager_load_state (self);
+
   /* Add actions to the `app` group, if available */
   if (self == default_manager)
     {
@@ -915,7 +1347,9 @@ valent_device_manager_finalize (GObject *object)
   g_clear_pointer (&self->plugins, g_hash_table_unref);
   g_clear_pointer (&self->plugins_context, g_object_unref);
   g_clear_pointer (&self->devices, g_ptr_array_unref);
+  g_clear_pointer (&self->restore, g_ptr_array_unref);
   g_clear_pointer (&self->state, json_node_unref);
+  g_clear_fd (&self->journal_fd, NULL);
 
   g_clear_object (&self->certificate);
   g_clear_object (&self->context);
@@ -1004,6 +1438,8 @@ valent_device_manager_init (ValentDeviceManager *self)
   self->exported = g_hash_table_new (NULL, NULL);
   self->plugins = g_hash_table_new_full (NULL, NULL, NULL, manager_plugin_free);
   self->plugins_context = valent_context_new (self->context, "network", NULL);
+  self->journal_fd = -1;
+  self->restore = g_ptr_array_new_with_free_func ((GDestroyNotify)json_node_unref);
 }
 
 /**
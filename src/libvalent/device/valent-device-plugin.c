@@ -81,11 +81,31 @@
  *     A list of packet types (eg. `kdeconnect.share.request`) separated by
  *     semi-colons indicating the packets that the plugin may send.
  *
+ * - `X-DevicePluginResident`
+ *
+ *     A boolean indicating that the plugin may hold user interface, mounts or
+ *     child processes, and must stay loaded when a remembered device has been
+ *     disconnected for the `plugin-timeout` setting.
+ *
  * - `X-DevicePluginSettings`
  *
  *     A [class@Gio.Settings] schema ID for the plugin's settings. See
  *     [method@Valent.Context.get_plugin_settings] for more information.
  *
+ * - `X-DevicePluginThreaded`
+ *
+ *     A list of packet types from `X-DevicePluginIncoming` separated by
+ *     semi-colons, indicating packets that should be passed to
+ *     [vfunc@Valent.DevicePlugin.handle_packet] on a worker thread. This is
+ *     intended for packets that are expensive to process, such as large
+ *     batches of messages or contacts.
+ *
+ *     Packets are still delivered in the order they were received, so a
+ *     packet that arrives while another is being handled on a worker thread
+ *     will wait for it to finish. The handler must be thread-safe, and should
+ *     use [func@GLib.idle_add_full] for anything that must happen on the main
+ *     thread.
+ *
  * Since: 1.0
  */
 
@@ -8,13 +8,19 @@
 G_BEGIN_DECLS
 
 _VALENT_EXTERN
-ValentDevice * valent_device_new_full      (JsonNode      *identity,
-                                            ValentContext *context);
+ValentDevice  * valent_device_new_full           (JsonNode      *identity,
+                                                  ValentContext *context);
 _VALENT_EXTERN
-void           valent_device_set_channel   (ValentDevice  *device,
-                                            ValentChannel *channel);
+ValentDevice  * valent_device_new_dormant        (JsonNode      *identity,
+                                                  ValentContext *context);
 _VALENT_EXTERN
-void           valent_device_set_paired    (ValentDevice  *device,
-                                            gboolean       paired);
+void            valent_device_set_channel        (ValentDevice  *device,
+                                                  ValentChannel *channel);
+_VALENT_EXTERN
+void            valent_device_set_paired         (ValentDevice  *device,
+                                                  gboolean       paired);
+_VALENT_EXTERN
+ValentChannel * valent_device_ref_packet_channel (ValentDevice  *device,
+                                                  JsonNode      *packet);
 
 G_END_DECLS
@@ -9,8 +9,10 @@
 
 #include <libvalent-core.h>
 
+#include "../core/valent-counters-private.h"
 #include "valent-channel.h"
 #include "valent-device.h"
+#include "valent-device-private.h"
 #include "valent-device-transfer.h"
 #include "valent-packet.h"
 
@@ -28,6 +30,13 @@
  * payload information the transfer is assumed to be a download, otherwise it is
  * assumed to be an upload.
  *
+ * If both identities of the channel list `gzip` in their `payloadCompression`
+ * field, compressible files are compressed for upload and the packet is marked
+ * with a top-level `payloadCompression` field. Channel services only advertise
+ * compression for slow transports, such as Bluetooth. Downloads marked this way
+ * are decompressed, while the payload size always describes the original file
+ * and bounds the decompressed size.
+ *
  * Since: 1.0
  */
 
@@ -42,6 +51,24 @@ struct _ValentDeviceTransfer
 
 G_DEFINE_FINAL_TYPE (ValentDeviceTransfer, valent_device_transfer, VALENT_TYPE_TRANSFER)
 
+#define PAYLOAD_COMPRESSION      "payloadCompression"
+#define PAYLOAD_COMPRESSION_GZIP "gzip"
+#define PAYLOAD_COMPRESSION_MIN  (4096)
+#define PAYLOAD_SPLICE_CHUNK     (65536)
+
+/* Content types that are already compressed, in addition to audio, image and
+ * video types. */
+static const char * const compressed_types[] = {
+  "application/gzip",
+  "application/vnd.android.package-archive",
+  "application/vnd.rar",
+  "application/x-7z-compressed",
+  "application/x-bzip2",
+  "application/x-xz",
+  "application/zip",
+  "application/zstd",
+};
+
 
 enum {
   PROP_0,
@@ -83,6 +110,117 @@ valent_device_transfer_update_packet (JsonNode  *packet,
   valent_packet_set_payload_size (packet, payload_size);
 }
 
+static inline gboolean
+identity_supports_compression (JsonNode   *identity,
+                               const char *method)
+{
+  g_auto (GStrv) methods = NULL;
+
+  if (identity == NULL)
+    return FALSE;
+
+  methods = valent_packet_dup_strv (identity, PAYLOAD_COMPRESSION);
+
+  return methods != NULL &&
+         g_strv_contains ((const char * const *)methods, method);
+}
+
+static gboolean
+valent_device_transfer_should_compress (ValentChannel *channel,
+                                        GFileInfo     *info)
+{
+  const char *content_type;
+
+  if (g_file_info_get_size (info) < PAYLOAD_COMPRESSION_MIN)
+    return FALSE;
+
+  content_type = g_file_info_get_attribute_string (info,
+                                                   G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE);
+
+  if (content_type != NULL)
+    {
+      if (g_str_has_prefix (content_type, "audio/") ||
+          g_str_has_prefix (content_type, "image/") ||
+          g_str_has_prefix (content_type, "video/"))
+        return FALSE;
+
+      for (size_t i = 0; i < G_N_ELEMENTS (compressed_types); i++)
+        {
+          if (g_content_type_is_a (content_type, compressed_types[i]))
+            return FALSE;
+        }
+    }
+
+  /* The local identity only lists compression for slow transports */
+  return identity_supports_compression (valent_channel_get_identity (channel),
+                                        PAYLOAD_COMPRESSION_GZIP) &&
+         identity_supports_compression (valent_channel_get_peer_identity (channel),
+                                        PAYLOAD_COMPRESSION_GZIP);
+}
+
+/*
+ * Copy @source to @target like g_output_stream_splice(), but fail if more than
+ * @limit bytes are read, so that a compressed payload can not expand beyond
+ * the payload size it claims.
+ */
+static gssize
+valent_device_transfer_splice_bounded (GOutputStream  *target,
+                                       GInputStream   *source,
+                                       goffset         limit,
+                                       GCancellable   *cancellable,
+                                       GError        **error)
+{
+  g_autofree char *buffer = NULL;
+  gssize transferred = 0;
+  gssize n_read;
+
+  buffer = g_malloc (PAYLOAD_SPLICE_CHUNK);
+
+  while ((n_read = g_input_stream_read (source,
+                                        buffer,
+                                        PAYLOAD_SPLICE_CHUNK,
+                                        cancellable,
+                                        error)) > 0)
+    {
+      if (transferred + n_read > limit)
+        {
+          g_set_error (error,
+                       G_IO_ERROR,
+                       G_IO_ERROR_INVALID_DATA,
+                       "Decompressed payload exceeds %"G_GOFFSET_FORMAT" bytes",
+                       limit);
+          n_read = -1;
+          break;
+        }
+
+      if (!g_output_stream_write_all (target,
+                                      buffer,
+                                      n_read,
+                                      NULL,
+                                      cancellable,
+                                      error))
+        {
+          n_read = -1;
+          break;
+        }
+
+      transferred += n_read;
+    }
+
+  g_input_stream_close (source, NULL, NULL);
+
+  if (n_read < 0)
+    {
+      g_output_stream_close (target, NULL, NULL);
+      return -1;
+    }
+
+  if (!g_output_stream_close (target, cancellable, error))
+    return -1;
+
+  return transferred;
+}
+
 /*
  * ValentDeviceTransfer
  */
@@ -100,6 +238,8 @@ valent_device_transfer_execute_task (GTask        *task,
   g_autoptr (GInputStream) source = NULL;
   g_autoptr (GOutputStream) target = NULL;
   gboolean is_download = FALSE;
+  gboolean compress = FALSE;
+  const char *compression = NULL;
   gssize transferred;
   int64_t last_modified = 0;
   int64_t creation_time = 0;
@@ -110,7 +250,7 @@ valent_device_transfer_execute_task (GTask        *task,
     return;
 
   valent_object_lock (VALENT_OBJECT (self));
-  channel = valent_device_ref_channel (self->device);
+  channel = valent_device_ref_packet_channel (self->device, self->packet);
   file = g_object_ref (self->file);
   packet = json_node_ref (self->packet);
   valent_object_unlock (VALENT_OBJECT (self));
@@ -147,6 +287,44 @@ valent_device_transfer_execute_task (GTask        *task,
         return g_task_return_error (task, error);
 
       source = g_object_ref (g_io_stream_get_input_stream (stream));
+
+      compression = json_object_get_string_member_with_default (json_node_get_object (packet),
+                                                                PAYLOAD_COMPRESSION,
+                                                                NULL);
+
+      if (g_strcmp0 (compression, PAYLOAD_COMPRESSION_GZIP) == 0)
+        {
+          g_autoptr (GZlibDecompressor) decompressor = NULL;
+          GInputStream *compressed = NULL;
+
+          /* The payload size is needed to bound the decompressed size */
+          if (valent_packet_get_payload_size (packet) < 0)
+            {
+              g_file_delete (file, NULL, NULL);
+              g_task_return_new_error (task,
+                                       G_IO_ERROR,
+                                       G_IO_ERROR_INVALID_DATA,
+                                       "Compressed payload without a size");
+              return;
+            }
+
+          compressed = g_steal_pointer (&source);
+
+          decompressor = g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+          source = g_converter_input_stream_new (compressed,
+                                                 G_CONVERTER (decompressor));
+          g_object_unref (compressed);
+        }
+      else if (compression != NULL)
+        {
+          g_file_delete (file, NULL, NULL);
+          g_task_return_new_error (task,
+                                   G_IO_ERROR,
+                                   G_IO_ERROR_NOT_SUPPORTED,
+                                   "Unsupported payload compression \"%s\"",
+                                   compression);
+          return;
+        }
     }
   else
     {
@@ -157,6 +335,7 @@ valent_device_transfer_execute_task (GTask        *task,
                                 G_FILE_ATTRIBUTE_TIME_CREATED_USEC","
                                 G_FILE_ATTRIBUTE_TIME_MODIFIED","
                                 G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC","
+                                G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE","
                                 G_FILE_ATTRIBUTE_STANDARD_SIZE,
                                 G_FILE_QUERY_INFO_NONE,
                                 cancellable,
@@ -170,22 +349,55 @@ valent_device_transfer_execute_task (GTask        *task,
       if (source == NULL)
         return g_task_return_error (task, error);
 
+      /* The packet must be marked before the channel sends it */
       valent_device_transfer_update_packet (packet, info);
+      compress = valent_device_transfer_should_compress (channel, info);
+
+      if (compress)
+        json_object_set_string_member (json_node_get_object (packet),
+                                       PAYLOAD_COMPRESSION,
+                                       PAYLOAD_COMPRESSION_GZIP);
+      else
+        json_object_remove_member (json_node_get_object (packet),
+                                   PAYLOAD_COMPRESSION);
+
       stream = valent_channel_upload (channel, packet, cancellable, &error);
 
       if (stream == NULL)
         return g_task_return_error (task, error);
 
       target = g_object_ref (g_io_stream_get_output_stream (stream));
+
+      if (compress)
+        {
+          g_autoptr (GZlibCompressor) compressor = NULL;
+          GOutputStream *uncompressed = g_steal_pointer (&target);
+
+          compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+          target = g_converter_output_stream_new (uncompressed,
+                                                  G_CONVERTER (compressor));
+          g_object_unref (uncompressed);
+        }
     }
 
   /* Transfer the payload */
-  transferred = g_output_stream_splice (target,
-                                        source,
-                                        (G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
-                                         G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET),
-                                        cancellable,
-                                        &error);
+  if (is_download && compression != NULL)
+    {
+      transferred = valent_device_transfer_splice_bounded (target,
+                                                           source,
+                                                           valent_packet_get_payload_size (packet),
+                                                           cancellable,
+                                                           &error);
+    }
+  else
+    {
+      transferred = g_output_stream_splice (target,
+                                            source,
+                                            (G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+                                             G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET),
+                                            cancellable,
+                                            &error);
+    }
 
   if (error != NULL)
     {
@@ -195,6 +407,11 @@ valent_device_transfer_execute_task (GTask        *task,
       return g_task_return_error (task, error);
     }
 
+  valent_counter_add (is_download
+                        ? VALENT_COUNTER_PAYLOAD_BYTES_IN
+                        : VALENT_COUNTER_PAYLOAD_BYTES_OUT,
+                      transferred);
+
   /* If possible, confirm the transferred size with the payload size */
   payload_size = valent_packet_get_payload_size (packet);
 
@@ -12,7 +12,9 @@
 #include "valent-device-enums.h"
 
 #include "../core/valent-component-private.h"
+#include "../core/valent-counters-private.h"
 #include "valent-channel.h"
+#include "valent-channel-private.h"
 #include "valent-device.h"
 #include "valent-device-plugin.h"
 #include "valent-device-private.h"
@@ -61,19 +63,34 @@ struct _ValentDevice
 
   /* State */
   ValentChannel  *channel;
+  GPtrArray      *channels;
+  GQueue          payloads;
   gboolean        paired;
   unsigned int    incoming_pair;
   unsigned int    outgoing_pair;
+  GQueue          pending;
+  gboolean        working;
 
   /* Plugins */
   PeasEngine     *engine;
   GHashTable     *plugins;
   GHashTable     *handlers;
+  GHashTable     *workers;
+  GHashTable     *slow_plugins;
   GHashTable     *actions;
   GMenu          *menu;
+  gboolean        dormant;
+  unsigned int    dormant_id;
+  gboolean        restored;
 };
 
+static void       valent_device_drop_channel    (ValentDevice   *device,
+                                                 ValentChannel  *channel);
+static void       valent_device_process_packet  (ValentDevice   *device,
+                                                 JsonNode       *packet);
 static void       valent_device_reload_plugins  (ValentDevice   *device);
+static void       valent_device_wake_plugins    (ValentDevice   *device);
+static gboolean   valent_device_sleep_plugins   (gpointer        data);
 static void       valent_device_update_plugins  (ValentDevice   *device);
 static gboolean   valent_device_supports_plugin (ValentDevice   *device,
                                                  PeasPluginInfo *info);
@@ -195,6 +212,10 @@ device_plugin_free (gpointer data)
 {
   ValentPlugin *plugin = data;
 
+  /* Plugins are not instantiated while the device is dormant */
+  if (plugin == NULL)
+    return;
+
   /* `::action-removed` needs to be emitted before the plugin is freed */
   if (plugin->extension != NULL)
     valent_object_destroy (VALENT_OBJECT (plugin->extension));
@@ -276,7 +297,9 @@ valent_device_enable_plugin (ValentDevice *device,
                              ValentPlugin *plugin)
 {
   g_auto (GStrv) actions = NULL;
+  g_auto (GStrv) threaded = NULL;
   const char *incoming = NULL;
+  const char *threaded_str = NULL;
 
   g_assert (VALENT_IS_DEVICE (device));
   g_assert (plugin != NULL);
@@ -290,9 +313,14 @@ valent_device_enable_plugin (ValentDevice *device,
                                                     NULL);
   g_return_if_fail (G_IS_OBJECT (plugin->extension));
 
-  /* Register packet handlers */
+  /* Register packet handlers, separating those run on a worker thread */
   incoming = peas_plugin_info_get_external_data (plugin->info,
                                                  "DevicePluginIncoming");
+  threaded_str = peas_plugin_info_get_external_data (plugin->info,
+                                                     "DevicePluginThreaded");
+
+  if (threaded_str != NULL)
+    threaded = g_strsplit (threaded_str, ";", -1);
 
   if (incoming != NULL)
     {
@@ -302,13 +330,17 @@ valent_device_enable_plugin (ValentDevice *device,
 
       for (unsigned int i = 0; capabilities[i] != NULL; i++)
         {
+          GHashTable *table = device->handlers;
           GPtrArray *handlers = NULL;
           const char *type = capabilities[i];
 
-          if ((handlers = g_hash_table_lookup (device->handlers, type)) == NULL)
+          if (threaded != NULL && g_strv_contains ((const char * const *)threaded, type))
+            table = device->workers;
+
+          if ((handlers = g_hash_table_lookup (table, type)) == NULL)
             {
               handlers = g_ptr_array_new ();
-              g_hash_table_insert (device->handlers, g_strdup (type), handlers);
+              g_hash_table_insert (table, g_strdup (type), handlers);
             }
 
           g_ptr_array_add (handlers, plugin->extension);
@@ -384,11 +416,13 @@ valent_device_disable_plugin (ValentDevice *device,
           const char *type = capabilities[i];
           GPtrArray *handlers = NULL;
 
-          if ((handlers = g_hash_table_lookup (device->handlers, type)) == NULL)
-            continue;
-
-          if (g_ptr_array_remove (handlers, plugin->extension) && handlers->len == 0)
+          if ((handlers = g_hash_table_lookup (device->handlers, type)) != NULL &&
+              g_ptr_array_remove (handlers, plugin->extension) && handlers->len == 0)
             g_hash_table_remove (device->handlers, type);
+
+          if ((handlers = g_hash_table_lookup (device->workers, type)) != NULL &&
+              g_ptr_array_remove (handlers, plugin->extension) && handlers->len == 0)
+            g_hash_table_remove (device->workers, type);
         }
     }
 
@@ -453,10 +487,7 @@ send_pair_cb (ValentChannel *channel,
 
       valent_device_reset_pair (device);
 
-      valent_object_lock (VALENT_OBJECT (device));
-      if (device->channel == channel)
-        valent_device_set_channel (device, NULL);
-      valent_object_unlock (VALENT_OBJECT (device));
+      valent_device_drop_channel (device, channel);
     }
 
   g_object_unref (device);
@@ -676,11 +707,281 @@ valent_device_handle_identity (ValentDevice *device,
   VALENT_EXIT;
 }
 
+/*
+ * Payload channels
+ *
+ * The transfer info of a payload is only valid for the channel that received
+ * the packet, which may not be the active channel. The channel is remembered
+ * for the most recent packets with payloads, for as long as it stays open.
+ */
+#define PAYLOAD_CHANNELS_MAX (32)
+
+typedef struct
+{
+  JsonNode      *packet;
+  ValentChannel *channel;
+} PayloadChannel;
+
+static void
+payload_channel_free (gpointer data)
+{
+  PayloadChannel *payload = data;
+
+  g_clear_pointer (&payload->packet, json_node_unref);
+  g_clear_object (&payload->channel);
+  g_free (payload);
+}
+
+static void
+valent_device_add_payload (ValentDevice  *device,
+                           ValentChannel *channel,
+                           JsonNode      *packet)
+{
+  PayloadChannel *payload = NULL;
+
+  payload = g_new0 (PayloadChannel, 1);
+  payload->packet = json_node_ref (packet);
+  payload->channel = g_object_ref (channel);
+
+  valent_object_lock (VALENT_OBJECT (device));
+  g_queue_push_head (&device->payloads, payload);
+
+  if (device->payloads.length > PAYLOAD_CHANNELS_MAX)
+    payload_channel_free (g_queue_pop_tail (&device->payloads));
+  valent_object_unlock (VALENT_OBJECT (device));
+}
+
+/*< private >
+ * valent_device_ref_packet_channel:
+ * @device: a #ValentDevice
+ * @packet: a KDE Connect packet
+ *
+ * Get the channel to transfer the payload of @packet with.
+ *
+ * If @packet was received by @device, this is the channel that received it,
+ * even if another channel has since become active, or %NULL if that channel
+ * has been closed. Otherwise, such as for uploads, this is the same as
+ * [method@Valent.Device.ref_channel].
+ *
+ * Returns: (transfer full) (nullable): a #ValentChannel
+ */
+ValentChannel *
+valent_device_ref_packet_channel (ValentDevice *device,
+                                  JsonNode     *packet)
+{
+  ValentChannel *ret = NULL;
+
+  g_return_val_if_fail (VALENT_IS_DEVICE (device), NULL);
+  g_return_val_if_fail (VALENT_IS_PACKET (packet), NULL);
+
+  valent_object_lock (VALENT_OBJECT (device));
+  for (const GList *iter = device->payloads.head; iter != NULL; iter = iter->next)
+    {
+      PayloadChannel *payload = iter->data;
+
+      if (payload->packet == packet)
+        {
+          if (payload->channel != NULL)
+            ret = g_object_ref (payload->channel);
+
+          valent_object_unlock (VALENT_OBJECT (device));
+          return ret;
+        }
+    }
+
+  if (device->channel != NULL)
+    ret = g_object_ref (device->channel);
+  valent_object_unlock (VALENT_OBJECT (device));
+
+  return ret;
+}
+
+/*
+ * Packet dispatch
+ *
+ * Packets are handled in the order they are received. Packets with handlers
+ * from `X-DevicePluginThreaded` are passed to those handlers in a thread, and
+ * any packets received in the meantime are queued until it completes.
+ */
+typedef struct
+{
+  GPtrArray *handlers;
+  JsonNode  *packet;
+} HandlePacketData;
+
+static void
+handle_packet_data_free (gpointer data)
+{
+  HandlePacketData *task_data = data;
+
+  g_clear_pointer (&task_data->handlers, g_ptr_array_unref);
+  g_clear_pointer (&task_data->packet, json_node_unref);
+  g_free (task_data);
+}
+
+static void
+valent_device_invoke_handler (ValentDevice       *device,
+                              ValentDevicePlugin *handler,
+                              const char         *type,
+                              JsonNode           *packet,
+                              gboolean            threaded)
+{
+  int64_t begin, elapsed;
+  unsigned int budget;
+
+  begin = g_get_monotonic_time ();
+  valent_device_plugin_handle_packet (handler, type, packet);
+  elapsed = g_get_monotonic_time () - begin;
+
+  valent_counter_add_dispatch (device->id, type, elapsed);
+
+  /* Handlers on a worker thread are allowed to take their time */
+  if (threaded)
+    return;
+
+  /* The `handler-budget` setting is in milliseconds, where `0` is disabled */
+  budget = g_settings_get_uint (device->settings, "handler-budget");
+
+  if G_UNLIKELY (budget > 0 && elapsed > (int64_t)budget * 1000)
+    {
+      g_autoptr (PeasPluginInfo) info = NULL;
+      const char *module = NULL;
+
+      valent_counter_add (VALENT_COUNTER_SLOW_HANDLERS, 1);
+
+      g_object_get (handler, "plugin-info", &info, NULL);
+      module = info != NULL
+        ? peas_plugin_info_get_module_name (info)
+        : G_OBJECT_TYPE_NAME (handler);
+
+      /* Warn once for each plugin, the counter tracks any repeat offenses */
+      if (g_hash_table_add (device->slow_plugins, g_strdup (module)))
+        {
+          g_warning ("%s: \"%s\" plugin took %.1fms to handle \"%s\"",
+                     device->name,
+                     module,
+                     (double)elapsed / 1000,
+                     type);
+        }
+      else
+        {
+          g_debug ("%s: \"%s\" plugin took %.1fms to handle \"%s\"",
+                   device->name,
+                   module,
+                   (double)elapsed / 1000,
+                   type);
+        }
+    }
+}
+
+static void
+valent_device_dispatch_packet (ValentDevice *device,
+                               const char   *type,
+                               JsonNode     *packet)
+{
+  GPtrArray *handlers = NULL;
+
+  if ((handlers = g_hash_table_lookup (device->handlers, type)) == NULL)
+    return;
+
+  for (unsigned int i = 0, len = handlers->len; i < len; i++)
+    {
+      ValentDevicePlugin *handler = g_ptr_array_index (handlers, i);
+
+      valent_device_invoke_handler (device, handler, type, packet, FALSE);
+    }
+}
+
+static void
+handle_packet_task (GTask        *task,
+                    gpointer      source_object,
+                    gpointer      task_data,
+                    GCancellable *cancellable)
+{
+  ValentDevice *device = VALENT_DEVICE (source_object);
+  HandlePacketData *data = task_data;
+  const char *type = valent_packet_get_type (data->packet);
+
+  for (unsigned int i = 0, len = data->handlers->len; i < len; i++)
+    {
+      ValentDevicePlugin *handler = g_ptr_array_index (data->handlers, i);
+
+      valent_device_invoke_handler (device, handler, type, data->packet, TRUE);
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static void
+handle_packet_cb (ValentDevice *device,
+                  GAsyncResult *result,
+                  gpointer      user_data)
+{
+  HandlePacketData *data = g_task_get_task_data (G_TASK (result));
+  JsonNode *packet;
+
+  g_assert (VALENT_IS_DEVICE (device));
+
+  device->working = FALSE;
+
+  /* Any handlers on the main thread follow those on the worker thread */
+  valent_device_dispatch_packet (device,
+                                 valent_packet_get_type (data->packet),
+                                 data->packet);
+
+  while (!device->working &&
+         (packet = g_queue_pop_head (&device->pending)) != NULL)
+    {
+      valent_device_process_packet (device, packet);
+      json_node_unref (packet);
+    }
+}
+
+static void
+valent_device_process_packet (ValentDevice *device,
+                              JsonNode     *packet)
+{
+  GPtrArray *workers = NULL;
+  const char *type;
+
+  g_assert (VALENT_IS_DEVICE (device));
+  g_assert (!device->working);
+
+  type = valent_packet_get_type (packet);
+
+  if ((workers = g_hash_table_lookup (device->workers, type)) != NULL)
+    {
+      g_autoptr (GTask) task = NULL;
+      HandlePacketData *data = NULL;
+
+      data = g_new0 (HandlePacketData, 1);
+      data->handlers = g_ptr_array_new_full (workers->len, g_object_unref);
+      data->packet = json_node_ref (packet);
+
+      for (unsigned int i = 0; i < workers->len; i++)
+        g_ptr_array_add (data->handlers, g_object_ref (g_ptr_array_index (workers, i)));
+
+      device->working = TRUE;
+
+      task = g_task_new (device, NULL, (GAsyncReadyCallback)handle_packet_cb, NULL);
+      g_task_set_source_tag (task, valent_device_process_packet);
+      g_task_set_task_data (task, data, handle_packet_data_free);
+      g_task_run_in_thread (task, handle_packet_task);
+    }
+  else if (g_hash_table_contains (device->handlers, type))
+    {
+      valent_device_dispatch_packet (device, type, packet);
+    }
+  else
+    {
+      VALENT_NOTE ("%s: Unsupported packet \"%s\"", device->name, type);
+    }
+}
+
 static void
 valent_device_handle_packet (ValentDevice *device,
                              JsonNode     *packet)
 {
-  GPtrArray *handlers = NULL;
   const char *type;
 
   g_assert (VALENT_IS_DEVICE (device));
@@ -698,18 +999,17 @@ valent_device_handle_packet (ValentDevice *device,
     {
       valent_device_send_pair (device, FALSE);
     }
-  else if ((handlers = g_hash_table_lookup (device->handlers, type)) != NULL)
-    {
-      for (unsigned int i = 0, len = handlers->len; i < len; i++)
-        {
-          ValentDevicePlugin *handler = g_ptr_array_index (handlers, i);
-
-          valent_device_plugin_handle_packet (handler, type, packet);
-        }
-    }
   else
     {
-      VALENT_NOTE ("%s: Unsupported packet \"%s\"", device->name, type);
+      /* Instantiate the plugins for the first packet they can handle */
+      if G_UNLIKELY (device->dormant)
+        valent_device_wake_plugins (device);
+
+      /* Wait for any packet still being handled on a worker thread */
+      if (device->working)
+        g_queue_push_tail (&device->pending, json_node_ref (packet));
+      else
+        valent_device_process_packet (device, packet);
     }
 }
 
@@ -721,7 +1021,7 @@ on_load_plugin (PeasEngine     *engine,
                 PeasPluginInfo *info,
                 ValentDevice   *self)
 {
-  ValentPlugin *plugin;
+  ValentPlugin *plugin = NULL;
 
   g_assert (PEAS_IS_ENGINE (engine));
   g_assert (info != NULL);
@@ -737,12 +1037,17 @@ on_load_plugin (PeasEngine     *engine,
                self->name,
                peas_plugin_info_get_module_name (info));
 
-  /* Register the plugin & data (hash tables are ref owners) */
-  plugin = valent_plugin_new (self, self->context, info,
-                              G_CALLBACK (on_plugin_enabled_changed));
+  /* Register the plugin & data (hash tables are ref owners). Dormant devices
+   * only track the plugin, until valent_device_wake_plugins() is called. */
+  if (!self->dormant)
+    {
+      plugin = valent_plugin_new (self, self->context, info,
+                                  G_CALLBACK (on_plugin_enabled_changed));
+    }
+
   g_hash_table_insert (self->plugins, info, plugin);
 
-  if (valent_plugin_get_enabled (plugin))
+  if (plugin != NULL && valent_plugin_get_enabled (plugin))
     valent_device_enable_plugin (self, plugin);
 
   g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_PLUGINS]);
@@ -824,10 +1129,13 @@ valent_device_destroy (ValentObject *object)
   valent_device_set_channel (self, NULL);
 
   /* Plugins */
+  g_clear_handle_id (&self->dormant_id, g_source_remove);
   g_signal_handlers_disconnect_by_data (self->engine, self);
   g_hash_table_remove_all (self->plugins);
   g_hash_table_remove_all (self->actions);
   g_hash_table_remove_all (self->handlers);
+  g_hash_table_remove_all (self->workers);
+  g_queue_clear_full (&self->pending, (GDestroyNotify)json_node_unref);
 
   VALENT_OBJECT_CLASS (valent_device_parent_class)->destroy (object);
 }
@@ -900,11 +1208,16 @@ valent_device_finalize (GObject *object)
 
   /* State */
   g_clear_object (&self->channel);
+  g_clear_pointer (&self->channels, g_ptr_array_unref);
+  g_queue_clear_full (&self->payloads, payload_channel_free);
 
   /* Plugins */
   g_clear_pointer (&self->plugins, g_hash_table_unref);
   g_clear_pointer (&self->actions, g_hash_table_unref);
   g_clear_pointer (&self->handlers, g_hash_table_unref);
+  g_clear_pointer (&self->workers, g_hash_table_unref);
+  g_clear_pointer (&self->slow_plugins, g_hash_table_unref);
+  g_queue_clear_full (&self->pending, (GDestroyNotify)json_node_unref);
   g_clear_object (&self->menu);
 
   G_OBJECT_CLASS (valent_device_parent_class)->finalize (object);
@@ -977,6 +1290,10 @@ valent_device_init (ValentDevice *self)
 {
   GSimpleAction *action = NULL;
 
+  /* State */
+  self->channels = g_ptr_array_new_with_free_func (g_object_unref);
+  g_queue_init (&self->payloads);
+
   /* Plugins */
   self->engine = valent_get_plugin_engine ();
   self->plugins = g_hash_table_new_full (NULL, NULL, NULL, device_plugin_free);
@@ -984,6 +1301,12 @@ valent_device_init (ValentDevice *self)
                                           g_str_equal,
                                           g_free,
                                           (GDestroyNotify)g_ptr_array_unref);
+  self->workers = g_hash_table_new_full (g_str_hash,
+                                         g_str_equal,
+                                         g_free,
+                                         (GDestroyNotify)g_ptr_array_unref);
+  self->slow_plugins = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_queue_init (&self->pending);
   self->actions = g_hash_table_new_full (g_str_hash,
                                          g_str_equal,
                                          g_free,
@@ -1170,6 +1493,47 @@ valent_device_new_full (JsonNode      *identity,
   return ret;
 }
 
+/*< private >
+ * valent_device_new_dormant:
+ * @identity: a KDE Connect identity packet
+ * @context: (nullable): a #ValentContext
+ *
+ * Create a new device for @identity, without instantiating its plugins.
+ *
+ * This is intended for remembered devices, which may never connect. Plugins are
+ * still listed in [property@Valent.Device:plugins], but are only instantiated
+ * when the device connects and released again after the device has been
+ * disconnected for the `plugin-timeout` setting. Plugins marked with
+ * `X-DevicePluginResident` are never released.
+ *
+ * Returns: (transfer full) (nullable): a new #ValentDevice
+ */
+ValentDevice *
+valent_device_new_dormant (JsonNode      *identity,
+                           ValentContext *context)
+{
+  ValentDevice *ret;
+  const char *id;
+
+  g_return_val_if_fail (VALENT_IS_PACKET (identity), NULL);
+
+  if (!valent_packet_get_string (identity, "deviceId", &id))
+    {
+      g_critical ("%s(): missing \"deviceId\" field", G_STRFUNC);
+      return NULL;
+    }
+
+  ret = g_object_new (VALENT_TYPE_DEVICE,
+                      "id",      id,
+                      "context", context,
+                      NULL);
+  ret->restored = TRUE;
+  valent_device_sleep_plugins (ret);
+  valent_device_handle_identity (ret, identity);
+
+  return ret;
+}
+
 static void
 valent_device_send_packet_cb (ValentChannel *channel,
                               GAsyncResult  *result,
@@ -1177,6 +1541,8 @@ valent_device_send_packet_cb (ValentChannel *channel,
 {
   g_autoptr (GTask) task = G_TASK (user_data);
   ValentDevice *device = g_task_get_source_object (task);
+  JsonNode *packet = g_task_get_task_data (task);
+  g_autoptr (ValentChannel) next = NULL;
   g_autoptr (GError) error = NULL;
 
   g_assert (VALENT_IS_DEVICE (device));
@@ -1185,12 +1551,23 @@ valent_device_send_packet_cb (ValentChannel *channel,
     return g_task_return_boolean (task, TRUE);
 
   VALENT_NOTE ("%s: %s", device->name, error->message);
-  g_task_return_error (task, g_steal_pointer (&error));
+  valent_device_drop_channel (device, channel);
 
-  valent_object_lock (VALENT_OBJECT (device));
-  if (device->channel == channel)
-    valent_device_set_channel (device, NULL);
-  valent_object_unlock (VALENT_OBJECT (device));
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  /* If another channel took over, try again before reporting an error */
+  if ((next = valent_device_ref_channel (device)) != NULL)
+    {
+      valent_channel_write_packet (next,
+                                   packet,
+                                   g_task_get_cancellable (task),
+                                   (GAsyncReadyCallback)valent_device_send_packet_cb,
+                                   g_steal_pointer (&task));
+      return;
+    }
+
+  g_task_return_error (task, g_steal_pointer (&error));
 }
 
 /**
@@ -1251,6 +1628,9 @@ valent_device_send_packet (ValentDevice        *device,
 
   task = g_task_new (device, cancellable, callback, user_data);
   g_task_set_source_tag (task, valent_device_send_packet);
+  g_task_set_task_data (task,
+                        json_node_ref (packet),
+                        (GDestroyNotify)json_node_unref);
 
   VALENT_JSON (packet, device->name);
   valent_channel_write_packet (device->channel,
@@ -1332,21 +1712,148 @@ read_packet_cb (ValentChannel *channel,
                                   (GAsyncReadyCallback)read_packet_cb,
                                   g_object_ref (device));
 
+      if (valent_packet_has_payload (packet))
+        valent_device_add_payload (device, channel, packet);
+
       valent_device_handle_packet (device, packet);
     }
 
-  /* On failure, drop our reference if it's still the active channel */
+  /* On failure, drop the channel and fail over to another, if possible */
   else
     {
       VALENT_NOTE ("%s: %s", device->name, error->message);
+      valent_device_drop_channel (device, channel);
+    }
+
+  g_object_unref (device);
+}
+
+static void
+valent_device_notify_connected (ValentDevice *device,
+                                gboolean      was_connected,
+                                gboolean      is_connected)
+{
+  /* If the state changed, update the plugins and notify */
+  if (is_connected == was_connected)
+    return;
+
+  if (is_connected)
+    {
+      g_clear_handle_id (&device->dormant_id, g_source_remove);
+
+      if (device->dormant)
+        valent_device_wake_plugins (device);
+      else
+        valent_device_update_plugins (device);
+    }
+  else
+    {
+      unsigned int timeout;
+
+      valent_device_update_plugins (device);
+
+      timeout = g_settings_get_uint (device->settings, "plugin-timeout");
 
-      valent_object_lock (VALENT_OBJECT (device));
-      if (device->channel == channel)
-        valent_device_set_channel (device, NULL);
+      /* Only devices restored at startup are allowed to sleep again */
+      if (device->restored && timeout > 0 && device->dormant_id == 0)
+        {
+          device->dormant_id = g_timeout_add_seconds (timeout,
+                                                      valent_device_sleep_plugins,
+                                                      device);
+          g_source_set_name_by_id (device->dormant_id,
+                                   "[valent] valent_device_sleep_plugins");
+        }
+    }
+
+  g_object_notify_by_pspec (G_OBJECT (device), properties [PROP_STATE]);
+}
+
+/*
+ * valent_device_select_channel:
+ * @device: a #ValentDevice
+ *
+ * Choose the channel @device should send packets with, which is the channel
+ * with the preferred transport priority, or the most recently connected of
+ * those. The caller must hold the device lock.
+ *
+ * Returns: (transfer none) (nullable): a #ValentChannel
+ */
+static ValentChannel *
+valent_device_select_channel (ValentDevice *device)
+{
+  ValentChannel *ret = NULL;
+  int64_t ret_priority = 0;
+
+  for (unsigned int i = 0; i < device->channels->len; i++)
+    {
+      ValentChannel *channel = g_ptr_array_index (device->channels, i);
+      int64_t priority = valent_channel_get_priority (channel);
+
+      if (ret == NULL || priority <= ret_priority)
+        {
+          ret = channel;
+          ret_priority = priority;
+        }
+    }
+
+  return ret;
+}
+
+/*
+ * valent_device_drop_channel:
+ * @device: a #ValentDevice
+ * @channel: a #ValentChannel
+ *
+ * Close @channel and stop using it. If @channel is the active channel, the
+ * preferred of the remaining channels takes over, without changing the state
+ * of the device.
+ */
+static void
+valent_device_drop_channel (ValentDevice  *device,
+                            ValentChannel *channel)
+{
+  g_autoptr (ValentChannel) dropped = NULL;
+  gboolean is_connected;
+
+  g_assert (VALENT_IS_DEVICE (device));
+  g_assert (VALENT_IS_CHANNEL (channel));
+
+  valent_object_lock (VALENT_OBJECT (device));
+  if (!g_ptr_array_find (device->channels, channel, NULL))
+    {
       valent_object_unlock (VALENT_OBJECT (device));
+      return;
     }
 
-  g_object_unref (device);
+  /* Close the channel asynchronously and drop our reference so the task holds
+   * the final reference. */
+  dropped = g_object_ref (channel);
+  g_ptr_array_remove (device->channels, channel);
+  valent_channel_close_async (dropped, NULL, NULL, NULL);
+
+  /* Payloads received by the channel can no longer be transferred */
+  for (const GList *iter = device->payloads.head; iter != NULL; iter = iter->next)
+    {
+      PayloadChannel *payload = iter->data;
+
+      if (payload->channel == channel)
+        g_clear_object (&payload->channel);
+    }
+
+  if (device->channel == channel)
+    {
+      ValentChannel *next = valent_device_select_channel (device);
+
+      g_set_object (&device->channel, next);
+
+      if (next != NULL)
+        VALENT_NOTE ("%s: failing over to %s", device->name, G_OBJECT_TYPE_NAME (next));
+    }
+
+  is_connected = (device->channel != NULL);
+  valent_object_unlock (VALENT_OBJECT (device));
+
+  valent_device_notify_connected (device, TRUE, is_connected);
 }
 
 /**
@@ -1356,6 +1863,16 @@ read_packet_cb (ValentChannel *channel,
  *
  * Sets the active channel.
  *
+ * A device may be connected by more than one channel at a time, such as over a
+ * network and Bluetooth. A new channel replaces an open channel of the same
+ * type. Packets are sent with the channel whose service is preferred by its
+ * `X-ChannelServicePriority`, or the most recently connected of those, while
+ * the others are kept open and take over if it is closed, without reloading
+ * plugins. Packets are received from every channel.
+ *
+ * If @channel is %NULL, all channels are closed and the device is
+ * disconnected.
+ *
  * Since: 1.0
  */
 void
@@ -1370,26 +1887,49 @@ valent_device_set_channel (ValentDevice  *device,
 
   valent_object_lock (VALENT_OBJECT (device));
 
-  if (device->channel == channel)
+  if (device->channel == channel ||
+      (channel != NULL && g_ptr_array_find (device->channels, channel, NULL)))
     {
       valent_object_unlock (VALENT_OBJECT (device));
       return;
     }
 
-  /* If there's an active channel, close it asynchronously and drop our
-   * reference so the task holds the final reference. */
-  if ((was_connected = (device->channel != NULL)))
+  was_connected = (device->channel != NULL);
+
+  /* If disconnecting, close each channel asynchronously and drop our
+   * references so the tasks hold the final reference. */
+  if (channel == NULL)
     {
-      valent_channel_close_async (device->channel, NULL, NULL, NULL);
+      for (unsigned int i = 0; i < device->channels->len; i++)
+        valent_channel_close_async (g_ptr_array_index (device->channels, i),
+                                    NULL, NULL, NULL);
+
+      g_ptr_array_set_size (device->channels, 0);
       g_clear_object (&device->channel);
     }
 
-  /* If there's a new channel, handle the peer identity and queue the first
-   * read operation before notifying of the state change. */
-  if ((is_connected = g_set_object (&device->channel, channel)))
+  /* If there's a new channel, it replaces any channel of the same transport
+   * and the preferred channel becomes active. Handle the peer identity and
+   * queue the first read operation before notifying of the state change. */
+  else
     {
       JsonNode *peer_identity;
 
+      for (unsigned int i = 0; i < device->channels->len; i++)
+        {
+          ValentChannel *existing = g_ptr_array_index (device->channels, i);
+
+          if (G_OBJECT_TYPE (existing) != G_OBJECT_TYPE (channel))
+            continue;
+
+          valent_channel_close_async (existing, NULL, NULL, NULL);
+          g_ptr_array_remove_index (device->channels, i);
+          break;
+        }
+
+      g_ptr_array_add (device->channels, g_object_ref (channel));
+      g_set_object (&device->channel, valent_device_select_channel (device));
+
       /* Handle the peer identity packet */
       peer_identity = valent_channel_get_peer_identity (channel);
       valent_device_handle_identity (device, peer_identity);
@@ -1401,14 +1941,10 @@ valent_device_set_channel (ValentDevice  *device,
                                   g_object_ref (device));
     }
 
+  is_connected = (device->channel != NULL);
   valent_object_unlock (VALENT_OBJECT (device));
 
-  /* If the state changed, update the plugins and notify */
-  if (is_connected == was_connected)
-    return;
-
-  valent_device_update_plugins (device);
-  g_object_notify_by_pspec (G_OBJECT (device), properties [PROP_STATE]);
+  valent_device_notify_connected (device, was_connected, is_connected);
 }
 
 /**
@@ -1642,6 +2178,113 @@ valent_device_reload_plugins (ValentDevice *device)
     }
 }
 
+/*< private >
+ * valent_device_wake_plugins:
+ * @device: a #ValentDevice
+ *
+ * Instantiate the plugins of a dormant device.
+ *
+ * Each plugin is bootstrapped with the current state of @device, as though it
+ * had just been loaded. Resident plugins that were never released are updated
+ * with the current state instead.
+ */
+static void
+valent_device_wake_plugins (ValentDevice *device)
+{
+  GHashTableIter iter;
+  PeasPluginInfo *info;
+  ValentPlugin *plugin;
+
+  g_assert (VALENT_IS_DEVICE (device));
+
+  if (!device->dormant)
+    return;
+
+  VALENT_NOTE ("%s: waking plugins", device->name);
+
+  device->dormant = FALSE;
+  g_clear_handle_id (&device->dormant_id, g_source_remove);
+
+  g_hash_table_iter_init (&iter, device->plugins);
+
+  while (g_hash_table_iter_next (&iter, (void **)&info, (void **)&plugin))
+    {
+      if (plugin != NULL)
+        {
+          if (plugin->extension != NULL)
+            valent_device_plugin_update_state (VALENT_DEVICE_PLUGIN (plugin->extension),
+                                               valent_device_get_state (device));
+          continue;
+        }
+
+      plugin = valent_plugin_new (device, device->context, info,
+                                  G_CALLBACK (on_plugin_enabled_changed));
+      g_hash_table_iter_replace (&iter, plugin);
+
+      if (valent_plugin_get_enabled (plugin))
+        valent_device_enable_plugin (device, plugin);
+    }
+}
+
+/*< private >
+ * valent_device_sleep_plugins:
+ * @data: a #ValentDevice
+ *
+ * Release the plugins of a disconnected device.
+ *
+ * The plugins remain listed in [property@Valent.Device:plugins], but their
+ * extensions and settings are freed until valent_device_wake_plugins() is
+ * called. Plugins marked with `X-DevicePluginResident` may hold user interface
+ * or child processes, so they are kept loaded.
+ *
+ * Returns: %G_SOURCE_REMOVE
+ */
+static gboolean
+valent_device_sleep_plugins (gpointer data)
+{
+  ValentDevice *device = VALENT_DEVICE (data);
+  GHashTableIter iter;
+  PeasPluginInfo *info;
+  ValentPlugin *plugin;
+
+  g_assert (VALENT_IS_DEVICE (device));
+
+  device->dormant_id = 0;
+
+  if (device->dormant)
+    return G_SOURCE_REMOVE;
+
+  if ((valent_device_get_state (device) & VALENT_DEVICE_STATE_CONNECTED) != 0)
+    return G_SOURCE_REMOVE;
+
+  VALENT_NOTE ("%s: releasing plugins", device->name);
+
+  device->dormant = TRUE;
+
+  g_hash_table_iter_init (&iter, device->plugins);
+
+  while (g_hash_table_iter_next (&iter, (void **)&info, (void **)&plugin))
+    {
+      const char *resident;
+
+      if (plugin == NULL)
+        continue;
+
+      resident = peas_plugin_info_get_external_data (info,
+                                                     "DevicePluginResident");
+
+      if (resident != NULL && g_ascii_strcasecmp (resident, "true") == 0)
+        continue;
+
+      if (plugin->extension != NULL)
+        valent_device_disable_plugin (device, plugin);
+
+      g_hash_table_iter_replace (&iter, NULL);
+    }
+
+  return G_SOURCE_REMOVE;
+}
+
 /*< private >
  * valent_device_update_plugins:
  * @device: a #ValentDevice
@@ -1665,7 +2308,7 @@ valent_device_update_plugins (ValentDevice *device)
 
   while (g_hash_table_iter_next (&iter, NULL, (void **)&plugin))
     {
-      if (plugin->extension == NULL)
+      if (plugin == NULL || plugin->extension == NULL)
         continue;
 
       valent_device_plugin_update_state (VALENT_DEVICE_PLUGIN (plugin->extension),
@@ -8,6 +8,7 @@
 #include <gio/gio.h>
 #include <json-glib/json-glib.h>
 
+#include "../core/valent-counters-private.h"
 #include "../core/valent-global.h"
 #include "valent-packet.h"
 
@@ -986,6 +987,8 @@ valent_packet_from_stream (GInputStream  *stream,
 
   if (!valent_packet_validate (packet, error))
     return NULL;
+
+  valent_counter_add_packet (valent_packet_get_type (packet), FALSE, count);
 #endif /* __clang_analyzer__ */
 
   return g_steal_pointer (&packet);
@@ -1050,6 +1053,8 @@ valent_packet_to_stream (GOutputStream  *stream,
       return FALSE;
     }
 
+  valent_counter_add_packet (valent_packet_get_type (packet), TRUE, packet_len);
+
   return TRUE;
 }
 
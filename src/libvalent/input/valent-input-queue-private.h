@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include "valent-input-adapter.h"
+
+G_BEGIN_DECLS
+
+typedef struct _ValentInputQueue ValentInputQueue;
+
+_VALENT_EXTERN
+ValentInputQueue * valent_input_queue_new             (void);
+_VALENT_EXTERN
+void               valent_input_queue_free            (ValentInputQueue   *queue);
+_VALENT_EXTERN
+void               valent_input_queue_clear           (ValentInputQueue   *queue);
+_VALENT_EXTERN
+void               valent_input_queue_keyboard_keysym (ValentInputQueue   *queue,
+                                                       uint32_t            keysym,
+                                                       gboolean            state);
+_VALENT_EXTERN
+void               valent_input_queue_pointer_axis    (ValentInputQueue   *queue,
+                                                       double              dx,
+                                                       double              dy);
+_VALENT_EXTERN
+void               valent_input_queue_pointer_button  (ValentInputQueue   *queue,
+                                                       unsigned int        button,
+                                                       gboolean            state);
+_VALENT_EXTERN
+void               valent_input_queue_pointer_motion  (ValentInputQueue   *queue,
+                                                       double              dx,
+                                                       double              dy);
+_VALENT_EXTERN
+void               valent_input_queue_replay          (ValentInputQueue   *queue,
+                                                       ValentInputAdapter *adapter);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (ValentInputQueue, valent_input_queue_free)
+
+G_END_DECLS
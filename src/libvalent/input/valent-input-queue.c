@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#define G_LOG_DOMAIN "valent-input-queue"
+
+#include "config.h"
+
+#include <libvalent-core.h>
+
+#include "valent-input-adapter.h"
+#include "valent-input-queue-private.h"
+
+#define INPUT_QUEUE_MAX (256)
+
+
+/*< private >
+ * ValentInputQueue:
+ *
+ * A queue of input events, for adapters that receive events before they are
+ * able to deliver them (e.g. while a remote desktop session is starting).
+ *
+ * Consecutive pointer motion or axis events are collapsed into one, so the
+ * queue is mostly filled by buttons and keys. Once the queue is full, pointer
+ * events and presses are dropped, but a release is always queued if its press
+ * was, so nothing is left held down when the events are replayed.
+ */
+typedef enum {
+  INPUT_EVENT_KEYBOARD_KEYSYM,
+  INPUT_EVENT_POINTER_AXIS,
+  INPUT_EVENT_POINTER_BUTTON,
+  INPUT_EVENT_POINTER_MOTION,
+} InputEventType;
+
+typedef struct
+{
+  InputEventType type;
+  double         dx;
+  double         dy;
+  uint32_t       code;
+  gboolean       state;
+} InputEvent;
+
+struct _ValentInputQueue
+{
+  GArray *events;
+};
+
+
+static gboolean
+valent_input_queue_is_pressed (ValentInputQueue *queue,
+                               InputEventType    type,
+                               uint32_t          code)
+{
+  for (unsigned int i = queue->events->len; i > 0; i--)
+    {
+      const InputEvent *event = &g_array_index (queue->events, InputEvent, i - 1);
+
+      if (event->type == type && event->code == code)
+        return event->state;
+    }
+
+  return FALSE;
+}
+
+static void
+valent_input_queue_push (ValentInputQueue *queue,
+                         InputEventType    type,
+                         double            dx,
+                         double            dy,
+                         uint32_t          code,
+                         gboolean          state)
+{
+  InputEvent event = { type, dx, dy, code, state };
+
+  if (type == INPUT_EVENT_POINTER_MOTION || type == INPUT_EVENT_POINTER_AXIS)
+    {
+      if (queue->events->len > 0)
+        {
+          InputEvent *last = &g_array_index (queue->events,
+                                             InputEvent,
+                                             queue->events->len - 1);
+
+          if (last->type == type)
+            {
+              last->dx += dx;
+              last->dy += dy;
+              return;
+            }
+        }
+
+      if (queue->events->len >= INPUT_QUEUE_MAX)
+        return;
+    }
+  else if (queue->events->len >= INPUT_QUEUE_MAX)
+    {
+      if (state || !valent_input_queue_is_pressed (queue, type, code))
+        {
+          g_debug ("%s(): event queue full, dropping event", G_STRFUNC);
+          return;
+        }
+    }
+
+  g_array_append_val (queue->events, event);
+}
+
+/**
+ * valent_input_queue_new:
+ *
+ * Create a new input event queue.
+ *
+ * Returns: (transfer full): a new `ValentInputQueue`
+ */
+ValentInputQueue *
+valent_input_queue_new (void)
+{
+  ValentInputQueue *queue;
+
+  queue = g_new0 (ValentInputQueue, 1);
+  queue->events = g_array_new (FALSE, FALSE, sizeof (InputEvent));
+
+  return queue;
+}
+
+/**
+ * valent_input_queue_free:
+ * @queue: a `ValentInputQueue`
+ *
+ * Free @queue and any events it holds.
+ */
+void
+valent_input_queue_free (ValentInputQueue *queue)
+{
+  g_return_if_fail (queue != NULL);
+
+  g_clear_pointer (&queue->events, g_array_unref);
+  g_free (queue);
+}
+
+/**
+ * valent_input_queue_clear:
+ * @queue: a `ValentInputQueue`
+ *
+ * Drop any events held by @queue.
+ */
+void
+valent_input_queue_clear (ValentInputQueue *queue)
+{
+  g_return_if_fail (queue != NULL);
+
+  g_array_set_size (queue->events, 0);
+}
+
+/**
+ * valent_input_queue_keyboard_keysym:
+ * @queue: a `ValentInputQueue`
+ * @keysym: a keysym
+ * @state: %TRUE to press, or %FALSE to release
+ *
+ * Queue a press or release of @keysym.
+ */
+void
+valent_input_queue_keyboard_keysym (ValentInputQueue *queue,
+                                    uint32_t          keysym,
+                                    gboolean          state)
+{
+  g_return_if_fail (queue != NULL);
+
+  valent_input_queue_push (queue, INPUT_EVENT_KEYBOARD_KEYSYM,
+                           0.0, 0.0, keysym, state);
+}
+
+/**
+ * valent_input_queue_pointer_axis:
+ * @queue: a `ValentInputQueue`
+ * @dx: movement on x-axis
+ * @dy: movement on y-axis
+ *
+ * Queue a scroll of (@dx, @dy).
+ */
+void
+valent_input_queue_pointer_axis (ValentInputQueue *queue,
+                                 double            dx,
+                                 double            dy)
+{
+  g_return_if_fail (queue != NULL);
+
+  valent_input_queue_push (queue, INPUT_EVENT_POINTER_AXIS,
+                           dx, dy, 0, FALSE);
+}
+
+/**
+ * valent_input_queue_pointer_button:
+ * @queue: a `ValentInputQueue`
+ * @button: a button number
+ * @state: %TRUE to press, or %FALSE to release
+ *
+ * Queue a press or release of @button.
+ */
+void
+valent_input_queue_pointer_button (ValentInputQueue *queue,
+                                   unsigned int      button,
+                                   gboolean          state)
+{
+  g_return_if_fail (queue != NULL);
+
+  valent_input_queue_push (queue, INPUT_EVENT_POINTER_BUTTON,
+                           0.0, 0.0, button, state);
+}
+
+/**
+ * valent_input_queue_pointer_motion:
+ * @queue: a `ValentInputQueue`
+ * @dx: movement on x-axis
+ * @dy: movement on y-axis
+ *
+ * Queue a pointer motion of (@dx, @dy).
+ */
+void
+valent_input_queue_pointer_motion (ValentInputQueue *queue,
+                                   double            dx,
+                                   double            dy)
+{
+  g_return_if_fail (queue != NULL);
+
+  valent_input_queue_push (queue, INPUT_EVENT_POINTER_MOTION,
+                           dx, dy, 0, FALSE);
+}
+
+/**
+ * valent_input_queue_replay:
+ * @queue: a `ValentInputQueue`
+ * @adapter: a `ValentInputAdapter`
+ *
+ * Deliver the events held by @queue to @adapter, in the order they were
+ * received, then clear the queue.
+ */
+void
+valent_input_queue_replay (ValentInputQueue   *queue,
+                           ValentInputAdapter *adapter)
+{
+  g_autoptr (GArray) events = NULL;
+
+  g_return_if_fail (queue != NULL);
+  g_return_if_fail (VALENT_IS_INPUT_ADAPTER (adapter));
+
+  if (queue->events->len == 0)
+    return;
+
+  /* An event may be queued again if the adapter becomes unavailable */
+  events = g_steal_pointer (&queue->events);
+  queue->events = g_array_new (FALSE, FALSE, sizeof (InputEvent));
+
+  for (unsigned int i = 0; i < events->len; i++)
+    {
+      const InputEvent *event = &g_array_index (events, InputEvent, i);
+
+      switch (event->type)
+        {
+        case INPUT_EVENT_KEYBOARD_KEYSYM:
+          valent_input_adapter_keyboard_keysym (adapter,
+                                                event->code,
+                                                event->state);
+          break;
+
+        case INPUT_EVENT_POINTER_AXIS:
+          valent_input_adapter_pointer_axis (adapter, event->dx, event->dy);
+          break;
+
+        case INPUT_EVENT_POINTER_BUTTON:
+          valent_input_adapter_pointer_button (adapter,
+                                               event->code,
+                                               event->state);
+          break;
+
+        case INPUT_EVENT_POINTER_MOTION:
+          valent_input_adapter_pointer_motion (adapter, event->dx, event->dy);
+          break;
+        }
+    }
+}
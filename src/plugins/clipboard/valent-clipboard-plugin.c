@@ -5,12 +5,25 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include <gio/gio.h>
 #include <json-glib/json-glib.h>
 #include <valent.h>
 
 #include "valent-clipboard-plugin.h"
 
+/* The quiet period required after a change to the local clipboard */
+#define CLIPBOARD_DEBOUNCE_MS (50)
+
+/* Text larger than this is sent as a payload, instead of inline */
+#define CLIPBOARD_INLINE_MAX (64 * 1024)
+
+/* Payloads larger than this are refused */
+#define CLIPBOARD_PAYLOAD_MAX (64 * 1024 * 1024)
+
+#define CLIPBOARD_TEXT_MIMETYPE "text/plain;charset=utf-8"
+
 
 struct _ValentClipboardPlugin
 {
@@ -19,15 +32,125 @@ struct _ValentClipboardPlugin
   ValentClipboard    *clipboard;
   unsigned long       changed_id;
 
-  char               *remote_text;
+  char               *remote_mimetype;
+  GBytes             *remote_bytes;
+  char               *remote_digest;
   int64_t             remote_timestamp;
   int64_t             local_timestamp;
+  unsigned int        changed_source_id;
   unsigned int        auto_pull : 1;
   unsigned int        auto_push : 1;
+  unsigned int        remote_payloads : 1;
 };
 
 G_DEFINE_FINAL_TYPE (ValentClipboardPlugin, valent_clipboard_plugin, VALENT_TYPE_DEVICE_PLUGIN)
 
+static void   valent_clipboard_read_text_cb  (ValentClipboard       *clipboard,
+                                              GAsyncResult          *result,
+                                              ValentClipboardPlugin *self);
+static void   valent_clipboard_read_bytes_cb (ValentClipboard       *clipboard,
+                                              GAsyncResult          *result,
+                                              gpointer               user_data);
+
+static const char * const text_mimetypes[] = {
+  "text/plain;charset=utf-8",
+  "text/plain",
+  "UTF8_STRING",
+  "STRING",
+  "TEXT",
+};
+
+
+/*
+ * The content held by the device is tracked by digest, whether it was received
+ * from or sent to it, so repeated changes of ownership (e.g. by clipboard
+ * managers) only result in a packet when the content actually changes.
+ */
+static inline char *
+clipboard_digest (const void *data,
+                  size_t      size)
+{
+  return g_compute_checksum_for_data (G_CHECKSUM_SHA256, data, size);
+}
+
+static inline gboolean
+clipboard_is_text (const char *mimetype)
+{
+  for (size_t i = 0; i < G_N_ELEMENTS (text_mimetypes); i++)
+    {
+      if (g_strcmp0 (mimetype, text_mimetypes[i]) == 0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/*
+ * Payload Transfers
+ *
+ * Images and large text are sent as a payload, with the packet carrying only
+ * the mime-type. Other implementations require the `content` field, so
+ * payloads are only sent to devices that set `acceptsPayloads` in the body of
+ * their `kdeconnect.clipboard.connect` packet.
+ *
+ * Payloads are staged in the cache directory and transferred with
+ * `ValentDeviceTransfer`, like any other payload.
+ */
+typedef struct
+{
+  ValentClipboardPlugin *self;
+  ValentTransfer        *transfer;
+  char                  *mimetype;
+} TransferData;
+
+static TransferData *
+transfer_data_new (ValentClipboardPlugin *self,
+                   ValentTransfer        *transfer,
+                   const char            *mimetype)
+{
+  TransferData *data = g_new0 (TransferData, 1);
+
+  data->self = g_object_ref (self);
+  data->transfer = g_object_ref (transfer);
+  data->mimetype = g_strdup (mimetype);
+
+  return data;
+}
+
+static void
+transfer_data_free (gpointer user_data)
+{
+  TransferData *data = (TransferData *)user_data;
+
+  g_clear_object (&data->self);
+  g_clear_object (&data->transfer);
+  g_clear_pointer (&data->mimetype, g_free);
+  g_free (data);
+}
+
+static inline gboolean
+valent_clipboard_plugin_accepts_payload (ValentClipboardPlugin *self)
+{
+  g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
+
+  return self->remote_payloads;
+}
+
+static GFile *
+valent_clipboard_plugin_new_payload_file (ValentClipboardPlugin *self)
+{
+  ValentContext *context = NULL;
+  g_autofree char *uuid = NULL;
+  g_autofree char *name = NULL;
+
+  g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
+
+  context = valent_extension_get_context (VALENT_EXTENSION (self));
+  uuid = g_uuid_string_random ();
+  name = g_strdup_printf ("clipboard-%s", uuid);
+
+  return valent_context_get_cache_file (context, name);
+}
 
 /*
  * Local Clipboard
@@ -52,6 +175,86 @@ valent_clipboard_plugin_clipboard (ValentClipboardPlugin *self,
   valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (self), packet);
 }
 
+static void
+upload_execute_cb (GObject      *object,
+                   GAsyncResult *result,
+                   gpointer      user_data)
+{
+  ValentTransfer *transfer = VALENT_TRANSFER (object);
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GError) error = NULL;
+
+  if (!valent_transfer_execute_finish (transfer, result, &error) &&
+      !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    g_debug ("%s(): %s", G_STRFUNC, error->message);
+
+  file = valent_device_transfer_ref_file (VALENT_DEVICE_TRANSFER (transfer));
+  g_file_delete (file, NULL, NULL);
+}
+
+static void
+upload_stage_cb (GFile        *file,
+                 GAsyncResult *result,
+                 gpointer      user_data)
+{
+  TransferData *data = (TransferData *)user_data;
+  g_autoptr (GCancellable) destroy = NULL;
+  g_autoptr (GError) error = NULL;
+
+  if (!g_file_replace_contents_finish (file, result, NULL, &error))
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_debug ("%s(): %s", G_STRFUNC, error->message);
+
+      g_file_delete (file, NULL, NULL);
+      g_clear_pointer (&data, transfer_data_free);
+      return;
+    }
+
+  destroy = valent_object_ref_cancellable (VALENT_OBJECT (data->self));
+  valent_transfer_execute (data->transfer,
+                           destroy,
+                           upload_execute_cb,
+                           NULL);
+  g_clear_pointer (&data, transfer_data_free);
+}
+
+static void
+valent_clipboard_plugin_clipboard_payload (ValentClipboardPlugin *self,
+                                           const char            *mimetype,
+                                           GBytes                *bytes)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) packet = NULL;
+  g_autoptr (ValentTransfer) transfer = NULL;
+  g_autoptr (GCancellable) destroy = NULL;
+  g_autoptr (GFile) file = NULL;
+  ValentDevice *device = NULL;
+
+  g_return_if_fail (VALENT_IS_CLIPBOARD_PLUGIN (self));
+  g_return_if_fail (mimetype != NULL && *mimetype != '\0');
+  g_return_if_fail (bytes != NULL);
+
+  valent_packet_init (&builder, "kdeconnect.clipboard");
+  json_builder_set_member_name (builder, "mimetype");
+  json_builder_add_string_value (builder, mimetype);
+  packet = valent_packet_end (&builder);
+
+  device = valent_extension_get_object (VALENT_EXTENSION (self));
+  file = valent_clipboard_plugin_new_payload_file (self);
+  transfer = valent_device_transfer_new (device, packet, file);
+
+  destroy = valent_object_ref_cancellable (VALENT_OBJECT (self));
+  g_file_replace_contents_bytes_async (file,
+                                       bytes,
+                                       NULL,
+                                       FALSE,
+                                       G_FILE_CREATE_PRIVATE,
+                                       destroy,
+                                       (GAsyncReadyCallback)upload_stage_cb,
+                                       transfer_data_new (self, transfer, mimetype));
+}
+
 static void
 valent_clipboard_plugin_clipboard_connect (ValentClipboardPlugin *self,
                                            const char            *content,
@@ -61,20 +264,95 @@ valent_clipboard_plugin_clipboard_connect (ValentClipboardPlugin *self,
   g_autoptr (JsonNode) packet = NULL;
 
   g_return_if_fail (VALENT_IS_CLIPBOARD_PLUGIN (self));
-
-  if (content == NULL)
-    return;
+  g_return_if_fail (content != NULL);
 
   valent_packet_init (&builder, "kdeconnect.clipboard.connect");
   json_builder_set_member_name (builder, "content");
   json_builder_add_string_value (builder, content);
   json_builder_set_member_name (builder, "timestamp");
   json_builder_add_int_value (builder, timestamp);
+  json_builder_set_member_name (builder, "acceptsPayloads");
+  json_builder_add_boolean_value (builder, TRUE);
   packet = valent_packet_end (&builder);
 
   valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (self), packet);
 }
 
+typedef struct
+{
+  ValentClipboardPlugin *self;
+  char                  *mimetype;
+} ReadData;
+
+static ReadData *
+read_data_new (ValentClipboardPlugin *self,
+               const char            *mimetype)
+{
+  ReadData *data = g_new0 (ReadData, 1);
+
+  data->self = g_object_ref (self);
+  data->mimetype = g_strdup (mimetype);
+
+  return data;
+}
+
+static void
+read_data_free (gpointer user_data)
+{
+  ReadData *data = (ReadData *)user_data;
+
+  g_clear_object (&data->self);
+  g_clear_pointer (&data->mimetype, g_free);
+  g_free (data);
+}
+
+static void
+valent_clipboard_plugin_read_local (ValentClipboardPlugin *self)
+{
+  g_auto (GStrv) mimetypes = NULL;
+  const char *mimetype = NULL;
+  g_autoptr (GCancellable) destroy = NULL;
+
+  g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
+
+  /* Text is preferred, otherwise the first image type offered */
+  mimetypes = valent_clipboard_get_mimetypes (self->clipboard);
+
+  for (size_t i = 0; mimetypes != NULL && mimetypes[i] != NULL; i++)
+    {
+      if (clipboard_is_text (mimetypes[i]))
+        {
+          mimetype = NULL;
+          break;
+        }
+
+      if (mimetype == NULL && g_str_has_prefix (mimetypes[i], "image/"))
+        mimetype = mimetypes[i];
+    }
+
+  /* Images can only be sent as a payload */
+  if (mimetype != NULL && !valent_clipboard_plugin_accepts_payload (self))
+    return;
+
+  destroy = valent_object_ref_cancellable (VALENT_OBJECT (self));
+
+  if (mimetype != NULL)
+    {
+      valent_clipboard_read_bytes (self->clipboard,
+                                   mimetype,
+                                   destroy,
+                                   (GAsyncReadyCallback)valent_clipboard_read_bytes_cb,
+                                   read_data_new (self, mimetype));
+    }
+  else
+    {
+      valent_clipboard_read_text (self->clipboard,
+                                  destroy,
+                                  (GAsyncReadyCallback)valent_clipboard_read_text_cb,
+                                  self);
+    }
+}
+
 static void
 valent_clipboard_read_text_cb (ValentClipboard       *clipboard,
                                GAsyncResult          *result,
@@ -82,6 +360,8 @@ valent_clipboard_read_text_cb (ValentClipboard       *clipboard,
 {
   g_autoptr (GError) error = NULL;
   g_autofree char *text = NULL;
+  g_autofree char *digest = NULL;
+  size_t length;
 
   g_assert (VALENT_IS_CLIPBOARD (clipboard));
   g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
@@ -96,11 +376,70 @@ valent_clipboard_read_text_cb (ValentClipboard       *clipboard,
       return;
     }
 
-  /* Skip if the local clipboard is empty, or already synced with the device */
-  if (text == NULL || g_strcmp0 (self->remote_text, text) == 0)
+  if (text == NULL)
     return;
 
-  valent_clipboard_plugin_clipboard (self, text);
+  /* Skip if the content came from the device, or was already sent to it */
+  length = strlen (text);
+  digest = clipboard_digest (text, length);
+  if (g_strcmp0 (self->remote_digest, digest) == 0)
+    return;
+
+  if (length > CLIPBOARD_INLINE_MAX &&
+      valent_clipboard_plugin_accepts_payload (self))
+    {
+      g_autoptr (GBytes) bytes = NULL;
+
+      bytes = g_bytes_new_take (g_steal_pointer (&text), length);
+      valent_clipboard_plugin_clipboard_payload (self,
+                                                 CLIPBOARD_TEXT_MIMETYPE,
+                                                 bytes);
+    }
+  else
+    {
+      valent_clipboard_plugin_clipboard (self, text);
+    }
+
+  g_set_str (&self->remote_digest, digest);
+}
+
+static void
+valent_clipboard_read_bytes_cb (ValentClipboard *clipboard,
+                                GAsyncResult    *result,
+                                gpointer         user_data)
+{
+  ReadData *data = (ReadData *)user_data;
+  ValentClipboardPlugin *self = data->self;
+  g_autoptr (GBytes) bytes = NULL;
+  g_autofree char *digest = NULL;
+  g_autoptr (GError) error = NULL;
+  const void *content;
+  size_t size;
+
+  g_assert (VALENT_IS_CLIPBOARD (clipboard));
+  g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
+
+  bytes = valent_clipboard_read_bytes_finish (clipboard, result, &error);
+
+  if (bytes == NULL)
+    {
+      if (error != NULL && !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_debug ("%s(): %s", G_STRFUNC, error->message);
+
+      g_clear_pointer (&data, read_data_free);
+      return;
+    }
+
+  content = g_bytes_get_data (bytes, &size);
+  digest = clipboard_digest (content, size);
+
+  if (size > 0 && g_strcmp0 (self->remote_digest, digest) != 0)
+    {
+      valent_clipboard_plugin_clipboard_payload (self, data->mimetype, bytes);
+      g_set_str (&self->remote_digest, digest);
+    }
+
+  g_clear_pointer (&data, read_data_free);
 }
 
 static void
@@ -124,26 +463,47 @@ valent_clipboard_read_text_connect_cb (ValentClipboard       *clipboard,
       return;
     }
 
+  /* The packet is sent regardless, to announce payload support; a timestamp
+   * of `0` tells the device to ignore the empty content. */
   if (text == NULL)
-    return;
-
-  valent_clipboard_plugin_clipboard_connect (self, text, self->local_timestamp);
+    valent_clipboard_plugin_clipboard_connect (self, "", 0);
+  else
+    valent_clipboard_plugin_clipboard_connect (self, text, self->local_timestamp);
 }
 
 static void
-valent_clipboard_write_text_cb (ValentClipboard *clipboard,
-                                GAsyncResult    *result,
-                                gpointer         user_data)
+valent_clipboard_write_bytes_cb (ValentClipboard *clipboard,
+                                 GAsyncResult    *result,
+                                 gpointer         user_data)
 {
   g_autoptr (GError) error = NULL;
 
   g_assert (VALENT_IS_CLIPBOARD (clipboard));
 
-  if (!valent_clipboard_write_text_finish (clipboard, result, &error) &&
+  if (!valent_clipboard_write_bytes_finish (clipboard, result, &error) &&
       !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
     g_warning ("%s(): %s", G_STRFUNC, error->message);
 }
 
+static void
+valent_clipboard_plugin_write_remote (ValentClipboardPlugin *self)
+{
+  g_autoptr (GCancellable) destroy = NULL;
+
+  g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
+
+  if (self->remote_bytes == NULL)
+    return;
+
+  destroy = valent_object_ref_cancellable (VALENT_OBJECT (self));
+  valent_clipboard_write_bytes (self->clipboard,
+                                self->remote_mimetype,
+                                self->remote_bytes,
+                                destroy,
+                                (GAsyncReadyCallback)valent_clipboard_write_bytes_cb,
+                                NULL);
+}
+
 static void
 on_auto_pull_changed (GSettings             *settings,
                       const char            *key,
@@ -151,7 +511,6 @@ on_auto_pull_changed (GSettings             *settings,
 {
   ValentDevice *device;
   ValentDeviceState state;
-  g_autoptr (GCancellable) destroy = NULL;
 
   g_assert (G_IS_SETTINGS (settings));
   g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
@@ -168,12 +527,7 @@ on_auto_pull_changed (GSettings             *settings,
       (state & VALENT_DEVICE_STATE_PAIRED) != 0)
     return;
 
-  destroy = valent_object_ref_cancellable (VALENT_OBJECT (self));
-  valent_clipboard_write_text (self->clipboard,
-                               self->remote_text,
-                               destroy,
-                               (GAsyncReadyCallback)valent_clipboard_write_text_cb,
-                               NULL);
+  valent_clipboard_plugin_write_remote (self);
 }
 
 static void
@@ -183,7 +537,6 @@ on_auto_push_changed (GSettings             *settings,
 {
   ValentDevice *device;
   ValentDeviceState state;
-  g_autoptr (GCancellable) destroy = NULL;
 
   g_assert (G_IS_SETTINGS (settings));
   g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
@@ -200,20 +553,26 @@ on_auto_push_changed (GSettings             *settings,
       (state & VALENT_DEVICE_STATE_PAIRED) != 0)
     return;
 
-  destroy = valent_object_ref_cancellable (VALENT_OBJECT (self));
-  valent_clipboard_read_text (valent_clipboard_get_default (),
-                              destroy,
-                              (GAsyncReadyCallback)valent_clipboard_read_text_cb,
-                              self);
+  valent_clipboard_plugin_read_local (self);
+}
+
+static gboolean
+on_clipboard_changed_timeout (gpointer data)
+{
+  ValentClipboardPlugin *self = VALENT_CLIPBOARD_PLUGIN (data);
+
+  g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
+
+  self->changed_source_id = 0;
+  valent_clipboard_plugin_read_local (self);
 
+  return G_SOURCE_REMOVE;
 }
 
 static void
 on_clipboard_changed (ValentClipboard       *clipboard,
                       ValentClipboardPlugin *self)
 {
-  g_autoptr (GCancellable) destroy = NULL;
-
   g_assert (VALENT_IS_CLIPBOARD (clipboard));
   g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
 
@@ -222,26 +581,169 @@ on_clipboard_changed (ValentClipboard       *clipboard,
   if (!self->auto_push)
     return;
 
-  destroy = valent_object_ref_cancellable (VALENT_OBJECT (self));
-  valent_clipboard_read_text (clipboard,
-                              destroy,
-                              (GAsyncReadyCallback)valent_clipboard_read_text_cb,
-                              self);
+  /* The content is read once the owner has settled, however often it changes */
+  g_clear_handle_id (&self->changed_source_id, g_source_remove);
+  self->changed_source_id = g_timeout_add (CLIPBOARD_DEBOUNCE_MS,
+                                           on_clipboard_changed_timeout,
+                                           self);
+  g_source_set_name_by_id (self->changed_source_id,
+                           "on_clipboard_changed_timeout");
 }
 
 /*
  * Remote Clipboard
  */
+static void
+valent_clipboard_plugin_set_remote (ValentClipboardPlugin *self,
+                                    const char            *mimetype,
+                                    GBytes                *bytes,
+                                    const char            *digest,
+                                    int64_t                timestamp)
+{
+  g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
+
+  /* The remote clipboard content is cached, for manual control over syncing,
+   * because there is no packet type for requesting it on-demand. */
+  g_set_str (&self->remote_mimetype, mimetype);
+  g_clear_pointer (&self->remote_bytes, g_bytes_unref);
+  self->remote_bytes = g_bytes_ref (bytes);
+  g_set_str (&self->remote_digest, digest);
+  self->remote_timestamp = timestamp;
+}
+
+static void
+download_load_cb (GFile        *file,
+                  GAsyncResult *result,
+                  gpointer      user_data)
+{
+  TransferData *data = (TransferData *)user_data;
+  ValentClipboardPlugin *self = data->self;
+  g_autoptr (GBytes) bytes = NULL;
+  g_autofree char *digest = NULL;
+  char *content = NULL;
+  size_t size;
+  g_autoptr (GError) error = NULL;
+
+  g_file_load_contents_finish (file, result, &content, &size, NULL, &error);
+  g_file_delete (file, NULL, NULL);
+
+  if (error != NULL)
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_debug ("%s(): %s", G_STRFUNC, error->message);
+
+      g_clear_pointer (&data, transfer_data_free);
+      return;
+    }
+
+  digest = clipboard_digest (content, size);
+
+  /* The loaded contents are always NUL-terminated, and text content includes
+   * the terminator. */
+  if (clipboard_is_text (data->mimetype))
+    bytes = g_bytes_new_take (content, size + 1);
+  else
+    bytes = g_bytes_new_take (content, size);
+
+  valent_clipboard_plugin_set_remote (self,
+                                      data->mimetype,
+                                      bytes,
+                                      digest,
+                                      valent_timestamp_ms ());
+
+  if (self->auto_pull)
+    valent_clipboard_plugin_write_remote (self);
+
+  g_clear_pointer (&data, transfer_data_free);
+}
+
+static void
+download_execute_cb (GObject      *object,
+                     GAsyncResult *result,
+                     gpointer      user_data)
+{
+  ValentTransfer *transfer = VALENT_TRANSFER (object);
+  TransferData *data = (TransferData *)user_data;
+  g_autoptr (GCancellable) destroy = NULL;
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GError) error = NULL;
+
+  if (!valent_transfer_execute_finish (transfer, result, &error))
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_debug ("%s(): %s", G_STRFUNC, error->message);
+
+      g_clear_pointer (&data, transfer_data_free);
+      return;
+    }
+
+  file = valent_device_transfer_ref_file (VALENT_DEVICE_TRANSFER (transfer));
+  destroy = valent_object_ref_cancellable (VALENT_OBJECT (data->self));
+  g_file_load_contents_async (file,
+                              destroy,
+                              (GAsyncReadyCallback)download_load_cb,
+                              g_steal_pointer (&data));
+}
+
+static void
+valent_clipboard_plugin_handle_clipboard_payload (ValentClipboardPlugin *self,
+                                                  JsonNode              *packet)
+{
+  g_autoptr (ValentTransfer) transfer = NULL;
+  g_autoptr (GCancellable) destroy = NULL;
+  g_autoptr (GFile) file = NULL;
+  ValentDevice *device = NULL;
+  const char *mimetype = CLIPBOARD_TEXT_MIMETYPE;
+  goffset payload_size;
+
+  g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
+  g_assert (VALENT_IS_PACKET (packet));
+
+  if (json_object_has_member (valent_packet_get_body (packet), "mimetype") &&
+      !valent_packet_get_string (packet, "mimetype", &mimetype))
+    {
+      g_debug ("%s(): expected \"mimetype\" field holding a string",
+               G_STRFUNC);
+      return;
+    }
+
+  payload_size = valent_packet_get_payload_size (packet);
+
+  if (payload_size <= 0 || payload_size > CLIPBOARD_PAYLOAD_MAX)
+    {
+      g_debug ("%s(): refusing payload of %"G_GOFFSET_FORMAT" bytes",
+               G_STRFUNC, payload_size);
+      return;
+    }
+
+  device = valent_extension_get_object (VALENT_EXTENSION (self));
+  file = valent_clipboard_plugin_new_payload_file (self);
+  transfer = valent_device_transfer_new (device, packet, file);
+
+  destroy = valent_object_ref_cancellable (VALENT_OBJECT (self));
+  valent_transfer_execute (transfer,
+                           destroy,
+                           download_execute_cb,
+                           transfer_data_new (self, transfer, mimetype));
+}
+
 static void
 valent_clipboard_plugin_handle_clipboard (ValentClipboardPlugin *self,
                                           JsonNode              *packet)
 {
   const char *content;
-  g_autoptr (GCancellable) destroy = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  g_autofree char *digest = NULL;
 
   g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
   g_assert (VALENT_IS_PACKET (packet));
 
+  if (valent_packet_has_payload (packet))
+    {
+      valent_clipboard_plugin_handle_clipboard_payload (self, packet);
+      return;
+    }
+
   if (!valent_packet_get_string (packet, "content", &content))
     {
       g_debug ("%s(): expected \"content\" field holding a string",
@@ -249,21 +751,18 @@ valent_clipboard_plugin_handle_clipboard (ValentClipboardPlugin *self,
       return;
     }
 
-  /* The remote clipboard content is cached, for manual control over syncing,
-   * because there is no packet type for requesting it on-demand. */
-  g_clear_pointer (&self->remote_text, g_free);
-  self->remote_text = g_strdup (content);
-  self->remote_timestamp = valent_timestamp_ms ();
+  bytes = g_bytes_new (content, strlen (content) + 1);
+  digest = clipboard_digest (content, strlen (content));
+  valent_clipboard_plugin_set_remote (self,
+                                      CLIPBOARD_TEXT_MIMETYPE,
+                                      bytes,
+                                      digest,
+                                      valent_timestamp_ms ());
 
   if (!self->auto_pull)
     return;
 
-  destroy = valent_object_ref_cancellable (VALENT_OBJECT (self));
-  valent_clipboard_write_text (self->clipboard,
-                               self->remote_text,
-                               destroy,
-                               (GAsyncReadyCallback)valent_clipboard_write_text_cb,
-                               NULL);
+  valent_clipboard_plugin_write_remote (self);
 }
 
 static void
@@ -272,7 +771,8 @@ valent_clipboard_plugin_handle_clipboard_connect (ValentClipboardPlugin *self,
 {
   int64_t timestamp;
   const char *content;
-  g_autoptr (GCancellable) destroy = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  g_autofree char *digest = NULL;
 
   g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
   g_assert (VALENT_IS_PACKET (packet));
@@ -291,11 +791,19 @@ valent_clipboard_plugin_handle_clipboard_connect (ValentClipboardPlugin *self,
       return;
     }
 
-  /* The remote clipboard content is cached, for manual control over syncing,
-   * because there is no packet type for requesting it on-demand. */
-  g_clear_pointer (&self->remote_text, g_free);
-  self->remote_text = g_strdup (content);
-  self->remote_timestamp = timestamp;
+  self->remote_payloads = valent_packet_check_field (packet, "acceptsPayloads");
+
+  /* A timestamp of `0` means the content should be ignored */
+  if (timestamp == 0)
+    return;
+
+  bytes = g_bytes_new (content, strlen (content) + 1);
+  digest = clipboard_digest (content, strlen (content));
+  valent_clipboard_plugin_set_remote (self,
+                                      CLIPBOARD_TEXT_MIMETYPE,
+                                      bytes,
+                                      digest,
+                                      timestamp);
 
   if (self->remote_timestamp <= self->local_timestamp)
     return;
@@ -303,12 +811,7 @@ valent_clipboard_plugin_handle_clipboard_connect (ValentClipboardPlugin *self,
   if (!self->auto_pull)
     return;
 
-  destroy = valent_object_ref_cancellable (VALENT_OBJECT (self));
-  valent_clipboard_write_text (self->clipboard,
-                               self->remote_text,
-                               destroy,
-                               (GAsyncReadyCallback)valent_clipboard_write_text_cb,
-                               NULL);
+  valent_clipboard_plugin_write_remote (self);
 }
 
 /*
@@ -320,22 +823,17 @@ clipboard_pull_action (GSimpleAction *action,
                        gpointer       user_data)
 {
   ValentClipboardPlugin *self = VALENT_CLIPBOARD_PLUGIN (user_data);
-  g_autoptr (GCancellable) destroy = NULL;
 
   g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
 
-  if (self->remote_text == NULL || *self->remote_text == '\0')
+  /* Text content includes a terminator */
+  if (self->remote_bytes == NULL || g_bytes_get_size (self->remote_bytes) <= 1)
     {
       g_debug ("%s(): remote clipboard empty", G_STRFUNC);
       return;
     }
 
-  destroy = valent_object_ref_cancellable (VALENT_OBJECT (self));
-  valent_clipboard_write_text (self->clipboard,
-                               self->remote_text,
-                               destroy,
-                               (GAsyncReadyCallback)valent_clipboard_write_text_cb,
-                               NULL);
+  valent_clipboard_plugin_write_remote (self);
 }
 
 static void
@@ -344,15 +842,12 @@ clipboard_push_action (GSimpleAction *action,
                        gpointer       user_data)
 {
   ValentClipboardPlugin *self = VALENT_CLIPBOARD_PLUGIN (user_data);
-  g_autoptr (GCancellable) destroy = NULL;
 
   g_assert (VALENT_IS_CLIPBOARD_PLUGIN (self));
 
-  destroy = valent_object_ref_cancellable (VALENT_OBJECT (self));
-  valent_clipboard_read_text (valent_clipboard_get_default (),
-                              destroy,
-                              (GAsyncReadyCallback)valent_clipboard_read_text_cb,
-                              self);
+  /* Forget the content held by the device, so it is always sent */
+  g_clear_pointer (&self->remote_digest, g_free);
+  valent_clipboard_plugin_read_local (self);
 }
 
 static const GActionEntry actions[] = {
@@ -399,6 +894,8 @@ valent_clipboard_plugin_update_state (ValentDevicePlugin *plugin,
   else
     {
       g_clear_signal_handler (&self->changed_id, self->clipboard);
+      g_clear_handle_id (&self->changed_source_id, g_source_remove);
+      self->remote_payloads = FALSE;
     }
 }
 
@@ -433,6 +930,7 @@ valent_clipboard_plugin_destroy (ValentObject *object)
   ValentClipboardPlugin *self = VALENT_CLIPBOARD_PLUGIN (object);
 
   g_clear_signal_handler (&self->changed_id, self->clipboard);
+  g_clear_handle_id (&self->changed_source_id, g_source_remove);
 
   VALENT_OBJECT_CLASS (valent_clipboard_plugin_parent_class)->destroy (object);
 }
@@ -476,7 +974,9 @@ valent_clipboard_plugin_finalize (GObject *object)
 {
   ValentClipboardPlugin *self = VALENT_CLIPBOARD_PLUGIN (object);
 
-  g_clear_pointer (&self->remote_text, g_free);
+  g_clear_pointer (&self->remote_mimetype, g_free);
+  g_clear_pointer (&self->remote_bytes, g_bytes_unref);
+  g_clear_pointer (&self->remote_digest, g_free);
 
   G_OBJECT_CLASS (valent_clipboard_plugin_parent_class)->finalize (object);
 }
@@ -278,11 +278,51 @@ valent_contact_store_add_contacts_cb (ValentContactStore *store,
     g_warning ("%s(): %s", G_STRFUNC, error->message);
 }
 
+/*
+ * `kdeconnect.contacts.response_vcards` is handled on a worker thread, so the
+ * vCards are parsed there and passed back to the main thread to be stored.
+ */
+typedef struct
+{
+  ValentContactsPlugin *plugin;
+  GSList               *contacts;
+} ResponseData;
+
+static void
+response_data_free (gpointer data)
+{
+  ResponseData *closure = data;
+
+  g_clear_object (&closure->plugin);
+  g_slist_free_full (closure->contacts, g_object_unref);
+  g_free (closure);
+}
+
+static gboolean
+valent_contact_plugin_handle_response_vcards_main (gpointer data)
+{
+  ResponseData *closure = data;
+  ValentContactsPlugin *self = closure->plugin;
+
+  /* The plugin was destroyed while the packet was being handled */
+  if (self->remote_store == NULL)
+    return G_SOURCE_REMOVE;
+
+  valent_contact_store_add_contacts (self->remote_store,
+                                     closure->contacts,
+                                     self->cancellable,
+                                     (GAsyncReadyCallback)valent_contact_store_add_contacts_cb,
+                                     NULL);
+
+  return G_SOURCE_REMOVE;
+}
+
 static void
 valent_contact_plugin_handle_response_vcards (ValentContactsPlugin *self,
                                               JsonNode             *packet)
 {
-  g_autoslist (EContact) contacts = NULL;
+  GSList *contacts = NULL;
+  ResponseData *closure = NULL;
   JsonObject *body;
   JsonObjectIter iter;
   const char *uid;
@@ -306,17 +346,20 @@ valent_contact_plugin_handle_response_vcards (ValentContactsPlugin *self,
       vcard = json_node_get_string (node);
       contact = e_contact_new_from_vcard_with_uid (vcard, uid);
 
-      contacts = g_slist_append (contacts, contact);
+      contacts = g_slist_prepend (contacts, contact);
     }
 
-  if (contacts != NULL)
-    {
-      valent_contact_store_add_contacts (self->remote_store,
-                                         contacts,
-                                         self->cancellable,
-                                         (GAsyncReadyCallback)valent_contact_store_add_contacts_cb,
-                                         NULL);
-    }
+  if (contacts == NULL)
+    return;
+
+  closure = g_new0 (ResponseData, 1);
+  closure->plugin = g_object_ref (self);
+  closure->contacts = g_slist_reverse (contacts);
+
+  g_idle_add_full (G_PRIORITY_DEFAULT,
+                   valent_contact_plugin_handle_response_vcards_main,
+                   g_steal_pointer (&closure),
+                   response_data_free);
 }
 
 static void
@@ -16,6 +16,7 @@
 #include <gio/gio.h>
 #include <valent.h>
 
+#include "valent-input-queue-private.h"
 #include "valent-mutter-input.h"
 
 #define SERVICE_NAME "org.gnome.Shell"
@@ -33,6 +34,17 @@ struct _ValentMutterInput
   GDBusProxy         *proxy;
   GDBusProxy         *session;
   uint8_t             session_state : 2;
+
+  /* Relative motion and axis events are accumulated, then sent once per main
+   * loop iteration. Other events flush them first, to preserve ordering. */
+  double              motion_dx;
+  double              motion_dy;
+  double              axis_dx;
+  double              axis_dy;
+  unsigned int        flush_id;
+
+  /* Events received while the session is starting */
+  ValentInputQueue   *events;
 };
 
 static void   g_async_initable_iface_init (GAsyncInitableIface *iface);
@@ -113,6 +125,7 @@ on_g_signal (GDBusProxy        *proxy,
         {
           g_clear_object (&self->session);
           self->session_state = SESSION_STATE_CLOSED;
+          valent_input_queue_clear (self->events);
         }
     }
 }
@@ -137,10 +150,12 @@ remote_desktop_start_screencast_cb (GDBusConnection   *connection,
 
       g_clear_object (&self->session);
       self->session_state = SESSION_STATE_CLOSED;
+      valent_input_queue_clear (self->events);
       return;
     }
 
   self->session_state = SESSION_STATE_ACTIVE;
+  valent_input_queue_replay (self->events, VALENT_INPUT_ADAPTER (self));
 }
 
 static void
@@ -165,6 +180,7 @@ remote_desktop_start_session_cb (GDBusProxy        *proxy,
 
       g_clear_object (&self->session);
       self->session_state = SESSION_STATE_CLOSED;
+      valent_input_queue_clear (self->events);
       return;
     }
 
@@ -208,6 +224,7 @@ remote_desktop_create_proxy_cb (GDBusProxy        *proxy,
         g_warning ("%s(): %s", G_STRFUNC, error->message);
 
       self->session_state = SESSION_STATE_CLOSED;
+      valent_input_queue_clear (self->events);
       return;
     }
 
@@ -247,6 +264,7 @@ remote_desktop_create_session_cb (GDBusProxy        *proxy,
 
       g_warning ("%s(): %s", G_STRFUNC, error->message);
       self->session_state = SESSION_STATE_CLOSED;
+      valent_input_queue_clear (self->events);
 
       return;
     }
@@ -291,9 +309,94 @@ valent_mutter_input_check (ValentMutterInput *self)
   return FALSE;
 }
 
+/*
+ * Without a callback, method calls are sent with the
+ * %G_DBUS_MESSAGE_FLAGS_NO_REPLY_EXPECTED flag set, so there is no round-trip.
+ */
+static inline void
+valent_mutter_input_notify (ValentMutterInput *self,
+                            const char        *method_name,
+                            GVariant          *parameters)
+{
+  g_dbus_proxy_call (self->session,
+                     method_name,
+                     parameters,
+                     G_DBUS_CALL_FLAGS_NONE,
+                     -1,
+                     NULL, NULL, NULL);
+}
+
+static void
+valent_mutter_input_flush (ValentMutterInput *self)
+{
+  g_assert (VALENT_IS_MUTTER_INPUT (self));
+
+  g_clear_handle_id (&self->flush_id, g_source_remove);
+
+  if (self->session_state != SESSION_STATE_ACTIVE)
+    {
+      self->motion_dx = self->motion_dy = 0.0;
+      self->axis_dx = self->axis_dy = 0.0;
+      return;
+    }
+
+  if (self->motion_dx != 0.0 || self->motion_dy != 0.0)
+    {
+      valent_mutter_input_notify (self,
+                                  "NotifyPointerMotionRelative",
+                                  g_variant_new ("(dd)",
+                                                 self->motion_dx,
+                                                 self->motion_dy));
+      self->motion_dx = self->motion_dy = 0.0;
+    }
+
+  if (self->axis_dx != 0.0 || self->axis_dy != 0.0)
+    {
+      valent_mutter_input_notify (self,
+                                  "NotifyPointerAxis",
+                                  g_variant_new ("(ddu)",
+                                                 self->axis_dx,
+                                                 self->axis_dy,
+                                                 POINTER_AXIS_TOUCH));
+      valent_mutter_input_notify (self,
+                                  "NotifyPointerAxis",
+                                  g_variant_new ("(ddu)",
+                                                 0.0,
+                                                 0.0,
+                                                 POINTER_AXIS_FINISH));
+      self->axis_dx = self->axis_dy = 0.0;
+    }
+}
+
+static gboolean
+valent_mutter_input_flush_idle (gpointer data)
+{
+  ValentMutterInput *self = VALENT_MUTTER_INPUT (data);
+
+  self->flush_id = 0;
+  valent_mutter_input_flush (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static inline void
+valent_mutter_input_queue_flush (ValentMutterInput *self)
+{
+  if (self->flush_id != 0)
+    return;
+
+  self->flush_id = g_idle_add_full (G_PRIORITY_HIGH_IDLE,
+                                    valent_mutter_input_flush_idle,
+                                    self,
+                                    NULL);
+  g_source_set_name_by_id (self->flush_id, "valent_mutter_input_flush_idle");
+}
+
 static void
 valent_mutter_input_close (ValentMutterInput *self)
 {
+  valent_mutter_input_flush (self);
+
   if (self->session_state == SESSION_STATE_CLOSED)
     return;
 
@@ -321,15 +424,17 @@ valent_mutter_input_keyboard_keysym (ValentInputAdapter *adapter,
   g_assert (VALENT_IS_MUTTER_INPUT (self));
 
   if G_UNLIKELY (!valent_mutter_input_check (self))
-    return;
+    {
+      valent_input_queue_keyboard_keysym (self->events, keysym, state);
+      return;
+    }
+
+  valent_mutter_input_flush (self);
 
   // TODO: XDP_KEY_PRESSED/XDP_KEY_RELEASED
-  g_dbus_proxy_call (self->session,
-                     "NotifyKeyboardKeysym",
-                     g_variant_new ("(ub)", keysym, state),
-                     G_DBUS_CALL_FLAGS_NONE,
-                     -1,
-                     NULL, NULL, NULL);
+  valent_mutter_input_notify (self,
+                              "NotifyKeyboardKeysym",
+                              g_variant_new ("(ub)", keysym, state));
 }
 
 static unsigned int
@@ -364,20 +469,17 @@ valent_mutter_input_pointer_axis (ValentInputAdapter *adapter,
   g_assert (!G_APPROX_VALUE (dx, 0.0, 0.01) || !G_APPROX_VALUE (dy, 0.0, 0.01));
 
   if G_UNLIKELY (!valent_mutter_input_check (self))
-    return;
+    {
+      valent_input_queue_pointer_axis (self->events, dx, dy);
+      return;
+    }
 
-  g_dbus_proxy_call (self->session,
-                     "NotifyPointerAxis",
-                     g_variant_new ("(ddu)", dx, dy, POINTER_AXIS_TOUCH),
-                     G_DBUS_CALL_FLAGS_NONE,
-                     -1,
-                     NULL, NULL, NULL);
-  g_dbus_proxy_call (self->session,
-                     "NotifyPointerAxis",
-                     g_variant_new ("(ddu)", 0.0, 0.0, POINTER_AXIS_FINISH),
-                     G_DBUS_CALL_FLAGS_NONE,
-                     -1,
-                     NULL, NULL, NULL);
+  if (self->motion_dx != 0.0 || self->motion_dy != 0.0)
+    valent_mutter_input_flush (self);
+
+  self->axis_dx += dx;
+  self->axis_dy += dy;
+  valent_mutter_input_queue_flush (self);
 }
 
 static void
@@ -391,16 +493,18 @@ valent_mutter_input_pointer_button (ValentInputAdapter *adapter,
   g_assert (VALENT_IS_MUTTER_INPUT (self));
 
   if G_UNLIKELY (!valent_mutter_input_check (self))
-    return;
+    {
+      valent_input_queue_pointer_button (self->events, button, pressed);
+      return;
+    }
+
+  valent_mutter_input_flush (self);
 
   /* Translate the button to EVDEV constant */
   button = translate_to_evdev_button (button);
-  g_dbus_proxy_call (self->session,
-                     "NotifyPointerButton",
-                     g_variant_new ("(ib)", (int32_t)button, pressed),
-                     G_DBUS_CALL_FLAGS_NONE,
-                     -1,
-                     NULL, NULL, NULL);
+  valent_mutter_input_notify (self,
+                              "NotifyPointerButton",
+                              g_variant_new ("(ib)", (int32_t)button, pressed));
 }
 
 static void
@@ -414,14 +518,17 @@ valent_mutter_input_pointer_motion (ValentInputAdapter *adapter,
   g_assert (VALENT_IS_MUTTER_INPUT (self));
 
   if G_UNLIKELY (!valent_mutter_input_check (self))
-    return;
+    {
+      valent_input_queue_pointer_motion (self->events, dx, dy);
+      return;
+    }
 
-  g_dbus_proxy_call (self->session,
-                     "NotifyPointerMotionRelative",
-                     g_variant_new ("(dd)", dx, dy),
-                     G_DBUS_CALL_FLAGS_NONE,
-                     -1,
-                     NULL, NULL, NULL);
+  if (self->axis_dx != 0.0 || self->axis_dy != 0.0)
+    valent_mutter_input_flush (self);
+
+  self->motion_dx += dx;
+  self->motion_dy += dy;
+  valent_mutter_input_queue_flush (self);
 }
 
 /*
@@ -543,6 +650,7 @@ valent_mutter_input_finalize (GObject *object)
 
   g_clear_object (&self->proxy);
   g_clear_object (&self->session);
+  g_clear_pointer (&self->events, valent_input_queue_free);
 
   G_OBJECT_CLASS (valent_mutter_input_parent_class)->finalize (object);
 }
@@ -567,6 +675,7 @@ valent_mutter_input_class_init (ValentMutterInputClass *klass)
 static void
 valent_mutter_input_init (ValentMutterInput *self)
 {
+  self->events = valent_input_queue_new ();
 }
 
 
@@ -5,6 +5,8 @@
 
 #include "config.h"
 
+#include <math.h>
+
 #include <gio/gio.h>
 #include <gdk/gdk.h>
 #include <gtk/gtk.h>
@@ -15,6 +17,7 @@
 
 #define DEFAULT_DOUBLE_CLICK_TIME (400)
 #define DEFAULT_LONG_PRESS_TIME   (500)
+#define DEFAULT_POINTER_RATE      (60)
 
 
 struct _ValentMousepadDevice
@@ -38,6 +41,14 @@ struct _ValentMousepadDevice
 
   int                 double_click_time;
   int                 long_press_time;
+
+  /* pointer motion */
+  double              motion_dx;
+  double              motion_dy;
+  double              axis_dx;
+  double              axis_dy;
+  unsigned int        motion_flush_id;
+  unsigned int        pointer_rate;
 };
 
 G_DEFINE_FINAL_TYPE (ValentMousepadDevice, valent_mousepad_device, VALENT_TYPE_INPUT_ADAPTER)
@@ -46,6 +57,7 @@ G_DEFINE_FINAL_TYPE (ValentMousepadDevice, valent_mousepad_device, VALENT_TYPE_I
 enum {
   PROP_0,
   PROP_DEVICE,
+  PROP_POINTER_RATE,
   N_PROPERTIES
 };
 
@@ -243,6 +255,112 @@ valent_mousepad_device_pointer_reset (ValentMousepadDevice *self)
   return G_SOURCE_REMOVE;
 }
 
+/*
+ * Pointer motion and scroll deltas are accumulated and sent at most once per
+ * interval of #ValentMousepadDevice:pointer-rate. Only whole units are sent,
+ * with any remainder carried over to the next interval, so the total
+ * displacement is preserved.
+ */
+static gboolean
+valent_mousepad_device_send_delta (ValentMousepadDevice *self,
+                                   double               *dx,
+                                   double               *dy,
+                                   gboolean              scroll)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) packet = NULL;
+  double tx = trunc (*dx);
+  double ty = trunc (*dy);
+
+  if (tx == 0.0 && ty == 0.0)
+    return FALSE;
+
+  valent_packet_init (&builder, "kdeconnect.mousepad.request");
+  json_builder_set_member_name (builder, "dx");
+  json_builder_add_double_value (builder, tx);
+  json_builder_set_member_name (builder, "dy");
+  json_builder_add_double_value (builder, ty);
+
+  if (scroll)
+    {
+      json_builder_set_member_name (builder, "scroll");
+      json_builder_add_boolean_value (builder, TRUE);
+    }
+
+  packet = valent_packet_end (&builder);
+  valent_device_send_packet (self->device, packet, NULL, NULL, NULL);
+
+  *dx -= tx;
+  *dy -= ty;
+
+  return TRUE;
+}
+
+static gboolean
+valent_mousepad_device_motion_send (ValentMousepadDevice *self)
+{
+  gboolean sent = FALSE;
+
+  g_assert (VALENT_IS_MOUSEPAD_DEVICE (self));
+
+  sent |= valent_mousepad_device_send_delta (self,
+                                             &self->motion_dx,
+                                             &self->motion_dy,
+                                             FALSE);
+  sent |= valent_mousepad_device_send_delta (self,
+                                             &self->axis_dx,
+                                             &self->axis_dy,
+                                             TRUE);
+
+  return sent;
+}
+
+static gboolean
+valent_mousepad_device_motion_flush (gpointer data)
+{
+  ValentMousepadDevice *self = VALENT_MOUSEPAD_DEVICE (data);
+
+  /* Stop the timer after an interval without any motion */
+  if (!valent_mousepad_device_motion_send (self))
+    {
+      self->motion_flush_id = 0;
+      return G_SOURCE_REMOVE;
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static inline void
+valent_mousepad_device_motion_queue (ValentMousepadDevice *self)
+{
+  g_assert (VALENT_IS_MOUSEPAD_DEVICE (self));
+
+  if (self->motion_flush_id != 0)
+    return;
+
+  /* The first event is sent immediately, then subsequent events are paced */
+  if (valent_mousepad_device_motion_send (self))
+    {
+      self->motion_flush_id = g_timeout_add (1000 / self->pointer_rate,
+                                             valent_mousepad_device_motion_flush,
+                                             self);
+      g_source_set_name_by_id (self->motion_flush_id,
+                               "valent_mousepad_device_motion_flush");
+    }
+}
+
+static inline void
+valent_mousepad_device_motion_reset (ValentMousepadDevice *self)
+{
+  g_assert (VALENT_IS_MOUSEPAD_DEVICE (self));
+
+  self->motion_dx = 0.0;
+  self->motion_dy = 0.0;
+  self->axis_dx = 0.0;
+  self->axis_dy = 0.0;
+  g_clear_handle_id (&self->motion_flush_id, g_source_remove);
+}
+
 static inline gboolean
 valent_mousepad_device_pointer_flush (gpointer data)
 {
@@ -357,6 +475,8 @@ valent_mousepad_device_keyboard_keysym (ValentInputAdapter *adapter,
   if (!state)
     return;
 
+  /* Pending motion must be sent before the key, to preserve ordering */
+  valent_mousepad_device_motion_send (self);
   g_array_append_val (self->keyboard_keys, keysym);
 
   /* If there are modifiers set, the key should be sent immediately */
@@ -378,21 +498,12 @@ valent_mousepad_device_pointer_axis (ValentInputAdapter *adapter,
                                      double              dy)
 {
   ValentMousepadDevice *self = VALENT_MOUSEPAD_DEVICE (adapter);
-  g_autoptr (JsonBuilder) builder = NULL;
-  g_autoptr (JsonNode) packet = NULL;
 
   g_assert (VALENT_IS_MOUSEPAD_DEVICE (self));
 
-  valent_packet_init (&builder, "kdeconnect.mousepad.request");
-  json_builder_set_member_name (builder, "dx");
-  json_builder_add_double_value (builder, dx);
-  json_builder_set_member_name (builder, "dy");
-  json_builder_add_double_value (builder, dy);
-  json_builder_set_member_name (builder, "scroll");
-  json_builder_add_boolean_value (builder, TRUE);
-  packet = valent_packet_end (&builder);
-
-  valent_device_send_packet (self->device, packet, NULL, NULL, NULL);
+  self->axis_dx += dx;
+  self->axis_dy += dy;
+  valent_mousepad_device_motion_queue (self);
 }
 
 static void
@@ -402,6 +513,9 @@ valent_mousepad_device_pointer_button (ValentInputAdapter *adapter,
 {
   ValentMousepadDevice *self = VALENT_MOUSEPAD_DEVICE (adapter);
 
+  /* Pending motion must be sent before the button, to preserve ordering */
+  valent_mousepad_device_motion_send (self);
+
   if (self->pointer_button != button)
     {
       self->pointer_button = button;
@@ -463,19 +577,12 @@ valent_mousepad_device_pointer_motion (ValentInputAdapter *adapter,
                                        double              dy)
 {
   ValentMousepadDevice *self = VALENT_MOUSEPAD_DEVICE (adapter);
-  g_autoptr (JsonBuilder) builder = NULL;
-  g_autoptr (JsonNode) packet = NULL;
 
   g_assert (VALENT_IS_MOUSEPAD_DEVICE (self));
 
-  valent_packet_init (&builder, "kdeconnect.mousepad.request");
-  json_builder_set_member_name (builder, "dx");
-  json_builder_add_double_value (builder, dx);
-  json_builder_set_member_name (builder, "dy");
-  json_builder_add_double_value (builder, dy);
-  packet = valent_packet_end (&builder);
-
-  valent_device_send_packet (self->device, packet, NULL, NULL, NULL);
+  self->motion_dx += dx;
+  self->motion_dy += dy;
+  valent_mousepad_device_motion_queue (self);
   valent_mousepad_device_pointer_reset (self);
 }
 
@@ -511,6 +618,7 @@ valent_mousepad_device_destroy (ValentObject *object)
 
   valent_mousepad_device_keyboard_reset (self);
   valent_mousepad_device_pointer_reset (self);
+  valent_mousepad_device_motion_reset (self);
 
   VALENT_OBJECT_CLASS (valent_mousepad_device_parent_class)->destroy (object);
 }
@@ -543,6 +651,10 @@ valent_mousepad_device_get_property (GObject    *object,
       g_value_set_object (value, self->device);
       break;
 
+    case PROP_POINTER_RATE:
+      g_value_set_uint (value, self->pointer_rate);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -562,6 +674,10 @@ valent_mousepad_device_set_property (GObject      *object,
       self->device = g_value_dup_object (value);
       break;
 
+    case PROP_POINTER_RATE:
+      self->pointer_rate = g_value_get_uint (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -597,6 +713,18 @@ valent_mousepad_device_class_init (ValentMousepadDeviceClass *klass)
                           G_PARAM_EXPLICIT_NOTIFY |
                           G_PARAM_STATIC_STRINGS));
 
+  /**
+   * ValentMousepadDevice:pointer-rate:
+   *
+   * The maximum rate pointer motion and scroll events are sent, in Hz.
+   */
+  properties [PROP_POINTER_RATE] =
+    g_param_spec_uint ("pointer-rate", NULL, NULL,
+                       1, 1000,
+                       DEFAULT_POINTER_RATE,
+                       (G_PARAM_READWRITE |
+                        G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_properties (object_class, N_PROPERTIES, properties);
 }
 
@@ -606,6 +734,7 @@ valent_mousepad_device_init (ValentMousepadDevice *self)
   self->keyboard_keys = g_array_new (FALSE, FALSE, sizeof (uint32_t));
   self->double_click_time = DEFAULT_DOUBLE_CLICK_TIME;
   self->long_press_time = DEFAULT_LONG_PRESS_TIME;
+  self->pointer_rate = DEFAULT_POINTER_RATE;
 
   if (gtk_is_initialized ())
     {
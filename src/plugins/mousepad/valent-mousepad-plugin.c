@@ -251,6 +251,11 @@ valent_mousepad_plugin_handle_mousepad_keyboardstate (ValentMousepadPlugin *self
                                            "device", device,
                                            "object", device,
                                            NULL);
+          g_settings_bind (valent_extension_get_settings (VALENT_EXTENSION (self)),
+                           "pointer-rate",
+                           self->controller,
+                           "pointer-rate",
+                           G_SETTINGS_BIND_GET);
           valent_input_export_adapter (self->input,
                                        VALENT_INPUT_ADAPTER (self->controller));
         }
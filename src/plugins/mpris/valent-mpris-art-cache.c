@@ -0,0 +1,822 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#define G_LOG_DOMAIN "valent-mpris-art-cache"
+
+#include "config.h"
+
+#include <gio/gio.h>
+#include <gtk/gtk.h>
+#include <valent.h>
+
+#include "valent-mpris-art-cache.h"
+
+#define ART_CACHE_MAX_ITEMS 128
+#define ART_CACHE_MAX_SIZE  (32 * 1024 * 1024)
+#define ART_UPLOAD_SIZE     512
+#define ART_PERSIST_DELAY   5
+
+
+/*
+ * Album Art Cache
+ *
+ * Album art is shared by all devices and stored by the SHA-256 of its content,
+ * so the same image offered under different URLs, or by different devices, is
+ * only stored once. An index maps the MD5 of each remote URL to the content it
+ * resolved to, so art is not downloaded again after a restart.
+ *
+ * Downscaled copies of local album art prepared for upload are stored in the
+ * same cache, keyed by the content hash of the original and the target size.
+ *
+ * Entries are evicted in least-recently-used order when the cache exceeds
+ * %ART_CACHE_MAX_ITEMS or %ART_CACHE_MAX_SIZE, except for entries pinned by an
+ * upload in progress. The order is preserved across restarts using the
+ * modification time of each file, which is written in batches from a thread
+ * rather than each time an entry is used.
+ *
+ * The cache is loaded in a thread, and until it is loaded lookups will miss.
+ */
+typedef struct
+{
+  GList         link;
+  char         *name;
+  goffset       size;
+  int64_t       used;
+  unsigned int  pins;
+  unsigned int  dirty : 1;
+} ArtEntry;
+
+static GMutex      art_lock;
+static GFile      *art_dir = NULL;
+static GHashTable *art_entries = NULL;
+static GHashTable *art_urls = NULL;
+static GQueue      art_lru = G_QUEUE_INIT;
+static goffset     art_size = 0;
+static int         art_loaded = FALSE;
+static int         art_loading = FALSE;
+static unsigned int art_persist_id = 0;
+
+
+static void
+art_entry_free (gpointer data)
+{
+  ArtEntry *entry = data;
+
+  g_clear_pointer (&entry->name, g_free);
+  g_free (entry);
+}
+
+static int
+art_info_compare (gconstpointer a,
+                  gconstpointer b)
+{
+  GFileInfo *info_a = *(GFileInfo **)a;
+  GFileInfo *info_b = *(GFileInfo **)b;
+  guint64 time_a, time_b;
+
+  time_a = g_file_info_get_attribute_uint64 (info_a, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+  time_b = g_file_info_get_attribute_uint64 (info_b, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+
+  return (time_a < time_b) - (time_a > time_b);
+}
+
+typedef struct
+{
+  char    *name;
+  int64_t  used;
+} ArtTouch;
+
+static void
+art_touch_free (gpointer data)
+{
+  ArtTouch *touch = data;
+
+  g_clear_pointer (&touch->name, g_free);
+  g_free (touch);
+}
+
+static void
+art_cache_persist_task (GTask        *task,
+                        gpointer      source_object,
+                        gpointer      task_data,
+                        GCancellable *cancellable)
+{
+  g_autoptr (GPtrArray) touches = NULL;
+  g_autoptr (GFile) dir = NULL;
+
+  touches = g_ptr_array_new_with_free_func (art_touch_free);
+
+  /* Collect the entries used since the last batch */
+  g_mutex_lock (&art_lock);
+  for (const GList *iter = art_lru.head; iter != NULL; iter = iter->next)
+    {
+      ArtEntry *entry = iter->data;
+      ArtTouch *touch;
+
+      if (!entry->dirty)
+        continue;
+
+      touch = g_new0 (ArtTouch, 1);
+      touch->name = g_strdup (entry->name);
+      touch->used = entry->used;
+      g_ptr_array_add (touches, touch);
+      entry->dirty = FALSE;
+    }
+
+  if (art_dir != NULL)
+    dir = g_object_ref (art_dir);
+  g_mutex_unlock (&art_lock);
+
+  /* Entries may have been evicted since, in which case this fails quietly */
+  for (unsigned int i = 0; dir != NULL && i < touches->len; i++)
+    {
+      ArtTouch *touch = g_ptr_array_index (touches, i);
+      g_autoptr (GFile) file = NULL;
+
+      file = g_file_get_child (dir, touch->name);
+      g_file_set_attribute_uint64 (file,
+                                   G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                                   (guint64)touch->used,
+                                   G_FILE_QUERY_INFO_NONE,
+                                   NULL,
+                                   NULL);
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static gboolean
+art_cache_persist (gpointer data)
+{
+  g_autoptr (GTask) task = NULL;
+
+  g_mutex_lock (&art_lock);
+  art_persist_id = 0;
+  g_mutex_unlock (&art_lock);
+
+  task = g_task_new (NULL, NULL, NULL, NULL);
+  g_task_set_source_tag (task, art_cache_persist);
+  g_task_run_in_thread (task, art_cache_persist_task);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+art_cache_touch (ArtEntry *entry)
+{
+  g_queue_unlink (&art_lru, &entry->link);
+  g_queue_push_head_link (&art_lru, &entry->link);
+
+  entry->used = g_get_real_time () / G_USEC_PER_SEC;
+  entry->dirty = TRUE;
+
+  if (art_persist_id == 0)
+    art_persist_id = g_timeout_add_seconds (ART_PERSIST_DELAY,
+                                            art_cache_persist,
+                                            NULL);
+}
+
+static ArtEntry *
+art_cache_insert (const char *name,
+                  goffset     size)
+{
+  ArtEntry *entry;
+
+  if ((entry = g_hash_table_lookup (art_entries, name)) != NULL)
+    {
+      art_size += size - entry->size;
+      entry->size = size;
+      art_cache_touch (entry);
+      return entry;
+    }
+
+  entry = g_new0 (ArtEntry, 1);
+  entry->link.data = entry;
+  entry->name = g_strdup (name);
+  entry->size = size;
+  entry->used = g_get_real_time () / G_USEC_PER_SEC;
+
+  g_hash_table_insert (art_entries, entry->name, entry);
+  g_queue_push_head_link (&art_lru, &entry->link);
+  art_size += size;
+
+  return entry;
+}
+
+static gboolean
+art_url_matches (gpointer key,
+                 gpointer value,
+                 gpointer user_data)
+{
+  return g_str_equal (value, user_data);
+}
+
+static void
+art_cache_save_index (void)
+{
+  g_autoptr (GKeyFile) index = NULL;
+  g_autoptr (GFile) file = NULL;
+  g_autofree char *path = NULL;
+  g_autoptr (GError) error = NULL;
+  GHashTableIter iter;
+  const char *key, *name;
+
+  index = g_key_file_new ();
+
+  g_hash_table_iter_init (&iter, art_urls);
+  while (g_hash_table_iter_next (&iter, (void **)&key, (void **)&name))
+    g_key_file_set_string (index, "urls", key, name);
+
+  file = g_file_get_child (art_dir, "index");
+  path = g_file_get_path (file);
+
+  if (!g_key_file_save_to_file (index, path, &error))
+    g_debug ("%s(): %s", G_STRFUNC, error->message);
+}
+
+/*
+ * Evict entries in least-recently-used order, until the cache is within its
+ * limits. The most recently used entry and pinned entries are never evicted.
+ */
+static gboolean
+art_cache_evict (void)
+{
+  GList *link = art_lru.tail;
+  gboolean changed = FALSE;
+
+  while (link != NULL && link != art_lru.head &&
+         (art_lru.length > ART_CACHE_MAX_ITEMS || art_size > ART_CACHE_MAX_SIZE))
+    {
+      ArtEntry *entry = link->data;
+      g_autoptr (GFile) file = NULL;
+
+      link = link->prev;
+
+      if (entry->pins > 0)
+        continue;
+
+      VALENT_NOTE ("evicting %s", entry->name);
+
+      file = g_file_get_child (art_dir, entry->name);
+      g_file_delete (file, NULL, NULL);
+
+      g_hash_table_foreach_remove (art_urls, art_url_matches, entry->name);
+      g_queue_unlink (&art_lru, &entry->link);
+      art_size -= entry->size;
+      g_hash_table_remove (art_entries, entry->name);
+      changed = TRUE;
+    }
+
+  return changed;
+}
+
+/*
+ * Album art used to be stored in the cache of each device, named by the MD5 of
+ * its URL. Those files are no longer used, so remove them.
+ */
+static gboolean
+art_is_legacy_name (const char *name)
+{
+  unsigned int i;
+
+  for (i = 0; name[i] != '\0'; i++)
+    {
+      if (!g_ascii_isxdigit (name[i]) || g_ascii_isupper (name[i]))
+        return FALSE;
+    }
+
+  return i == 32;
+}
+
+static void
+art_cache_purge_legacy (void)
+{
+  g_autoptr (ValentContext) context = NULL;
+  g_autoptr (GFile) devices = NULL;
+  g_autoptr (GFileEnumerator) iter = NULL;
+  GFileInfo *info;
+  GFile *dir;
+
+  context = valent_context_new (NULL, NULL, NULL);
+  devices = valent_context_get_cache_file (context, "device");
+  iter = g_file_enumerate_children (devices,
+                                    G_FILE_ATTRIBUTE_STANDARD_NAME","
+                                    G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                    G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                    NULL,
+                                    NULL);
+
+  while (iter != NULL &&
+         g_file_enumerator_iterate (iter, &info, &dir, NULL, NULL) &&
+         info != NULL)
+    {
+      g_autoptr (GFileEnumerator) files = NULL;
+      GFileInfo *file_info;
+      GFile *file;
+
+      if (g_file_info_get_file_type (info) != G_FILE_TYPE_DIRECTORY)
+        continue;
+
+      files = g_file_enumerate_children (dir,
+                                         G_FILE_ATTRIBUTE_STANDARD_NAME","
+                                         G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                         G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                         NULL,
+                                         NULL);
+
+      while (files != NULL &&
+             g_file_enumerator_iterate (files, &file_info, &file, NULL, NULL) &&
+             file_info != NULL)
+        {
+          if (g_file_info_get_file_type (file_info) == G_FILE_TYPE_REGULAR &&
+              art_is_legacy_name (g_file_info_get_name (file_info)))
+            g_file_delete (file, NULL, NULL);
+        }
+    }
+}
+
+static void
+art_cache_load (void)
+{
+  g_autoptr (ValentContext) context = NULL;
+  g_autoptr (GFileEnumerator) iter = NULL;
+  g_autoptr (GPtrArray) infos = NULL;
+  g_autoptr (GKeyFile) index = NULL;
+  g_autoptr (GFile) index_file = NULL;
+  g_autofree char *index_path = NULL;
+  g_auto (GStrv) keys = NULL;
+  GFileInfo *info;
+  g_autoptr (GError) error = NULL;
+
+  if (art_dir != NULL)
+    return;
+
+  art_cache_purge_legacy ();
+
+  art_entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                       NULL, art_entry_free);
+  art_urls = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  context = valent_context_new (NULL, "plugin", "mpris");
+  art_dir = valent_context_get_cache_file (context, "art");
+
+  if (!g_file_make_directory_with_parents (art_dir, NULL, &error) &&
+      !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+    {
+      g_warning ("%s(): %s", G_STRFUNC, error->message);
+      g_atomic_int_set (&art_loaded, TRUE);
+      return;
+    }
+  g_clear_error (&error);
+
+  /* Restore the entries, most recently used first */
+  iter = g_file_enumerate_children (art_dir,
+                                    G_FILE_ATTRIBUTE_STANDARD_NAME","
+                                    G_FILE_ATTRIBUTE_STANDARD_SIZE","
+                                    G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                                    G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                    NULL,
+                                    &error);
+
+  if (iter == NULL)
+    {
+      g_warning ("%s(): %s", G_STRFUNC, error->message);
+      g_atomic_int_set (&art_loaded, TRUE);
+      return;
+    }
+
+  infos = g_ptr_array_new_with_free_func (g_object_unref);
+
+  while ((info = g_file_enumerator_next_file (iter, NULL, NULL)) != NULL)
+    {
+      const char *name = g_file_info_get_name (info);
+
+      /* Incomplete downloads from a previous session */
+      if (g_str_has_prefix (name, "."))
+        {
+          g_autoptr (GFile) file = g_file_get_child (art_dir, name);
+
+          g_file_delete (file, NULL, NULL);
+          g_object_unref (info);
+          continue;
+        }
+
+      if (g_str_equal (name, "index"))
+        {
+          g_object_unref (info);
+          continue;
+        }
+
+      g_ptr_array_add (infos, info);
+    }
+
+  g_ptr_array_sort (infos, art_info_compare);
+
+  for (unsigned int i = infos->len; i > 0; i--)
+    {
+      info = g_ptr_array_index (infos, i - 1);
+      art_cache_insert (g_file_info_get_name (info),
+                        g_file_info_get_size (info));
+    }
+
+  /* Restore the URL index, dropping references to missing entries */
+  index = g_key_file_new ();
+  index_file = g_file_get_child (art_dir, "index");
+  index_path = g_file_get_path (index_file);
+
+  if (g_key_file_load_from_file (index, index_path, G_KEY_FILE_NONE, NULL))
+    keys = g_key_file_get_keys (index, "urls", NULL, NULL);
+
+  for (unsigned int i = 0; keys != NULL && keys[i] != NULL; i++)
+    {
+      g_autofree char *name = NULL;
+
+      name = g_key_file_get_string (index, "urls", keys[i], NULL);
+
+      if (name != NULL && g_hash_table_contains (art_entries, name))
+        g_hash_table_replace (art_urls, g_strdup (keys[i]), g_steal_pointer (&name));
+    }
+
+  if (art_cache_evict ())
+    art_cache_save_index ();
+
+  g_atomic_int_set (&art_loaded, TRUE);
+}
+
+static void
+art_cache_load_task (GTask        *task,
+                     gpointer      source_object,
+                     gpointer      task_data,
+                     GCancellable *cancellable)
+{
+  g_mutex_lock (&art_lock);
+  art_cache_load ();
+  g_mutex_unlock (&art_lock);
+
+  g_task_return_boolean (task, TRUE);
+}
+
+/**
+ * valent_mpris_art_cache_load:
+ *
+ * Start loading the album art cache in a thread, if it is not already loaded.
+ *
+ * Until the cache is loaded, valent_mpris_art_cache_lookup() will return %NULL.
+ */
+void
+valent_mpris_art_cache_load (void)
+{
+  g_autoptr (GTask) task = NULL;
+
+  if (g_atomic_int_get (&art_loaded) ||
+      !g_atomic_int_compare_and_exchange (&art_loading, FALSE, TRUE))
+    return;
+
+  task = g_task_new (NULL, NULL, NULL, NULL);
+  g_task_set_source_tag (task, valent_mpris_art_cache_load);
+  g_task_run_in_thread (task, art_cache_load_task);
+}
+
+/**
+ * valent_mpris_art_cache_lookup:
+ * @url: a remote album art URL
+ *
+ * Get the cached album art for @url.
+ *
+ * This never blocks on I/O. If the cache has not been loaded yet, loading is
+ * started in a thread and %NULL is returned.
+ *
+ * Returns: (transfer full) (nullable): a #GFile, or %NULL if not cached
+ */
+GFile *
+valent_mpris_art_cache_lookup (const char *url)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  g_autofree char *key = NULL;
+  const char *name;
+  ArtEntry *entry;
+
+  g_return_val_if_fail (url != NULL && *url != '\0', NULL);
+
+  if (!g_atomic_int_get (&art_loaded))
+    {
+      valent_mpris_art_cache_load ();
+      return NULL;
+    }
+
+  locker = g_mutex_locker_new (&art_lock);
+
+  if (art_entries == NULL)
+    return NULL;
+
+  key = g_compute_checksum_for_string (G_CHECKSUM_MD5, url, -1);
+
+  if ((name = g_hash_table_lookup (art_urls, key)) == NULL ||
+      (entry = g_hash_table_lookup (art_entries, name)) == NULL)
+    return NULL;
+
+  art_cache_touch (entry);
+
+  return g_file_get_child (art_dir, entry->name);
+}
+
+/**
+ * valent_mpris_art_cache_create_download:
+ *
+ * Create a temporary file in the cache directory, to download album art to.
+ *
+ * The file should be passed to valent_mpris_art_cache_add() when the download
+ * completes, or deleted if it fails.
+ *
+ * Returns: (transfer full): a #GFile
+ */
+GFile *
+valent_mpris_art_cache_create_download (void)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  g_autofree char *uuid = NULL;
+  g_autofree char *name = NULL;
+
+  locker = g_mutex_locker_new (&art_lock);
+  art_cache_load ();
+
+  uuid = g_uuid_string_random ();
+  name = g_strdup_printf (".download-%s", uuid);
+
+  return g_file_get_child (art_dir, name);
+}
+
+/**
+ * valent_mpris_art_cache_add:
+ * @url: a remote album art URL
+ * @download: a completed download
+ * @error: (nullable): a #GError
+ *
+ * Add @download to the cache as the album art for @url.
+ *
+ * If the content of @download is already cached, @download is deleted and the
+ * existing entry is used.
+ *
+ * Returns: (transfer full) (nullable): a #GFile, or %NULL with @error set
+ */
+GFile *
+valent_mpris_art_cache_add (const char  *url,
+                            GFile       *download,
+                            GError     **error)
+{
+  g_autoptr (GMutexLocker) locker = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  g_autoptr (GFile) file = NULL;
+  g_autofree char *name = NULL;
+
+  g_return_val_if_fail (url != NULL && *url != '\0', NULL);
+  g_return_val_if_fail (G_IS_FILE (download), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  if ((bytes = g_file_load_bytes (download, NULL, NULL, error)) == NULL)
+    return NULL;
+
+  name = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, bytes);
+
+  locker = g_mutex_locker_new (&art_lock);
+  art_cache_load ();
+
+  file = g_file_get_child (art_dir, name);
+
+  if (g_hash_table_contains (art_entries, name))
+    {
+      g_file_delete (download, NULL, NULL);
+    }
+  else if (!g_file_move (download, file, G_FILE_COPY_OVERWRITE,
+                         NULL, NULL, NULL, error))
+    {
+      g_file_delete (download, NULL, NULL);
+      return NULL;
+    }
+
+  art_cache_insert (name, g_bytes_get_size (bytes));
+  g_hash_table_replace (art_urls,
+                        g_compute_checksum_for_string (G_CHECKSUM_MD5, url, -1),
+                        g_strdup (name));
+
+  art_cache_evict ();
+  art_cache_save_index ();
+
+  return g_steal_pointer (&file);
+}
+
+/*
+ * Release a file returned by valent_mpris_art_cache_prepare_upload(), unpinning
+ * it if it's a cache entry.
+ */
+static void
+art_cache_unpin (gpointer data)
+{
+  g_autoptr (GFile) file = G_FILE (data);
+  g_autoptr (GFile) parent = NULL;
+  g_autofree char *name = NULL;
+  ArtEntry *entry;
+
+  g_mutex_lock (&art_lock);
+  if (art_dir != NULL &&
+      (parent = g_file_get_parent (file)) != NULL &&
+      g_file_equal (parent, art_dir))
+    {
+      name = g_file_get_basename (file);
+
+      if ((entry = g_hash_table_lookup (art_entries, name)) != NULL &&
+          entry->pins > 0)
+        entry->pins--;
+    }
+  g_mutex_unlock (&art_lock);
+}
+
+static void
+on_size_prepared (GdkPixbufLoader *loader,
+                  int              width,
+                  int              height,
+                  gboolean        *scaled)
+{
+  double scale;
+
+  if (width <= ART_UPLOAD_SIZE && height <= ART_UPLOAD_SIZE)
+    return;
+
+  scale = (double)ART_UPLOAD_SIZE / MAX (width, height);
+  gdk_pixbuf_loader_set_size (loader,
+                              MAX (1, (int)(width * scale)),
+                              MAX (1, (int)(height * scale)));
+  *scaled = TRUE;
+}
+
+static void
+prepare_upload_task (GTask        *task,
+                     gpointer      source_object,
+                     gpointer      task_data,
+                     GCancellable *cancellable)
+{
+  GFile *source = G_FILE (task_data);
+  g_autoptr (GBytes) bytes = NULL;
+  g_autoptr (GdkPixbufLoader) loader = NULL;
+  g_autoptr (GFile) file = NULL;
+  g_autofree char *hash = NULL;
+  g_autofree char *name = NULL;
+  g_autofree char *buffer = NULL;
+  GdkPixbuf *pixbuf;
+  ArtEntry *entry = NULL;
+  gboolean scaled = FALSE;
+  size_t buffer_size;
+  GError *error = NULL;
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  if ((bytes = g_file_load_bytes (source, cancellable, NULL, &error)) == NULL)
+    return g_task_return_error (task, error);
+
+  hash = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, bytes);
+  name = g_strdup_printf ("%s@%d", hash, ART_UPLOAD_SIZE);
+
+  /* Check for a previously scaled copy, pinning it until it's released */
+  g_mutex_lock (&art_lock);
+  art_cache_load ();
+
+  if ((entry = g_hash_table_lookup (art_entries, name)) != NULL)
+    {
+      art_cache_touch (entry);
+      entry->pins++;
+      file = g_file_get_child (art_dir, name);
+    }
+  g_mutex_unlock (&art_lock);
+
+  if (file != NULL)
+    return g_task_return_pointer (task, g_steal_pointer (&file), art_cache_unpin);
+
+  /* Images that are already small enough, or can not be loaded, are uploaded
+   * as they are */
+  loader = gdk_pixbuf_loader_new ();
+  g_signal_connect (loader,
+                    "size-prepared",
+                    G_CALLBACK (on_size_prepared),
+                    &scaled);
+
+  if (!gdk_pixbuf_loader_write_bytes (loader, bytes, &error))
+    gdk_pixbuf_loader_close (loader, NULL);
+  else
+    gdk_pixbuf_loader_close (loader, &error);
+
+  if (error != NULL)
+    {
+      g_debug ("%s(): %s", G_STRFUNC, error->message);
+      g_clear_error (&error);
+      scaled = FALSE;
+    }
+
+  if (!scaled || (pixbuf = gdk_pixbuf_loader_get_pixbuf (loader)) == NULL)
+    return g_task_return_pointer (task, g_object_ref (source), g_object_unref);
+
+  if (gdk_pixbuf_get_has_alpha (pixbuf))
+    {
+      gdk_pixbuf_save_to_buffer (pixbuf, &buffer, &buffer_size, "png", &error,
+                                 NULL);
+    }
+  else
+    {
+      gdk_pixbuf_save_to_buffer (pixbuf, &buffer, &buffer_size, "jpeg", &error,
+                                 "quality", "90",
+                                 NULL);
+    }
+
+  if (error != NULL)
+    {
+      g_debug ("%s(): %s", G_STRFUNC, error->message);
+      g_clear_error (&error);
+      return g_task_return_pointer (task, g_object_ref (source), g_object_unref);
+    }
+
+  g_mutex_lock (&art_lock);
+  file = g_file_get_child (art_dir, name);
+
+  if (g_file_replace_contents (file, buffer, buffer_size,
+                               NULL, FALSE, G_FILE_CREATE_NONE, NULL,
+                               cancellable, &error))
+    {
+      entry = art_cache_insert (name, buffer_size);
+      entry->pins++;
+      art_cache_evict ();
+    }
+  g_mutex_unlock (&art_lock);
+
+  if (error != NULL)
+    return g_task_return_error (task, error);
+
+  g_task_return_pointer (task, g_steal_pointer (&file), art_cache_unpin);
+}
+
+/**
+ * valent_mpris_art_cache_prepare_upload:
+ * @file: a local album art file
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: (scope async): a #GAsyncReadyCallback
+ * @user_data: user supplied data
+ *
+ * Prepare @file to be uploaded as album art.
+ *
+ * Images larger than the size the remote device will display are downscaled,
+ * and the result is cached so repeated requests are not encoded again.
+ *
+ * Call valent_mpris_art_cache_prepare_upload_finish() to get the result.
+ */
+void
+valent_mpris_art_cache_prepare_upload (GFile               *file,
+                                       GCancellable        *cancellable,
+                                       GAsyncReadyCallback  callback,
+                                       gpointer             user_data)
+{
+  g_autoptr (GTask) task = NULL;
+
+  g_return_if_fail (G_IS_FILE (file));
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_source_tag (task, valent_mpris_art_cache_prepare_upload);
+  g_task_set_task_data (task, g_object_ref (file), g_object_unref);
+  g_task_run_in_thread (task, prepare_upload_task);
+}
+
+/**
+ * valent_mpris_art_cache_prepare_upload_finish:
+ * @result: a #GAsyncResult
+ * @error: (nullable): a #GError
+ *
+ * Finish an operation started by valent_mpris_art_cache_prepare_upload().
+ *
+ * If the result is a cache entry, it will not be evicted until it is passed to
+ * valent_mpris_art_cache_release(), which should be called when the upload
+ * completes.
+ *
+ * Returns: (transfer full) (nullable): the #GFile to upload
+ */
+GFile *
+valent_mpris_art_cache_prepare_upload_finish (GAsyncResult  *result,
+                                              GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/**
+ * valent_mpris_art_cache_release:
+ * @file: (transfer full): a #GFile
+ *
+ * Release @file, returned by valent_mpris_art_cache_prepare_upload_finish().
+ */
+void
+valent_mpris_art_cache_release (GFile *file)
+{
+  g_return_if_fail (G_IS_FILE (file));
+
+  art_cache_unpin (file);
+}
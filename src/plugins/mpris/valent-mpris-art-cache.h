@@ -0,0 +1,24 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include <valent.h>
+
+G_BEGIN_DECLS
+
+void    valent_mpris_art_cache_load                  (void);
+GFile * valent_mpris_art_cache_lookup                (const char           *url);
+GFile * valent_mpris_art_cache_create_download       (void);
+GFile * valent_mpris_art_cache_add                   (const char           *url,
+                                                      GFile                *download,
+                                                      GError              **error);
+void    valent_mpris_art_cache_prepare_upload        (GFile                *file,
+                                                      GCancellable         *cancellable,
+                                                      GAsyncReadyCallback   callback,
+                                                      gpointer              user_data);
+GFile * valent_mpris_art_cache_prepare_upload_finish (GAsyncResult         *result,
+                                                      GError              **error);
+void    valent_mpris_art_cache_release               (GFile                *file);
+
+G_END_DECLS
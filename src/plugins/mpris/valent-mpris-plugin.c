@@ -12,10 +12,15 @@
 #include <json-glib/json-glib.h>
 #include <valent.h>
 
+#include "valent-mpris-art-cache.h"
 #include "valent-mpris-device.h"
 #include "valent-mpris-plugin.h"
 #include "valent-mpris-utils.h"
 
+/* Position changes within this many seconds of where the remote device would
+ * extrapolate the position to, are not sent */
+#define POSITION_TOLERANCE 0.5
+
 
 struct _ValentMprisPlugin
 {
@@ -28,16 +33,21 @@ struct _ValentMprisPlugin
   GHashTable         *transfers;
 
   GHashTable         *pending;
+  GHashTable         *states;
   unsigned int        flush_id;
 };
 
 G_DEFINE_FINAL_TYPE (ValentMprisPlugin, valent_mpris_plugin, VALENT_TYPE_DEVICE_PLUGIN)
 
-static void valent_mpris_plugin_send_player_info    (ValentMprisPlugin *self,
-                                                     ValentMediaPlayer *player,
-                                                     gboolean           now_playing,
-                                                     gboolean           volume);
-static void valent_mpris_plugin_send_player_list    (ValentMprisPlugin *self);
+static JsonNode * valent_mpris_plugin_build_player_info (ValentMprisPlugin *self,
+                                                         ValentMediaPlayer *player,
+                                                         gboolean           now_playing,
+                                                         gboolean           volume);
+static void       valent_mpris_plugin_send_player_info  (ValentMprisPlugin *self,
+                                                         ValentMediaPlayer *player,
+                                                         gboolean           now_playing,
+                                                         gboolean           volume);
+static void       valent_mpris_plugin_send_player_list  (ValentMprisPlugin *self);
 
 
 static gpointer
@@ -71,16 +81,95 @@ send_album_art_cb (ValentTransfer    *transfer,
                    GAsyncResult      *result,
                    ValentMprisPlugin *self)
 {
+  g_autoptr (JsonNode) packet = NULL;
+  g_autoptr (GFile) file = NULL;
   g_autoptr (GError) error = NULL;
-  g_autofree char *id = NULL;
+  const char *url;
 
   g_assert (VALENT_IS_TRANSFER (transfer));
 
   if (!valent_transfer_execute_finish (transfer, result, &error))
     g_debug ("Failed to upload album art: %s", error->message);
 
-  id = valent_transfer_dup_id (transfer);
-  g_hash_table_remove (self->transfers, id);
+  g_object_get (transfer,
+                "file",   &file,
+                "packet", &packet,
+                NULL);
+  valent_mpris_art_cache_release (g_steal_pointer (&file));
+
+  if (valent_packet_get_string (packet, "albumArtUrl", &url))
+    g_hash_table_remove (self->transfers, url);
+}
+
+typedef struct
+{
+  ValentMprisPlugin *self;
+  char              *player;
+  char              *url;
+} AlbumArtUpload;
+
+static void
+album_art_upload_free (gpointer data)
+{
+  AlbumArtUpload *upload = data;
+
+  g_clear_object (&upload->self);
+  g_clear_pointer (&upload->player, g_free);
+  g_clear_pointer (&upload->url, g_free);
+  g_free (upload);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (AlbumArtUpload, album_art_upload_free)
+
+static void
+valent_mpris_art_cache_prepare_upload_cb (GObject      *object,
+                                          GAsyncResult *result,
+                                          gpointer      user_data)
+{
+  g_autoptr (AlbumArtUpload) upload = user_data;
+  ValentMprisPlugin *self = upload->self;
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) packet = NULL;
+  g_autoptr (ValentTransfer) transfer = NULL;
+  ValentDevice *device;
+  g_autoptr (GError) error = NULL;
+
+  file = valent_mpris_art_cache_prepare_upload_finish (result, &error);
+
+  if (file == NULL)
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+          g_debug ("Failed to prepare album art: %s", error->message);
+          g_hash_table_remove (self->transfers, upload->url);
+        }
+
+      return;
+    }
+
+  /* Build the payload packet */
+  valent_packet_init (&builder, "kdeconnect.mpris");
+  json_builder_set_member_name (builder, "player");
+  json_builder_add_string_value (builder, upload->player);
+  json_builder_set_member_name (builder, "albumArtUrl");
+  json_builder_add_string_value (builder, upload->url);
+  json_builder_set_member_name (builder, "transferringAlbumArt");
+  json_builder_add_boolean_value (builder, TRUE);
+  packet = valent_packet_end (&builder);
+
+  /* Start the transfer */
+  device = valent_extension_get_object (VALENT_EXTENSION (self));
+  transfer = valent_device_transfer_new (device, packet, file);
+
+  g_hash_table_replace (self->transfers,
+                        g_strdup (upload->url),
+                        g_object_ref (transfer));
+
+  valent_transfer_execute (transfer,
+                           NULL,
+                           (GAsyncReadyCallback)send_album_art_cb,
+                           self);
 }
 
 static void
@@ -92,10 +181,8 @@ valent_mpris_plugin_send_album_art (ValentMprisPlugin *self,
   const char *real_uri;
   g_autoptr (GFile) real_file = NULL;
   g_autoptr (GFile) requested_file = NULL;
-  g_autoptr (JsonBuilder) builder = NULL;
-  g_autoptr (JsonNode) packet = NULL;
-  g_autoptr (ValentTransfer) transfer = NULL;
-  ValentDevice *device;
+  g_autoptr (GCancellable) cancellable = NULL;
+  AlbumArtUpload *upload;
 
   g_assert (VALENT_IS_MPRIS_PLUGIN (self));
 
@@ -123,28 +210,204 @@ valent_mpris_plugin_send_album_art (ValentMprisPlugin *self,
       return;
     }
 
-  /* Build the payload packet */
-  valent_packet_init (&builder, "kdeconnect.mpris");
-  json_builder_set_member_name (builder, "player");
-  json_builder_add_string_value (builder, valent_media_player_get_name (player));
-  json_builder_set_member_name (builder, "albumArtUrl");
-  json_builder_add_string_value (builder, requested_uri);
-  json_builder_set_member_name (builder, "transferringAlbumArt");
-  json_builder_add_boolean_value (builder, TRUE);
-  packet = valent_packet_end (&builder);
-
-  /* Start the transfer */
-  device = valent_extension_get_object (VALENT_EXTENSION (self));
-  transfer = valent_device_transfer_new (device, packet, real_file);
-
+  /* The image is downscaled and cached in a thread; until the transfer starts,
+   * the request is tracked by its cancellable */
+  cancellable = valent_object_ref_cancellable (VALENT_OBJECT (self));
   g_hash_table_insert (self->transfers,
                        g_strdup (requested_uri),
-                       g_object_ref (transfer));
+                       g_object_ref (cancellable));
 
-  valent_transfer_execute (transfer,
-                           NULL,
-                           (GAsyncReadyCallback)send_album_art_cb,
-                           self);
+  upload = g_new0 (AlbumArtUpload, 1);
+  upload->self = g_object_ref (self);
+  upload->player = g_strdup (valent_media_player_get_name (player));
+  upload->url = g_strdup (requested_uri);
+
+  valent_mpris_art_cache_prepare_upload (real_file,
+                                         cancellable,
+                                         valent_mpris_art_cache_prepare_upload_cb,
+                                         upload);
+}
+
+/*
+ * Player State
+ *
+ * The last state sent to the remote device is tracked for each player, so that
+ * updates only include the fields that changed. Most fields are compared on
+ * their own, but the flags are compared as a group since they must be sent
+ * together to be interpreted correctly (e.g. omitting `canPlay` from a group of
+ * flags implies %FALSE).
+ */
+typedef struct
+{
+  JsonObject *sent;
+  double      position;
+  int64_t     position_time;
+  gboolean    is_playing;
+} PlayerState;
+
+static const char * const player_info_groups[][6] = {
+  {"canPause", "canPlay", "canGoNext", "canGoPrevious", "canSeek", NULL},
+  {"artist", NULL},
+  {"title", NULL},
+  {"album", NULL},
+  {"length", NULL},
+  {"albumArtUrl", NULL},
+  {"loopStatus", NULL},
+  {"shuffle", NULL},
+  {"isPlaying", NULL},
+  {"volume", NULL},
+};
+
+static void
+player_state_free (gpointer data)
+{
+  PlayerState *state = data;
+
+  g_clear_pointer (&state->sent, json_object_unref);
+  g_free (state);
+}
+
+static PlayerState *
+valent_mpris_plugin_lookup_state (ValentMprisPlugin *self,
+                                  ValentMediaPlayer *player)
+{
+  PlayerState *state;
+
+  g_assert (VALENT_IS_MPRIS_PLUGIN (self));
+  g_assert (VALENT_IS_MEDIA_PLAYER (player));
+
+  if ((state = g_hash_table_lookup (self->states, player)) == NULL)
+    {
+      state = g_new0 (PlayerState, 1);
+      state->sent = json_object_new ();
+      g_hash_table_insert (self->states, g_object_ref (player), state);
+    }
+
+  return state;
+}
+
+static void
+player_state_update_position (PlayerState *state,
+                              JsonObject  *body)
+{
+  g_assert (state != NULL);
+  g_assert (body != NULL);
+
+  if (json_object_has_member (body, "isPlaying"))
+    state->is_playing = json_object_get_boolean_member (body, "isPlaying");
+
+  if (json_object_has_member (body, "pos"))
+    {
+      /* Convert milliseconds to seconds */
+      state->position = json_object_get_int_member (body, "pos") / 1000.0;
+      state->position_time = g_get_monotonic_time ();
+    }
+}
+
+static gboolean
+player_state_group_changed (PlayerState        *state,
+                            JsonObject         *body,
+                            const char * const *group)
+{
+  for (unsigned int i = 0; group[i] != NULL; i++)
+    {
+      JsonNode *current = json_object_get_member (body, group[i]);
+      JsonNode *sent = json_object_get_member (state->sent, group[i]);
+
+      if (current == NULL && sent == NULL)
+        continue;
+
+      if (current == NULL || sent == NULL || !json_node_equal (current, sent))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+player_state_position_changed (PlayerState *state,
+                               JsonObject  *body)
+{
+  double position, expected;
+
+  if (!json_object_has_member (body, "pos"))
+    return FALSE;
+
+  /* Convert milliseconds to seconds */
+  position = json_object_get_int_member (body, "pos") / 1000.0;
+  expected = state->position;
+
+  if (state->is_playing)
+    expected += (g_get_monotonic_time () - state->position_time) / (double)G_TIME_SPAN_SECOND;
+
+  return fabs (position - expected) > POSITION_TOLERANCE;
+}
+
+static JsonNode *
+valent_mpris_plugin_build_player_delta (ValentMprisPlugin *self,
+                                        ValentMediaPlayer *player)
+{
+  PlayerState *state;
+  g_autoptr (JsonNode) packet = NULL;
+  JsonObject *body;
+  g_autoptr (JsonNode) delta = NULL;
+  JsonObject *delta_body;
+  gboolean changed = FALSE;
+
+  g_assert (VALENT_IS_MPRIS_PLUGIN (self));
+  g_assert (VALENT_IS_MEDIA_PLAYER (player));
+
+  state = valent_mpris_plugin_lookup_state (self, player);
+  packet = valent_mpris_plugin_build_player_info (self, player, TRUE, TRUE);
+  body = valent_packet_get_body (packet);
+
+  delta = valent_packet_new ("kdeconnect.mpris");
+  delta_body = valent_packet_get_body (delta);
+  json_object_set_string_member (delta_body,
+                                 "player",
+                                 json_object_get_string_member (body, "player"));
+
+  for (unsigned int i = 0; i < G_N_ELEMENTS (player_info_groups); i++)
+    {
+      const char * const *group = player_info_groups[i];
+
+      if (!player_state_group_changed (state, body, group))
+        continue;
+
+      for (unsigned int j = 0; group[j] != NULL; j++)
+        {
+          JsonNode *node = json_object_get_member (body, group[j]);
+
+          if (node == NULL)
+            {
+              json_object_remove_member (state->sent, group[j]);
+              continue;
+            }
+
+          json_object_set_member (delta_body, group[j], json_node_copy (node));
+          json_object_set_member (state->sent, group[j], json_node_copy (node));
+        }
+
+      changed = TRUE;
+    }
+
+  /* The position is only sent if it has drifted from where the remote device
+   * would extrapolate it to, or if the playback state changed. */
+  if (json_object_has_member (delta_body, "isPlaying") ||
+      player_state_position_changed (state, body))
+    {
+      json_object_set_member (delta_body,
+                              "pos",
+                              json_object_dup_member (body, "pos"));
+      changed = TRUE;
+    }
+
+  if (!changed)
+    return NULL;
+
+  player_state_update_position (state, delta_body);
+
+  return g_steal_pointer (&delta);
 }
 
 static gboolean
@@ -157,7 +420,13 @@ valent_mpris_plugin_flush (gpointer data)
   g_hash_table_iter_init (&iter, self->pending);
   while (g_hash_table_iter_next (&iter, (void **)&player, NULL))
     {
-      valent_mpris_plugin_send_player_info (self, player, TRUE, TRUE);
+      g_autoptr (JsonNode) packet = NULL;
+
+      packet = valent_mpris_plugin_build_player_delta (self, player);
+
+      if (packet != NULL)
+        valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (self), packet);
+
       g_hash_table_iter_remove (&iter);
     }
 
@@ -167,49 +436,58 @@ valent_mpris_plugin_flush (gpointer data)
 }
 
 static void
-on_player_seeked (ValentMediaPlayer *player,
-                  double             position,
-                  ValentMprisPlugin *self)
+on_player_changed (ValentMediaPlayer *player,
+                   GParamSpec        *pspec,
+                   ValentMprisPlugin *self)
 {
-  const char *name;
-  g_autoptr (JsonBuilder) builder = NULL;
-  g_autoptr (JsonNode) packet = NULL;
-
   g_assert (VALENT_IS_MPRIS_PLUGIN (self));
 
-  name = valent_media_player_get_name (player);
-
-  /* Convert seconds to milliseconds */
-  valent_packet_init (&builder, "kdeconnect.mpris");
-  json_builder_set_member_name (builder, "player");
-  json_builder_add_string_value (builder, name);
-  json_builder_set_member_name (builder, "pos");
-  json_builder_add_int_value (builder, position * 1000L);
-  packet = valent_packet_end (&builder);
+  if (!g_hash_table_contains (self->pending, player))
+    g_hash_table_add (self->pending, g_object_ref (player));
 
-  valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (self), packet);
+  if (self->flush_id == 0)
+    self->flush_id = g_idle_add (valent_mpris_plugin_flush, self);
 }
 
-static void
-on_player_changed (ValentMediaPlayer *player,
-                   GParamSpec        *pspec,
-                   ValentMprisPlugin *self)
+static gboolean
+_valent_media_has_player (ValentMedia       *media,
+                          ValentMediaPlayer *player)
 {
-  g_assert (VALENT_IS_MPRIS_PLUGIN (self));
+  unsigned int n_players = 0;
+
+  g_assert (VALENT_IS_MEDIA (media));
+  g_assert (VALENT_IS_MEDIA_PLAYER (player));
+
+  n_players = g_list_model_get_n_items (G_LIST_MODEL (media));
 
-  if (g_str_equal (pspec->name, "position"))
+  for (unsigned int i = 0; i < n_players; i++)
     {
-      double position = 0.0;
+      g_autoptr (ValentMediaPlayer) item = g_list_model_get_item (G_LIST_MODEL (media), i);
 
-      position = valent_media_player_get_position (player);
-      on_player_seeked (player, position, self);
+      if (item == player)
+        return TRUE;
     }
-  else
+
+  return FALSE;
+}
+
+static void
+valent_mpris_plugin_forget_removed (ValentMprisPlugin *self,
+                                    GHashTable        *table)
+{
+  GHashTableIter iter;
+  ValentMediaPlayer *player;
+
+  g_assert (VALENT_IS_MPRIS_PLUGIN (self));
+
+  g_hash_table_iter_init (&iter, table);
+  while (g_hash_table_iter_next (&iter, (void **)&player, NULL))
     {
-      g_hash_table_add (self->pending, player);
+      if (_valent_media_has_player (self->media, player))
+        continue;
 
-      if (self->flush_id == 0)
-        self->flush_id = g_idle_add (valent_mpris_plugin_flush, self);
+      g_signal_handlers_disconnect_by_data (player, self);
+      g_hash_table_iter_remove (&iter);
     }
 }
 
@@ -222,10 +500,13 @@ on_players_changed (ValentMedia       *media,
 {
   gboolean changed = FALSE;
 
+  /* Only forget the state of the players that were removed, so the others
+   * don't have to be sent in full again */
   if (removed > 0)
     {
       changed = TRUE;
-      g_hash_table_remove_all (self->pending);
+      valent_mpris_plugin_forget_removed (self, self->pending);
+      valent_mpris_plugin_forget_removed (self, self->states);
     }
 
   for (unsigned int i = 0; i < added; i++)
@@ -358,15 +639,14 @@ valent_mpris_plugin_handle_mpris_request (ValentMprisPlugin *self,
     valent_mpris_plugin_send_album_art (self, player, url);
 }
 
-static void
-valent_mpris_plugin_send_player_info (ValentMprisPlugin *self,
-                                      ValentMediaPlayer *player,
-                                      gboolean           request_now_playing,
-                                      gboolean           request_volume)
+static JsonNode *
+valent_mpris_plugin_build_player_info (ValentMprisPlugin *self,
+                                       ValentMediaPlayer *player,
+                                       gboolean           request_now_playing,
+                                       gboolean           request_volume)
 {
   const char *name;
   g_autoptr (JsonBuilder) builder = NULL;
-  g_autoptr (JsonNode) response = NULL;
 
   g_assert (VALENT_IS_MPRIS_PLUGIN (self));
   g_assert (VALENT_IS_MEDIA_PLAYER (player));
@@ -390,6 +670,9 @@ valent_mpris_plugin_send_player_info (ValentMprisPlugin *self,
       g_autoptr (GVariant) metadata = NULL;
       g_autofree char *artist = NULL;
       const char *title = NULL;
+      const char *album = NULL;
+      const char *art_url = NULL;
+      int64_t length_us = 0;
 
       /* Player State */
       flags = valent_media_player_get_flags (player);
@@ -425,49 +708,37 @@ valent_mpris_plugin_send_player_info (ValentMprisPlugin *self,
       /* Track Metadata
        *
        * See: https://www.freedesktop.org/wiki/Specifications/mpris-spec/metadata/
+       *
+       * Missing fields are sent as empty values, so that a remote device
+       * receiving partial updates can clear them.
        */
       if ((metadata = valent_media_player_get_metadata (player)) != NULL)
         {
           g_autofree const char **artists = NULL;
-          int64_t length_us;
-          const char *art_url;
-          const char *album;
 
           if (g_variant_lookup (metadata, "xesam:artist", "^a&s", &artists) &&
               artists[0] != NULL && *artists[0] != '\0')
-            {
-              artist = g_strjoinv (", ", (char **)artists);
-              json_builder_set_member_name (builder, "artist");
-              json_builder_add_string_value (builder, artist);
-            }
+            artist = g_strjoinv (", ", (char **)artists);
 
-          if (g_variant_lookup (metadata, "xesam:title", "&s", &title) &&
-              *title != '\0')
-            {
-              json_builder_set_member_name (builder, "title");
-              json_builder_add_string_value (builder, title);
-            }
+          g_variant_lookup (metadata, "xesam:title", "&s", &title);
+          g_variant_lookup (metadata, "xesam:album", "&s", &album);
+          g_variant_lookup (metadata, "mpris:length", "x", &length_us);
+          g_variant_lookup (metadata, "mpris:artUrl", "&s", &art_url);
+        }
 
-          if (g_variant_lookup (metadata, "xesam:album", "&s", &album) &&
-              *album != '\0')
-            {
-              json_builder_set_member_name (builder, "album");
-              json_builder_add_string_value (builder, album);
-            }
+      json_builder_set_member_name (builder, "artist");
+      json_builder_add_string_value (builder, artist ? artist : "");
+      json_builder_set_member_name (builder, "title");
+      json_builder_add_string_value (builder, title ? title : "");
+      json_builder_set_member_name (builder, "album");
+      json_builder_add_string_value (builder, album ? album : "");
 
-          /* Convert microseconds to milliseconds */
-          if (g_variant_lookup (metadata, "mpris:length", "x", &length_us))
-            {
-              json_builder_set_member_name (builder, "length");
-              json_builder_add_int_value (builder, length_us / 1000L);
-            }
+      /* Convert microseconds to milliseconds */
+      json_builder_set_member_name (builder, "length");
+      json_builder_add_int_value (builder, length_us / 1000L);
 
-          if (g_variant_lookup (metadata, "mpris:artUrl", "&s", &art_url))
-            {
-              json_builder_set_member_name (builder, "albumArtUrl");
-              json_builder_add_string_value (builder, art_url);
-            }
-        }
+      json_builder_set_member_name (builder, "albumArtUrl");
+      json_builder_add_string_value (builder, art_url ? art_url : "");
     }
 
   /* Volume Level */
@@ -480,8 +751,40 @@ valent_mpris_plugin_send_player_info (ValentMprisPlugin *self,
       json_builder_add_int_value (builder, level);
     }
 
-  /* Send Response */
-  response = valent_packet_end (&builder);
+  return valent_packet_end (&builder);
+}
+
+static void
+valent_mpris_plugin_send_player_info (ValentMprisPlugin *self,
+                                      ValentMediaPlayer *player,
+                                      gboolean           request_now_playing,
+                                      gboolean           request_volume)
+{
+  g_autoptr (JsonNode) response = NULL;
+  PlayerState *state = NULL;
+  JsonObject *body;
+  JsonObjectIter iter;
+  const char *member;
+  JsonNode *node;
+
+  g_assert (VALENT_IS_MPRIS_PLUGIN (self));
+  g_assert (VALENT_IS_MEDIA_PLAYER (player));
+
+  response = valent_mpris_plugin_build_player_info (self,
+                                                    player,
+                                                    request_now_playing,
+                                                    request_volume);
+
+  /* Requested fields are always sent, but still update the remote state */
+  state = valent_mpris_plugin_lookup_state (self, player);
+  body = valent_packet_get_body (response);
+
+  json_object_iter_init (&iter, body);
+  while (json_object_iter_next (&iter, &member, &node))
+    json_object_set_member (state->sent, member, json_node_copy (node));
+
+  player_state_update_position (state, body);
+
   valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (self), response);
 }
 
@@ -576,6 +879,8 @@ valent_mpris_plugin_watch_media (ValentMprisPlugin *self,
         }
 
       g_clear_handle_id (&self->flush_id, g_source_remove);
+      g_hash_table_remove_all (self->pending);
+      g_hash_table_remove_all (self->states);
       g_signal_handlers_disconnect_by_data (self->media, self);
       self->media_watch = FALSE;
     }
@@ -632,23 +937,35 @@ receive_art_cb (ValentTransfer    *transfer,
                 ValentMprisPlugin *self)
 {
   g_autoptr (JsonNode) packet = NULL;
+  g_autoptr (GFile) download = NULL;
   g_autoptr (GFile) file = NULL;
   g_autoptr (GError) error = NULL;
   ValentMediaPlayer *player = NULL;
   const char *name;
+  const char *url;
+
+  g_object_get (transfer,
+                "file",   &download,
+                "packet", &packet,
+                NULL);
 
   if (!valent_transfer_execute_finish (transfer, result, &error))
     {
       if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
         g_warning ("%s(): %s", G_STRFUNC, error->message);
 
+      g_file_delete (download, NULL, NULL);
       return;
     }
 
-  g_object_get (transfer,
-                "file",   &file,
-                "packet", &packet,
-                NULL);
+  valent_packet_get_string (packet, "albumArtUrl", &url);
+  file = valent_mpris_art_cache_add (url, download, &error);
+
+  if (file == NULL)
+    {
+      g_warning ("%s(): %s", G_STRFUNC, error->message);
+      return;
+    }
 
   if (valent_packet_get_string (packet, "player", &name) &&
       valent_mpris_plugin_find_player (self, name, &player))
@@ -660,9 +977,7 @@ valent_mpris_plugin_receive_album_art (ValentMprisPlugin *self,
                                        JsonNode          *packet)
 {
   ValentDevice *device;
-  ValentContext *context = NULL;
   const char *url;
-  g_autofree char *filename = NULL;
   g_autoptr (GFile) file = NULL;
   g_autoptr (ValentTransfer) transfer = NULL;
 
@@ -674,9 +989,7 @@ valent_mpris_plugin_receive_album_art (ValentMprisPlugin *self,
     }
 
   device = valent_extension_get_object (VALENT_EXTENSION (self));
-  context = valent_device_get_context (device);
-  filename = g_compute_checksum_for_string (G_CHECKSUM_MD5, url, -1);
-  file = valent_context_get_cache_file (context, filename);
+  file = valent_mpris_art_cache_create_download ();
 
   transfer = valent_device_transfer_new (device, packet, file);
   valent_transfer_execute (transfer,
@@ -878,6 +1191,9 @@ valent_mpris_plugin_constructed (GObject *object)
 
   self->media = valent_media_get_default ();
 
+  /* Load the album art cache before it's needed */
+  valent_mpris_art_cache_load ();
+
   G_OBJECT_CLASS (valent_mpris_plugin_parent_class)->constructed (object);
 }
 
@@ -887,6 +1203,7 @@ valent_mpris_plugin_finalize (GObject *object)
   ValentMprisPlugin *self = VALENT_MPRIS_PLUGIN (object);
 
   g_clear_pointer (&self->pending, g_hash_table_unref);
+  g_clear_pointer (&self->states, g_hash_table_unref);
   g_clear_pointer (&self->players, g_ptr_array_unref);
   g_clear_pointer (&self->transfers, g_hash_table_unref);
 
@@ -917,6 +1234,7 @@ valent_mpris_plugin_init (ValentMprisPlugin *self)
                                            g_str_equal,
                                            g_free,
                                            g_object_unref);
-  self->pending = g_hash_table_new (NULL, NULL);
+  self->pending = g_hash_table_new_full (NULL, NULL, g_object_unref, NULL);
+  self->states = g_hash_table_new_full (NULL, NULL, g_object_unref, player_state_free);
 }
 
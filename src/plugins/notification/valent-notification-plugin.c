@@ -11,6 +11,7 @@
 #include <json-glib/json-glib.h>
 #include <valent.h>
 
+#include "valent-device-private.h"
 #include "valent-notification-dialog.h"
 #include "valent-notification-plugin.h"
 #include "valent-notification-upload.h"
@@ -29,6 +30,12 @@ struct _ValentNotificationPlugin
   GHashTable          *cache;
   GHashTable          *dialogs;
   unsigned int         notifications_watch : 1;
+
+  /* Forwarding filter */
+  GHashTable          *forward_deny;
+  GPtrArray           *forward_deny_patterns;
+  unsigned int         forward_notifications : 1;
+  unsigned int         forward_when_active : 1;
 };
 
 G_DEFINE_FINAL_TYPE (ValentNotificationPlugin, valent_notification_plugin, VALENT_TYPE_DEVICE_PLUGIN)
@@ -57,34 +64,89 @@ static void valent_notification_plugin_show_notification           (ValentNotifi
 
 
 /*
- * ValentNotifications Callbacks
+ * Forwarding Filter
  */
 static void
-on_notification_added (ValentNotifications      *listener,
-                       ValentNotification       *notification,
-                       ValentNotificationPlugin *self)
+on_settings_changed (GSettings                *settings,
+                     const char               *key,
+                     ValentNotificationPlugin *self)
 {
-  GSettings *settings;
-  const char *application;
   g_auto (GStrv) deny = NULL;
 
-  g_assert (VALENT_IS_NOTIFICATIONS (listener));
-  g_assert (VALENT_IS_NOTIFICATION (notification));
+  g_assert (G_IS_SETTINGS (settings));
   g_assert (VALENT_IS_NOTIFICATION_PLUGIN (self));
 
-  settings = valent_extension_get_settings (VALENT_EXTENSION (self));
+  self->forward_notifications = g_settings_get_boolean (settings,
+                                                        "forward-notifications");
+  self->forward_when_active = g_settings_get_boolean (settings,
+                                                      "forward-when-active");
 
-  if (!g_settings_get_boolean (settings, "forward-notifications"))
-    return;
+  /* Applications are usually matched by name, but entries may also be glob
+   * patterns (e.g. `Chat*`) */
+  g_hash_table_remove_all (self->forward_deny);
+  g_ptr_array_set_size (self->forward_deny_patterns, 0);
 
-  if (!g_settings_get_boolean (settings, "forward-when-active") &&
-      valent_session_get_active (self->session))
-    return;
-
-  application = valent_notification_get_application (notification);
   deny = g_settings_get_strv (settings, "forward-deny");
 
-  if (application && g_strv_contains ((const char * const *)deny, application))
+  for (unsigned int i = 0; deny[i] != NULL; i++)
+    {
+      if (strpbrk (deny[i], "*?") != NULL)
+        {
+          g_ptr_array_add (self->forward_deny_patterns,
+                           g_pattern_spec_new (deny[i]));
+        }
+      else
+        {
+          g_hash_table_add (self->forward_deny, g_strdup (deny[i]));
+        }
+    }
+}
+
+static gboolean
+valent_notification_plugin_should_forward (ValentNotificationPlugin *self,
+                                           ValentNotification       *notification)
+{
+  const char *application;
+
+  g_assert (VALENT_IS_NOTIFICATION_PLUGIN (self));
+  g_assert (VALENT_IS_NOTIFICATION (notification));
+
+  if (!self->forward_notifications)
+    return FALSE;
+
+  if (!self->forward_when_active && valent_session_get_active (self->session))
+    return FALSE;
+
+  if ((application = valent_notification_get_application (notification)) == NULL)
+    return TRUE;
+
+  if (g_hash_table_contains (self->forward_deny, application))
+    return FALSE;
+
+  for (unsigned int i = 0; i < self->forward_deny_patterns->len; i++)
+    {
+      GPatternSpec *pattern = g_ptr_array_index (self->forward_deny_patterns, i);
+
+      if (g_pattern_spec_match_string (pattern, application))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/*
+ * ValentNotifications Callbacks
+ */
+static void
+on_notification_added (ValentNotifications      *listener,
+                       ValentNotification       *notification,
+                       ValentNotificationPlugin *self)
+{
+  g_assert (VALENT_IS_NOTIFICATIONS (listener));
+  g_assert (VALENT_IS_NOTIFICATION (notification));
+  g_assert (VALENT_IS_NOTIFICATION_PLUGIN (self));
+
+  if (!valent_notification_plugin_should_forward (self, notification))
     return;
 
   valent_notification_plugin_send_notification (self,
@@ -232,8 +294,8 @@ download_icon_task (GTask        *task,
                                           g_strerror (errno));
         }
 
-      /* Get the device channel */
-      if ((channel = valent_device_ref_channel (device)) == NULL)
+      /* Get the channel that received the packet */
+      if ((channel = valent_device_ref_packet_channel (device, packet)) == NULL)
         {
           return g_task_return_new_error (task,
                                           G_IO_ERROR,
@@ -986,12 +1048,18 @@ static void
 valent_notification_plugin_destroy (ValentObject *object)
 {
   ValentNotificationPlugin *self = VALENT_NOTIFICATION_PLUGIN (object);
+  GSettings *settings;
 
   valent_notification_plugin_watch_notifications (self, FALSE);
 
+  settings = valent_extension_get_settings (VALENT_EXTENSION (self));
+  g_signal_handlers_disconnect_by_func (settings, on_settings_changed, self);
+
   /* Close any open reply dialogs */
   g_clear_pointer (&self->cache, g_hash_table_unref);
   g_clear_pointer (&self->dialogs, g_hash_table_unref);
+  g_clear_pointer (&self->forward_deny, g_hash_table_unref);
+  g_clear_pointer (&self->forward_deny_patterns, g_ptr_array_unref);
 
   /* Cancel any pending operations */
   g_cancellable_cancel (self->cancellable);
@@ -1008,6 +1076,7 @@ valent_notification_plugin_constructed (GObject *object)
 {
   ValentNotificationPlugin *self = VALENT_NOTIFICATION_PLUGIN (object);
   ValentDevicePlugin *plugin = VALENT_DEVICE_PLUGIN (object);
+  GSettings *settings = NULL;
 
   self->cancellable = g_cancellable_new ();
   self->notifications = valent_notifications_get_default();
@@ -1027,6 +1096,19 @@ valent_notification_plugin_constructed (GObject *object)
                                          g_object_unref,
                                          (GDestroyNotify)gtk_window_destroy);
 
+  /* The forwarding filter is only rebuilt when the settings change */
+  self->forward_deny = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                              g_free, NULL);
+  self->forward_deny_patterns =
+    g_ptr_array_new_with_free_func ((GDestroyNotify)g_pattern_spec_free);
+
+  settings = valent_extension_get_settings (VALENT_EXTENSION (plugin));
+  g_signal_connect_object (settings,
+                           "changed",
+                           G_CALLBACK (on_settings_changed),
+                           self, 0);
+  on_settings_changed (settings, NULL, self);
+
   G_OBJECT_CLASS (valent_notification_plugin_parent_class)->constructed (object);
 }
 
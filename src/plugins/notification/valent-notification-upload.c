@@ -13,6 +13,8 @@
 #include "valent-notification-upload.h"
 
 #define DEFAULT_ICON_SIZE 512
+#define ICON_CACHE_MAX_ITEMS 32
+#define ICON_CACHE_MAX_SIZE  (4 * 1024 * 1024)
 
 
 /**
@@ -46,6 +48,192 @@ enum {
 static GParamSpec *properties[N_PROPERTIES] = { 0, };
 
 
+/*
+ * Icon Cache
+ *
+ * Encoded icons are shared by every device, so that applications that post
+ * many notifications with the same icon only pay to decode and encode it once.
+ *
+ * Icons are keyed by a string that changes with their content: themed icons by
+ * name, file icons by URI, entity tag and size, and bytes icons by a checksum,
+ * so that a file rewritten in place is not served from a stale entry.
+ */
+typedef struct
+{
+  GList   link;
+  char   *key;
+  GBytes *bytes;
+  char   *payload_hash;
+} IconCacheEntry;
+
+static GMutex icon_cache_mutex;
+static GHashTable *icon_cache = NULL;
+static GQueue icon_cache_lru = G_QUEUE_INIT;
+static size_t icon_cache_size = 0;
+static unsigned int icon_cache_hits = 0;
+
+static void
+icon_cache_entry_free (gpointer data)
+{
+  IconCacheEntry *entry = data;
+
+  g_clear_pointer (&entry->key, g_free);
+  g_clear_pointer (&entry->bytes, g_bytes_unref);
+  g_clear_pointer (&entry->payload_hash, g_free);
+  g_free (entry);
+}
+
+static char *
+icon_cache_key (GIcon        *icon,
+                GCancellable *cancellable)
+{
+  g_assert (G_IS_ICON (icon));
+
+  if (G_IS_THEMED_ICON (icon))
+    {
+      return g_icon_to_string (icon);
+    }
+  else if (G_IS_FILE_ICON (icon))
+    {
+      GFile *file = g_file_icon_get_file (G_FILE_ICON (icon));
+      g_autoptr (GFileInfo) info = NULL;
+      g_autofree char *uri = NULL;
+      const char *etag = NULL;
+
+      info = g_file_query_info (file,
+                                G_FILE_ATTRIBUTE_ETAG_VALUE","
+                                G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                G_FILE_QUERY_INFO_NONE,
+                                cancellable,
+                                NULL);
+
+      if (info == NULL)
+        return NULL;
+
+      if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_ETAG_VALUE))
+        etag = g_file_info_get_etag (info);
+
+      uri = g_file_get_uri (file);
+
+      return g_strdup_printf ("file:%s:%s:%" G_GOFFSET_FORMAT,
+                              uri,
+                              etag != NULL ? etag : "",
+                              g_file_info_get_size (info));
+    }
+  else if (G_IS_BYTES_ICON (icon))
+    {
+      GBytes *bytes = g_bytes_icon_get_bytes (G_BYTES_ICON (icon));
+      g_autofree char *checksum = NULL;
+
+      if (bytes == NULL)
+        return NULL;
+
+      checksum = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, bytes);
+
+      return g_strconcat ("bytes:", checksum, NULL);
+    }
+
+  return NULL;
+}
+
+static gboolean
+icon_cache_lookup (const char  *key,
+                   GBytes     **bytes,
+                   char       **payload_hash)
+{
+  IconCacheEntry *entry = NULL;
+
+  g_assert (key != NULL);
+  g_assert (bytes != NULL && *bytes == NULL);
+  g_assert (payload_hash != NULL && *payload_hash == NULL);
+
+  g_mutex_lock (&icon_cache_mutex);
+  if (icon_cache != NULL &&
+      (entry = g_hash_table_lookup (icon_cache, key)) != NULL)
+    {
+      g_queue_unlink (&icon_cache_lru, &entry->link);
+      g_queue_push_head_link (&icon_cache_lru, &entry->link);
+
+      *bytes = g_bytes_ref (entry->bytes);
+      *payload_hash = g_strdup (entry->payload_hash);
+      icon_cache_hits++;
+    }
+  g_mutex_unlock (&icon_cache_mutex);
+
+  return entry != NULL;
+}
+
+static void
+icon_cache_insert (const char *key,
+                   GBytes     *bytes,
+                   const char *payload_hash)
+{
+  IconCacheEntry *entry = NULL;
+  size_t size = g_bytes_get_size (bytes);
+
+  g_assert (key != NULL);
+  g_assert (bytes != NULL);
+  g_assert (payload_hash != NULL);
+
+  /* Skip icons that would evict the whole cache */
+  if (size > ICON_CACHE_MAX_SIZE / 4)
+    return;
+
+  g_mutex_lock (&icon_cache_mutex);
+  if (icon_cache == NULL)
+    {
+      icon_cache = g_hash_table_new_full (g_str_hash,
+                                          g_str_equal,
+                                          NULL,
+                                          icon_cache_entry_free);
+    }
+
+  /* Another thread may have encoded the same icon */
+  if (!g_hash_table_contains (icon_cache, key))
+    {
+      entry = g_new0 (IconCacheEntry, 1);
+      entry->link.data = entry;
+      entry->key = g_strdup (key);
+      entry->bytes = g_bytes_ref (bytes);
+      entry->payload_hash = g_strdup (payload_hash);
+
+      g_hash_table_insert (icon_cache, entry->key, entry);
+      g_queue_push_head_link (&icon_cache_lru, &entry->link);
+      icon_cache_size += size;
+    }
+
+  while (icon_cache_lru.length > ICON_CACHE_MAX_ITEMS ||
+         icon_cache_size > ICON_CACHE_MAX_SIZE)
+    {
+      GList *link = g_queue_pop_tail_link (&icon_cache_lru);
+
+      entry = link->data;
+      icon_cache_size -= g_bytes_get_size (entry->bytes);
+      g_hash_table_remove (icon_cache, entry->key);
+    }
+  g_mutex_unlock (&icon_cache_mutex);
+}
+
+/*< private >
+ * valent_notification_upload_get_cache_hits:
+ *
+ * Get the number of times an encoded icon has been served from the cache.
+ *
+ * Returns: the number of cache hits
+ */
+unsigned int
+valent_notification_upload_get_cache_hits (void)
+{
+  unsigned int ret;
+
+  g_mutex_lock (&icon_cache_mutex);
+  ret = icon_cache_hits;
+  g_mutex_unlock (&icon_cache_mutex);
+
+  return ret;
+}
+
+
 /*
  * GIcon Helpers
  */
@@ -264,6 +452,7 @@ valent_notification_upload_execute_task (GTask        *task,
   g_autoptr (JsonNode) packet = NULL;
   g_autoptr (GBytes) bytes = NULL;
   g_autoptr (GIOStream) target = NULL;
+  g_autofree char *cache_key = NULL;
   g_autofree char *payload_hash = NULL;
   const uint8_t *payload_data = NULL;
   size_t payload_size = 0;
@@ -290,18 +479,33 @@ valent_notification_upload_execute_task (GTask        *task,
       return;
     }
 
-  /* Try to get the icon bytes */
-  bytes = valent_notification_upload_get_icon_bytes (icon, cancellable, &error);
-
-  if (bytes == NULL)
-    return g_task_return_error (task, error);
-
   /* A payload hash is included, allowing the remote device to ignore icon
    * transfers that it already has cached. */
-  payload_data = g_bytes_get_data (bytes, &payload_size);
-  payload_hash = g_compute_checksum_for_data (G_CHECKSUM_MD5,
-                                              payload_data,
-                                              payload_size);
+  cache_key = icon_cache_key (icon, cancellable);
+
+  if (cache_key != NULL &&
+      icon_cache_lookup (cache_key, &bytes, &payload_hash))
+    {
+      payload_data = g_bytes_get_data (bytes, &payload_size);
+    }
+  else
+    {
+      bytes = valent_notification_upload_get_icon_bytes (icon,
+                                                         cancellable,
+                                                         &error);
+
+      if (bytes == NULL)
+        return g_task_return_error (task, error);
+
+      payload_data = g_bytes_get_data (bytes, &payload_size);
+      payload_hash = g_compute_checksum_for_data (G_CHECKSUM_MD5,
+                                                  payload_data,
+                                                  payload_size);
+
+      if (cache_key != NULL)
+        icon_cache_insert (cache_key, bytes, payload_hash);
+    }
+
   json_object_set_string_member (valent_packet_get_body (packet),
                                  "payloadHash",
                                  payload_hash);
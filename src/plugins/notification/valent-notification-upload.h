@@ -11,9 +11,10 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (ValentNotificationUpload, valent_notification_upload, VALENT, NOTIFICATION_UPLOAD, ValentTransfer)
 
-ValentTransfer * valent_notification_upload_new (ValentDevice *device,
-                                                 JsonNode     *packet,
-                                                 GIcon        *icon);
+ValentTransfer * valent_notification_upload_new            (ValentDevice *device,
+                                                            JsonNode     *packet,
+                                                            GIcon        *icon);
+unsigned int     valent_notification_upload_get_cache_hits (void);
 
 G_END_DECLS
 
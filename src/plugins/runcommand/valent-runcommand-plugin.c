@@ -5,6 +5,10 @@
 
 #include "config.h"
 
+#include <signal.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
 #include <glib/gi18n.h>
 #include <json-glib/json-glib.h>
 #include <libportal/portal.h>
@@ -13,6 +17,9 @@
 #include "valent-runcommand-plugin.h"
 #include "valent-runcommand-utils.h"
 
+#define RUNCOMMAND_OUTPUT_MAX (64 * 1024)
+#define RUNCOMMAND_QUEUE_MAX  (16)
+
 
 struct _ValentRuncommandPlugin
 {
@@ -20,6 +27,8 @@ struct _ValentRuncommandPlugin
 
   GSubprocessLauncher *launcher;
   GHashTable          *subprocesses;
+  GQueue               pending;
+  unsigned int         n_dropped;
 
   unsigned long        commands_changed_id;
 };
@@ -37,28 +46,193 @@ static void valent_runcommand_plugin_handle_runcommand         (ValentRuncommand
 static void valent_runcommand_plugin_handle_runcommand_request (ValentRuncommandPlugin *self,
                                                                 JsonNode               *packet);
 static void valent_runcommand_plugin_send_command_list         (ValentRuncommandPlugin *self);
+static void valent_runcommand_plugin_send_output               (ValentRuncommandPlugin *self,
+                                                                const char             *key,
+                                                                int                     exit_status,
+                                                                GByteArray             *output);
 
 
 /*
  * Launcher Helpers
+ *
+ * Commands requested by the device are run in a queue, with at most
+ * `max-concurrent` running at once. A command holds its slot until the
+ * launched process exits, even if it leaves children or output behind. Each
+ * command runs in its own process group with optional resource limits, so the
+ * whole group can be stopped when the `timeout` expires or the device is
+ * unpaired. Commands are left running when the plugin is disabled.
+ *
+ * When running in a Flatpak, commands are run on the host by `flatpak-spawn`,
+ * so the process group and limits of the child would only apply to the
+ * wrapper. Instead the limits are applied with `ulimit` by a host shell, and
+ * the command is stopped with `SIGTERM`, which `flatpak-spawn` forwards to the
+ * host. A command that ignores `SIGTERM` may outlive its `timeout`.
  */
+typedef struct
+{
+  rlim_t cpu_limit;
+  rlim_t memory_limit;
+} LauncherLimits;
+
+typedef struct
+{
+  ValentRuncommandPlugin *plugin;
+  GSubprocess            *subprocess;
+  GCancellable           *cancellable;
+  char                   *key;
+  GByteArray             *output;
+  pid_t                   pgid;
+  int                     exit_status;
+  unsigned int            n_pending;
+  unsigned int            timeout_id;
+  gboolean                host;
+} LauncherJob;
+
+static void launcher_drain (ValentRuncommandPlugin *self);
+
+static void
+launcher_job_kill (LauncherJob *job)
+{
+  /* A forced exit would leave the host command running */
+  if (job->host)
+    {
+      g_subprocess_send_signal (job->subprocess, SIGTERM);
+      return;
+    }
+
+  if (job->pgid > 0)
+    kill (-job->pgid, SIGKILL);
+
+  g_subprocess_force_exit (job->subprocess);
+}
+
+static void
+launcher_job_release (LauncherJob *job)
+{
+  if (--job->n_pending > 0)
+    return;
+
+  if (job->plugin != NULL &&
+      job->output != NULL &&
+      !g_cancellable_is_cancelled (job->cancellable))
+    {
+      valent_runcommand_plugin_send_output (job->plugin,
+                                            job->key,
+                                            job->exit_status,
+                                            job->output);
+    }
+
+  g_clear_handle_id (&job->timeout_id, g_source_remove);
+  g_clear_object (&job->plugin);
+  g_clear_object (&job->subprocess);
+  g_clear_object (&job->cancellable);
+  g_clear_pointer (&job->key, g_free);
+  g_clear_pointer (&job->output, g_byte_array_unref);
+  g_free (job);
+}
+
+static gboolean
+launcher_job_timeout (gpointer data)
+{
+  LauncherJob *job = data;
+
+  g_debug ("%s(): command \"%s\" timed out", G_STRFUNC, job->key);
+
+  job->timeout_id = 0;
+  launcher_job_kill (job);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+launcher_read_cb (GInputStream *stream,
+                  GAsyncResult *result,
+                  LauncherJob  *job)
+{
+  g_autoptr (GBytes) bytes = NULL;
+  g_autoptr (GError) error = NULL;
+  size_t size;
+
+  bytes = g_input_stream_read_bytes_finish (stream, result, &error);
+
+  if (bytes == NULL || g_bytes_get_size (bytes) == 0)
+    {
+      if (error != NULL && !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_debug ("%s(): %s", G_STRFUNC, error->message);
+
+      launcher_job_release (job);
+      return;
+    }
+
+  /* Keep reading past the limit, so the command doesn't block on a full pipe */
+  size = MIN (g_bytes_get_size (bytes), RUNCOMMAND_OUTPUT_MAX - job->output->len);
+
+  if (size > 0)
+    g_byte_array_append (job->output, g_bytes_get_data (bytes, NULL), size);
+
+  g_input_stream_read_bytes_async (stream,
+                                   4096,
+                                   G_PRIORITY_DEFAULT,
+                                   job->cancellable,
+                                   (GAsyncReadyCallback)launcher_read_cb,
+                                   job);
+}
+
+static void
+launcher_watch (GSubprocess  *subprocess,
+                GAsyncResult *result,
+                LauncherJob  *job)
+{
+  ValentRuncommandPlugin *self = job->plugin;
+  g_autoptr (GError) error = NULL;
+
+  if (!g_subprocess_wait_finish (subprocess, result, &error) &&
+      !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    g_warning ("Process failed: %s", error->message);
+
+  if (g_subprocess_get_if_exited (subprocess))
+    job->exit_status = g_subprocess_get_exit_status (subprocess);
+
+  /* The slot is free once the process exits, even if output is pending. The
+   * job may have been detached from a destroyed plugin. */
+  if (self != NULL && g_hash_table_remove (self->subprocesses, subprocess))
+    launcher_drain (self);
+
+  launcher_job_release (job);
+}
+
+static void
+launcher_child_setup (gpointer user_data)
+{
+  LauncherLimits *limits = user_data;
+
+  /* NOTE: this runs after fork(), so it must be async-signal-safe */
+  setpgid (0, 0);
+
+  if (limits->cpu_limit > 0)
+    {
+      struct rlimit rlim = { limits->cpu_limit, limits->cpu_limit };
+
+      setrlimit (RLIMIT_CPU, &rlim);
+    }
+
+  if (limits->memory_limit > 0)
+    {
+      struct rlimit rlim = { limits->memory_limit, limits->memory_limit };
+
+      setrlimit (RLIMIT_AS, &rlim);
+    }
+}
+
 static void
 launcher_init (ValentRuncommandPlugin *self)
 {
   ValentDevice *device;
-  GSubprocessFlags flags;
 
   if G_UNLIKELY (self->launcher != NULL)
     return;
 
-#ifdef VALENT_ENABLE_DEBUG
-  flags = G_SUBPROCESS_FLAGS_NONE;
-#else
-  flags = (G_SUBPROCESS_FLAGS_STDERR_SILENCE |
-           G_SUBPROCESS_FLAGS_STDOUT_SILENCE);
-#endif /* VALENT_ENABLE_DEBUG */
-
-  self->launcher = g_subprocess_launcher_new (flags);
+  self->launcher = g_subprocess_launcher_new (G_SUBPROCESS_FLAGS_NONE);
 
   device = valent_extension_get_object (VALENT_EXTENSION (self));
   g_subprocess_launcher_setenv (self->launcher,
@@ -75,13 +249,17 @@ static void
 launcher_clear (ValentRuncommandPlugin *self)
 {
   GHashTableIter iter;
-  gpointer subprocess;
+  gpointer job;
+
+  g_queue_clear_full (&self->pending, (GDestroyNotify)g_variant_unref);
+  self->n_dropped = 0;
 
   g_hash_table_iter_init (&iter, self->subprocesses);
 
-  while (g_hash_table_iter_next (&iter, NULL, &subprocess))
+  while (g_hash_table_iter_next (&iter, NULL, &job))
     {
-      g_subprocess_force_exit (G_SUBPROCESS (subprocess));
+      g_cancellable_cancel (((LauncherJob *)job)->cancellable);
+      launcher_job_kill (job);
       g_hash_table_iter_remove (&iter);
     }
 
@@ -89,53 +267,131 @@ launcher_clear (ValentRuncommandPlugin *self)
 }
 
 static void
-launcher_watch (GSubprocess  *subprocess,
-                GAsyncResult *result,
-                GHashTable   *subprocesses)
+launcher_detach (ValentRuncommandPlugin *self)
 {
-  g_autoptr (GError) error = NULL;
+  GHashTableIter iter;
+  gpointer job;
 
-  if (!g_subprocess_wait_finish (subprocess, result, &error) &&
-      !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
-    g_warning ("Process failed: %s", error->message);
+  g_queue_clear_full (&self->pending, (GDestroyNotify)g_variant_unref);
+  self->n_dropped = 0;
+
+  /* Running commands were started by the user, so leave them running but stop
+   * reading their output and drop their hold on the plugin */
+  g_hash_table_iter_init (&iter, self->subprocesses);
 
-  g_hash_table_remove (subprocesses, subprocess);
-  g_hash_table_unref (subprocesses);
+  while (g_hash_table_iter_next (&iter, NULL, &job))
+    {
+      g_cancellable_cancel (((LauncherJob *)job)->cancellable);
+      g_clear_handle_id (&((LauncherJob *)job)->timeout_id, g_source_remove);
+      g_clear_object (&((LauncherJob *)job)->plugin);
+      g_hash_table_iter_remove (&iter);
+    }
+
+  g_clear_object (&self->launcher);
 }
 
 static gboolean
 launcher_execute (ValentRuncommandPlugin  *self,
+                  const char              *key,
                   GVariant                *command,
                   GError                 **error)
 {
+  GSettings *settings;
   g_autoptr (GSubprocess) subprocess = NULL;
   g_autoptr (GString) args = NULL;
   g_auto (GStrv) argv = NULL;
   g_autofree char *command_quoted = NULL;
   const char *command_args = "";
+  const char *identifier;
+  g_autofree LauncherLimits *limits = NULL;
+  LauncherJob *job;
+  GSubprocessFlags flags;
+  gboolean host = FALSE;
+  gboolean send_output;
+  unsigned int timeout;
 
   g_assert (VALENT_IS_RUNCOMMAND_PLUGIN (self));
+  g_assert (key != NULL);
   g_assert (command != NULL && g_variant_is_of_type (command, G_VARIANT_TYPE_VARDICT));
   g_assert (error == NULL || *error == NULL);
 
   launcher_init (self);
 
+  settings = valent_extension_get_settings (VALENT_EXTENSION (self));
+  send_output = g_settings_get_boolean (settings, "send-output");
+  timeout = g_settings_get_uint (settings, "timeout");
+
+  /* Limits are in seconds of CPU time and MiB of address space */
+  limits = g_new0 (LauncherLimits, 1);
+  limits->cpu_limit = g_settings_get_uint (settings, "cpu-limit");
+  limits->memory_limit = (rlim_t)g_settings_get_uint (settings, "memory-limit") * 1024 * 1024;
+
   args = g_string_new ("");
   g_variant_lookup (command, "command", "&s", &command_args);
 
+  /* Quote the arguments for the shell */
+  command_quoted = g_shell_quote (command_args);
 
-  /* When running in a Flatpak, run the command on the host if possible */
+  /* When running in a Flatpak, run the command on the host if possible, with
+   * the limits applied by a host shell (`ulimit -v` is in KiB) */
   if (xdp_portal_running_under_flatpak () &&
       valent_runcommand_can_spawn_host ())
-    g_string_append (args, "flatpak-spawn --host ");
+    {
+      g_autoptr (GString) host_args = NULL;
+      g_autofree char *host_quoted = NULL;
 
-  /* Quote the arguments for the shell */
-  command_quoted = g_shell_quote (command_args);
-  g_string_append_printf (args, "sh -c %s", command_quoted);
+      host_args = g_string_new ("");
+
+      if (limits->cpu_limit > 0)
+        g_string_append_printf (host_args, "ulimit -t %" G_GUINT64_FORMAT "; ",
+                                (guint64)limits->cpu_limit);
+
+      if (limits->memory_limit > 0)
+        g_string_append_printf (host_args, "ulimit -v %" G_GUINT64_FORMAT "; ",
+                                (guint64)limits->memory_limit / 1024);
+
+      g_string_append_printf (host_args, "exec sh -c %s", command_quoted);
+      host_quoted = g_shell_quote (host_args->str);
+      g_string_append_printf (args, "flatpak-spawn --host sh -c %s", host_quoted);
+      host = TRUE;
+    }
+  else
+    {
+      g_string_append_printf (args, "sh -c %s", command_quoted);
+    }
 
   if (!g_shell_parse_argv (args->str, NULL, &argv, error))
     return FALSE;
 
+  if (send_output)
+    {
+      flags = (G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+               G_SUBPROCESS_FLAGS_STDERR_MERGE);
+    }
+  else
+    {
+#ifdef VALENT_ENABLE_DEBUG
+      flags = G_SUBPROCESS_FLAGS_NONE;
+#else
+      flags = (G_SUBPROCESS_FLAGS_STDERR_SILENCE |
+               G_SUBPROCESS_FLAGS_STDOUT_SILENCE);
+#endif /* VALENT_ENABLE_DEBUG */
+    }
+
+  g_subprocess_launcher_set_flags (self->launcher, flags);
+
+  if (host)
+    {
+      g_subprocess_launcher_set_child_setup (self->launcher, NULL, NULL, NULL);
+    }
+  else
+    {
+      g_subprocess_launcher_set_child_setup (self->launcher,
+                                             launcher_child_setup,
+                                             g_steal_pointer (&limits),
+                                             g_free);
+    }
+
   subprocess = g_subprocess_launcher_spawnv (self->launcher,
                                              (const char * const *)argv,
                                              error);
@@ -143,16 +399,106 @@ launcher_execute (ValentRuncommandPlugin  *self,
   if (subprocess == NULL)
     return FALSE;
 
-  /* The task holds the final reference to the GSubprocess object */
+  job = g_new0 (LauncherJob, 1);
+  job->plugin = g_object_ref (self);
+  job->subprocess = g_object_ref (subprocess);
+  job->cancellable = g_cancellable_new ();
+  job->key = g_strdup (key);
+  job->exit_status = -1;
+  job->n_pending = 1;
+  job->host = host;
+
+  if (!host && (identifier = g_subprocess_get_identifier (subprocess)) != NULL)
+    job->pgid = (pid_t)g_ascii_strtoll (identifier, NULL, 10);
+
+  if (timeout > 0)
+    job->timeout_id = g_timeout_add_seconds (timeout, launcher_job_timeout, job);
+
+  if (send_output)
+    {
+      job->output = g_byte_array_new ();
+      job->n_pending += 1;
+      g_input_stream_read_bytes_async (g_subprocess_get_stdout_pipe (subprocess),
+                                       4096,
+                                       G_PRIORITY_DEFAULT,
+                                       job->cancellable,
+                                       (GAsyncReadyCallback)launcher_read_cb,
+                                       job);
+    }
+
   g_subprocess_wait_async (subprocess,
                            NULL,
                            (GAsyncReadyCallback)launcher_watch,
-                           g_hash_table_ref (self->subprocesses));
-  g_hash_table_add (self->subprocesses, subprocess);
+                           job);
+  g_hash_table_insert (self->subprocesses, subprocess, job);
 
   return TRUE;
 }
 
+static void
+launcher_drain (ValentRuncommandPlugin *self)
+{
+  GSettings *settings;
+  unsigned int max_concurrent;
+
+  g_assert (VALENT_IS_RUNCOMMAND_PLUGIN (self));
+
+  settings = valent_extension_get_settings (VALENT_EXTENSION (self));
+  max_concurrent = g_settings_get_uint (settings, "max-concurrent");
+
+  while (g_hash_table_size (self->subprocesses) < max_concurrent &&
+         !g_queue_is_empty (&self->pending))
+    {
+      g_autoptr (GVariant) request = NULL;
+      g_autoptr (GVariant) command = NULL;
+      g_autoptr (GError) error = NULL;
+      const char *key;
+
+      request = g_queue_pop_head (&self->pending);
+      g_variant_get (request, "(&s@a{sv})", &key, &command);
+
+      if (!launcher_execute (self, key, command, &error))
+        g_warning ("%s(): %s", G_STRFUNC, error->message);
+    }
+
+  /* Report the requests dropped while the queue was full */
+  if (self->n_dropped > 0 && g_queue_is_empty (&self->pending))
+    {
+      ValentDevice *device = valent_extension_get_object (VALENT_EXTENSION (self));
+
+      g_message ("%s: dropped %u command requests while the queue was full",
+                 valent_device_get_name (device),
+                 self->n_dropped);
+      self->n_dropped = 0;
+    }
+}
+
+static void
+launcher_queue (ValentRuncommandPlugin *self,
+                const char             *key,
+                GVariant               *command)
+{
+  g_assert (VALENT_IS_RUNCOMMAND_PLUGIN (self));
+  g_assert (key != NULL);
+  g_assert (command != NULL && g_variant_is_of_type (command, G_VARIANT_TYPE_VARDICT));
+
+  if (g_queue_get_length (&self->pending) >= RUNCOMMAND_QUEUE_MAX)
+    {
+      ValentDevice *device = valent_extension_get_object (VALENT_EXTENSION (self));
+
+      if (self->n_dropped++ == 0)
+        g_message ("%s: too many pending commands; dropping requests",
+                   valent_device_get_name (device));
+
+      g_debug ("%s(): dropping \"%s\"", G_STRFUNC, key);
+      return;
+    }
+
+  g_queue_push_tail (&self->pending,
+                     g_variant_ref_sink (g_variant_new ("(s@a{sv})", key, command)));
+  launcher_drain (self);
+}
+
 /*
  * Local Commands
  */
@@ -183,7 +529,6 @@ valent_runcommand_plugin_execute_local_command (ValentRuncommandPlugin *self,
   GSettings *settings;
   g_autoptr (GVariant) commands = NULL;
   g_autoptr (GVariant) command = NULL;
-  g_autoptr (GError) error = NULL;
 
   g_assert (VALENT_IS_RUNCOMMAND_PLUGIN (self));
   g_return_if_fail (key != NULL);
@@ -195,8 +540,7 @@ valent_runcommand_plugin_execute_local_command (ValentRuncommandPlugin *self,
   if (!g_variant_lookup (commands, key, "@a{sv}", &command))
     return valent_runcommand_plugin_send_command_list (self);
 
-  if (!launcher_execute (self, command, &error))
-    g_warning ("%s(): %s", G_STRFUNC, error->message);
+  launcher_queue (self, key, command);
 }
 
 static void
@@ -257,6 +601,35 @@ valent_runcommand_plugin_send_command_list (ValentRuncommandPlugin *self)
   valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (self), packet);
 }
 
+static void
+valent_runcommand_plugin_send_output (ValentRuncommandPlugin *self,
+                                      const char             *key,
+                                      int                     exit_status,
+                                      GByteArray             *output)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) packet = NULL;
+  g_autofree char *output_str = NULL;
+
+  g_assert (VALENT_IS_RUNCOMMAND_PLUGIN (self));
+  g_assert (key != NULL);
+  g_assert (output != NULL);
+
+  /* Output is truncated at RUNCOMMAND_OUTPUT_MAX, possibly mid-character */
+  output_str = g_utf8_make_valid ((const char *)output->data, output->len);
+
+  valent_packet_init (&builder, "kdeconnect.runcommand");
+  json_builder_set_member_name (builder, "key");
+  json_builder_add_string_value (builder, key);
+  json_builder_set_member_name (builder, "exitStatus");
+  json_builder_add_int_value (builder, exit_status);
+  json_builder_set_member_name (builder, "output");
+  json_builder_add_string_value (builder, output_str);
+  packet = valent_packet_end (&builder);
+
+  valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (self), packet);
+}
+
 static void
 valent_runcommand_plugin_handle_runcommand_request (ValentRuncommandPlugin *self,
                                                     JsonNode               *packet)
@@ -361,6 +734,18 @@ valent_runcommand_plugin_handle_runcommand (ValentRuncommandPlugin *self,
   g_assert (VALENT_IS_PACKET (packet));
 
   body = valent_packet_get_body (packet);
+
+  /* The result of a remote command, rather than the command list */
+  if (!json_object_has_member (body, "commandList") &&
+      json_object_has_member (body, "key"))
+    {
+      g_debug ("%s(): command \"%s\" exited with status %i",
+               G_STRFUNC,
+               json_object_get_string_member (body, "key"),
+               (int)json_object_get_int_member_with_default (body, "exitStatus", -1));
+      return;
+    }
+
   command_json = json_object_get_string_member_with_default (body, "commandList", "{}");
   command_node = json_from_string (command_json, NULL);
 
@@ -484,6 +869,9 @@ valent_runcommand_plugin_destroy (ValentObject *object)
   settings = valent_extension_get_settings (VALENT_EXTENSION (plugin));
   g_clear_signal_handler (&self->commands_changed_id, settings);
 
+  /* Drop queued commands, leaving running commands to finish */
+  launcher_detach (self);
+
   VALENT_OBJECT_CLASS (valent_runcommand_plugin_parent_class)->destroy (object);
 }
 
@@ -510,6 +898,7 @@ valent_runcommand_plugin_finalize (GObject *object)
 
   g_clear_object (&self->launcher);
   g_clear_pointer (&self->subprocesses, g_hash_table_unref);
+  g_queue_clear_full (&self->pending, (GDestroyNotify)g_variant_unref);
 
   G_OBJECT_CLASS (valent_runcommand_plugin_parent_class)->finalize (object);
 }
@@ -534,5 +923,6 @@ static void
 valent_runcommand_plugin_init (ValentRuncommandPlugin *self)
 {
   self->subprocesses = g_hash_table_new (NULL, NULL);
+  g_queue_init (&self->pending);
 }
 
@@ -25,6 +25,8 @@ struct _ValentSftpPlugin
 
 G_DEFINE_FINAL_TYPE (ValentSftpPlugin, valent_sftp_plugin, VALENT_TYPE_DEVICE_PLUGIN)
 
+static void   valent_sftp_plugin_sftp_request (ValentSftpPlugin *self);
+
 
 static char *
 get_device_host (ValentSftpPlugin *self)
@@ -55,8 +57,15 @@ get_device_host (ValentSftpPlugin *self)
  * @username: Username (deprecated)
  * @password: Password (deprecated)
  * @mount: A #GMount for the session
+ * @mounting: %TRUE if a mount operation is in progress
+ * @remount: %TRUE if the mount operation is using cached connection data
+ * @browse: %TRUE if the session should be opened once mounted
  *
  * #ValentSftpSession is a simple representation of a SFTP session.
+ *
+ * The session outlives its mount, or a failed attempt to mount it, so that it
+ * can be remounted with the same connection data when the device reconnects,
+ * without another request.
  */
 typedef struct _ValentSftpSession
 {
@@ -65,8 +74,11 @@ typedef struct _ValentSftpSession
   char     *username;
   char     *password;
 
-  char    *uri;
-  GMount  *mount;
+  char     *uri;
+  GMount   *mount;
+  gboolean  mounting;
+  gboolean  remount;
+  gboolean  browse;
 } ValentSftpSession;
 
 
@@ -167,19 +179,18 @@ static gboolean
 sftp_session_find (ValentSftpPlugin *self)
 {
   g_autofree char *host = NULL;
-  g_autofree char *host_pattern = NULL;
-  g_autoptr (GRegex) regex = NULL;
+  g_autofree char *host_prefix = NULL;
   g_autolist (GMount) mounts = NULL;
 
-  if (self->session && self->session->mount)
-    return TRUE;
+  /* A known session is kept current by the volume monitor callbacks, so the
+   * mounts only need to be searched for one mounted by a previous instance */
+  if (self->session != NULL)
+    return self->session->mount != NULL;
 
   if ((host = get_device_host (self)) == NULL)
     return FALSE;
 
-  // TODO: is this reasonable?
-  host_pattern = g_strdup_printf ("sftp://(%s):([22-65535])", host);
-  regex = g_regex_new (host_pattern, G_REGEX_OPTIMIZE, 0, NULL);
+  host_prefix = g_strdup_printf ("sftp://%s:", host);
 
   /* Search through each mount in the volume monitor... */
   mounts = g_volume_monitor_get_mounts (self->monitor);
@@ -193,7 +204,7 @@ sftp_session_find (ValentSftpPlugin *self)
       uri = g_file_get_uri (root);
 
       /* The URI matches our mount */
-      if (g_regex_match (regex, uri, 0, NULL))
+      if (g_str_has_prefix (uri, host_prefix))
         {
           if (self->session == NULL)
             self->session = g_new0 (ValentSftpSession, 1);
@@ -248,7 +259,13 @@ on_mount_removed (GVolumeMonitor   *volume_monitor,
   root = g_mount_get_root (mount);
   uri = g_file_get_uri (root);
 
-  if (g_strcmp0 (self->session->uri, uri) == 0)
+  if (g_strcmp0 (self->session->uri, uri) != 0)
+    return;
+
+  /* Keep the connection data for a remount, if there is any */
+  if (self->session->port != 0)
+    g_clear_object (&self->session->mount);
+  else
     g_clear_pointer (&self->session, sftp_session_free);
 }
 
@@ -332,14 +349,27 @@ mount_cb (GFile            *file,
 
   g_assert (VALENT_IS_SFTP_PLUGIN (self));
 
-  /* On success we will acquire the mount from the volume monitor */
-  if (g_file_mount_enclosing_volume_finish (file, result, &error))
+  /* The session may have been dropped while mounting */
+  if (self->session == NULL)
     return;
 
-  /* On the off-chance this happens, we will just ensure we have the mount */
-  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_ALREADY_MOUNTED) &&
-      sftp_session_find (self))
-    return;
+  self->session->mounting = FALSE;
+
+  /* On success we will acquire the mount from the volume monitor */
+  if (g_file_mount_enclosing_volume_finish (file, result, &error) ||
+      g_error_matches (error, G_IO_ERROR, G_IO_ERROR_ALREADY_MOUNTED))
+    {
+      self->session->remount = FALSE;
+
+      if (self->session->browse)
+        {
+          self->session->browse = FALSE;
+          g_app_info_launch_default_for_uri_async (self->session->uri,
+                                                   NULL, NULL, NULL, NULL);
+        }
+
+      return;
+    }
 
   /* On failure, we're particularly interested in host key failures so that
    * we can remove those from the ssh-agent. These are reported by GVfs as
@@ -348,32 +378,43 @@ mount_cb (GFile            *file,
     {
       g_warning ("%s(): Error mounting: %s", G_STRFUNC, error->message);
 
-      if (self->session && self->session->host)
+      if (self->session->host != NULL)
         remove_host_key (self->session->host);
     }
 
-  g_clear_pointer (&self->session, sftp_session_free);
+  /* If cached connection data failed, the remote server may have restarted
+   * with a new port or password, so request a new session if the user is
+   * waiting to browse or has opted into automatic mounting */
+  if (self->session->remount)
+    {
+      GSettings *settings;
+      gboolean browse = self->session->browse;
+
+      g_clear_pointer (&self->session, sftp_session_free);
+
+      settings = valent_extension_get_settings (VALENT_EXTENSION (self));
+
+      if (browse || g_settings_get_boolean (settings, "auto-mount"))
+        valent_sftp_plugin_sftp_request (self);
+
+      return;
+    }
+
+  /* Otherwise keep the connection data, to be tried again before requesting a
+   * new session */
+  self->session->browse = FALSE;
 }
 
 static void
-ssh_add_cb (GSubprocess      *proc,
-            GAsyncResult     *result,
-            ValentSftpPlugin *self)
+sftp_session_mount (ValentSftpPlugin *self)
 {
   ValentSftpSession *session = self->session;
-  g_autoptr (GError) error = NULL;
   g_autoptr (GFile) file = NULL;
   g_autoptr (GMountOperation) op = NULL;
 
+  g_assert (VALENT_IS_SFTP_PLUGIN (self));
   g_assert (self->session != NULL);
 
-  if (!g_subprocess_wait_check_finish (proc, result, &error))
-    {
-      g_warning ("%s(): Failed to add host key: %s", G_STRFUNC, error->message);
-      g_clear_pointer (&self->session, sftp_session_free);
-      return;
-    }
-
   /* Prepare the mount operation */
   op = g_mount_operation_new ();
   g_signal_connect (op, "ask-password", G_CALLBACK (ask_password_cb), session);
@@ -389,24 +430,91 @@ ssh_add_cb (GSubprocess      *proc,
                                  self);
 }
 
+static void
+ssh_add_cb (GSubprocess      *proc,
+            GAsyncResult     *result,
+            ValentSftpPlugin *self)
+{
+  g_autoptr (GError) error = NULL;
+
+  g_assert (self->session != NULL);
+
+  if (!g_subprocess_wait_check_finish (proc, result, &error))
+    {
+      g_warning ("%s(): Failed to add host key: %s", G_STRFUNC, error->message);
+      g_clear_pointer (&self->session, sftp_session_free);
+      return;
+    }
+
+  sftp_session_mount (self);
+}
+
+static void
+ssh_list_cb (GSubprocess      *proc,
+             GAsyncResult     *result,
+             ValentSftpPlugin *self)
+{
+  g_autoptr (ValentContext) context = NULL;
+  g_autoptr (GSubprocess) add_proc = NULL;
+  g_autoptr (GFile) private_key = NULL;
+  g_autoptr (GError) error = NULL;
+  g_autofree char *identities = NULL;
+
+  g_assert (self->session != NULL);
+
+  /* `ssh-add -l` fails if the agent has no keys or isn't running, in which
+   * case the key is added (or the error reported) as usual */
+  if (!g_subprocess_communicate_utf8_finish (proc, result, &identities, NULL, &error))
+    g_debug ("%s(): %s", G_STRFUNC, error->message);
+
+  /* Keys without a comment, like ours, are listed by their file path */
+  context = valent_context_new (NULL, NULL, NULL);
+  private_key = valent_context_get_config_file (context, "private.pem");
+
+  if (identities != NULL &&
+      g_strstr_len (identities, -1, g_file_peek_path (private_key)) != NULL)
+    {
+      sftp_session_mount (self);
+      return;
+    }
+
+  add_proc = g_subprocess_new (G_SUBPROCESS_FLAGS_STDOUT_SILENCE |
+                               G_SUBPROCESS_FLAGS_STDERR_MERGE,
+                               &error,
+                               "ssh-add", g_file_peek_path (private_key),
+                               NULL);
+
+  if (add_proc == NULL)
+    {
+      g_warning ("%s(): Failed to add host key: %s", G_STRFUNC, error->message);
+      g_clear_pointer (&self->session, sftp_session_free);
+      return;
+    }
+
+  g_subprocess_wait_check_async (add_proc,
+                                 NULL,
+                                 (GAsyncReadyCallback)ssh_add_cb,
+                                 self);
+}
+
 static void
 sftp_session_begin (ValentSftpPlugin  *self,
                     ValentSftpSession *session)
 {
-  g_autoptr (ValentContext) context = NULL;
   g_autoptr (GSubprocess) proc = NULL;
   g_autoptr (GError) error = NULL;
-  g_autoptr (GFile) private_key = NULL;
 
   g_assert (VALENT_IS_SFTP_PLUGIN (self));
+  g_assert (self->session == session);
 
-  /* Get the root context and add the private key to the ssh-agent */
-  context = valent_context_new (NULL, NULL, NULL);
-  private_key = valent_context_get_config_file (context, "private.pem");
-  proc = g_subprocess_new (G_SUBPROCESS_FLAGS_STDOUT_SILENCE |
-                           G_SUBPROCESS_FLAGS_STDERR_MERGE,
+  session->mounting = TRUE;
+
+  /* Check the ssh-agent for the private key each time, since the agent may
+   * have been restarted or replaced since it was last added */
+  proc = g_subprocess_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+                           G_SUBPROCESS_FLAGS_STDERR_SILENCE,
                            &error,
-                           "ssh-add", g_file_peek_path (private_key),
+                           "ssh-add", "-l",
                            NULL);
 
   if (proc == NULL)
@@ -416,10 +524,11 @@ sftp_session_begin (ValentSftpPlugin  *self,
       return;
     }
 
-  g_subprocess_wait_check_async (proc,
-                                 NULL,
-                                 (GAsyncReadyCallback)ssh_add_cb,
-                                 self);
+  g_subprocess_communicate_utf8_async (proc,
+                                       NULL,
+                                       NULL,
+                                       (GAsyncReadyCallback)ssh_list_cb,
+                                       self);
 }
 
 
@@ -463,17 +572,56 @@ static void
 handle_sftp_mount (ValentSftpPlugin *self,
                    JsonNode         *packet)
 {
+  ValentSftpSession *session;
+  gboolean browse = FALSE;
+
   g_assert (VALENT_IS_SFTP_PLUGIN (self));
 
   /* Check if we're already mounted or mounting */
-  if (self->session != NULL)
+  if (self->session != NULL &&
+      (self->session->mount != NULL || self->session->mounting))
     return;
 
-  /* Parse the connection data */
-  self->session = sftp_session_new (self, packet);
+  /* Parse the connection data, replacing any cached session */
+  if ((session = sftp_session_new (self, packet)) == NULL)
+    return;
 
   if (self->session != NULL)
-    sftp_session_begin (self, self->session);
+    browse = self->session->browse;
+
+  g_clear_pointer (&self->session, sftp_session_free);
+  self->session = session;
+  self->session->browse = browse;
+  sftp_session_begin (self, self->session);
+}
+
+static void
+sftp_session_remount (ValentSftpPlugin *self)
+{
+  ValentSftpSession *session = self->session;
+  g_autofree char *host = NULL;
+
+  g_assert (VALENT_IS_SFTP_PLUGIN (self));
+
+  if (session == NULL || session->port == 0 ||
+      session->mount != NULL || session->mounting)
+    return;
+
+  /* The address may have changed since the session was created */
+  if ((host = get_device_host (self)) == NULL)
+    return;
+
+  if (g_strcmp0 (session->host, host) != 0)
+    {
+      g_set_str (&session->host, host);
+      g_free (session->uri);
+      session->uri = g_strdup_printf ("sftp://%s:%u/",
+                                      session->host,
+                                      session->port);
+    }
+
+  session->remount = TRUE;
+  sftp_session_begin (self, session);
 }
 
 static void
@@ -576,11 +724,21 @@ mount_action (GSimpleAction *action,
 
   g_assert (VALENT_IS_SFTP_PLUGIN (self));
 
-  if (self->session != NULL && self->session->uri != NULL)
-    g_app_info_launch_default_for_uri_async (self->session->uri,
-                                             NULL, NULL, NULL, NULL);
+  if (self->session != NULL && self->session->mount != NULL)
+    {
+      g_app_info_launch_default_for_uri_async (self->session->uri,
+                                               NULL, NULL, NULL, NULL);
+    }
+  else if (self->session != NULL && self->session->port != 0)
+    {
+      /* Open the cached session once it's remounted */
+      self->session->browse = TRUE;
+      sftp_session_remount (self);
+    }
   else
-    valent_sftp_plugin_sftp_request (self);
+    {
+      valent_sftp_plugin_sftp_request (self);
+    }
 }
 
 static const GActionEntry actions[] = {
@@ -610,11 +768,20 @@ valent_sftp_plugin_update_state (ValentDevicePlugin *plugin,
     {
       GSettings *settings;
 
-      sftp_session_find (self);
+      /* Reuse a session that is still mounted */
+      if (sftp_session_find (self))
+        return;
 
+      /* Otherwise only mount in the background if the user has opted in,
+       * preferring to remount a cached session after a reconnect */
       settings = valent_extension_get_settings (VALENT_EXTENSION (plugin));
 
-      if (g_settings_get_boolean (settings, "auto-mount"))
+      if (!g_settings_get_boolean (settings, "auto-mount"))
+        return;
+
+      if (self->session != NULL && self->session->port != 0)
+        sftp_session_remount (self);
+      else
         valent_sftp_plugin_sftp_request (self);
     }
 }
@@ -195,9 +195,9 @@ messages_is_thread (JsonArray *messages)
   return first == second;
 }
 
-static void
-valent_sms_plugin_handle_thread (ValentSmsPlugin *self,
-                                 JsonArray       *messages)
+static GPtrArray *
+valent_sms_plugin_deserialize_thread (ValentSmsPlugin *self,
+                                      JsonArray       *messages)
 {
   g_autoptr (GPtrArray) results = NULL;
   unsigned int n_messages;
@@ -207,7 +207,7 @@ valent_sms_plugin_handle_thread (ValentSmsPlugin *self,
 
   /* Handle each message */
   n_messages = json_array_get_length (messages);
-  results = g_ptr_array_new_with_free_func (g_object_unref);
+  results = g_ptr_array_new_full (n_messages, g_object_unref);
 
   for (unsigned int i = 0; i < n_messages; i++)
     {
@@ -216,40 +216,26 @@ valent_sms_plugin_handle_thread (ValentSmsPlugin *self,
 
       message_node = json_array_get_element (messages, i);
       message = valent_sms_plugin_deserialize_message (self, message_node);
-      g_ptr_array_add (results, message);
+
+      if (message != NULL)
+        g_ptr_array_add (results, message);
     }
 
-  valent_sms_store_add_messages (self->store, results, NULL, NULL, NULL);
+  return g_steal_pointer (&results);
 }
 
 static void
-valent_sms_plugin_handle_messages (ValentSmsPlugin *self,
-                                   JsonNode        *packet)
+valent_sms_plugin_handle_summary (ValentSmsPlugin *self,
+                                  JsonArray       *messages)
 {
-  JsonObject *body;
-  JsonArray *messages;
   unsigned int n_messages;
 
   g_assert (VALENT_IS_SMS_PLUGIN (self));
-  g_assert (VALENT_IS_PACKET (packet));
+  g_assert (messages != NULL);
 
-  body = valent_packet_get_body (packet);
-  messages = json_object_get_array_member (body, "messages");
+  /* If this is a summary of threads we'll request each new thread */
   n_messages = json_array_get_length (messages);
 
-  /* This would typically mean "all threads have been deleted", but it's more
-   * reasonable to assume this was the result of an error. */
-  if (n_messages == 0)
-    return;
-
-  /* If this is a thread of messages we'll add them to the store */
-  if (messages_is_thread (messages))
-    {
-      valent_sms_plugin_handle_thread (self, messages);
-      return;
-    }
-
-  /* If this is a summary of threads we'll request each new thread */
   for (unsigned int i = 0; i < n_messages; i++)
     {
       JsonObject *message;
@@ -269,6 +255,91 @@ valent_sms_plugin_handle_messages (ValentSmsPlugin *self,
     }
 }
 
+/*
+ * `kdeconnect.sms.messages` is handled on a worker thread, so the messages are
+ * deserialized there and passed back to the main thread to update the store.
+ */
+typedef struct
+{
+  ValentSmsPlugin *plugin;
+  JsonNode        *packet;
+  GPtrArray       *messages;
+} MessagesData;
+
+static void
+messages_data_free (gpointer data)
+{
+  MessagesData *closure = data;
+
+  g_clear_object (&closure->plugin);
+  g_clear_pointer (&closure->packet, json_node_unref);
+  g_clear_pointer (&closure->messages, g_ptr_array_unref);
+  g_free (closure);
+}
+
+static gboolean
+valent_sms_plugin_handle_messages_main (gpointer data)
+{
+  MessagesData *closure = data;
+  ValentSmsPlugin *self = closure->plugin;
+  JsonArray *messages;
+
+  /* The plugin was destroyed while the packet was being handled */
+  if (self->store == NULL)
+    return G_SOURCE_REMOVE;
+
+  if (closure->messages != NULL)
+    {
+      valent_sms_store_add_messages (self->store,
+                                     closure->messages,
+                                     NULL, NULL, NULL);
+    }
+  else
+    {
+      messages = json_object_get_array_member (valent_packet_get_body (closure->packet),
+                                               "messages");
+      valent_sms_plugin_handle_summary (self, messages);
+    }
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+valent_sms_plugin_handle_messages (ValentSmsPlugin *self,
+                                   JsonNode        *packet)
+{
+  MessagesData *closure = NULL;
+  JsonObject *body;
+  JsonArray *messages;
+  unsigned int n_messages;
+
+  g_assert (VALENT_IS_SMS_PLUGIN (self));
+  g_assert (VALENT_IS_PACKET (packet));
+
+  body = valent_packet_get_body (packet);
+  messages = json_object_get_array_member (body, "messages");
+  n_messages = json_array_get_length (messages);
+
+  /* This would typically mean "all threads have been deleted", but it's more
+   * reasonable to assume this was the result of an error. */
+  if (n_messages == 0)
+    return;
+
+  closure = g_new0 (MessagesData, 1);
+  closure->plugin = g_object_ref (self);
+  closure->packet = json_node_ref (packet);
+
+  /* If this is a thread of messages we'll add them to the store, otherwise
+   * it's a summary of threads to compare with the store */
+  if (messages_is_thread (messages))
+    closure->messages = valent_sms_plugin_deserialize_thread (self, messages);
+
+  g_idle_add_full (G_PRIORITY_DEFAULT,
+                   valent_sms_plugin_handle_messages_main,
+                   g_steal_pointer (&closure),
+                   messages_data_free);
+}
+
 static void
 valent_sms_plugin_request_conversation (ValentSmsPlugin *self,
                                         int64_t          thread_id,
@@ -11,6 +11,7 @@
 
 #include "valent-message.h"
 #include "valent-message-thread.h"
+#include "valent-object-private.h"
 #include "valent-sms-store.h"
 #include "valent-sms-store-private.h"
 
@@ -59,37 +60,25 @@ static char *statements[N_STATEMENTS] = { NULL, };
 /*
  * Signal Emission Helpers
  */
-typedef struct
+static void
+emit_message_added_main (ValentObject *object,
+                         gpointer      user_data)
 {
-  GRecMutex       mutex;
-  GWeakRef        store;
-  ValentMessage  *message;
-  guint           signal_id;
-} ChangeEmission;
+  g_signal_emit (G_OBJECT (object), signals [MESSAGE_ADDED], 0, user_data);
+}
 
-static gboolean
-emit_change_main (gpointer data)
+static void
+emit_message_changed_main (ValentObject *object,
+                           gpointer      user_data)
 {
-  ChangeEmission *emission = data;
-  g_autoptr (ValentSmsStore) store = NULL;
-
-  g_assert (emission != NULL);
-
-  g_rec_mutex_lock (&emission->mutex);
-  if ((store = g_weak_ref_get (&emission->store)) != NULL)
-    {
-      g_signal_emit (G_OBJECT (store),
-                     emission->signal_id, 0,
-                     emission->message);
-    }
-
-  g_weak_ref_clear (&emission->store);
-  g_clear_object (&emission->message);
-  g_rec_mutex_unlock (&emission->mutex);
-  g_rec_mutex_clear (&emission->mutex);
-  g_clear_pointer (&emission, g_free);
+  g_signal_emit (G_OBJECT (object), signals [MESSAGE_CHANGED], 0, user_data);
+}
 
-  return G_SOURCE_REMOVE;
+static void
+emit_message_removed_main (ValentObject *object,
+                           gpointer      user_data)
+{
+  g_signal_emit (G_OBJECT (object), signals [MESSAGE_REMOVED], 0, user_data);
 }
 
 
@@ -1448,8 +1437,6 @@ void
 valent_sms_store_message_added (ValentSmsStore *store,
                                 ValentMessage  *message)
 {
-  ChangeEmission *emission;
-
   g_return_if_fail (VALENT_IS_SMS_STORE (store));
   g_return_if_fail (VALENT_IS_MESSAGE (message));
 
@@ -1459,18 +1446,10 @@ valent_sms_store_message_added (ValentSmsStore *store,
       return;
     }
 
-  emission = g_new0 (ChangeEmission, 1);
-  g_rec_mutex_init (&emission->mutex);
-  g_rec_mutex_lock (&emission->mutex);
-  g_weak_ref_init (&emission->store, store);
-  emission->message = g_object_ref (message);
-  emission->signal_id = signals [MESSAGE_ADDED];
-  g_rec_mutex_unlock (&emission->mutex);
-
-  g_idle_add_full (G_PRIORITY_DEFAULT,
-                   emit_change_main,
-                   g_steal_pointer (&emission),
-                   NULL);
+  valent_object_invoke_main (VALENT_OBJECT (store),
+                             emit_message_added_main,
+                             g_object_ref (message),
+                             g_object_unref);
 }
 
 /**
@@ -1489,8 +1468,6 @@ void
 valent_sms_store_message_removed (ValentSmsStore *store,
                                   ValentMessage  *message)
 {
-  ChangeEmission *emission;
-
   g_return_if_fail (VALENT_IS_SMS_STORE (store));
   g_return_if_fail (VALENT_IS_MESSAGE (message));
 
@@ -1500,18 +1477,10 @@ valent_sms_store_message_removed (ValentSmsStore *store,
       return;
     }
 
-  emission = g_new0 (ChangeEmission, 1);
-  g_rec_mutex_init (&emission->mutex);
-  g_rec_mutex_lock (&emission->mutex);
-  g_weak_ref_init (&emission->store, store);
-  emission->message = g_object_ref (message);
-  emission->signal_id = signals [MESSAGE_REMOVED];
-  g_rec_mutex_unlock (&emission->mutex);
-
-  g_idle_add_full (G_PRIORITY_DEFAULT,
-                   emit_change_main,
-                   g_steal_pointer (&emission),
-                   NULL);
+  valent_object_invoke_main (VALENT_OBJECT (store),
+                             emit_message_removed_main,
+                             g_object_ref (message),
+                             g_object_unref);
 }
 
 /**
@@ -1530,8 +1499,6 @@ void
 valent_sms_store_message_changed (ValentSmsStore *store,
                                   ValentMessage  *message)
 {
-  ChangeEmission *emission;
-
   g_return_if_fail (VALENT_IS_SMS_STORE (store));
   g_return_if_fail (VALENT_IS_MESSAGE (message));
 
@@ -1541,17 +1508,9 @@ valent_sms_store_message_changed (ValentSmsStore *store,
       return;
     }
 
-  emission = g_new0 (ChangeEmission, 1);
-  g_rec_mutex_init (&emission->mutex);
-  g_rec_mutex_lock (&emission->mutex);
-  g_weak_ref_init (&emission->store, store);
-  emission->message = g_object_ref (message);
-  emission->signal_id = signals [MESSAGE_CHANGED];
-  g_rec_mutex_unlock (&emission->mutex);
-
-  g_idle_add_full (G_PRIORITY_DEFAULT,
-                   emit_change_main,
-                   g_steal_pointer (&emission),
-                   NULL);
+  valent_object_invoke_main (VALENT_OBJECT (store),
+                             emit_message_changed_main,
+                             g_object_ref (message),
+                             g_object_unref);
 }
 
@@ -11,6 +11,9 @@
 
 #include "valent-systemvolume-plugin.h"
 
+/* The minimum interval between volume updates for a stream */
+#define VOLUME_UPDATE_INTERVAL_MS (50)
+
 
 struct _ValentSystemvolumePlugin
 {
@@ -19,6 +22,7 @@ struct _ValentSystemvolumePlugin
   ValentMixer        *mixer;
   unsigned int        mixer_watch : 1;
   GPtrArray          *states;
+  GHashTable         *index;
 };
 
 static void valent_systemvolume_plugin_handle_request     (ValentSystemvolumePlugin *self,
@@ -32,31 +36,145 @@ G_DEFINE_FINAL_TYPE (ValentSystemvolumePlugin, valent_systemvolume_plugin, VALEN
 
 /*
  * Local Mixer
+ *
+ * Streams are tracked in the order of the mixer, for the sink list, and indexed
+ * by name, for updates and requests. Changes to a known stream are sent as a
+ * delta for that sink, with volume changes limited to one update per interval,
+ * so dragging a slider costs the same however many sinks there are.
  */
 typedef struct
 {
-  ValentMixerStream *stream;
-  unsigned long      notify_id;
-  char              *name;
-  char              *description;
-  unsigned int       volume;
-  unsigned int       muted : 1;
-  unsigned int       enabled : 1;
+  ValentSystemvolumePlugin *plugin;
+  ValentMixerStream        *stream;
+  unsigned long             notify_id;
+  char                     *name;
+  char                     *description;
+  unsigned int              volume;
+  unsigned int              volume_source_id;
+  unsigned int              volume_pending : 1;
+  unsigned int              muted : 1;
+  unsigned int              enabled : 1;
 } StreamState;
 
-static StreamState *
+static inline StreamState *
 stream_state_find (ValentSystemvolumePlugin *self,
                    const char               *name)
 {
-  for (unsigned int i = 0; i < self->states->len; i++)
+  return g_hash_table_lookup (self->index, name);
+}
+
+static void
+stream_state_send_update (StreamState *state,
+                          gboolean     volume,
+                          gboolean     muted,
+                          gboolean     enabled)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) packet = NULL;
+
+  valent_packet_init (&builder, "kdeconnect.systemvolume");
+  json_builder_set_member_name (builder, "name");
+  json_builder_add_string_value (builder, state->name);
+
+  if (muted)
+    {
+      json_builder_set_member_name (builder, "muted");
+      json_builder_add_boolean_value (builder, state->muted);
+    }
+
+  if (volume)
+    {
+      json_builder_set_member_name (builder, "volume");
+      json_builder_add_int_value (builder, state->volume);
+    }
+
+  if (enabled)
+    {
+      json_builder_set_member_name (builder, "enabled");
+      json_builder_add_boolean_value (builder, state->enabled);
+    }
+
+  packet = valent_packet_end (&builder);
+
+  valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (state->plugin), packet);
+}
+
+static gboolean
+stream_state_volume_timeout (gpointer data)
+{
+  StreamState *state = data;
+
+  if (!state->volume_pending)
+    {
+      state->volume_source_id = 0;
+      return G_SOURCE_REMOVE;
+    }
+
+  state->volume_pending = FALSE;
+  stream_state_send_update (state, TRUE, FALSE, FALSE);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+stream_state_update (StreamState *state)
+{
+  ValentSystemvolumePlugin *self = state->plugin;
+  gboolean enabled;
+  gboolean muted;
+  unsigned int volume;
+  gboolean volume_changed = FALSE;
+  gboolean muted_changed = FALSE;
+  gboolean enabled_changed = FALSE;
+
+  enabled = valent_mixer_get_default_output (self->mixer) == state->stream;
+  muted = valent_mixer_stream_get_muted (state->stream);
+  volume = valent_mixer_stream_get_level (state->stream);
+
+  if (state->muted != muted)
+    {
+      state->muted = muted;
+      muted_changed = TRUE;
+    }
+
+  if (state->enabled != enabled)
+    {
+      state->enabled = enabled;
+      enabled_changed = TRUE;
+    }
+
+  if (state->volume != volume)
     {
-      StreamState *state = g_ptr_array_index (self->states, i);
+      state->volume = volume;
+      volume_changed = TRUE;
+    }
 
-      if (g_strcmp0 (state->name, name) == 0)
-        return state;
+  /* Other changes carry any pending volume; otherwise a volume change during
+   * the interval is deferred until it elapses */
+  if (muted_changed || enabled_changed)
+    {
+      volume_changed |= state->volume_pending;
+      state->volume_pending = FALSE;
+    }
+  else if (volume_changed && state->volume_source_id != 0)
+    {
+      state->volume_pending = TRUE;
+      return;
     }
 
-  return NULL;
+  if (!volume_changed && !muted_changed && !enabled_changed)
+    return;
+
+  if (volume_changed && state->volume_source_id == 0)
+    {
+      state->volume_source_id = g_timeout_add (VOLUME_UPDATE_INTERVAL_MS,
+                                               stream_state_volume_timeout,
+                                               state);
+      g_source_set_name_by_id (state->volume_source_id,
+                               "stream_state_volume_timeout");
+    }
+
+  stream_state_send_update (state, volume_changed, muted_changed, enabled_changed);
 }
 
 static void
@@ -67,11 +185,6 @@ on_stream_changed (ValentMixerStream        *stream,
   StreamState *state;
   const char *name;
   const char *description;
-  gboolean enabled;
-  gboolean muted;
-  unsigned int volume;
-  g_autoptr (JsonBuilder) builder = NULL;
-  g_autoptr (JsonNode) packet = NULL;
 
   g_assert (VALENT_IS_MIXER_STREAM (stream));
   g_assert (VALENT_IS_SYSTEMVOLUME_PLUGIN (self));
@@ -95,45 +208,7 @@ on_stream_changed (ValentMixerStream        *stream,
       return;
     }
 
-  /* If none of the other properties changed, there's nothing to update */
-  enabled = valent_mixer_get_default_output (self->mixer) == stream;
-  muted = valent_mixer_stream_get_muted (stream);
-  volume = valent_mixer_stream_get_level (stream);
-
-  if (state->enabled == enabled &&
-      state->muted == muted &&
-      state->volume == volume)
-    return;
-
-  /* Sink update */
-  valent_packet_init (&builder, "kdeconnect.systemvolume");
-  json_builder_set_member_name (builder, "name");
-  json_builder_add_string_value (builder, state->name);
-
-  if (state->muted != muted)
-    {
-      state->muted = muted;
-      json_builder_set_member_name (builder, "muted");
-      json_builder_add_boolean_value (builder, state->muted);
-    }
-
-  if (state->volume != volume)
-    {
-      state->volume = volume;
-      json_builder_set_member_name (builder, "volume");
-      json_builder_add_int_value (builder, state->volume);
-    }
-
-  if (state->enabled != enabled)
-    {
-      state->enabled = enabled;
-      json_builder_set_member_name (builder, "enabled");
-      json_builder_add_boolean_value (builder, state->enabled);
-    }
-
-  packet = valent_packet_end (&builder);
-
-  valent_device_plugin_queue_packet (VALENT_DEVICE_PLUGIN (self), packet);
+  stream_state_update (state);
 }
 
 static StreamState *
@@ -146,11 +221,12 @@ stream_state_new (ValentSystemvolumePlugin *self,
   g_assert (VALENT_IS_MIXER_STREAM (stream));
 
   state = g_new0 (StreamState, 1);
+  state->plugin = self;
   state->stream = g_object_ref (stream);
-  g_signal_connect_object (state->stream,
-                           "notify",
-                           G_CALLBACK (on_stream_changed),
-                           self, 0);
+  state->notify_id = g_signal_connect_object (state->stream,
+                                              "notify",
+                                              G_CALLBACK (on_stream_changed),
+                                              self, 0);
 
   state->name = g_strdup (valent_mixer_stream_get_name (stream));
   state->description = g_strdup (valent_mixer_stream_get_description (stream));
@@ -166,6 +242,7 @@ stream_state_free (gpointer data)
 {
   StreamState *state = data;
 
+  g_clear_handle_id (&state->volume_source_id, g_source_remove);
   g_clear_signal_handler (&state->notify_id, state->stream);
   g_clear_object (&state->stream);
   g_clear_pointer (&state->name, g_free);
@@ -178,23 +255,12 @@ on_default_output_changed (ValentMixer              *mixer,
                            GParamSpec               *pspec,
                            ValentSystemvolumePlugin *self)
 {
-  ValentMixerStream *default_output = NULL;
-
   g_assert (VALENT_IS_MIXER (mixer));
   g_assert (VALENT_IS_SYSTEMVOLUME_PLUGIN (self));
 
-  default_output = valent_mixer_get_default_output (mixer);
-
+  /* Only the previous and current default outputs will send an update */
   for (unsigned int i = 0; i < self->states->len; i++)
-    {
-      StreamState *state = g_ptr_array_index (self->states, i);
-
-      state->enabled = state->stream == default_output;
-    }
-
-  /* It's unclear whether the `enabled` field with a value of `false` is
-   * relevant in the protocol, we resend the whole list */
-  valent_systemvolume_plugin_send_sinklist (self);
+    stream_state_update (g_ptr_array_index (self->states, i));
 }
 
 static void
@@ -204,27 +270,56 @@ on_items_changed (GListModel               *list,
                   unsigned int              added,
                   ValentSystemvolumePlugin *self)
 {
+  g_autoptr (GHashTable) previous = NULL;
   unsigned int n_streams = 0;
+  gboolean changed = FALSE;
 
   g_assert (G_IS_LIST_MODEL (list));
   g_assert (VALENT_IS_SYSTEMVOLUME_PLUGIN (self));
 
-  g_ptr_array_remove_range (self->states, 0, self->states->len);
+  /* Rebuild the list in the order of the mixer, reusing the state for known
+   * streams, and only send the sink list if the set of outputs changed. */
+  previous = g_steal_pointer (&self->index);
+  self->index = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                       NULL, stream_state_free);
+  g_ptr_array_set_size (self->states, 0);
   n_streams = g_list_model_get_n_items (list);
 
   for (unsigned int i = 0; i < n_streams; i++)
     {
       g_autoptr (ValentMixerStream) stream = NULL;
+      StreamState *state = NULL;
+      const char *name;
 
       stream = g_list_model_get_item (list, i);
 
       if (valent_mixer_stream_get_direction (stream) != VALENT_MIXER_OUTPUT)
         continue;
 
-      g_ptr_array_add (self->states, stream_state_new (self, stream));
+      name = valent_mixer_stream_get_name (stream);
+
+      if (g_hash_table_contains (self->index, name))
+        {
+          g_debug ("%s(): duplicate stream \"%s\"", G_STRFUNC, name);
+          continue;
+        }
+
+      if (g_hash_table_steal_extended (previous, name, NULL, (gpointer *)&state) &&
+          state->stream != stream)
+        g_clear_pointer (&state, stream_state_free);
+
+      if (state == NULL)
+        {
+          state = stream_state_new (self, stream);
+          changed = TRUE;
+        }
+
+      g_hash_table_insert (self->index, state->name, state);
+      g_ptr_array_add (self->states, state);
     }
 
-  valent_systemvolume_plugin_send_sinklist (self);
+  if (changed || g_hash_table_size (previous) > 0)
+    valent_systemvolume_plugin_send_sinklist (self);
 }
 
 static void
@@ -257,7 +352,8 @@ valent_systemvolume_plugin_watch_mixer (ValentSystemvolumePlugin *self,
   else
     {
       g_signal_handlers_disconnect_by_data (self->mixer, self);
-      g_ptr_array_remove_range (self->states, 0, self->states->len);
+      g_ptr_array_set_size (self->states, 0);
+      g_hash_table_remove_all (self->index);
       self->mixer_watch = FALSE;
     }
 }
@@ -410,6 +506,7 @@ valent_systemvolume_plugin_destroy (ValentObject *object)
 
   valent_systemvolume_plugin_watch_mixer (self, FALSE);
   g_clear_pointer (&self->states, g_ptr_array_unref);
+  g_clear_pointer (&self->index, g_hash_table_unref);
 
   VALENT_OBJECT_CLASS (valent_systemvolume_plugin_parent_class)->destroy (object);
 }
@@ -422,7 +519,9 @@ valent_systemvolume_plugin_constructed (GObject *object)
 {
   ValentSystemvolumePlugin *self = VALENT_SYSTEMVOLUME_PLUGIN (object);
 
-  self->states = g_ptr_array_new_with_free_func (stream_state_free);
+  self->states = g_ptr_array_new ();
+  self->index = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                       NULL, stream_state_free);
 
   G_OBJECT_CLASS (valent_systemvolume_plugin_parent_class)->constructed (object);
 }
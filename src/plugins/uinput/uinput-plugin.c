@@ -0,0 +1,19 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#include "config.h"
+
+#include <gio/gio.h>
+#include <libpeas.h>
+#include <valent.h>
+
+#include "valent-uinput-input.h"
+
+
+_VALENT_EXTERN void
+valent_uinput_plugin_register_types (PeasObjectModule *module)
+{
+  peas_object_module_register_extension_type (module,
+                                              VALENT_TYPE_INPUT_ADAPTER,
+                                              VALENT_TYPE_UINPUT_INPUT);
+}
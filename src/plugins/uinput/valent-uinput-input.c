@@ -0,0 +1,551 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#define G_LOG_DOMAIN "valent-uinput-input"
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <linux/uinput.h>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <valent.h>
+#include <xkbcommon/xkbcommon.h>
+
+#include "valent-uinput-input.h"
+
+#define UINPUT_DEVICE_PATH "/dev/uinput"
+#define UINPUT_DEVICE_NAME "Valent Virtual Input"
+
+/* The offset between XKB and evdev keycodes */
+#define XKB_EVDEV_OFFSET (8)
+
+/* Bit flagged in the keymap for keysyms on the shift level */
+#define KEYCODE_SHIFT (1 << 16)
+
+/* The resolution of a high-resolution wheel, in units per detent */
+#define AXIS_HI_RES_DETENT (120)
+
+/* The largest batch of events written at once */
+#define EVENT_BATCH_MAX (8)
+
+
+struct _ValentUinputInput
+{
+  ValentInputAdapter  parent_instance;
+
+  int                 fd;
+  GHashTable         *keymap;
+
+  /* Sub-unit remainders, carried to the next event */
+  double              motion_dx;
+  double              motion_dy;
+  double              axis_dx;
+  double              axis_dy;
+
+  /* High-resolution wheel units, pending a whole detent */
+  int32_t             wheel_x;
+  int32_t             wheel_y;
+};
+
+static void   g_initable_iface_init (GInitableIface *iface);
+
+G_DEFINE_FINAL_TYPE_WITH_CODE (ValentUinputInput, valent_uinput_input, VALENT_TYPE_INPUT_ADAPTER,
+                               G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE, g_initable_iface_init));
+
+
+/*
+ * Keymap
+ *
+ * The virtual device emits evdev keycodes, so keysyms are mapped back to the
+ * key that produces them in the default XKB keymap. Keysyms on the second
+ * shift level are flagged, so the key can be wrapped in a shift press.
+ */
+static void
+keymap_add_key (struct xkb_keymap *keymap,
+                xkb_keycode_t      keycode,
+                void              *data)
+{
+  GHashTable *table = data;
+  xkb_level_index_t n_levels;
+
+  if (keycode < XKB_EVDEV_OFFSET)
+    return;
+
+  n_levels = xkb_keymap_num_levels_for_key (keymap, keycode, 0);
+
+  for (xkb_level_index_t level = 0; level < MIN (n_levels, 2); level++)
+    {
+      const xkb_keysym_t *syms = NULL;
+      int n_syms;
+
+      n_syms = xkb_keymap_key_get_syms_by_level (keymap, keycode, 0, level, &syms);
+
+      for (int i = 0; i < n_syms; i++)
+        {
+          uint32_t code = keycode - XKB_EVDEV_OFFSET;
+
+          /* Prefer the lowest level and keycode */
+          if (g_hash_table_contains (table, GUINT_TO_POINTER (syms[i])))
+            continue;
+
+          if (level == 1)
+            code |= KEYCODE_SHIFT;
+
+          g_hash_table_insert (table,
+                               GUINT_TO_POINTER (syms[i]),
+                               GUINT_TO_POINTER (code));
+        }
+    }
+}
+
+static GHashTable *
+keymap_new (GError **error)
+{
+  g_autoptr (GHashTable) table = NULL;
+  struct xkb_context *context = NULL;
+  struct xkb_keymap *keymap = NULL;
+
+  context = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
+  if (context == NULL)
+    {
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_FAILED,
+                           "Failed to create XKB context");
+      return NULL;
+    }
+
+  /* NULL names select the system defaults (e.g. XKB_DEFAULT_LAYOUT) */
+  keymap = xkb_keymap_new_from_names (context, NULL, XKB_KEYMAP_COMPILE_NO_FLAGS);
+  if (keymap == NULL)
+    {
+      xkb_context_unref (context);
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_FAILED,
+                           "Failed to compile XKB keymap");
+      return NULL;
+    }
+
+  table = g_hash_table_new (NULL, NULL);
+  xkb_keymap_key_for_each (keymap, keymap_add_key, table);
+
+  xkb_keymap_unref (keymap);
+  xkb_context_unref (context);
+
+  return g_steal_pointer (&table);
+}
+
+/*
+ * Event Injection
+ *
+ * Each input is written as one batch, terminated by a synchronization event,
+ * with a single write() to the device.
+ */
+typedef struct
+{
+  struct input_event events[EVENT_BATCH_MAX];
+  unsigned int       n_events;
+} EventBatch;
+
+static inline void
+event_batch_add (EventBatch *batch,
+                 uint16_t    type,
+                 uint16_t    code,
+                 int32_t     value)
+{
+  struct input_event *event;
+
+  g_assert (batch->n_events < EVENT_BATCH_MAX - 1);
+
+  event = &batch->events[batch->n_events++];
+  event->type = type;
+  event->code = code;
+  event->value = value;
+}
+
+static void
+valent_uinput_input_emit (ValentUinputInput *self,
+                          EventBatch        *batch)
+{
+  size_t size;
+  ssize_t written;
+
+  g_assert (VALENT_IS_UINPUT_INPUT (self));
+
+  if G_UNLIKELY (self->fd < 0 || batch->n_events == 0)
+    return;
+
+  batch->events[batch->n_events].type = EV_SYN;
+  batch->events[batch->n_events].code = SYN_REPORT;
+  batch->events[batch->n_events].value = 0;
+  batch->n_events++;
+
+  size = batch->n_events * sizeof (struct input_event);
+
+  do
+    written = write (self->fd, batch->events, size);
+  while (written == -1 && errno == EINTR);
+
+  if G_UNLIKELY (written != (ssize_t)size)
+    g_debug ("%s(): %s", G_STRFUNC, g_strerror (errno));
+}
+
+/* Split @value into whole units, carrying the remainder */
+static inline int32_t
+take_units (double *remainder,
+            double  value)
+{
+  double units;
+
+  *remainder += value;
+  units = trunc (*remainder);
+  *remainder -= units;
+
+  return (int32_t)units;
+}
+
+
+/*
+ * ValentInputAdapter
+ */
+static void
+valent_uinput_input_keyboard_keysym (ValentInputAdapter *adapter,
+                                     uint32_t            keysym,
+                                     gboolean            state)
+{
+  ValentUinputInput *self = VALENT_UINPUT_INPUT (adapter);
+  EventBatch batch = { 0, };
+  gpointer value;
+  uint16_t keycode;
+  gboolean shift;
+
+  g_assert (VALENT_IS_INPUT_ADAPTER (adapter));
+  g_assert (VALENT_IS_UINPUT_INPUT (self));
+
+  if G_UNLIKELY (self->keymap == NULL)
+    return;
+
+  if (!g_hash_table_lookup_extended (self->keymap,
+                                     GUINT_TO_POINTER (keysym),
+                                     NULL,
+                                     &value))
+    {
+      g_debug ("%s(): no keycode for keysym 0x%x", G_STRFUNC, keysym);
+      return;
+    }
+
+  keycode = GPOINTER_TO_UINT (value) & ~KEYCODE_SHIFT;
+  shift = (GPOINTER_TO_UINT (value) & KEYCODE_SHIFT) != 0;
+
+  if (shift && state)
+    event_batch_add (&batch, EV_KEY, KEY_LEFTSHIFT, 1);
+
+  event_batch_add (&batch, EV_KEY, keycode, state ? 1 : 0);
+
+  if (shift && !state)
+    event_batch_add (&batch, EV_KEY, KEY_LEFTSHIFT, 0);
+
+  valent_uinput_input_emit (self, &batch);
+}
+
+static unsigned int
+translate_to_evdev_button (unsigned int button)
+{
+  switch (button)
+    {
+    case VALENT_POINTER_PRIMARY:
+      return BTN_LEFT;
+
+    case VALENT_POINTER_MIDDLE:
+      return BTN_MIDDLE;
+
+    case VALENT_POINTER_SECONDARY:
+      return BTN_RIGHT;
+
+    default:
+      /* Any other buttons go after the legacy scroll buttons (4-7). */
+      return button + (BTN_LEFT - 1) - 4;
+    }
+}
+
+static void
+valent_uinput_input_pointer_axis (ValentInputAdapter *adapter,
+                                  double              dx,
+                                  double              dy)
+{
+  ValentUinputInput *self = VALENT_UINPUT_INPUT (adapter);
+  EventBatch batch = { 0, };
+  int32_t hwheel, wheel;
+
+  g_assert (VALENT_IS_INPUT_ADAPTER (adapter));
+  g_assert (VALENT_IS_UINPUT_INPUT (self));
+  g_assert (!G_APPROX_VALUE (dx, 0.0, 0.01) || !G_APPROX_VALUE (dy, 0.0, 0.01));
+
+  /* Wheel events are positive "away from the user", the inverse of @dy */
+  hwheel = take_units (&self->axis_dx, dx * AXIS_HI_RES_DETENT);
+  wheel = take_units (&self->axis_dy, -dy * AXIS_HI_RES_DETENT);
+
+#ifdef REL_WHEEL_HI_RES
+  if (hwheel != 0)
+    event_batch_add (&batch, EV_REL, REL_HWHEEL_HI_RES, hwheel);
+
+  if (wheel != 0)
+    event_batch_add (&batch, EV_REL, REL_WHEEL_HI_RES, wheel);
+#endif /* REL_WHEEL_HI_RES */
+
+  /* Legacy events are sent for each whole detent */
+  self->wheel_x += hwheel;
+  if (self->wheel_x / AXIS_HI_RES_DETENT != 0)
+    {
+      event_batch_add (&batch, EV_REL, REL_HWHEEL,
+                       self->wheel_x / AXIS_HI_RES_DETENT);
+      self->wheel_x %= AXIS_HI_RES_DETENT;
+    }
+
+  self->wheel_y += wheel;
+  if (self->wheel_y / AXIS_HI_RES_DETENT != 0)
+    {
+      event_batch_add (&batch, EV_REL, REL_WHEEL,
+                       self->wheel_y / AXIS_HI_RES_DETENT);
+      self->wheel_y %= AXIS_HI_RES_DETENT;
+    }
+
+  valent_uinput_input_emit (self, &batch);
+}
+
+static void
+valent_uinput_input_pointer_button (ValentInputAdapter *adapter,
+                                    unsigned int        button,
+                                    gboolean            pressed)
+{
+  ValentUinputInput *self = VALENT_UINPUT_INPUT (adapter);
+  EventBatch batch = { 0, };
+
+  g_assert (VALENT_IS_INPUT_ADAPTER (adapter));
+  g_assert (VALENT_IS_UINPUT_INPUT (self));
+
+  /* Translate the button to EVDEV constant */
+  button = translate_to_evdev_button (button);
+  event_batch_add (&batch, EV_KEY, button, pressed ? 1 : 0);
+  valent_uinput_input_emit (self, &batch);
+}
+
+static void
+valent_uinput_input_pointer_motion (ValentInputAdapter *adapter,
+                                    double              dx,
+                                    double              dy)
+{
+  ValentUinputInput *self = VALENT_UINPUT_INPUT (adapter);
+  EventBatch batch = { 0, };
+  int32_t x, y;
+
+  g_assert (VALENT_IS_INPUT_ADAPTER (adapter));
+  g_assert (VALENT_IS_UINPUT_INPUT (self));
+
+  x = take_units (&self->motion_dx, dx);
+  y = take_units (&self->motion_dy, dy);
+
+  if (x != 0)
+    event_batch_add (&batch, EV_REL, REL_X, x);
+
+  if (y != 0)
+    event_batch_add (&batch, EV_REL, REL_Y, y);
+
+  valent_uinput_input_emit (self, &batch);
+}
+
+
+/*
+ * GInitable
+ */
+static gboolean
+valent_uinput_input_setup (ValentUinputInput  *self,
+                           GError            **error)
+{
+  struct uinput_setup setup = {
+    .id = {
+      .bustype = BUS_VIRTUAL,
+      .vendor = 0x0000,
+      .product = 0x0000,
+      .version = 1,
+    },
+    .name = UINPUT_DEVICE_NAME,
+  };
+  static const unsigned int rel_codes[] = {
+    REL_X,
+    REL_Y,
+    REL_WHEEL,
+    REL_HWHEEL,
+#ifdef REL_WHEEL_HI_RES
+    REL_WHEEL_HI_RES,
+    REL_HWHEEL_HI_RES,
+#endif /* REL_WHEEL_HI_RES */
+  };
+
+  if (ioctl (self->fd, UI_SET_EVBIT, EV_SYN) == -1 ||
+      ioctl (self->fd, UI_SET_EVBIT, EV_KEY) == -1 ||
+      ioctl (self->fd, UI_SET_EVBIT, EV_REL) == -1)
+    goto error;
+
+  /* Keyboard keys, up to the first button code */
+  for (unsigned int code = KEY_ESC; code < BTN_MISC; code++)
+    {
+      if (ioctl (self->fd, UI_SET_KEYBIT, code) == -1)
+        goto error;
+    }
+
+  /* Pointer buttons */
+  for (unsigned int code = BTN_LEFT; code <= BTN_TASK; code++)
+    {
+      if (ioctl (self->fd, UI_SET_KEYBIT, code) == -1)
+        goto error;
+    }
+
+  for (unsigned int i = 0; i < G_N_ELEMENTS (rel_codes); i++)
+    {
+      if (ioctl (self->fd, UI_SET_RELBIT, rel_codes[i]) == -1)
+        goto error;
+    }
+
+  if (ioctl (self->fd, UI_DEV_SETUP, &setup) == -1 ||
+      ioctl (self->fd, UI_DEV_CREATE) == -1)
+    goto error;
+
+  return TRUE;
+
+error:
+  g_set_error (error,
+               G_IO_ERROR,
+               g_io_error_from_errno (errno),
+               "Failed to create virtual input device: %s",
+               g_strerror (errno));
+  return FALSE;
+}
+
+static gboolean
+valent_uinput_input_initable_init (GInitable     *initable,
+                                   GCancellable  *cancellable,
+                                   GError       **error)
+{
+  ValentUinputInput *self = VALENT_UINPUT_INPUT (initable);
+  g_autoptr (GError) warning = NULL;
+
+  g_assert (VALENT_IS_UINPUT_INPUT (self));
+
+  self->fd = open (UINPUT_DEVICE_PATH, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+
+  /* Without access to the device, defer to the other adapters */
+  if (self->fd == -1)
+    {
+      int errsv = errno;
+
+      if (errsv == EACCES || errsv == ENOENT || errsv == EPERM)
+        {
+          g_set_error (&warning,
+                       G_IO_ERROR,
+                       g_io_error_from_errno (errsv),
+                       "%s: %s",
+                       UINPUT_DEVICE_PATH,
+                       g_strerror (errsv));
+          valent_extension_plugin_state_changed (VALENT_EXTENSION (self),
+                                                 VALENT_PLUGIN_STATE_INACTIVE,
+                                                 warning);
+          return TRUE;
+        }
+
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errsv),
+                   "%s: %s",
+                   UINPUT_DEVICE_PATH,
+                   g_strerror (errsv));
+      valent_extension_plugin_state_changed (VALENT_EXTENSION (self),
+                                             VALENT_PLUGIN_STATE_ERROR,
+                                             *error);
+      return FALSE;
+    }
+
+  if ((self->keymap = keymap_new (error)) == NULL ||
+      !valent_uinput_input_setup (self, error))
+    {
+      g_clear_fd (&self->fd, NULL);
+      valent_extension_plugin_state_changed (VALENT_EXTENSION (self),
+                                             VALENT_PLUGIN_STATE_ERROR,
+                                             *error);
+      return FALSE;
+    }
+
+  valent_extension_plugin_state_changed (VALENT_EXTENSION (self),
+                                         VALENT_PLUGIN_STATE_ACTIVE,
+                                         NULL);
+
+  return TRUE;
+}
+
+static void
+g_initable_iface_init (GInitableIface *iface)
+{
+  iface->init = valent_uinput_input_initable_init;
+}
+
+/*
+ * ValentObject
+ */
+static void
+valent_uinput_input_destroy (ValentObject *object)
+{
+  ValentUinputInput *self = VALENT_UINPUT_INPUT (object);
+
+  if (self->fd >= 0)
+    {
+      ioctl (self->fd, UI_DEV_DESTROY);
+      g_clear_fd (&self->fd, NULL);
+    }
+
+  VALENT_OBJECT_CLASS (valent_uinput_input_parent_class)->destroy (object);
+}
+
+/*
+ * GObject
+ */
+static void
+valent_uinput_input_finalize (GObject *object)
+{
+  ValentUinputInput *self = VALENT_UINPUT_INPUT (object);
+
+  g_clear_pointer (&self->keymap, g_hash_table_unref);
+
+  G_OBJECT_CLASS (valent_uinput_input_parent_class)->finalize (object);
+}
+
+static void
+valent_uinput_input_class_init (ValentUinputInputClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  ValentObjectClass *vobject_class = VALENT_OBJECT_CLASS (klass);
+  ValentInputAdapterClass *adapter_class = VALENT_INPUT_ADAPTER_CLASS (klass);
+
+  object_class->finalize = valent_uinput_input_finalize;
+
+  vobject_class->destroy = valent_uinput_input_destroy;
+
+  adapter_class->keyboard_keysym = valent_uinput_input_keyboard_keysym;
+  adapter_class->pointer_axis = valent_uinput_input_pointer_axis;
+  adapter_class->pointer_button = valent_uinput_input_pointer_button;
+  adapter_class->pointer_motion = valent_uinput_input_pointer_motion;
+}
+
+static void
+valent_uinput_input_init (ValentUinputInput *self)
+{
+  self->fd = -1;
+}
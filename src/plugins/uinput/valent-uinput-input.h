@@ -0,0 +1,14 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#pragma once
+
+#include <valent.h>
+
+G_BEGIN_DECLS
+
+#define VALENT_TYPE_UINPUT_INPUT (valent_uinput_input_get_type())
+
+G_DECLARE_FINAL_TYPE (ValentUinputInput, valent_uinput_input, VALENT, UINPUT_INPUT, ValentInputAdapter)
+
+G_END_DECLS
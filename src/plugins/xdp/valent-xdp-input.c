@@ -21,6 +21,7 @@
 #include <libportal/portal.h>
 #include <valent.h>
 
+#include "valent-input-queue-private.h"
 #include "valent-xdp-input.h"
 #include "valent-xdp-utils.h"
 
@@ -37,6 +38,9 @@ struct _ValentXdpInput
   guint               session_expiry_id;
   gboolean            session_starting;
   gboolean            started;
+
+  /* Events received while the session is starting */
+  ValentInputQueue   *events;
 };
 
 G_DEFINE_FINAL_TYPE (ValentXdpInput, valent_xdp_input, VALENT_TYPE_INPUT_ADAPTER)
@@ -64,6 +68,7 @@ on_session_closed (XdpSession *session,
 
   /* Mark the session as inactive */
   self->started = FALSE;
+  valent_input_queue_clear (self->events);
   g_clear_handle_id (&self->session_expiry_id, g_source_remove);
   g_clear_object (&self->session);
 }
@@ -114,6 +119,7 @@ on_session_started (XdpSession   *session,
       g_warning ("%s(): %s", G_STRFUNC, error->message);
       g_clear_object (&self->session);
       self->session_starting = FALSE;
+      valent_input_queue_clear (self->events);
 
       return;
     }
@@ -124,6 +130,7 @@ on_session_started (XdpSession   *session,
       g_warning ("%s(): failed to get input device", G_STRFUNC);
       g_clear_object (&self->session);
       self->session_starting = FALSE;
+      valent_input_queue_clear (self->events);
 
       return;
     }
@@ -143,6 +150,7 @@ on_session_started (XdpSession   *session,
 
   self->session_starting = FALSE;
   self->started = TRUE;
+  valent_input_queue_replay (self->events, VALENT_INPUT_ADAPTER (self));
 }
 
 static void
@@ -162,6 +170,7 @@ on_session_created (XdpPortal    *portal,
     {
       g_warning ("%s(): %s", G_STRFUNC, error->message);
       self->session_starting = FALSE;
+      valent_input_queue_clear (self->events);
 
       return;
     }
@@ -221,7 +230,10 @@ valent_xdp_input_keyboard_keysym (ValentInputAdapter *adapter,
   g_assert (VALENT_IS_XDP_INPUT (self));
 
   if G_UNLIKELY (!ensure_session (self))
-    return;
+    {
+      valent_input_queue_keyboard_keysym (self->events, keysym, state);
+      return;
+    }
 
   // TODO: XDP_KEY_PRESSED/XDP_KEY_RELEASED
 
@@ -260,7 +272,10 @@ valent_xdp_input_pointer_axis (ValentInputAdapter *adapter,
   g_assert (!G_APPROX_VALUE (dx, 0.0, 0.01) || !G_APPROX_VALUE (dy, 0.0, 0.01));
 
   if G_UNLIKELY (!ensure_session (self))
-    return;
+    {
+      valent_input_queue_pointer_axis (self->events, dx, dy);
+      return;
+    }
 
   /* On X11 we use discrete axis steps (eg. mouse wheel) because the absolute
    * axis change doesn't seem to work
@@ -298,7 +313,10 @@ valent_xdp_input_pointer_button (ValentInputAdapter *adapter,
   g_assert (VALENT_IS_XDP_INPUT (self));
 
   if G_UNLIKELY (!ensure_session (self))
-    return;
+    {
+      valent_input_queue_pointer_button (self->events, button, pressed);
+      return;
+    }
 
   /* Translate the button to EVDEV constant */
   button = translate_to_evdev_button (button);
@@ -316,7 +334,10 @@ valent_xdp_input_pointer_motion (ValentInputAdapter *adapter,
   g_assert (VALENT_IS_XDP_INPUT (self));
 
   if G_UNLIKELY (!ensure_session (self))
-    return;
+    {
+      valent_input_queue_pointer_motion (self->events, dx, dy);
+      return;
+    }
 
   xdp_session_pointer_motion (self->session, dx, dy);
 }
@@ -349,6 +370,7 @@ valent_xdp_input_finalize (GObject *object)
   g_clear_object (&self->cancellable);
   g_clear_object (&self->settings);
   g_clear_object (&self->session);
+  g_clear_pointer (&self->events, valent_input_queue_free);
 
   G_OBJECT_CLASS (valent_xdp_input_parent_class)->finalize (object);
 }
@@ -375,5 +397,6 @@ valent_xdp_input_init (ValentXdpInput *self)
 {
   self->cancellable = g_cancellable_new ();
   self->settings = g_settings_new ("ca.andyholmes.Valent.Plugin.xdp");
+  self->events = valent_input_queue_new ();
 }
 
@@ -23,10 +23,15 @@ valent_mock_device_plugin_handle_echo (ValentMockDevicePlugin *self,
 {
   g_autoptr (JsonNode) response = NULL;
   g_autofree char *packet_json = NULL;
+  int64_t delay = 0;
 
   g_assert (VALENT_IS_MOCK_DEVICE_PLUGIN (self));
   g_assert (VALENT_IS_PACKET (packet));
 
+  /* Simulate a slow handler, for testing the handler budget */
+  if (valent_packet_get_int (packet, "delay", &delay) && delay > 0)
+    g_usleep (delay * 1000);
+
   packet_json = json_to_string (packet, TRUE);
   g_message ("Received echo: %s", packet_json);
 
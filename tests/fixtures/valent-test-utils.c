@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 // SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
 
+#include <errno.h>
 #include <locale.h>
 #include <stdio.h>
 #include <sys/socket.h>
@@ -580,6 +581,75 @@ valent_test_upload (ValentChannel  *channel,
   return g_task_propagate_boolean (task, error);
 }
 
+/**
+ * valent_test_benchmark:
+ * @name: a name for the measurement
+ * @unit: the unit of @value
+ * @value: the measured value
+ * @maximized: %TRUE if larger values are better
+ *
+ * Report a benchmark result for the current test.
+ *
+ * The result is logged with g_test_maximized_result() or
+ * g_test_minimized_result(). If `VALENT_BENCHMARK_OUTPUT` is set, it is also
+ * appended to that file as a line of JSON, so that results can be compared
+ * between builds.
+ */
+void
+valent_test_benchmark (const char *name,
+                       const char *unit,
+                       double      value,
+                       gboolean    maximized)
+{
+  const char *path;
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) result = NULL;
+  g_autofree char *line = NULL;
+  FILE *file;
+
+  g_assert (name != NULL && *name != '\0');
+  g_assert (unit != NULL && *unit != '\0');
+
+  if (maximized)
+    g_test_maximized_result (value, "%s: %.3f %s", name, value, unit);
+  else
+    g_test_minimized_result (value, "%s: %.3f %s", name, value, unit);
+
+  path = g_getenv ("VALENT_BENCHMARK_OUTPUT");
+
+  if (path == NULL || *path == '\0')
+    return;
+
+  builder = json_builder_new ();
+  json_builder_begin_object (builder);
+  json_builder_set_member_name (builder, "test");
+  json_builder_add_string_value (builder, g_test_get_path ());
+  json_builder_set_member_name (builder, "name");
+  json_builder_add_string_value (builder, name);
+  json_builder_set_member_name (builder, "value");
+  json_builder_add_double_value (builder, value);
+  json_builder_set_member_name (builder, "unit");
+  json_builder_add_string_value (builder, unit);
+  json_builder_set_member_name (builder, "better");
+  json_builder_add_string_value (builder, maximized ? "higher" : "lower");
+  json_builder_set_member_name (builder, "time");
+  json_builder_add_int_value (builder, g_get_real_time () / G_USEC_PER_SEC);
+  json_builder_end_object (builder);
+  result = json_builder_get_root (builder);
+
+  line = json_to_string (result, FALSE);
+
+  /* Results from every benchmark executable share the file */
+  if ((file = fopen (path, "a")) == NULL)
+    {
+      g_warning ("%s(): %s: %s", G_STRFUNC, path, g_strerror (errno));
+      return;
+    }
+
+  fprintf (file, "%s\n", line);
+  fclose (file);
+}
+
 static void
 valent_type_ensure (void)
 {
@@ -51,6 +51,10 @@ gboolean         valent_test_upload        (ValentChannel    *channel,
                                             JsonNode         *packet,
                                             GFile            *file,
                                             GError          **error);
+void             valent_test_benchmark     (const char       *name,
+                                            const char       *unit,
+                                            double            value,
+                                            gboolean          maximized);
 
 #define valent_test_await_boolean(ptr)        \
   G_STMT_START {                              \
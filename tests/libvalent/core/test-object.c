@@ -4,6 +4,8 @@
 #include <valent.h>
 #include <libvalent-test.h>
 
+#include "valent-object-private.h"
+
 
 static void
 on_destroy (ValentObject *object,
@@ -222,6 +224,69 @@ test_object_notify_thread (void)
 }
 
 
+static void
+on_notify_count (ValentObject *object,
+                 GParamSpec   *pspec,
+                 unsigned int *n_notified)
+{
+  g_assert_true (VALENT_IS_MAIN_THREAD());
+  g_assert_true (G_IS_PARAM_SPEC (pspec));
+
+  *n_notified += 1;
+}
+
+static void
+invoke_main_func (ValentObject *object,
+                  gpointer      user_data)
+{
+  gboolean *invoked = user_data;
+
+  g_assert_true (VALENT_IS_MAIN_THREAD());
+  g_assert_true (VALENT_IS_OBJECT (object));
+
+  *invoked = TRUE;
+}
+
+static gpointer
+coalesce_thread_func (ValentObject *object)
+{
+  gboolean *invoked = g_object_get_data (G_OBJECT (object), "invoked");
+
+  for (unsigned int i = 0; i < 1000; i++)
+    valent_object_notify (object, "cancellable");
+
+  valent_object_invoke_main (object, invoke_main_func, invoked, NULL);
+
+  return NULL;
+}
+
+static void
+test_object_notify_coalesce (void)
+{
+  g_autoptr (ValentObject) object = NULL;
+  g_autoptr (GThread) thread = NULL;
+  unsigned int n_notified = 0;
+  gboolean invoked = FALSE;
+
+  object = g_object_new (VALENT_TYPE_OBJECT, NULL);
+  g_object_set_data (G_OBJECT (object), "invoked", &invoked);
+  g_signal_connect (object,
+                    "notify::cancellable",
+                    G_CALLBACK (on_notify_count),
+                    &n_notified);
+
+  /* Every emission is queued before the main context is iterated, so they
+   * should be dispatched together and the notifications coalesced. */
+  thread = g_thread_new ("valent-object-coalesce",
+                         (GThreadFunc)coalesce_thread_func,
+                         object);
+  g_assert_null (g_thread_join (g_steal_pointer (&thread)));
+
+  valent_test_await_boolean (&invoked);
+  g_assert_cmpuint (n_notified, ==, 1);
+}
+
+
 int
 main (int   argc,
       char *argv[])
@@ -243,5 +308,8 @@ main (int   argc,
   g_test_add_func ("/libvalent/core/object/notify-thread",
                    test_object_notify_thread);
 
+  g_test_add_func ("/libvalent/core/object/notify-coalesce",
+                   test_object_notify_coalesce);
+
   g_test_run ();
 }
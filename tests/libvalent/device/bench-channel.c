@@ -0,0 +1,196 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#include <valent.h>
+#include <libvalent-test.h>
+
+#define N_ROUND_TRIPS 1000
+#define N_PACKETS     10000
+
+
+typedef struct
+{
+  JsonNode      *node;
+  JsonNode      *large_node;
+  ValentChannel *channel;
+  ValentChannel *endpoint;
+} ChannelFixture;
+
+static void
+channel_fixture_set_up (ChannelFixture *fixture,
+                        gconstpointer   user_data)
+{
+  g_autofree ValentChannel **channels = NULL;
+  JsonNode *identity;
+
+  fixture->node = valent_test_load_json ("core.json");
+  fixture->large_node = valent_test_load_json ("core-large.json");
+
+  identity = json_object_get_member (json_node_get_object (fixture->node),
+                                     "identity");
+
+  channels = valent_test_channel_pair (identity, identity);
+  fixture->channel = g_steal_pointer (&channels[0]);
+  fixture->endpoint = g_steal_pointer (&channels[1]);
+}
+
+static void
+channel_fixture_tear_down (ChannelFixture *fixture,
+                           gconstpointer   user_data)
+{
+  valent_channel_close (fixture->endpoint, NULL, NULL);
+  valent_channel_close (fixture->channel, NULL, NULL);
+
+  v_await_finalize_object (fixture->endpoint);
+  v_await_finalize_object (fixture->channel);
+
+  g_clear_pointer (&fixture->node, json_node_unref);
+  g_clear_pointer (&fixture->large_node, json_node_unref);
+}
+
+static void
+read_packet_cb (ValentChannel  *channel,
+                GAsyncResult   *result,
+                JsonNode      **packet)
+{
+  g_autoptr (GError) error = NULL;
+
+  *packet = valent_channel_read_packet_finish (channel, result, &error);
+  g_assert_no_error (error);
+}
+
+static void
+write_packet_cb (ValentChannel *channel,
+                 GAsyncResult  *result,
+                 unsigned int  *n_written)
+{
+  g_autoptr (GError) error = NULL;
+
+  valent_channel_write_packet_finish (channel, result, &error);
+  g_assert_no_error (error);
+
+  *n_written += 1;
+}
+
+static JsonNode *
+read_packet (ValentChannel *channel)
+{
+  JsonNode *packet = NULL;
+
+  valent_channel_read_packet (channel,
+                              NULL,
+                              (GAsyncReadyCallback)read_packet_cb,
+                              &packet);
+  valent_test_await_pointer (&packet);
+
+  return packet;
+}
+
+static void
+bench_channel_round_trip (ChannelFixture *fixture,
+                          gconstpointer   user_data)
+{
+  JsonNode *packet;
+  unsigned int n_written = 0;
+  double elapsed;
+
+  packet = json_object_get_member (json_node_get_object (fixture->node),
+                                   "test-echo");
+
+  VALENT_TEST_CHECK ("Packets can be echoed between two channels");
+  g_test_timer_start ();
+
+  for (unsigned int i = 0; i < N_ROUND_TRIPS; i++)
+    {
+      g_autoptr (JsonNode) request = NULL;
+      g_autoptr (JsonNode) response = NULL;
+
+      valent_channel_write_packet (fixture->channel,
+                                   packet,
+                                   NULL,
+                                   (GAsyncReadyCallback)write_packet_cb,
+                                   &n_written);
+      request = read_packet (fixture->endpoint);
+
+      valent_channel_write_packet (fixture->endpoint,
+                                   request,
+                                   NULL,
+                                   (GAsyncReadyCallback)write_packet_cb,
+                                   &n_written);
+      response = read_packet (fixture->channel);
+    }
+
+  while (n_written < N_ROUND_TRIPS * 2)
+    g_main_context_iteration (NULL, FALSE);
+
+  elapsed = g_test_timer_elapsed ();
+
+  valent_test_benchmark ("round-trip latency", "µs",
+                         elapsed * G_USEC_PER_SEC / N_ROUND_TRIPS,
+                         FALSE);
+}
+
+static void
+bench_channel_throughput (ChannelFixture *fixture,
+                          gconstpointer   user_data)
+{
+  JsonNode *packet;
+  g_autofree char *packet_str = NULL;
+  unsigned int n_written = 0;
+  double elapsed;
+
+  packet = fixture->large_node;
+  packet_str = valent_packet_serialize (packet);
+
+  VALENT_TEST_CHECK ("Packets can be streamed from one channel to another");
+  g_test_timer_start ();
+
+  for (unsigned int i = 0; i < N_PACKETS; i++)
+    {
+      valent_channel_write_packet (fixture->channel,
+                                   packet,
+                                   NULL,
+                                   (GAsyncReadyCallback)write_packet_cb,
+                                   &n_written);
+    }
+
+  for (unsigned int i = 0; i < N_PACKETS; i++)
+    {
+      g_autoptr (JsonNode) received = NULL;
+
+      received = read_packet (fixture->endpoint);
+    }
+
+  while (n_written < N_PACKETS)
+    g_main_context_iteration (NULL, FALSE);
+
+  elapsed = g_test_timer_elapsed ();
+
+  valent_test_benchmark ("packet rate", "packets/s",
+                         N_PACKETS / elapsed,
+                         TRUE);
+  valent_test_benchmark ("packet throughput", "MiB/s",
+                         (double)strlen (packet_str) * N_PACKETS / elapsed / (1024 * 1024),
+                         TRUE);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  valent_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/libvalent/device/channel/round-trip",
+              ChannelFixture, NULL,
+              channel_fixture_set_up,
+              bench_channel_round_trip,
+              channel_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/channel/throughput",
+              ChannelFixture, NULL,
+              channel_fixture_set_up,
+              bench_channel_throughput,
+              channel_fixture_tear_down);
+
+  return g_test_run ();
+}
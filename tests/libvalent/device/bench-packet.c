@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#include <valent.h>
+#include <libvalent-test.h>
+
+#define N_ITERATIONS 10000
+
+
+typedef struct
+{
+  JsonNode *node;
+  JsonNode *large_node;
+} PacketFixture;
+
+static void
+packet_fixture_set_up (PacketFixture *fixture,
+                       gconstpointer  user_data)
+{
+  fixture->node = valent_test_load_json ("core.json");
+  fixture->large_node = valent_test_load_json ("core-large.json");
+}
+
+static void
+packet_fixture_tear_down (PacketFixture *fixture,
+                          gconstpointer  user_data)
+{
+  g_clear_pointer (&fixture->node, json_node_unref);
+  g_clear_pointer (&fixture->large_node, json_node_unref);
+}
+
+static JsonNode *
+packet_fixture_get_packet (PacketFixture *fixture,
+                           const char    *name)
+{
+  if (g_strcmp0 (name, "large") == 0)
+    return fixture->large_node;
+
+  return json_object_get_member (json_node_get_object (fixture->node), name);
+}
+
+static void
+bench_packet_serialize (PacketFixture *fixture,
+                        gconstpointer  user_data)
+{
+  JsonNode *packet = packet_fixture_get_packet (fixture, user_data);
+  size_t n_bytes = 0;
+  double elapsed;
+
+  VALENT_TEST_CHECK ("Function `valent_packet_serialize()` performance");
+  g_test_timer_start ();
+
+  for (unsigned int i = 0; i < N_ITERATIONS; i++)
+    {
+      g_autofree char *packet_str = NULL;
+
+      packet_str = valent_packet_serialize (packet);
+      n_bytes += strlen (packet_str);
+    }
+
+  elapsed = g_test_timer_elapsed ();
+
+  valent_test_benchmark ("serialize latency", "µs/packet",
+                         elapsed * G_USEC_PER_SEC / N_ITERATIONS,
+                         FALSE);
+  valent_test_benchmark ("serialize throughput", "MiB/s",
+                         n_bytes / elapsed / (1024 * 1024),
+                         TRUE);
+}
+
+static void
+bench_packet_deserialize (PacketFixture *fixture,
+                          gconstpointer  user_data)
+{
+  JsonNode *packet = packet_fixture_get_packet (fixture, user_data);
+  g_autofree char *packet_str = NULL;
+  size_t n_bytes;
+  double elapsed;
+
+  packet_str = valent_packet_serialize (packet);
+  n_bytes = strlen (packet_str);
+
+  VALENT_TEST_CHECK ("Function `valent_packet_deserialize()` performance");
+  g_test_timer_start ();
+
+  for (unsigned int i = 0; i < N_ITERATIONS; i++)
+    {
+      g_autoptr (JsonNode) result = NULL;
+      g_autoptr (GError) error = NULL;
+
+      result = valent_packet_deserialize (packet_str, &error);
+      g_assert_no_error (error);
+    }
+
+  elapsed = g_test_timer_elapsed ();
+
+  valent_test_benchmark ("deserialize latency", "µs/packet",
+                         elapsed * G_USEC_PER_SEC / N_ITERATIONS,
+                         FALSE);
+  valent_test_benchmark ("deserialize throughput", "MiB/s",
+                         (double)n_bytes * N_ITERATIONS / elapsed / (1024 * 1024),
+                         TRUE);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  valent_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/libvalent/device/packet/serialize/identity",
+              PacketFixture, "identity",
+              packet_fixture_set_up,
+              bench_packet_serialize,
+              packet_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/packet/serialize/large",
+              PacketFixture, "large",
+              packet_fixture_set_up,
+              bench_packet_serialize,
+              packet_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/packet/deserialize/identity",
+              PacketFixture, "identity",
+              packet_fixture_set_up,
+              bench_packet_deserialize,
+              packet_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/packet/deserialize/large",
+              PacketFixture, "large",
+              packet_fixture_set_up,
+              bench_packet_deserialize,
+              packet_fixture_tear_down);
+
+  return g_test_run ();
+}
@@ -1,9 +1,15 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 // SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
 
+#include <sys/socket.h>
+
+#include <glib/gstdio.h>
+
 #include <valent.h>
 #include <libvalent-test.h>
 
+#define N_HANDSHAKES (10)
+
 
 static void
 new_certificate_cb (GObject          *object,
@@ -18,6 +24,20 @@ new_certificate_cb (GObject          *object,
   g_assert_no_error (error);
 }
 
+static void
+certificate_path_remove (const char *path)
+{
+  g_autofree char *cert_path = NULL;
+  g_autofree char *key_path = NULL;
+
+  cert_path = g_build_filename (path, "certificate.pem", NULL);
+  key_path = g_build_filename (path, "private.pem", NULL);
+
+  g_remove (cert_path);
+  g_remove (key_path);
+  g_rmdir (path);
+}
+
 static void
 test_certificate_new (void)
 {
@@ -33,6 +53,8 @@ test_certificate_new (void)
 
   g_assert_true (G_IS_TLS_CERTIFICATE (certificate));
   g_clear_object (&certificate);
+
+  certificate_path_remove (path);
 }
 
 static void
@@ -60,6 +82,138 @@ test_certificate_properties (void)
   g_assert_cmpuint (public_key->len, >, 0);
 
   g_clear_object (&certificate);
+  certificate_path_remove (path);
+}
+
+static gboolean
+accept_certificate_cb (GTlsConnection       *connection,
+                       GTlsCertificate      *peer_cert,
+                       GTlsCertificateFlags  errors,
+                       gpointer              user_data)
+{
+  return TRUE;
+}
+
+static void
+handshake_cb (GTlsConnection *connection,
+              GAsyncResult   *result,
+              gboolean       *done)
+{
+  GError *error = NULL;
+
+  g_tls_connection_handshake_finish (connection, result, &error);
+  g_assert_no_error (error);
+
+  *done = TRUE;
+}
+
+static int64_t
+certificate_handshake (GTlsCertificate *certificate)
+{
+  g_autoptr (GSocket) server_socket = NULL;
+  g_autoptr (GSocket) client_socket = NULL;
+  g_autoptr (GSocketConnection) server_base = NULL;
+  g_autoptr (GSocketConnection) client_base = NULL;
+  g_autoptr (GIOStream) server = NULL;
+  g_autoptr (GIOStream) client = NULL;
+  gboolean server_done = FALSE;
+  gboolean client_done = FALSE;
+  int64_t begin;
+  int fds[2];
+  GError *error = NULL;
+
+  g_assert_no_errno (socketpair (AF_UNIX, SOCK_STREAM, 0, fds));
+  server_socket = g_socket_new_from_fd (fds[0], &error);
+  g_assert_no_error (error);
+  client_socket = g_socket_new_from_fd (fds[1], &error);
+  g_assert_no_error (error);
+
+  server_base = g_socket_connection_factory_create_connection (server_socket);
+  client_base = g_socket_connection_factory_create_connection (client_socket);
+
+  /* Both sides authenticate, as they do in KDE Connect */
+  server = g_tls_server_connection_new (G_IO_STREAM (server_base),
+                                        certificate,
+                                        &error);
+  g_assert_no_error (error);
+  g_object_set (server,
+                "authentication-mode", G_TLS_AUTHENTICATION_REQUIRED,
+                NULL);
+
+  client = g_tls_client_connection_new (G_IO_STREAM (client_base), NULL, &error);
+  g_assert_no_error (error);
+  g_tls_connection_set_certificate (G_TLS_CONNECTION (client), certificate);
+
+  g_signal_connect (server,
+                    "accept-certificate",
+                    G_CALLBACK (accept_certificate_cb),
+                    NULL);
+  g_signal_connect (client,
+                    "accept-certificate",
+                    G_CALLBACK (accept_certificate_cb),
+                    NULL);
+
+  begin = g_get_monotonic_time ();
+  g_tls_connection_handshake_async (G_TLS_CONNECTION (server),
+                                    G_PRIORITY_DEFAULT,
+                                    NULL,
+                                    (GAsyncReadyCallback)handshake_cb,
+                                    &server_done);
+  g_tls_connection_handshake_async (G_TLS_CONNECTION (client),
+                                    G_PRIORITY_DEFAULT,
+                                    NULL,
+                                    (GAsyncReadyCallback)handshake_cb,
+                                    &client_done);
+  valent_test_await_boolean (&server_done);
+  valent_test_await_boolean (&client_done);
+
+  return g_get_monotonic_time () - begin;
+}
+
+static void
+test_certificate_key_type (gconstpointer user_data)
+{
+  const char *key_type = user_data;
+  g_autoptr (GTlsCertificate) certificate = NULL;
+  g_autofree char *path = NULL;
+  GError *error = NULL;
+  int64_t generate_time = 0;
+  int64_t handshake_time = 0;
+  unsigned int n_handshakes = 1;
+
+  VALENT_TEST_CHECK ("Certificates can be generated with a %s key", key_type);
+  path = g_dir_make_tmp ("XXXXXX.valent", NULL);
+
+  g_setenv ("VALENT_CERTIFICATE_KEY_TYPE", key_type, TRUE);
+  generate_time = g_get_monotonic_time ();
+  certificate = valent_certificate_new_sync (path, &error);
+  generate_time = g_get_monotonic_time () - generate_time;
+  g_unsetenv ("VALENT_CERTIFICATE_KEY_TYPE");
+
+  g_assert_no_error (error);
+  g_assert_true (G_IS_TLS_CERTIFICATE (certificate));
+  g_assert_nonnull (valent_certificate_get_common_name (certificate));
+  g_assert_nonnull (valent_certificate_get_fingerprint (certificate));
+  g_assert_nonnull (valent_certificate_get_public_key (certificate));
+
+  VALENT_TEST_CHECK ("Certificates with a %s key can authenticate a TLS connection",
+                     key_type);
+  if (g_test_perf ())
+    n_handshakes = N_HANDSHAKES;
+
+  for (unsigned int i = 0; i < n_handshakes; i++)
+    handshake_time += certificate_handshake (certificate);
+
+  g_test_minimized_result ((double)generate_time / G_USEC_PER_SEC,
+                           "%s key generation: %.3fs",
+                           key_type,
+                           (double)generate_time / G_USEC_PER_SEC);
+  g_test_minimized_result ((double)handshake_time / n_handshakes / 1000,
+                           "%s handshake: %.3fms",
+                           key_type,
+                           (double)handshake_time / n_handshakes / 1000);
+
+  certificate_path_remove (path);
 }
 
 int
@@ -73,5 +227,15 @@ main (int   argc,
   g_test_add_func ("/libvalent/device/certificate/properties",
                    test_certificate_properties);
 
+  g_test_add_data_func ("/libvalent/device/certificate/key-type/rsa",
+                        "rsa",
+                        test_certificate_key_type);
+  g_test_add_data_func ("/libvalent/device/certificate/key-type/ecdsa",
+                        "ecdsa",
+                        test_certificate_key_type);
+  g_test_add_data_func ("/libvalent/device/certificate/key-type/ed25519",
+                        "ed25519",
+                        test_certificate_key_type);
+
   return g_test_run ();
 }
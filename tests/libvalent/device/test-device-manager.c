@@ -2,9 +2,12 @@
 // SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
 
 #include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
 #include <valent.h>
 #include <libvalent-test.h>
 
+#include "valent-counters-private.h"
 #include "valent-mock-channel.h"
 #include "valent-mock-channel-service.h"
 
@@ -31,6 +34,7 @@ manager_fixture_set_up (ManagerFixture *fixture,
   g_autoptr (JsonNode) state = NULL;
   g_autofree char *state_json = NULL;
   g_autofree char *state_path = NULL;
+  g_autofree char *journal_path = NULL;
 
   /* Copy the mock device configuration */
   context = valent_context_new (NULL, NULL, NULL);
@@ -41,6 +45,8 @@ manager_fixture_set_up (ManagerFixture *fixture,
   state_json = json_to_string (state, TRUE);
   state_path = g_build_filename (cache_path, "devices.json", NULL);
   g_file_set_contents (state_path, state_json, -1, NULL);
+  journal_path = g_build_filename (cache_path, "devices.journal", NULL);
+  g_remove (journal_path);
 
   fixture->manager = valent_device_manager_get_default ();
 }
@@ -121,6 +127,12 @@ test_manager_management (ManagerFixture *fixture,
   valent_device_manager_refresh (fixture->manager);
   g_assert_true (VALENT_IS_DEVICE (fixture->device));
 
+  VALENT_TEST_CHECK ("Manager records the time to the first identity");
+  g_assert_cmpint (valent_counter_get (VALENT_COUNTER_FIRST_IDENTITY), >, 0);
+  g_test_minimized_result (valent_counter_get (VALENT_COUNTER_FIRST_IDENTITY) / 1000.0,
+                           "First identity after %.3fms",
+                           valent_counter_get (VALENT_COUNTER_FIRST_IDENTITY) / 1000.0);
+
   n_devices = g_list_model_get_n_items (G_LIST_MODEL (fixture->manager));
   g_assert_cmpuint (n_devices, ==, 1);
 
@@ -129,6 +141,230 @@ test_manager_management (ManagerFixture *fixture,
   g_assert_true (VALENT_IS_DEVICE (fixture->device));
 }
 
+static void
+test_manager_state (ManagerFixture *fixture,
+                    gconstpointer   user_data)
+{
+  g_autoptr (ValentContext) context = NULL;
+  g_autoptr (GFile) cache = NULL;
+  g_autoptr (JsonNode) state = NULL;
+  g_autoptr (JsonNode) record = NULL;
+  g_autoptr (GString) journal = NULL;
+  g_autofree char *state_path = NULL;
+  g_autofree char *journal_path = NULL;
+  g_autofree char *contents = NULL;
+  g_autofree char *expected_id = NULL;
+  JsonObjectIter iter;
+  const char *device_id;
+  JsonNode *identity;
+  unsigned int n_devices = 0;
+
+  /* An empty snapshot, with the devices in the journal followed by a record
+   * that was only partially written */
+  context = valent_context_new (NULL, NULL, NULL);
+  cache = valent_context_get_cache_file (context, ".");
+  state_path = g_build_filename (g_file_peek_path (cache), "devices.json", NULL);
+  journal_path = g_build_filename (g_file_peek_path (cache), "devices.journal", NULL);
+
+  state = valent_test_load_json ("core-state.json");
+  journal = g_string_new (NULL);
+  json_object_iter_init (&iter, json_node_get_object (state));
+
+  while (json_object_iter_next (&iter, &device_id, &identity))
+    {
+      g_autofree char *json = json_to_string (identity, FALSE);
+
+      g_string_append_printf (journal,
+                              "{\"deviceId\":\"%s\",\"identity\":%s}\n",
+                              device_id, json);
+    }
+
+  g_string_append (journal, "{\"deviceId\":\"");
+  g_file_set_contents (state_path, "{}", -1, NULL);
+  g_file_set_contents (journal_path, journal->str, journal->len, NULL);
+
+  g_signal_connect (fixture->manager,
+                    "items-changed",
+                    G_CALLBACK (on_devices_changed),
+                    fixture);
+
+  VALENT_TEST_CHECK ("Manager replays the state journal when started");
+  valent_application_plugin_startup (VALENT_APPLICATION_PLUGIN (fixture->manager));
+  valent_test_await_pointer (&fixture->device);
+
+  n_devices = g_list_model_get_n_items (G_LIST_MODEL (fixture->manager));
+  g_assert_cmpuint (n_devices, ==, 1);
+
+  VALENT_TEST_CHECK ("Manager compacts a damaged state journal");
+  g_assert_true (g_file_get_contents (journal_path, &contents, NULL, NULL));
+  g_assert_cmpstr (contents, ==, "");
+  g_clear_pointer (&contents, g_free);
+
+  VALENT_TEST_CHECK ("Manager journals state changes as they happen");
+  expected_id = g_strdup (valent_device_get_id (fixture->device));
+  g_object_notify (G_OBJECT (fixture->device), "state");
+  g_assert_false (VALENT_IS_DEVICE (fixture->device));
+
+  g_assert_true (g_file_get_contents (journal_path, &contents, NULL, NULL));
+  g_assert_true (strchr (contents, '\n') == strrchr (contents, '\n'));
+  g_assert_true (g_str_has_suffix (contents, "\n"));
+
+  record = json_from_string (contents, NULL);
+  g_assert_true (JSON_NODE_HOLDS_OBJECT (record));
+  g_assert_cmpstr (json_object_get_string_member (json_node_get_object (record), "deviceId"),
+                   ==, expected_id);
+  g_assert_false (json_object_has_member (json_node_get_object (record), "identity"));
+}
+
+static void
+test_manager_state_shutdown (ManagerFixture *fixture,
+                             gconstpointer   user_data)
+{
+  g_autoptr (ValentContext) context = NULL;
+  g_autoptr (GFile) cache = NULL;
+  g_autoptr (JsonNode) record = NULL;
+  g_autofree char *state_path = NULL;
+  g_autofree char *journal_path = NULL;
+  g_autofree char *contents = NULL;
+  g_autofree char *expected_id = NULL;
+  g_autoptr (ValentDevice) device = NULL;
+  JsonObject *object;
+
+  /* An empty snapshot, so only the journal can restore the device */
+  context = valent_context_new (NULL, NULL, NULL);
+  cache = valent_context_get_cache_file (context, ".");
+  state_path = g_build_filename (g_file_peek_path (cache), "devices.json", NULL);
+  journal_path = g_build_filename (g_file_peek_path (cache), "devices.journal", NULL);
+  g_file_set_contents (state_path, "{}", -1, NULL);
+
+  g_signal_connect (fixture->manager,
+                    "items-changed",
+                    G_CALLBACK (on_devices_changed),
+                    fixture);
+
+  /* The state can't finish loading until the main context is iterated */
+  valent_application_plugin_startup (VALENT_APPLICATION_PLUGIN (fixture->manager));
+  valent_device_manager_refresh (fixture->manager);
+  g_assert_true (VALENT_IS_DEVICE (fixture->device));
+
+  expected_id = g_strdup (valent_device_get_id (fixture->device));
+  valent_device_set_paired (fixture->device, TRUE);
+
+  VALENT_TEST_CHECK ("Manager journals changes made while the state is "
+                     "loading, when shutdown");
+  valent_application_plugin_shutdown (VALENT_APPLICATION_PLUGIN (fixture->manager));
+
+  g_assert_true (g_file_get_contents (journal_path, &contents, NULL, NULL));
+  g_assert_true (strchr (contents, '\n') == strrchr (contents, '\n'));
+  g_assert_true (g_str_has_suffix (contents, "\n"));
+
+  record = json_from_string (contents, NULL);
+  g_assert_true (JSON_NODE_HOLDS_OBJECT (record));
+  object = json_node_get_object (record);
+  g_assert_cmpstr (json_object_get_string_member (object, "deviceId"),
+                   ==, expected_id);
+  g_assert_true (json_object_has_member (object, "identity"));
+
+  VALENT_TEST_CHECK ("Manager restores devices from the journal when started");
+  valent_application_plugin_startup (VALENT_APPLICATION_PLUGIN (fixture->manager));
+
+  while (g_list_model_get_n_items (G_LIST_MODEL (fixture->manager)) == 0)
+    g_main_context_iteration (NULL, FALSE);
+
+  device = g_list_model_get_item (G_LIST_MODEL (fixture->manager), 0);
+  g_assert_cmpstr (valent_device_get_id (device), ==, expected_id);
+}
+
+static size_t
+get_resident_size (void)
+{
+  g_autofree char *statm = NULL;
+  g_auto (GStrv) fields = NULL;
+
+  if (!g_file_get_contents ("/proc/self/statm", &statm, NULL, NULL))
+    return 0;
+
+  fields = g_strsplit (statm, " ", -1);
+
+  if (g_strv_length (fields) < 2)
+    return 0;
+
+  return g_ascii_strtoull (fields[1], NULL, 10) * sysconf (_SC_PAGESIZE);
+}
+
+static void
+test_manager_startup (ManagerFixture *fixture,
+                      gconstpointer   user_data)
+{
+  g_autoptr (ValentContext) context = NULL;
+  g_autoptr (GFile) cache = NULL;
+  g_autoptr (JsonNode) state = NULL;
+  g_autoptr (JsonObject) devices = NULL;
+  g_autofree char *state_path = NULL;
+  g_autofree char *state_json = NULL;
+  JsonNode *identity;
+  unsigned int n_devices = g_test_perf () ? 1000 : 100;
+  size_t rss_before, rss_after;
+  double elapsed;
+
+  /* A snapshot of synthetic remembered devices, cloned from the mock device */
+  context = valent_context_new (NULL, NULL, NULL);
+  cache = valent_context_get_cache_file (context, ".");
+  state_path = g_build_filename (g_file_peek_path (cache), "devices.json", NULL);
+
+  state = valent_test_load_json ("core-state.json");
+  identity = json_object_get_member (json_node_get_object (state), "test-device");
+  devices = json_object_new ();
+
+  for (unsigned int i = 0; i < n_devices; i++)
+    {
+      g_autofree char *device_id = g_strdup_printf ("test-device-%u", i);
+      JsonNode *node = json_node_copy (identity);
+      JsonObject *body;
+
+      body = json_object_get_object_member (json_node_get_object (node), "body");
+      json_object_set_string_member (body, "deviceId", device_id);
+      json_object_set_member (devices, device_id, node);
+    }
+
+  json_node_take_object (state, g_steal_pointer (&devices));
+  state_json = json_to_string (state, FALSE);
+  g_file_set_contents (state_path, state_json, -1, NULL);
+
+  VALENT_TEST_CHECK ("Manager adds remembered devices when started");
+  rss_before = get_resident_size ();
+  g_test_timer_start ();
+  valent_application_plugin_startup (VALENT_APPLICATION_PLUGIN (fixture->manager));
+
+  while (g_list_model_get_n_items (G_LIST_MODEL (fixture->manager)) < n_devices)
+    g_main_context_iteration (NULL, FALSE);
+
+  elapsed = g_test_timer_elapsed ();
+  rss_after = MAX (rss_before, get_resident_size ());
+  g_test_minimized_result (elapsed, "Started with %u devices in %.3fs",
+                           n_devices, elapsed);
+  g_test_message ("Resident size grew by %zu KiB",
+                  (rss_after - rss_before) / 1024);
+
+  VALENT_TEST_CHECK ("Manager defers plugins for remembered devices");
+  for (unsigned int i = 0; i < n_devices; i++)
+    {
+      g_autoptr (ValentDevice) device = NULL;
+      g_auto (GStrv) plugins = NULL;
+
+      device = g_list_model_get_item (G_LIST_MODEL (fixture->manager), i);
+      g_assert_true (VALENT_IS_DEVICE (device));
+
+      if ((valent_device_get_state (device) & VALENT_DEVICE_STATE_CONNECTED) != 0)
+        continue;
+
+      plugins = valent_device_get_plugins (device);
+      g_assert_cmpuint (g_strv_length (plugins), >, 0);
+      g_assert_false (g_action_group_has_action (G_ACTION_GROUP (device),
+                                                 "mock.echo"));
+    }
+}
+
 static void
 manager_finish (GObject             *object,
                 GAsyncResult        *result,
@@ -278,6 +514,24 @@ main (int   argc,
               test_manager_management,
               manager_fixture_tear_down);
 
+  g_test_add ("/libvalent/device/device-manager/state",
+              ManagerFixture, NULL,
+              manager_fixture_set_up,
+              test_manager_state,
+              manager_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/device-manager/state-shutdown",
+              ManagerFixture, NULL,
+              manager_fixture_set_up,
+              test_manager_state_shutdown,
+              manager_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/device-manager/startup",
+              ManagerFixture, NULL,
+              manager_fixture_set_up,
+              test_manager_startup,
+              manager_fixture_tear_down);
+
   g_test_add ("/libvalent/device/device-manager/dbus",
               ManagerFixture, NULL,
               manager_fixture_set_up,
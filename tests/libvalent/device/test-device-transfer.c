@@ -86,6 +86,215 @@ test_device_transfer (ValentTestFixture *fixture,
     }
 }
 
+static GBytes *
+create_text_payload (size_t size)
+{
+  GString *text = g_string_sized_new (size);
+
+  /* Compressible, but not trivially so */
+  for (unsigned int i = 0; text->len < size; i++)
+    g_string_append_printf (text, "BEGIN:VCARD\nFN:Contact %u\nTEL:555-%04u\nEND:VCARD\n", i, i % 10000);
+
+  g_string_truncate (text, size);
+
+  return g_string_free_to_bytes (text);
+}
+
+static void
+transfer_execute_cb (ValentTransfer *transfer,
+                     GAsyncResult   *result,
+                     gboolean       *done)
+{
+  g_autoptr (GError) error = NULL;
+
+  valent_transfer_execute_finish (transfer, result, &error);
+  g_assert_no_error (error);
+
+  *done = TRUE;
+}
+
+static void
+read_packet_cb (ValentChannel  *channel,
+                GAsyncResult   *result,
+                JsonNode      **packet)
+{
+  g_autoptr (GError) error = NULL;
+
+  *packet = valent_channel_read_packet_finish (channel, result, &error);
+  g_assert_no_error (error);
+}
+
+static void
+upload_bytes_task (GTask        *task,
+                   gpointer      source_object,
+                   gpointer      task_data,
+                   GCancellable *cancellable)
+{
+  JsonNode *packet = task_data;
+  GBytes *bytes = g_object_get_data (G_OBJECT (task), "bytes");
+  g_autoptr (GIOStream) stream = NULL;
+  GError *error = NULL;
+
+  stream = valent_channel_upload (VALENT_CHANNEL (source_object),
+                                  packet,
+                                  cancellable,
+                                  &error);
+
+  if (stream == NULL ||
+      !g_output_stream_write_all (g_io_stream_get_output_stream (stream),
+                                  g_bytes_get_data (bytes, NULL),
+                                  g_bytes_get_size (bytes),
+                                  NULL,
+                                  cancellable,
+                                  &error) ||
+      !g_io_stream_close (stream, cancellable, &error))
+    return g_task_return_error (task, error);
+
+  g_task_return_boolean (task, TRUE);
+}
+
+/*
+ * Upload @bytes as the payload of @packet, without changing the payload size,
+ * since a compressed payload is smaller than the size it describes.
+ */
+static void
+upload_bytes (ValentChannel *channel,
+              JsonNode      *packet,
+              GBytes        *bytes)
+{
+  g_autoptr (GTask) task = NULL;
+  GError *error = NULL;
+
+  task = g_task_new (channel, NULL, NULL, NULL);
+  g_task_set_task_data (task, json_node_ref (packet), (GDestroyNotify)json_node_unref);
+  g_object_set_data_full (G_OBJECT (task),
+                          "bytes",
+                          g_bytes_ref (bytes),
+                          (GDestroyNotify)g_bytes_unref);
+  g_task_run_in_thread (task, upload_bytes_task);
+
+  while (!g_task_get_completed (task))
+    g_main_context_iteration (NULL, FALSE);
+
+  g_task_propagate_boolean (task, &error);
+  g_assert_no_error (error);
+}
+
+static void
+test_device_transfer_compression (ValentTestFixture *fixture,
+                                  gconstpointer      user_data)
+{
+  g_autoptr (GBytes) payload = NULL;
+  g_autoptr (GBytes) compressed = NULL;
+  g_autoptr (GBytes) received = NULL;
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GFile) dest = NULL;
+  g_autoptr (ValentTransfer) transfer = NULL;
+  g_autoptr (GIOStream) stream = NULL;
+  g_autoptr (GOutputStream) target = NULL;
+  g_autoptr (GInputStream) base_stream = NULL;
+  g_autoptr (GInputStream) source = NULL;
+  g_autoptr (GConverter) converter = NULL;
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) packet = NULL;
+  g_autofree char *contents = NULL;
+  const char *dest_dir = NULL;
+  size_t contents_len = 0;
+  gboolean done = FALSE;
+  GError *error = NULL;
+
+  valent_test_fixture_connect (fixture, TRUE);
+
+  payload = create_text_payload (256 * 1024);
+  file = g_file_new_build_filename (g_get_user_cache_dir (), "upload.txt", NULL);
+  g_file_replace_contents (file,
+                           g_bytes_get_data (payload, NULL),
+                           g_bytes_get_size (payload),
+                           NULL, FALSE, G_FILE_CREATE_NONE, NULL, NULL,
+                           &error);
+  g_assert_no_error (error);
+
+  VALENT_TEST_CHECK ("Uploads are compressed when the peer supports it");
+  valent_packet_init (&builder, "kdeconnect.mock.transfer");
+  json_builder_set_member_name (builder, "filename");
+  json_builder_add_string_value (builder, "upload.txt");
+  packet = valent_packet_end (&builder);
+
+  transfer = valent_device_transfer_new (fixture->device, packet, file);
+  valent_transfer_execute (transfer,
+                           NULL,
+                           (GAsyncReadyCallback)transfer_execute_cb,
+                           &done);
+  g_clear_pointer (&packet, json_node_unref);
+
+  valent_channel_read_packet (fixture->endpoint,
+                              NULL,
+                              (GAsyncReadyCallback)read_packet_cb,
+                              &packet);
+  valent_test_await_pointer (&packet);
+
+  g_assert_cmpstr (json_object_get_string_member (json_node_get_object (packet),
+                                                  "payloadCompression"),
+                   ==, "gzip");
+  g_assert_cmpint (valent_packet_get_payload_size (packet),
+                   ==, g_bytes_get_size (payload));
+
+  stream = valent_channel_download (fixture->endpoint, packet, NULL, &error);
+  g_assert_no_error (error);
+
+  target = g_memory_output_stream_new_resizable ();
+  g_output_stream_splice (target,
+                          g_io_stream_get_input_stream (stream),
+                          (G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+                           G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET),
+                          NULL,
+                          &error);
+  g_assert_no_error (error);
+  valent_test_await_boolean (&done);
+
+  compressed = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (target));
+  g_assert_cmpuint (g_bytes_get_size (compressed), <, g_bytes_get_size (payload) / 4);
+  g_clear_object (&target);
+
+  converter = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+  base_stream = g_memory_input_stream_new_from_bytes (compressed);
+  source = g_converter_input_stream_new (base_stream, converter);
+  target = g_memory_output_stream_new_resizable ();
+  g_output_stream_splice (target,
+                          source,
+                          (G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+                           G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET),
+                          NULL,
+                          &error);
+  g_assert_no_error (error);
+
+  received = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (target));
+  g_assert_true (g_bytes_equal (received, payload));
+
+  VALENT_TEST_CHECK ("Compressed downloads are decompressed up to the payload size");
+  g_clear_pointer (&packet, json_node_unref);
+  valent_packet_init (&builder, "kdeconnect.mock.transfer");
+  json_builder_set_member_name (builder, "filename");
+  json_builder_add_string_value (builder, "download.txt");
+  packet = valent_packet_end (&builder);
+  json_object_set_string_member (json_node_get_object (packet),
+                                 "payloadCompression",
+                                 "gzip");
+  valent_packet_set_payload_size (packet, g_bytes_get_size (payload));
+
+  upload_bytes (fixture->endpoint, packet, compressed);
+
+  /* Ensure the download task has time to finish */
+  valent_test_await_timeout (1);
+
+  dest_dir = valent_get_user_directory (G_USER_DIRECTORY_DOWNLOAD);
+  dest = valent_get_user_file (dest_dir, "download.txt", FALSE);
+  g_file_load_contents (dest, NULL, &contents, &contents_len, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_cmpmem (contents, contents_len,
+                   g_bytes_get_data (payload, NULL), g_bytes_get_size (payload));
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -100,5 +309,11 @@ main (int   argc,
               test_device_transfer,
               valent_test_fixture_clear);
 
+  g_test_add ("/libvalent/device/device-transfer/compression",
+              ValentTestFixture, path,
+              valent_test_fixture_init,
+              test_device_transfer_compression,
+              valent_test_fixture_clear);
+
   return g_test_run ();
 }
@@ -1,10 +1,15 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 // SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
 
+#include <sys/socket.h>
+
 #include <gio/gio.h>
 #include <valent.h>
 #include <libvalent-test.h>
 
+#include "valent-channel-private.h"
+#include "valent-counters-private.h"
+
 
 typedef struct
 {
@@ -224,6 +229,229 @@ test_device_connecting (DeviceFixture *fixture,
   g_assert_false (valent_device_get_connected (fixture->device));
 }
 
+static void
+on_state_changed (ValentDevice *device,
+                  GParamSpec   *pspec,
+                  unsigned int *n_changes)
+{
+  *n_changes += 1;
+}
+
+static JsonNode *
+endpoint_read_type (ValentChannel *endpoint,
+                    const char    *type)
+{
+  JsonNode *packet = NULL;
+
+  do
+    {
+      g_clear_pointer (&packet, json_node_unref);
+      valent_channel_read_packet (endpoint,
+                                  NULL,
+                                  (GAsyncReadyCallback)endpoint_expect_packet_cb,
+                                  &packet);
+      valent_test_await_pointer (&packet);
+    }
+  while (!g_str_equal (valent_packet_get_type (packet), type));
+
+  return packet;
+}
+
+/*
+ * Create a pair of connected channels of the base type, standing in for a
+ * second transport alongside the mock channels.
+ */
+static ValentChannel **
+base_channel_pair (JsonNode *identity,
+                   JsonNode *peer_identity)
+{
+  ValentChannel **channels = NULL;
+  int sv[2] = { 0, };
+
+  channels = g_new0 (ValentChannel *, 2);
+  g_assert_no_errno (socketpair (AF_UNIX, SOCK_STREAM, 0, sv));
+
+  for (unsigned int i = 0; i < 2; i++)
+    {
+      g_autoptr (GSocket) socket = NULL;
+      g_autoptr (GSocketConnection) connection = NULL;
+      GError *error = NULL;
+
+      socket = g_socket_new_from_fd (sv[i], &error);
+      g_assert_no_error (error);
+      connection = g_object_new (G_TYPE_SOCKET_CONNECTION,
+                                 "socket", socket,
+                                 NULL);
+      channels[i] = g_object_new (VALENT_TYPE_CHANNEL,
+                                  "base-stream",   connection,
+                                  "identity",      i == 0 ? identity : peer_identity,
+                                  "peer-identity", i == 0 ? peer_identity : identity,
+                                  NULL);
+    }
+
+  return channels;
+}
+
+static void
+test_device_failover (DeviceFixture *fixture,
+                      gconstpointer  user_data)
+{
+  g_autofree ValentChannel **channels = NULL;
+  g_autoptr (ValentChannel) channel = NULL;
+  g_autoptr (ValentChannel) endpoint = NULL;
+  g_autoptr (ValentChannel) replacement = NULL;
+  g_autoptr (ValentChannel) replacement_endpoint = NULL;
+  g_autoptr (ValentChannel) active = NULL;
+  g_autoptr (GIOStream) base_stream = NULL;
+  g_autoptr (JsonNode) echo = NULL;
+  JsonNode *identity = get_packet (fixture, "identity");
+  JsonNode *packet = get_packet (fixture, "test-echo");
+  unsigned int n_changes = 0;
+
+  /* A preferred transport, connected before a less preferred one */
+  channels = base_channel_pair (identity, identity);
+  channel = g_steal_pointer (&channels[0]);
+  endpoint = g_steal_pointer (&channels[1]);
+  g_clear_pointer (&channels, g_free);
+  valent_channel_set_priority (channel, 100);
+  valent_channel_set_priority (fixture->channel, 200);
+
+  valent_device_set_channel (fixture->device, channel);
+  valent_device_set_paired (fixture->device, TRUE);
+  g_signal_connect (fixture->device,
+                    "notify::state",
+                    G_CALLBACK (on_state_changed),
+                    &n_changes);
+
+  VALENT_TEST_CHECK ("Device uses the preferred transport of several channels");
+  valent_device_set_channel (fixture->device, fixture->channel);
+  g_assert_true (valent_device_get_connected (fixture->device));
+  g_assert_cmpuint (n_changes, ==, 0);
+
+  active = valent_device_ref_channel (fixture->device);
+  g_assert_true (active == channel);
+  g_clear_object (&active);
+
+  valent_device_send_packet (fixture->device, packet, NULL, NULL, NULL);
+  echo = endpoint_read_type (endpoint, "kdeconnect.mock.echo");
+  g_clear_pointer (&echo, json_node_unref);
+
+  VALENT_TEST_CHECK ("Device receives packets from each channel");
+  valent_channel_write_packet (fixture->endpoint, packet, NULL, NULL, NULL);
+  echo = endpoint_read_type (endpoint, "kdeconnect.mock.echo");
+  g_clear_pointer (&echo, json_node_unref);
+
+  VALENT_TEST_CHECK ("Device replaces a channel of the same transport");
+  channels = valent_test_channel_pair (identity, identity);
+  replacement = g_steal_pointer (&channels[0]);
+  replacement_endpoint = g_steal_pointer (&channels[1]);
+  valent_channel_set_priority (replacement, 200);
+
+  valent_device_set_channel (fixture->device, replacement);
+  base_stream = valent_channel_ref_base_stream (fixture->channel);
+
+  while (!g_io_stream_is_closed (base_stream))
+    g_main_context_iteration (NULL, FALSE);
+
+  active = valent_device_ref_channel (fixture->device);
+  g_assert_true (active == channel);
+  g_assert_cmpuint (n_changes, ==, 0);
+  g_clear_object (&active);
+
+  VALENT_TEST_CHECK ("Device fails over when the active channel is closed");
+  valent_channel_close (endpoint, NULL, NULL);
+
+  while ((active = valent_device_ref_channel (fixture->device)) == channel)
+    {
+      g_clear_object (&active);
+      g_main_context_iteration (NULL, FALSE);
+    }
+
+  g_assert_true (active == replacement);
+  g_assert_true (valent_device_get_connected (fixture->device));
+  g_assert_true (g_action_group_has_action (G_ACTION_GROUP (fixture->device),
+                                            "mock.echo"));
+  g_assert_cmpuint (n_changes, ==, 0);
+  g_clear_object (&active);
+
+  valent_device_send_packet (fixture->device, packet, NULL, NULL, NULL);
+  echo = endpoint_read_type (replacement_endpoint, "kdeconnect.mock.echo");
+  g_clear_pointer (&echo, json_node_unref);
+
+  VALENT_TEST_CHECK ("Device disconnects when the last channel is closed");
+  valent_device_set_channel (fixture->device, NULL);
+  g_assert_false (valent_device_get_connected (fixture->device));
+  g_assert_cmpuint (n_changes, ==, 1);
+
+  g_signal_handlers_disconnect_by_data (fixture->device, &n_changes);
+  valent_channel_close (replacement_endpoint, NULL, NULL);
+  v_await_finalize_object (g_steal_pointer (&replacement_endpoint));
+  v_await_finalize_object (g_steal_pointer (&replacement));
+  v_await_finalize_object (g_steal_pointer (&endpoint));
+  v_await_finalize_object (g_steal_pointer (&channel));
+}
+
+static void
+test_device_payload_channel (DeviceFixture *fixture,
+                             gconstpointer  user_data)
+{
+  g_autofree ValentChannel **channels = NULL;
+  g_autoptr (ValentChannel) channel = NULL;
+  g_autoptr (ValentChannel) endpoint = NULL;
+  g_autoptr (ValentChannel) active = NULL;
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GFile) dest = NULL;
+  g_autoptr (GBytes) expected = NULL;
+  g_autoptr (GBytes) received = NULL;
+  JsonNode *identity = get_packet (fixture, "identity");
+  JsonNode *packet = get_packet (fixture, "test-transfer");
+  const char *dest_dir = NULL;
+  GError *error = NULL;
+
+  /* The preferred transport does not support payloads */
+  channels = base_channel_pair (identity, identity);
+  channel = g_steal_pointer (&channels[0]);
+  endpoint = g_steal_pointer (&channels[1]);
+  valent_channel_set_priority (channel, 100);
+  valent_channel_set_priority (fixture->channel, 200);
+
+  valent_device_set_channel (fixture->device, fixture->channel);
+  valent_device_set_channel (fixture->device, channel);
+  valent_device_set_paired (fixture->device, TRUE);
+
+  active = valent_device_ref_channel (fixture->device);
+  g_assert_true (active == channel);
+  g_clear_object (&active);
+
+  VALENT_TEST_CHECK ("Device downloads payloads with the channel that received the packet");
+  file = g_file_new_for_uri ("resource:///tests/image.png");
+  expected = g_file_load_bytes (file, NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  valent_test_upload (fixture->endpoint, packet, file, &error);
+  g_assert_no_error (error);
+
+  dest_dir = valent_get_user_directory (G_USER_DIRECTORY_DOWNLOAD);
+  dest = valent_get_user_file (dest_dir, "image.png", FALSE);
+
+  do
+    {
+      g_clear_pointer (&received, g_bytes_unref);
+      g_main_context_iteration (NULL, FALSE);
+      received = g_file_load_bytes (dest, NULL, NULL, NULL);
+    }
+  while (received == NULL || !g_bytes_equal (received, expected));
+
+  active = valent_device_ref_channel (fixture->device);
+  g_assert_true (active == channel);
+  g_clear_object (&active);
+
+  valent_device_set_channel (fixture->device, NULL);
+  valent_channel_close (endpoint, NULL, NULL);
+  v_await_finalize_object (g_steal_pointer (&endpoint));
+  v_await_finalize_object (g_steal_pointer (&channel));
+}
+
 /*
  * Test pairing
  */
@@ -518,6 +746,56 @@ test_device_plugins (DeviceFixture *fixture,
   g_clear_pointer (&device_plugins, g_strfreev);
 }
 
+static void
+test_device_dormant (DeviceFixture *fixture,
+                     gconstpointer  user_data)
+{
+  g_autoptr (ValentDevice) device = NULL;
+  g_autoptr (GSettings) settings = NULL;
+  g_autofree ValentChannel **channels = NULL;
+  g_auto (GStrv) plugins = NULL;
+  JsonNode *identity;
+
+  identity = get_packet (fixture, "identity");
+  settings = g_settings_new_with_path ("ca.andyholmes.Valent.Device",
+                                       "/ca/andyholmes/valent/device/test-device/");
+  g_settings_set_uint (settings, "plugin-timeout", 1);
+
+  VALENT_TEST_CHECK ("Dormant devices list plugins without instantiating them");
+  device = valent_device_new_dormant (identity, NULL);
+  plugins = valent_device_get_plugins (device);
+  g_assert_cmpuint (g_strv_length (plugins), ==, 2);
+  g_assert_false (g_action_group_has_action (G_ACTION_GROUP (device), "mock.echo"));
+
+  VALENT_TEST_CHECK ("Dormant devices instantiate plugins when connected");
+  valent_device_set_channel (device, fixture->channel);
+  g_assert_true (g_action_group_has_action (G_ACTION_GROUP (device), "mock.echo"));
+
+  VALENT_TEST_CHECK ("Devices release plugins after disconnecting for the timeout");
+  valent_device_set_channel (device, NULL);
+  g_assert_true (g_action_group_has_action (G_ACTION_GROUP (device), "mock.echo"));
+
+  valent_test_await_timeout (1500);
+  g_assert_false (g_action_group_has_action (G_ACTION_GROUP (device), "mock.echo"));
+  g_clear_pointer (&plugins, g_strfreev);
+  plugins = valent_device_get_plugins (device);
+  g_assert_cmpuint (g_strv_length (plugins), ==, 2);
+
+  VALENT_TEST_CHECK ("Devices created for a connection keep their plugins");
+  channels = valent_test_channel_pair (identity, identity);
+  valent_device_set_channel (fixture->device, channels[0]);
+  valent_device_set_channel (fixture->device, NULL);
+
+  valent_test_await_timeout (1500);
+  g_assert_true (g_action_group_has_action (G_ACTION_GROUP (fixture->device), "mock.echo"));
+  valent_channel_close (channels[1], NULL, NULL);
+  g_clear_object (&channels[0]);
+  g_clear_object (&channels[1]);
+
+  g_settings_reset (settings, "plugin-timeout");
+  valent_object_destroy (VALENT_OBJECT (device));
+}
+
 /*
  * Packet Handling
  */
@@ -526,6 +804,10 @@ test_handle_packet (DeviceFixture *fixture,
                     gconstpointer  user_data)
 {
   JsonNode *packet = get_packet (fixture, "test-echo");
+  g_autoptr (GVariant) snapshot = NULL;
+  g_autoptr (GVariant) dispatch = NULL;
+  g_autoptr (GVariant) types = NULL;
+  uint64_t count = 0;
 
   valent_device_set_channel (fixture->device, fixture->channel);
   g_assert_true (valent_device_get_connected (fixture->device));
@@ -537,6 +819,20 @@ test_handle_packet (DeviceFixture *fixture,
   valent_channel_write_packet (fixture->endpoint, packet, NULL, NULL, NULL);
   endpoint_expect_packet_echo (fixture, packet);
 
+  VALENT_TEST_CHECK ("Packet handlers are timed by device and type");
+  snapshot = g_variant_ref_sink (valent_counters_snapshot ());
+  dispatch = g_variant_lookup_value (snapshot, "dispatch", G_VARIANT_TYPE ("a{sa{s(tttat)}}"));
+  g_assert_nonnull (dispatch);
+  g_assert_true (g_variant_lookup (dispatch,
+                                   valent_device_get_id (fixture->device),
+                                   "@a{s(tttat)}",
+                                   &types));
+  g_assert_true (g_variant_lookup (types,
+                                   "kdeconnect.mock.echo",
+                                   "(tttat)",
+                                   &count, NULL, NULL, NULL));
+  g_assert_cmpuint (count, >=, 1);
+
   /* Local device is unpaired, we expect to receive a pair packet informing us
    * that the device is unpaired. */
   valent_device_set_paired (fixture->device, FALSE);
@@ -546,6 +842,54 @@ test_handle_packet (DeviceFixture *fixture,
   endpoint_expect_packet_pair (fixture, FALSE);
 }
 
+static void
+test_handle_packet_budget (DeviceFixture *fixture,
+                           gconstpointer  user_data)
+{
+  JsonNode *packet = get_packet (fixture, "test-echo");
+  g_autoptr (GSettings) settings = NULL;
+  g_autofree char *path = NULL;
+  int64_t slow_handlers = 0;
+
+  path = g_strdup_printf ("/ca/andyholmes/valent/device/%s/",
+                          valent_device_get_id (fixture->device));
+  settings = g_settings_new_with_path ("ca.andyholmes.Valent.Device", path);
+  g_settings_set_uint (settings, "handler-budget", 10);
+
+  valent_device_set_channel (fixture->device, fixture->channel);
+  valent_device_set_paired (fixture->device, TRUE);
+  slow_handlers = valent_counter_get (VALENT_COUNTER_SLOW_HANDLERS);
+
+  VALENT_TEST_CHECK ("Handlers within the budget are not reported");
+  valent_channel_write_packet (fixture->endpoint, packet, NULL, NULL, NULL);
+  endpoint_expect_packet_echo (fixture, packet);
+  g_assert_cmpint (valent_counter_get (VALENT_COUNTER_SLOW_HANDLERS), ==, slow_handlers);
+
+  VALENT_TEST_CHECK ("Handlers over the budget are reported with the plugin name");
+  json_object_set_int_member (valent_packet_get_body (packet), "delay", 20);
+  g_test_expect_message (NULL,
+                         G_LOG_LEVEL_MESSAGE,
+                         "Received echo*");
+  g_test_expect_message ("valent-device",
+                         G_LOG_LEVEL_WARNING,
+                         "*\"mock\" plugin took *ms to handle \"kdeconnect.mock.echo\"");
+  valent_channel_write_packet (fixture->endpoint, packet, NULL, NULL, NULL);
+  endpoint_expect_packet_echo (fixture, packet);
+  g_test_assert_expected_messages ();
+  g_assert_cmpint (valent_counter_get (VALENT_COUNTER_SLOW_HANDLERS), ==, slow_handlers + 1);
+
+  VALENT_TEST_CHECK ("Repeat offenses are counted, but only warned once");
+  g_test_expect_message (NULL,
+                         G_LOG_LEVEL_MESSAGE,
+                         "Received echo*");
+  valent_channel_write_packet (fixture->endpoint, packet, NULL, NULL, NULL);
+  endpoint_expect_packet_echo (fixture, packet);
+  g_test_assert_expected_messages ();
+  g_assert_cmpint (valent_counter_get (VALENT_COUNTER_SLOW_HANDLERS), ==, slow_handlers + 2);
+
+  g_settings_reset (settings, "handler-budget");
+}
+
 static void
 send_available_cb (ValentDevice *device,
                    GAsyncResult *result,
@@ -663,6 +1007,18 @@ main (int   argc,
               test_device_connecting,
               device_fixture_tear_down);
 
+  g_test_add ("/libvalent/device/device/failover",
+              DeviceFixture, NULL,
+              device_fixture_set_up,
+              test_device_failover,
+              device_fixture_tear_down);
+
+  g_test_add ("/libvalent/device/device/payload-channel",
+              DeviceFixture, NULL,
+              device_fixture_set_up,
+              test_device_payload_channel,
+              device_fixture_tear_down);
+
   g_test_add ("/libvalent/device/device/pairing",
               DeviceFixture, NULL,
               device_fixture_set_up,
@@ -681,12 +1037,24 @@ main (int   argc,
               test_device_plugins,
               device_fixture_tear_down);
 
+  g_test_add ("/libvalent/device/device/dormant",
+              DeviceFixture, NULL,
+              device_fixture_set_up,
+              test_device_dormant,
+              device_fixture_tear_down);
+
   g_test_add ("/libvalent/device/device/handle-packet",
               DeviceFixture, NULL,
               device_fixture_set_up,
               test_handle_packet,
               device_fixture_tear_down);
 
+  g_test_add ("/libvalent/device/device/handle-packet-budget",
+              DeviceFixture, NULL,
+              device_fixture_set_up,
+              test_handle_packet_budget,
+              device_fixture_tear_down);
+
   g_test_add ("/libvalent/device/device/send-packet",
               DeviceFixture, NULL,
               device_fixture_set_up,
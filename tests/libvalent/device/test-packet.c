@@ -4,6 +4,8 @@
 #include <valent.h>
 #include <libvalent-test.h>
 
+#include "valent-counters-private.h"
+
 
 static const char *corrupt_packet =
   "{"
@@ -216,8 +218,20 @@ test_packet_streaming (PacketFixture *fixture,
   GOutputStream *out = NULL;
   g_autofree char *packet_str = NULL;
   g_autoptr (GBytes) bytes = NULL;
+  g_autoptr (GVariant) snapshot = NULL;
+  g_autoptr (GVariant) packets = NULL;
+  int64_t packets_in = 0;
+  int64_t packets_out = 0;
+  int64_t bytes_in = 0;
+  int64_t bytes_out = 0;
+  int64_t n_packets = 0;
   GError *error = NULL;
 
+  packets_in = valent_counter_get (VALENT_COUNTER_PACKETS_IN);
+  packets_out = valent_counter_get (VALENT_COUNTER_PACKETS_OUT);
+  bytes_in = valent_counter_get (VALENT_COUNTER_PACKET_BYTES_IN);
+  bytes_out = valent_counter_get (VALENT_COUNTER_PACKET_BYTES_OUT);
+
   /* Write packets */
   out = g_memory_output_stream_new_resizable ();
   json_object_iter_init (&iter, fixture->packets);
@@ -226,11 +240,18 @@ test_packet_streaming (PacketFixture *fixture,
     {
       valent_packet_to_stream (out, packet_in, NULL, &error);
       g_assert_no_error (error);
+      n_packets++;
     }
 
   g_output_stream_close (out, NULL, &error);
   g_assert_no_error (error);
 
+  VALENT_TEST_CHECK ("Packets written to a stream are counted");
+  g_assert_cmpint (valent_counter_get (VALENT_COUNTER_PACKETS_OUT),
+                   ==, packets_out + n_packets);
+  g_assert_cmpint (valent_counter_get (VALENT_COUNTER_PACKET_BYTES_OUT),
+                   ==, bytes_out + g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (out)));
+
   /* Read packets */
   bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (out));
   in = g_memory_input_stream_new_from_bytes (bytes);
@@ -245,6 +266,18 @@ test_packet_streaming (PacketFixture *fixture,
       g_clear_pointer (&packet_out, json_node_unref);
     }
 
+  VALENT_TEST_CHECK ("Packets read from a stream are counted");
+  g_assert_cmpint (valent_counter_get (VALENT_COUNTER_PACKETS_IN),
+                   ==, packets_in + n_packets);
+  g_assert_cmpint (valent_counter_get (VALENT_COUNTER_PACKET_BYTES_IN),
+                   ==, bytes_in + g_bytes_get_size (bytes));
+
+  VALENT_TEST_CHECK ("Counter snapshots include packets by type");
+  snapshot = g_variant_ref_sink (valent_counters_snapshot ());
+  packets = g_variant_lookup_value (snapshot, "packets", G_VARIANT_TYPE ("a{s(xx)}"));
+  g_assert_nonnull (packets);
+  g_assert_cmpuint (g_variant_n_children (packets), >, 0);
+
   g_clear_object (&out);
   g_clear_object (&in);
   g_clear_pointer (&bytes, g_bytes_unref);
@@ -5,6 +5,8 @@
 #include <valent.h>
 #include <libvalent-test.h>
 
+#include "valent-input-queue-private.h"
+
 
 typedef struct
 {
@@ -80,6 +82,41 @@ test_input_component_self (InputComponentFixture *fixture,
   valent_test_event_cmpstr ("KEYSYM 97 0");
 }
 
+static void
+test_input_component_queue (InputComponentFixture *fixture,
+                            gconstpointer          user_data)
+{
+  g_autoptr (ValentInputQueue) queue = NULL;
+  g_autofree char *expected = NULL;
+
+  queue = valent_input_queue_new ();
+
+  VALENT_TEST_CHECK ("Queue collapses consecutive pointer motion");
+  valent_input_queue_pointer_motion (queue, 1.0, 1.0);
+  valent_input_queue_pointer_motion (queue, 1.0, 1.0);
+  valent_input_queue_replay (queue, fixture->adapter);
+  valent_test_event_cmpstr ("POINTER MOTION 2.0 2.0");
+
+  VALENT_TEST_CHECK ("Queue keeps releases for queued presses when full");
+  for (unsigned int i = 0; i < 256; i++)
+    valent_input_queue_keyboard_keysym (queue, 0x100 + i, TRUE);
+
+  valent_input_queue_keyboard_keysym (queue, 'a', TRUE);
+  valent_input_queue_keyboard_keysym (queue, 'a', FALSE);
+  valent_input_queue_pointer_button (queue, VALENT_POINTER_PRIMARY, TRUE);
+  valent_input_queue_keyboard_keysym (queue, 0x100, FALSE);
+  valent_input_queue_replay (queue, fixture->adapter);
+
+  for (unsigned int i = 0; i < 256; i++)
+    {
+      expected = g_strdup_printf ("KEYSYM %u 1", 0x100 + i);
+      valent_test_event_cmpstr (expected);
+      g_clear_pointer (&expected, g_free);
+    }
+
+  valent_test_event_cmpstr ("KEYSYM 256 0");
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -98,5 +135,11 @@ main (int   argc,
               test_input_component_self,
               input_component_fixture_tear_down);
 
+  g_test_add ("/libvalent/input/queue",
+              InputComponentFixture, NULL,
+              input_component_fixture_set_up,
+              test_input_component_queue,
+              input_component_fixture_tear_down);
+
   return g_test_run ();
 }
@@ -0,0 +1,296 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#include <gio/gio.h>
+#include <valent.h>
+#include <libvalent-test.h>
+#include <sys/socket.h>
+
+#include "valent-mux-connection.h"
+
+#define N_PACKETS    10000
+#define PAYLOAD_SIZE (64 * 1024 * 1024)
+
+
+typedef struct
+{
+  JsonNode            *packets;
+  ValentMuxConnection *sender;
+  ValentMuxConnection *receiver;
+  ValentChannel       *channel;
+  ValentChannel       *endpoint;
+} MuxFixture;
+
+static void
+mux_handshake_cb (ValentMuxConnection  *connection,
+                  GAsyncResult         *result,
+                  ValentChannel       **channel)
+{
+  GError *error = NULL;
+
+  *channel = valent_mux_connection_handshake_finish (connection, result, &error);
+  g_assert_no_error (error);
+}
+
+static ValentMuxConnection *
+mux_connection_new (int fd)
+{
+  g_autoptr (GSocket) socket = NULL;
+  g_autoptr (GSocketConnection) connection = NULL;
+  GError *error = NULL;
+
+  socket = g_socket_new_from_fd (fd, &error);
+  g_assert_no_error (error);
+  connection = g_object_new (G_TYPE_SOCKET_CONNECTION,
+                             "socket", socket,
+                             NULL);
+
+  return valent_mux_connection_new (G_IO_STREAM (connection));
+}
+
+static void
+mux_fixture_set_up (MuxFixture    *fixture,
+                    gconstpointer  user_data)
+{
+  JsonNode *identity;
+  int fds[2] = { 0, };
+
+  fixture->packets = valent_test_load_json ("plugin-bluez.json");
+
+  g_assert_no_errno (socketpair (AF_UNIX, SOCK_STREAM, 0, fds));
+  fixture->sender = mux_connection_new (fds[0]);
+  fixture->receiver = mux_connection_new (fds[1]);
+
+  identity = json_object_get_member (json_node_get_object (fixture->packets),
+                                     "identity");
+  valent_mux_connection_handshake_async (fixture->sender,
+                                         identity,
+                                         NULL,
+                                         (GAsyncReadyCallback)mux_handshake_cb,
+                                         &fixture->channel);
+  valent_mux_connection_handshake_async (fixture->receiver,
+                                         identity,
+                                         NULL,
+                                         (GAsyncReadyCallback)mux_handshake_cb,
+                                         &fixture->endpoint);
+  valent_test_await_pointer (&fixture->channel);
+  valent_test_await_pointer (&fixture->endpoint);
+}
+
+static void
+mux_fixture_tear_down (MuxFixture    *fixture,
+                       gconstpointer  user_data)
+{
+  valent_mux_connection_close (fixture->sender, NULL, NULL);
+  valent_mux_connection_close (fixture->receiver, NULL, NULL);
+
+  g_clear_object (&fixture->channel);
+  g_clear_object (&fixture->endpoint);
+  g_clear_object (&fixture->sender);
+  g_clear_object (&fixture->receiver);
+  g_clear_pointer (&fixture->packets, json_node_unref);
+}
+
+static void
+write_packet_cb (ValentChannel *channel,
+                 GAsyncResult  *result,
+                 unsigned int  *n_written)
+{
+  g_autoptr (GError) error = NULL;
+
+  valent_channel_write_packet_finish (channel, result, &error);
+  g_assert_no_error (error);
+
+  *n_written += 1;
+}
+
+static void
+read_packet_cb (ValentChannel  *channel,
+                GAsyncResult   *result,
+                JsonNode      **packet)
+{
+  g_autoptr (GError) error = NULL;
+
+  *packet = valent_channel_read_packet_finish (channel, result, &error);
+  g_assert_no_error (error);
+}
+
+static void
+bench_mux_packets (MuxFixture    *fixture,
+                   gconstpointer  user_data)
+{
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) packet = NULL;
+  unsigned int n_written = 0;
+  double elapsed;
+
+  valent_packet_init (&builder, "kdeconnect.ping");
+  json_builder_set_member_name (builder, "message");
+  json_builder_add_string_value (builder, "Benchmark");
+  packet = valent_packet_end (&builder);
+
+  VALENT_TEST_CHECK ("Packets can be streamed over a muxed channel");
+  g_test_timer_start ();
+
+  for (unsigned int i = 0; i < N_PACKETS; i++)
+    {
+      valent_channel_write_packet (fixture->channel,
+                                   packet,
+                                   NULL,
+                                   (GAsyncReadyCallback)write_packet_cb,
+                                   &n_written);
+    }
+
+  for (unsigned int i = 0; i < N_PACKETS; i++)
+    {
+      g_autoptr (JsonNode) received = NULL;
+
+      valent_channel_read_packet (fixture->endpoint,
+                                  NULL,
+                                  (GAsyncReadyCallback)read_packet_cb,
+                                  &received);
+      valent_test_await_pointer (&received);
+    }
+
+  while (n_written < N_PACKETS)
+    g_main_context_iteration (NULL, FALSE);
+
+  elapsed = g_test_timer_elapsed ();
+
+  valent_test_benchmark ("packet rate", "packets/s",
+                         N_PACKETS / elapsed,
+                         TRUE);
+}
+
+typedef struct
+{
+  ValentMuxConnection *muxer;
+  GBytes              *payload;
+  char                *uuid;
+} MuxWriteData;
+
+static void
+mux_write_data_free (gpointer data)
+{
+  MuxWriteData *write = data;
+
+  g_clear_object (&write->muxer);
+  g_clear_pointer (&write->payload, g_bytes_unref);
+  g_clear_pointer (&write->uuid, g_free);
+  g_free (write);
+}
+
+static void
+mux_write_task (GTask        *task,
+                gpointer      source_object,
+                gpointer      task_data,
+                GCancellable *cancellable)
+{
+  MuxWriteData *write = task_data;
+  g_autoptr (GIOStream) stream = NULL;
+  GOutputStream *target;
+  GError *error = NULL;
+
+  stream = valent_mux_connection_open_channel (write->muxer,
+                                               write->uuid,
+                                               cancellable,
+                                               &error);
+
+  if (stream == NULL)
+    return g_task_return_error (task, error);
+
+  target = g_io_stream_get_output_stream (stream);
+
+  if (!g_output_stream_write_all (target,
+                                  g_bytes_get_data (write->payload, NULL),
+                                  g_bytes_get_size (write->payload),
+                                  NULL,
+                                  cancellable,
+                                  &error) ||
+      !g_io_stream_close (stream, cancellable, &error))
+    return g_task_return_error (task, error);
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static void
+bench_mux_stream (MuxFixture    *fixture,
+                  gconstpointer  user_data)
+{
+  g_autoptr (GTask) task = NULL;
+  g_autoptr (GIOStream) stream = NULL;
+  g_autoptr (GOutputStream) target = NULL;
+  g_autoptr (GBytes) payload = NULL;
+  MuxWriteData *write;
+  uint8_t *data;
+  gssize n_spliced;
+  double elapsed;
+  GError *error = NULL;
+
+  data = g_malloc (PAYLOAD_SIZE);
+
+  for (size_t i = 0; i < PAYLOAD_SIZE; i++)
+    data[i] = (uint8_t)(i % 251);
+
+  payload = g_bytes_new_take (data, PAYLOAD_SIZE);
+
+  write = g_new0 (MuxWriteData, 1);
+  write->muxer = g_object_ref (fixture->sender);
+  write->payload = g_bytes_ref (payload);
+  write->uuid = g_uuid_string_random ();
+
+  VALENT_TEST_CHECK ("Payloads can be streamed over a muxed channel");
+  task = g_task_new (fixture->sender, NULL, NULL, NULL);
+  g_task_set_task_data (task, write, mux_write_data_free);
+  g_task_run_in_thread (task, mux_write_task);
+
+  stream = valent_mux_connection_accept_channel (fixture->receiver,
+                                                 write->uuid,
+                                                 NULL,
+                                                 &error);
+  g_assert_no_error (error);
+
+  /* Time the transfer from when the channel is accepted */
+  g_test_timer_start ();
+  target = g_memory_output_stream_new_resizable ();
+  n_spliced = g_output_stream_splice (target,
+                                      g_io_stream_get_input_stream (stream),
+                                      (G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+                                       G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET),
+                                      NULL,
+                                      &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (n_spliced, ==, PAYLOAD_SIZE);
+  elapsed = g_test_timer_elapsed ();
+
+  while (!g_task_get_completed (task))
+    g_main_context_iteration (NULL, FALSE);
+
+  g_task_propagate_boolean (task, &error);
+  g_assert_no_error (error);
+
+  valent_test_benchmark ("stream throughput", "MiB/s",
+                         PAYLOAD_SIZE / elapsed / (1024 * 1024),
+                         TRUE);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  valent_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/plugins/bluez/mux-connection/packets",
+              MuxFixture, NULL,
+              mux_fixture_set_up,
+              bench_mux_packets,
+              mux_fixture_tear_down);
+
+  g_test_add ("/plugins/bluez/mux-connection/stream",
+              MuxFixture, NULL,
+              mux_fixture_set_up,
+              bench_mux_stream,
+              mux_fixture_tear_down);
+
+  return g_test_run ();
+}
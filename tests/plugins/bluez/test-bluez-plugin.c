@@ -302,6 +302,216 @@ test_bluez_service_new_connection (BluezBackendFixture *fixture,
   valent_object_destroy (VALENT_OBJECT (fixture->service));
 }
 
+static void
+mux_handshake_cb (ValentMuxConnection  *connection,
+                  GAsyncResult         *result,
+                  ValentChannel       **channel)
+{
+  GError *error = NULL;
+
+  *channel = valent_mux_connection_handshake_finish (connection, result, &error);
+  g_assert_no_error (error);
+}
+
+typedef struct
+{
+  ValentMuxConnection *muxer;
+  GBytes              *payload;
+  char                *uuid;
+  gboolean             compress;
+} MuxWriteData;
+
+static void
+mux_write_data_free (gpointer data)
+{
+  MuxWriteData *write = data;
+
+  g_clear_object (&write->muxer);
+  g_clear_pointer (&write->payload, g_bytes_unref);
+  g_clear_pointer (&write->uuid, g_free);
+  g_free (write);
+}
+
+static void
+mux_write_task (GTask        *task,
+                gpointer      source_object,
+                gpointer      task_data,
+                GCancellable *cancellable)
+{
+  MuxWriteData *write = task_data;
+  g_autoptr (GIOStream) stream = NULL;
+  g_autoptr (GOutputStream) target = NULL;
+  GError *error = NULL;
+
+  stream = valent_mux_connection_open_channel (write->muxer,
+                                               write->uuid,
+                                               cancellable,
+                                               &error);
+
+  if (stream == NULL)
+    return g_task_return_error (task, error);
+
+  target = g_object_ref (g_io_stream_get_output_stream (stream));
+
+  if (write->compress)
+    {
+      g_autoptr (GZlibCompressor) compressor = NULL;
+      g_autoptr (GOutputStream) base_stream = g_steal_pointer (&target);
+
+      compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+      target = g_converter_output_stream_new (base_stream,
+                                              G_CONVERTER (compressor));
+    }
+
+  if (!g_output_stream_write_all (target,
+                                  g_bytes_get_data (write->payload, NULL),
+                                  g_bytes_get_size (write->payload),
+                                  NULL,
+                                  cancellable,
+                                  &error) ||
+      !g_output_stream_close (target, cancellable, &error) ||
+      !g_io_stream_close (stream, cancellable, &error))
+    return g_task_return_error (task, error);
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static double
+mux_transfer (ValentMuxConnection *sender,
+              ValentMuxConnection *receiver,
+              GBytes              *payload,
+              gboolean             compress)
+{
+  g_autoptr (GTask) task = NULL;
+  g_autoptr (GIOStream) stream = NULL;
+  g_autoptr (GInputStream) source = NULL;
+  g_autoptr (GOutputStream) target = NULL;
+  g_autoptr (GBytes) received = NULL;
+  MuxWriteData *write;
+  double elapsed;
+  GError *error = NULL;
+
+  write = g_new0 (MuxWriteData, 1);
+  write->muxer = g_object_ref (sender);
+  write->payload = g_bytes_ref (payload);
+  write->uuid = g_uuid_string_random ();
+  write->compress = compress;
+
+  task = g_task_new (sender, NULL, NULL, NULL);
+  g_task_set_task_data (task, write, mux_write_data_free);
+  g_task_run_in_thread (task, mux_write_task);
+
+  stream = valent_mux_connection_accept_channel (receiver, write->uuid, NULL, &error);
+  g_assert_no_error (error);
+
+  /* Time the transfer from when the channel is accepted */
+  g_test_timer_start ();
+  source = g_object_ref (g_io_stream_get_input_stream (stream));
+
+  if (compress)
+    {
+      g_autoptr (GZlibDecompressor) decompressor = NULL;
+      g_autoptr (GInputStream) base_stream = g_steal_pointer (&source);
+
+      decompressor = g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+      source = g_converter_input_stream_new (base_stream,
+                                             G_CONVERTER (decompressor));
+    }
+
+  target = g_memory_output_stream_new_resizable ();
+  g_output_stream_splice (target,
+                          source,
+                          (G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+                           G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET),
+                          NULL,
+                          &error);
+  g_assert_no_error (error);
+  elapsed = g_test_timer_elapsed ();
+
+  while (!g_task_get_completed (task))
+    g_main_context_iteration (NULL, FALSE);
+
+  g_task_propagate_boolean (task, &error);
+  g_assert_no_error (error);
+
+  received = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (target));
+  g_assert_true (g_bytes_equal (received, payload));
+
+  return elapsed;
+}
+
+static void
+test_bluez_payload_compression (BluezBackendFixture *fixture,
+                                gconstpointer        user_data)
+{
+  g_autoptr (GSocket) sender_socket = NULL;
+  g_autoptr (GSocket) receiver_socket = NULL;
+  g_autoptr (GSocketConnection) sender_connection = NULL;
+  g_autoptr (GSocketConnection) receiver_connection = NULL;
+  g_autoptr (ValentMuxConnection) sender = NULL;
+  g_autoptr (ValentMuxConnection) receiver = NULL;
+  g_autoptr (GBytes) payload = NULL;
+  GString *text = NULL;
+  JsonNode *identity;
+  size_t size = g_test_perf () ? 64 * 1024 * 1024 : 1024 * 1024;
+  double raw_time, gzip_time;
+  GError *error = NULL;
+
+  /* Two multiplexers, connected to each other */
+  sender_socket = g_socket_new_from_fd (fixture->fds[0], &error);
+  g_assert_no_error (error);
+  sender_connection = g_object_new (G_TYPE_SOCKET_CONNECTION,
+                                    "socket", sender_socket,
+                                    NULL);
+  sender = valent_mux_connection_new (G_IO_STREAM (sender_connection));
+
+  receiver_socket = g_socket_new_from_fd (fixture->fds[1], &error);
+  g_assert_no_error (error);
+  receiver_connection = g_object_new (G_TYPE_SOCKET_CONNECTION,
+                                      "socket", receiver_socket,
+                                      NULL);
+  receiver = valent_mux_connection_new (G_IO_STREAM (receiver_connection));
+
+  identity = json_object_get_member (json_node_get_object (fixture->packets),
+                                     "identity");
+  valent_mux_connection_handshake_async (sender,
+                                         identity,
+                                         NULL,
+                                         (GAsyncReadyCallback)mux_handshake_cb,
+                                         &fixture->channel);
+  valent_mux_connection_handshake_async (receiver,
+                                         identity,
+                                         NULL,
+                                         (GAsyncReadyCallback)mux_handshake_cb,
+                                         &fixture->endpoint);
+  valent_test_await_pointer (&fixture->channel);
+  valent_test_await_pointer (&fixture->endpoint);
+
+  /* Text, like vCards or SMS threads */
+  text = g_string_sized_new (size);
+
+  for (unsigned int i = 0; text->len < size; i++)
+    g_string_append_printf (text, "BEGIN:VCARD\nFN:Contact %u\nTEL:555-%04u\nEND:VCARD\n", i, i % 10000);
+
+  g_string_truncate (text, size);
+  payload = g_string_free_to_bytes (text);
+
+  VALENT_TEST_CHECK ("Payloads can be transferred over a muxed channel");
+  raw_time = mux_transfer (sender, receiver, payload, FALSE);
+
+  VALENT_TEST_CHECK ("Compressed payloads can be transferred over a muxed channel");
+  gzip_time = mux_transfer (sender, receiver, payload, TRUE);
+
+  g_test_maximized_result (size / gzip_time / (1024 * 1024),
+                           "Compressed throughput %.2f MiB/s",
+                           size / gzip_time / (1024 * 1024));
+  g_test_message ("Raw throughput %.2f MiB/s",
+                  size / raw_time / (1024 * 1024));
+
+  valent_mux_connection_close (sender, NULL, NULL);
+  valent_mux_connection_close (receiver, NULL, NULL);
+}
+
 #if 0
 static void
 test_bluez_service_channel (BluezBackendFixture *fixture,
@@ -383,6 +593,12 @@ main (int   argc,
               test_bluez_service_new_connection,
               bluez_service_fixture_tear_down);
 
+  g_test_add ("/plugins/bluez/payload-compression",
+              BluezBackendFixture, NULL,
+              bluez_service_fixture_set_up,
+              test_bluez_payload_compression,
+              bluez_service_fixture_tear_down);
+
 #if 0
   g_test_add ("/plugins/bluez/channel",
               BluezBackendFixture, NULL,
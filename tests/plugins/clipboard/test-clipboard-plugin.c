@@ -1,6 +1,8 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 // SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
 
+#include <string.h>
+
 #include <gio/gio.h>
 #include <valent.h>
 #include <libvalent-test.h>
@@ -19,6 +21,19 @@ valent_clipboard_read_text_cb (ValentClipboard *clipboard,
   g_assert_no_error (error);
 }
 
+static void
+valent_clipboard_read_bytes_cb (ValentClipboard *clipboard,
+                                GAsyncResult    *result,
+                                gpointer        *bytes)
+{
+  GError *error = NULL;
+
+  if (bytes != NULL)
+    *bytes = valent_clipboard_read_bytes_finish (clipboard, result, &error);
+
+  g_assert_no_error (error);
+}
+
 static void
 test_clipboard_plugin_connect (ValentTestFixture *fixture,
                                gconstpointer      user_data)
@@ -130,6 +145,181 @@ test_clipboard_plugin_send_content (ValentTestFixture *fixture,
   v_assert_packet_type (packet, "kdeconnect.clipboard");
   v_assert_packet_cmpstr (packet, "content", ==, "send-content");
   json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin sends only the latest of rapid changes");
+  valent_clipboard_write_text (valent_clipboard_get_default (),
+                               "rapid-content-1",
+                               NULL,
+                               NULL,
+                               NULL);
+  valent_clipboard_write_text (valent_clipboard_get_default (),
+                               "rapid-content-2",
+                               NULL,
+                               NULL,
+                               NULL);
+  valent_clipboard_write_text (valent_clipboard_get_default (),
+                               "rapid-content-3",
+                               NULL,
+                               NULL,
+                               NULL);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.clipboard");
+  v_assert_packet_cmpstr (packet, "content", ==, "rapid-content-3");
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin does not resend unchanged content");
+  valent_clipboard_write_text (valent_clipboard_get_default (),
+                               "rapid-content-3",
+                               NULL,
+                               NULL,
+                               NULL);
+  valent_test_await_timeout (100);
+
+  valent_clipboard_write_text (valent_clipboard_get_default (),
+                               "changed-content",
+                               NULL,
+                               NULL,
+                               NULL);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.clipboard");
+  v_assert_packet_cmpstr (packet, "content", ==, "changed-content");
+  json_node_unref (packet);
+}
+
+static void
+test_clipboard_plugin_payload (ValentTestFixture *fixture,
+                               gconstpointer      user_data)
+{
+  JsonNode *packet;
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GBytes) image = NULL;
+  g_autofree char *text = NULL;
+  GBytes *content = NULL;
+  gboolean watch = FALSE;
+  g_autoptr (GError) error = NULL;
+
+  valent_test_watch_signal (valent_clipboard_get_default (), "changed", &watch);
+
+  g_settings_set_boolean (fixture->settings, "auto-pull", TRUE);
+  g_settings_set_boolean (fixture->settings, "auto-push", TRUE);
+
+  valent_test_fixture_connect (fixture, TRUE);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.clipboard.connect");
+  v_assert_packet_true (packet, "acceptsPayloads");
+  json_node_unref (packet);
+
+  packet = valent_test_fixture_lookup_packet (fixture, "clipboard-connect-payloads");
+  valent_test_fixture_handle_packet (fixture, packet);
+  valent_test_await_pending ();
+
+  VALENT_TEST_CHECK ("Plugin sends images as a payload");
+  image = g_resources_lookup_data ("/tests/image.png",
+                                   G_RESOURCE_LOOKUP_FLAGS_NONE,
+                                   NULL);
+  valent_clipboard_write_bytes (valent_clipboard_get_default (),
+                                "image/png",
+                                image,
+                                NULL,
+                                NULL,
+                                NULL);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.clipboard");
+  v_assert_packet_cmpstr (packet, "mimetype", ==, "image/png");
+  v_assert_packet_no_field (packet, "content");
+  g_assert_true (valent_packet_has_payload (packet));
+  g_assert_cmpint (valent_packet_get_payload_size (packet), ==, g_bytes_get_size (image));
+
+  valent_test_fixture_download (fixture, packet, &error);
+  g_assert_no_error (error);
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin sends large text as a payload");
+  text = g_strnfill (128 * 1024, 'a');
+  valent_clipboard_write_text (valent_clipboard_get_default (),
+                               text,
+                               NULL,
+                               NULL,
+                               NULL);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.clipboard");
+  v_assert_packet_cmpstr (packet, "mimetype", ==, "text/plain;charset=utf-8");
+  v_assert_packet_no_field (packet, "content");
+  g_assert_true (valent_packet_has_payload (packet));
+  g_assert_cmpint (valent_packet_get_payload_size (packet), ==, strlen (text));
+
+  valent_test_fixture_download (fixture, packet, &error);
+  g_assert_no_error (error);
+  json_node_unref (packet);
+  valent_test_await_pending ();
+  watch = FALSE;
+
+  VALENT_TEST_CHECK ("Plugin copies remote images to the local clipboard");
+  packet = valent_test_fixture_lookup_packet (fixture, "clipboard-image");
+  file = g_file_new_for_uri ("resource:///tests/image.png");
+  valent_test_fixture_upload (fixture, packet, file, &error);
+  g_assert_no_error (error);
+  valent_test_await_boolean (&watch);
+
+  valent_clipboard_read_bytes (valent_clipboard_get_default (),
+                               "image/png",
+                               NULL,
+                               (GAsyncReadyCallback)valent_clipboard_read_bytes_cb,
+                               &content);
+  valent_test_await_pointer (&content);
+
+  g_assert_true (g_bytes_equal (content, image));
+  g_clear_pointer (&content, g_bytes_unref);
+
+  valent_test_watch_clear (valent_clipboard_get_default (), &watch);
+}
+
+static void
+test_clipboard_plugin_payload_inline (ValentTestFixture *fixture,
+                                      gconstpointer      user_data)
+{
+  JsonNode *packet;
+  g_autoptr (GBytes) image = NULL;
+  g_autofree char *text = NULL;
+
+  g_settings_set_boolean (fixture->settings, "auto-push", TRUE);
+
+  valent_test_fixture_connect (fixture, TRUE);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.clipboard.connect");
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin sends images only to devices with payload support");
+  image = g_resources_lookup_data ("/tests/image.png",
+                                   G_RESOURCE_LOOKUP_FLAGS_NONE,
+                                   NULL);
+  valent_clipboard_write_bytes (valent_clipboard_get_default (),
+                                "image/png",
+                                image,
+                                NULL,
+                                NULL,
+                                NULL);
+  valent_test_await_timeout (100);
+
+  VALENT_TEST_CHECK ("Plugin sends large text inline to devices without payload support");
+  text = g_strnfill (128 * 1024, 'a');
+  valent_clipboard_write_text (valent_clipboard_get_default (),
+                               text,
+                               NULL,
+                               NULL,
+                               NULL);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.clipboard");
+  v_assert_packet_cmpstr (packet, "content", ==, text);
+  g_assert_false (valent_packet_has_payload (packet));
+  json_node_unref (packet);
 }
 
 static void
@@ -225,6 +415,18 @@ main (int   argc,
               test_clipboard_plugin_send_content,
               valent_test_fixture_clear);
 
+  g_test_add ("/plugins/clipboard/payload",
+              ValentTestFixture, path,
+              valent_test_fixture_init,
+              test_clipboard_plugin_payload,
+              valent_test_fixture_clear);
+
+  g_test_add ("/plugins/clipboard/payload-inline",
+              ValentTestFixture, path,
+              valent_test_fixture_init,
+              test_clipboard_plugin_payload_inline,
+              valent_test_fixture_clear);
+
   g_test_add ("/plugins/clipboard/actions",
               ValentTestFixture, path,
               valent_test_fixture_init,
@@ -144,6 +144,111 @@ test_contacts_plugin_provide_contacts (ValentTestFixture *fixture,
   json_node_unref (packet);
 }
 
+typedef struct
+{
+  int64_t last;
+  int64_t max_gap;
+} LatencyProbe;
+
+static gboolean
+latency_probe_tick (gpointer data)
+{
+  LatencyProbe *probe = data;
+  int64_t now = g_get_monotonic_time ();
+
+  probe->max_gap = MAX (probe->max_gap, now - probe->last);
+  probe->last = now;
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+on_contact_added_count (ValentContactStore *store,
+                        EContact           *contact,
+                        unsigned int       *n_added)
+{
+  *n_added += 1;
+}
+
+static void
+test_contacts_plugin_large_response (ValentTestFixture *fixture,
+                                     gconstpointer      user_data)
+{
+  ValentContactStore *store;
+  ValentDevice *device;
+  g_autoptr (JsonBuilder) builder = NULL;
+  g_autoptr (JsonNode) response = NULL;
+  g_autofree char *note = NULL;
+  LatencyProbe probe = { 0, };
+  unsigned int probe_id = 0;
+  unsigned int n_added = 0;
+  unsigned int n_contacts = g_test_perf () ? 20000 : 5000;
+  JsonNode *packet;
+
+  device = valent_test_fixture_get_device (fixture);
+  store = valent_contacts_ensure_store (valent_contacts_get_default (),
+                                        valent_device_get_id (device),
+                                        valent_device_get_name (device));
+
+  valent_test_fixture_connect (fixture, TRUE);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.contacts.request_all_uids_timestamps");
+  json_node_unref (packet);
+
+  /* Several megabytes of vCards */
+  note = g_strnfill (512, 'x');
+  valent_packet_init (&builder, "kdeconnect.contacts.response_vcards");
+
+  for (unsigned int i = 0; i < n_contacts; i++)
+    {
+      g_autofree char *uid = NULL;
+      g_autofree char *vcard = NULL;
+
+      uid = g_strdup_printf ("large-contact%u", i);
+      vcard = g_strdup_printf ("BEGIN:VCARD\n"
+                               "VERSION:2.1\n"
+                               "FN:Contact %u\n"
+                               "TEL;CELL:555-%07u\n"
+                               "NOTE:%s\n"
+                               "END:VCARD",
+                               i, i, note);
+      json_builder_set_member_name (builder, uid);
+      json_builder_add_string_value (builder, vcard);
+    }
+
+  response = valent_packet_end (&builder);
+
+  VALENT_TEST_CHECK ("Plugin handles large responses without blocking the main loop");
+  g_signal_connect (store,
+                    "contact-added",
+                    G_CALLBACK (on_contact_added_count),
+                    &n_added);
+
+  probe.last = g_get_monotonic_time ();
+  probe_id = g_timeout_add (10, latency_probe_tick, &probe);
+  valent_test_fixture_handle_packet (fixture, response);
+
+  while (n_added < n_contacts)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_clear_handle_id (&probe_id, g_source_remove);
+  g_signal_handlers_disconnect_by_data (store, &n_added);
+
+  g_test_minimized_result ((double)probe.max_gap / G_USEC_PER_SEC,
+                           "Longest main loop stall: %.3fs",
+                           (double)probe.max_gap / G_USEC_PER_SEC);
+
+  /* Only hold the main loop to a tight bound when measuring performance, since
+   * a loaded test runner can stall for reasons unrelated to the plugin */
+  if (g_test_perf ())
+    g_assert_cmpint (probe.max_gap, <, G_USEC_PER_SEC / 4);
+  else
+    g_assert_cmpint (probe.max_gap, <, G_USEC_PER_SEC * 5);
+
+  valent_test_await_pending ();
+}
+
 static const char *schemas[] = {
   "/tests/kdeconnect.contacts.request_all_uids_timestamps.json",
   "/tests/kdeconnect.contacts.request_vcards_by_uid.json",
@@ -183,6 +288,12 @@ main (int   argc,
               test_contacts_plugin_provide_contacts,
               valent_test_fixture_clear);
 
+  g_test_add ("/plugins/contacts/large-response",
+              ValentTestFixture, path,
+              contacts_plugin_fixture_set_up,
+              test_contacts_plugin_large_response,
+              valent_test_fixture_clear);
+
   g_test_add ("/plugins/contacts/fuzz",
               ValentTestFixture, path,
               valent_test_fixture_init,
@@ -12,6 +12,8 @@
 #define MAIN_PATH "/org/gnome/Mutter/RemoteDesktop"
 #define MAIN_IFACE "org.gnome.Mutter.RemoteDesktop"
 #define SESSION_IFACE "org.gnome.Mutter.RemoteDesktop.Session"
+#define SESSION_PATH "/org/gnome/Mutter/RemoteDesktop/Session/u1"
+#define MOCK_IFACE "org.freedesktop.DBus.Mock"
 
 
 typedef struct
@@ -42,16 +44,94 @@ mutter_input_fixture_tear_down (MutterInputFixture *fixture,
   v_assert_finalize_object (fixture->input);
 }
 
+static GVariant *
+mutter_input_fixture_get_calls (MutterInputFixture *fixture)
+{
+  g_autoptr (GVariant) reply = NULL;
+  g_autoptr (GError) error = NULL;
+
+  reply = g_dbus_connection_call_sync (fixture->connection,
+                                       BUS_NAME,
+                                       SESSION_PATH,
+                                       MOCK_IFACE,
+                                       "GetCalls",
+                                       NULL,
+                                       G_VARIANT_TYPE ("(a(tsav))"),
+                                       G_DBUS_CALL_FLAGS_NONE,
+                                       -1,
+                                       NULL,
+                                       &error);
+  g_assert_no_error (error);
+
+  return g_variant_get_child_value (reply, 0);
+}
+
+static void
+mutter_input_fixture_clear_calls (MutterInputFixture *fixture)
+{
+  g_autoptr (GVariant) reply = NULL;
+  g_autoptr (GError) error = NULL;
+
+  reply = g_dbus_connection_call_sync (fixture->connection,
+                                       BUS_NAME,
+                                       SESSION_PATH,
+                                       MOCK_IFACE,
+                                       "ClearCalls",
+                                       NULL,
+                                       NULL,
+                                       G_DBUS_CALL_FLAGS_NONE,
+                                       -1,
+                                       NULL,
+                                       &error);
+  g_assert_no_error (error);
+}
+
 static void
 test_mutter_input_adapter (MutterInputFixture *fixture,
                            gconstpointer       user_data)
 {
+  g_autoptr (GVariant) calls = NULL;
+  g_autoptr (GVariant) args = NULL;
+  g_autoptr (GVariant) dx = NULL;
+  g_autoptr (GVariant) dy = NULL;
+  const char *method;
+
   /* Wait a bit longer for initialization to finish, then pump the adapter to
    * start a remote desktop session.
    */
   valent_test_await_timeout (250);
   valent_input_pointer_motion (fixture->input, 1.0, 0.0);
+  valent_input_pointer_motion (fixture->input, 1.0, 0.0);
+  valent_input_keyboard_keysym (fixture->input, 'a', TRUE);
+  valent_input_keyboard_keysym (fixture->input, 'a', FALSE);
   valent_test_await_timeout (50);
+  valent_test_await_pending ();
+
+  VALENT_TEST_CHECK ("Adapter replays events received while the session starts");
+  calls = mutter_input_fixture_get_calls (fixture);
+
+  for (size_t i = 0, n_calls = g_variant_n_children (calls); i < n_calls; i++)
+    {
+      g_variant_get_child (calls, i, "(t&s@av)", NULL, &method, NULL);
+
+      if (g_str_equal (method, "NotifyPointerMotionRelative"))
+        {
+          g_variant_get_child (calls, i, "(t&s@av)", NULL, NULL, &args);
+          g_variant_get_child (args, 0, "v", &dx);
+          g_assert_cmpfloat (g_variant_get_double (dx), ==, 2.0);
+          g_clear_pointer (&dx, g_variant_unref);
+          g_clear_pointer (&args, g_variant_unref);
+
+          g_variant_get_child (calls, ++i, "(t&s@av)", NULL, &method, NULL);
+          g_assert_cmpstr (method, ==, "NotifyKeyboardKeysym");
+          g_variant_get_child (calls, ++i, "(t&s@av)", NULL, &method, NULL);
+          g_assert_cmpstr (method, ==, "NotifyKeyboardKeysym");
+          break;
+        }
+
+      g_assert_cmpuint (i + 1, <, n_calls);
+    }
+  g_clear_pointer (&calls, g_variant_unref);
 
   VALENT_TEST_CHECK ("Adapter handles relative pointer motion");
   valent_input_pointer_motion (fixture->input, 1.0, 1.0);
@@ -74,6 +154,47 @@ test_mutter_input_adapter (MutterInputFixture *fixture,
   VALENT_TEST_CHECK ("Adapter handles keyboard key release");
   valent_input_keyboard_keysym (fixture->input, 'a', FALSE);
   valent_test_await_pending ();
+  mutter_input_fixture_clear_calls (fixture);
+
+  VALENT_TEST_CHECK ("Adapter coalesces relative pointer motion");
+  for (unsigned int i = 0; i < 100; i++)
+    valent_input_pointer_motion (fixture->input, 1.0, 0.5);
+  valent_test_await_pending ();
+
+  calls = mutter_input_fixture_get_calls (fixture);
+  g_assert_cmpuint (g_variant_n_children (calls), ==, 1);
+
+  g_variant_get_child (calls, 0, "(t&s@av)", NULL, &method, &args);
+  g_assert_cmpstr (method, ==, "NotifyPointerMotionRelative");
+  g_variant_get_child (args, 0, "v", &dx);
+  g_variant_get_child (args, 1, "v", &dy);
+  g_assert_cmpfloat (g_variant_get_double (dx), ==, 100.0);
+  g_assert_cmpfloat (g_variant_get_double (dy), ==, 50.0);
+  g_clear_pointer (&dx, g_variant_unref);
+  g_clear_pointer (&dy, g_variant_unref);
+  g_clear_pointer (&args, g_variant_unref);
+  g_clear_pointer (&calls, g_variant_unref);
+  mutter_input_fixture_clear_calls (fixture);
+
+  VALENT_TEST_CHECK ("Adapter preserves ordering of motion and button events");
+  valent_input_pointer_motion (fixture->input, 1.0, 1.0);
+  valent_input_pointer_motion (fixture->input, 1.0, 1.0);
+  valent_input_pointer_button (fixture->input, VALENT_POINTER_PRIMARY, TRUE);
+  valent_input_pointer_motion (fixture->input, 1.0, 1.0);
+  valent_input_pointer_button (fixture->input, VALENT_POINTER_PRIMARY, FALSE);
+  valent_test_await_pending ();
+
+  calls = mutter_input_fixture_get_calls (fixture);
+  g_assert_cmpuint (g_variant_n_children (calls), ==, 4);
+
+  g_variant_get_child (calls, 0, "(t&s@av)", NULL, &method, NULL);
+  g_assert_cmpstr (method, ==, "NotifyPointerMotionRelative");
+  g_variant_get_child (calls, 1, "(t&s@av)", NULL, &method, NULL);
+  g_assert_cmpstr (method, ==, "NotifyPointerButton");
+  g_variant_get_child (calls, 2, "(t&s@av)", NULL, &method, NULL);
+  g_assert_cmpstr (method, ==, "NotifyPointerMotionRelative");
+  g_variant_get_child (calls, 3, "(t&s@av)", NULL, &method, NULL);
+  g_assert_cmpstr (method, ==, "NotifyPointerButton");
 }
 
 int
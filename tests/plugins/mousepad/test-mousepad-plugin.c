@@ -6,6 +6,8 @@
 #include <valent.h>
 #include <libvalent-test.h>
 
+#include "valent-mousepad-device.h"
+
 
 static void
 mousepad_plugin_fixture_tear_down (ValentTestFixture *fixture,
@@ -308,6 +310,66 @@ test_mousepad_plugin_send_pointer_request (ValentTestFixture *fixture,
   valent_test_watch_clear (actions, &watch);
 }
 
+static void
+test_mousepad_plugin_send_pointer_motion (ValentTestFixture *fixture,
+                                          gconstpointer      user_data)
+{
+  g_autoptr (ValentMousepadDevice) controller = NULL;
+  JsonNode *packet;
+  double dx = 0.0, dy = 0.0;
+  unsigned int n_packets = 0;
+  int64_t begin, elapsed;
+
+  VALENT_TEST_CHECK ("Plugin sends the keyboard state on connect");
+  valent_test_fixture_connect (fixture, TRUE);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.mousepad.keyboardstate");
+  v_assert_packet_true (packet, "state");
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Adapter coalesces pointer motion");
+  controller = valent_mousepad_device_new (fixture->device);
+  g_object_set (controller, "pointer-rate", 60, NULL);
+
+  begin = g_get_monotonic_time ();
+
+  for (unsigned int i = 0; i < 1000; i++)
+    {
+      valent_input_adapter_pointer_motion (VALENT_INPUT_ADAPTER (controller),
+                                           0.25,
+                                           -0.125);
+
+      if (i % 10 == 0)
+        g_main_context_iteration (NULL, FALSE);
+    }
+
+  while (dx < 250.0 || dy > -125.0)
+    {
+      JsonObject *body;
+
+      packet = valent_test_fixture_expect_packet (fixture);
+      v_assert_packet_type (packet, "kdeconnect.mousepad.request");
+      v_assert_packet_no_field (packet, "scroll");
+
+      body = valent_packet_get_body (packet);
+      dx += json_object_get_double_member (body, "dx");
+      dy += json_object_get_double_member (body, "dy");
+      n_packets++;
+
+      json_node_unref (packet);
+    }
+
+  elapsed = g_get_monotonic_time () - begin;
+
+  VALENT_TEST_CHECK ("Adapter preserves the total displacement");
+  g_assert_cmpfloat (dx, ==, 250.0);
+  g_assert_cmpfloat (dy, ==, -125.0);
+
+  VALENT_TEST_CHECK ("Adapter bounds the packet rate");
+  g_assert_cmpuint (n_packets, <=, 2 + (elapsed * 60) / G_USEC_PER_SEC);
+}
+
 static const char *schemas[] = {
   "/tests/kdeconnect.mousepad.echo.json",
   "/tests/kdeconnect.mousepad.keyboardstate.json",
@@ -366,6 +428,12 @@ main (int   argc,
               test_mousepad_plugin_send_pointer_request,
               mousepad_plugin_fixture_tear_down);
 
+  g_test_add ("/plugins/mousepad/send-pointer-motion",
+              ValentTestFixture, path,
+              valent_test_fixture_init,
+              test_mousepad_plugin_send_pointer_motion,
+              mousepad_plugin_fixture_tear_down);
+
   g_test_add ("/plugins/mousepad/fuzz",
               ValentTestFixture, path,
               valent_test_fixture_init,
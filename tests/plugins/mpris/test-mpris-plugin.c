@@ -7,6 +7,7 @@
 #include <libvalent-test.h>
 
 #include "valent-mock-media-player.h"
+#include "valent-mpris-art-cache.h"
 #include "valent-mpris-impl.h"
 #include "valent-mpris-player.h"
 
@@ -36,6 +37,59 @@ create_albumart_request (const char *art_url)
   return valent_packet_end (&builder);
 }
 
+/*
+ * Apply an update to @state, the way a remote device would.
+ */
+static void
+apply_player_update (JsonNode *state,
+                     JsonNode *packet)
+{
+  JsonObject *state_body = valent_packet_get_body (state);
+  JsonObject *body = valent_packet_get_body (packet);
+  JsonObjectIter iter;
+  const char *member;
+  JsonNode *node;
+
+  json_object_iter_init (&iter, body);
+  while (json_object_iter_next (&iter, &member, &node))
+    json_object_set_member (state_body, member, json_node_copy (node));
+}
+
+/*
+ * Apply updates to @state until each of @fields has been received.
+ */
+static void
+expect_player_update (ValentTestFixture  *fixture,
+                      JsonNode           *state,
+                      const char * const *fields)
+{
+  g_autoptr (GHashTable) received = NULL;
+
+  received = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (unsigned int i = 0; fields[i] != NULL; i++)
+    g_hash_table_add (received, (char *)fields[i]);
+
+  while (g_hash_table_size (received) > 0)
+    {
+      JsonNode *packet;
+      JsonObjectIter iter;
+      const char *member;
+      JsonNode *node;
+
+      packet = valent_test_fixture_expect_packet (fixture);
+      v_assert_packet_type (packet, "kdeconnect.mpris");
+      v_assert_packet_cmpstr (packet, "player", ==, "Mock Player");
+
+      json_object_iter_init (&iter, valent_packet_get_body (packet));
+      while (json_object_iter_next (&iter, &member, &node))
+        g_hash_table_remove (received, member);
+
+      apply_player_update (state, packet);
+      json_node_unref (packet);
+    }
+}
+
 static void
 text_mpris_plugin_fixture_clear (ValentTestFixture *fixture,
                                  gconstpointer      user_data)
@@ -53,6 +107,7 @@ test_mpris_plugin_handle_request (ValentTestFixture *fixture,
   g_autoptr (ValentMediaPlayer) player = NULL;
   g_autoptr (ValentMPRISImpl) impl = NULL;
   g_autoptr (GError) error = NULL;
+  g_autoptr (JsonNode) state = NULL;
   JsonNode *packet;
   JsonArray *player_list;
   const char *player_name;
@@ -89,47 +144,70 @@ test_mpris_plugin_handle_request (ValentTestFixture *fixture,
   valent_test_fixture_handle_packet (fixture, packet);
 
   VALENT_TEST_CHECK ("Plugin sends players with the expected properties");
-  packet = valent_test_fixture_expect_packet (fixture);
-  v_assert_packet_type (packet, "kdeconnect.mpris");
-
-  v_assert_packet_cmpstr (packet, "player", ==, "Mock Player");
-  v_assert_packet_false (packet, "canPause");
-  v_assert_packet_false (packet, "canPlay");
-  v_assert_packet_false (packet, "canGoNext");
-  v_assert_packet_false (packet, "canGoPrevious");
-  v_assert_packet_false (packet, "canSeek");
-  v_assert_packet_false (packet, "isPlaying");
-  v_assert_packet_cmpstr (packet, "loopStatus", ==, "None");
-  v_assert_packet_false (packet, "shuffle");
-  v_assert_packet_cmpint (packet, "volume", ==, 100);
-
-  v_assert_packet_no_field (packet, "artist");
-  v_assert_packet_no_field (packet, "title");
-  v_assert_packet_no_field (packet, "album");
-  v_assert_packet_no_field (packet, "length");
-
-  json_node_unref (packet);
+  state = valent_packet_new ("kdeconnect.mpris");
+  expect_player_update (fixture, state, VALENT_STRV_INIT ("isPlaying", "volume"));
+
+  v_assert_packet_cmpstr (state, "player", ==, "Mock Player");
+  v_assert_packet_false (state, "canPause");
+  v_assert_packet_false (state, "canPlay");
+  v_assert_packet_false (state, "canGoNext");
+  v_assert_packet_false (state, "canGoPrevious");
+  v_assert_packet_false (state, "canSeek");
+  v_assert_packet_false (state, "isPlaying");
+  v_assert_packet_cmpstr (state, "loopStatus", ==, "None");
+  v_assert_packet_false (state, "shuffle");
+  v_assert_packet_cmpint (state, "volume", ==, 100);
+
+  v_assert_packet_cmpstr (state, "artist", ==, "");
+  v_assert_packet_cmpstr (state, "title", ==, "");
+  v_assert_packet_cmpstr (state, "album", ==, "");
+  v_assert_packet_cmpint (state, "length", ==, 0);
 
   /* Request Play */
   VALENT_TEST_CHECK ("Plugin responds to a request to Play");
   packet = valent_test_fixture_lookup_packet (fixture, "request-play");
   valent_test_fixture_handle_packet (fixture, packet);
 
+  VALENT_TEST_CHECK ("Plugin only sends the fields that changed");
   packet = valent_test_fixture_expect_packet (fixture);
   v_assert_packet_type (packet, "kdeconnect.mpris");
-
   v_assert_packet_cmpstr (packet, "player", ==, "Mock Player");
-  v_assert_packet_true (packet, "canPause");
-  v_assert_packet_true (packet, "canGoNext");
-  v_assert_packet_true (packet, "canSeek");
-  v_assert_packet_true (packet, "isPlaying");
-  v_assert_packet_cmpstr (packet, "loopStatus", ==, "None");
-  v_assert_packet_false (packet, "shuffle");
+  v_assert_packet_no_field (packet, "loopStatus");
+  v_assert_packet_no_field (packet, "shuffle");
+  v_assert_packet_no_field (packet, "volume");
+  v_assert_packet_field (packet, "isPlaying");
+  v_assert_packet_field (packet, "canPause");
+  v_assert_packet_field (packet, "title");
+  apply_player_update (state, packet);
+  json_node_unref (packet);
 
-  v_assert_packet_cmpstr (packet, "artist", ==, "Test Artist");
-  v_assert_packet_cmpstr (packet, "title", ==, "Track 1");
-  v_assert_packet_cmpstr (packet, "album", ==, "Test Album");
-  v_assert_packet_cmpint (packet, "length", ==, 180000);
+  v_assert_packet_true (state, "canPause");
+  v_assert_packet_true (state, "canGoNext");
+  v_assert_packet_true (state, "canSeek");
+  v_assert_packet_true (state, "isPlaying");
+  v_assert_packet_cmpstr (state, "loopStatus", ==, "None");
+  v_assert_packet_false (state, "shuffle");
+
+  v_assert_packet_cmpstr (state, "artist", ==, "Test Artist");
+  v_assert_packet_cmpstr (state, "title", ==, "Track 1");
+  v_assert_packet_cmpstr (state, "album", ==, "Test Album");
+  v_assert_packet_cmpint (state, "length", ==, 180000);
+
+  VALENT_TEST_CHECK ("Plugin does not send position updates during steady playback");
+  for (unsigned int i = 0; i < 60; i++)
+    {
+      g_object_notify (G_OBJECT (player), "position");
+      valent_test_await_pending ();
+    }
+
+  valent_media_player_set_volume (player, 0.75);
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.mpris");
+  v_assert_packet_cmpint (packet, "volume", ==, 75);
+  v_assert_packet_no_field (packet, "pos");
+  v_assert_packet_no_field (packet, "isPlaying");
+  v_assert_packet_no_field (packet, "title");
+  apply_player_update (state, packet);
   json_node_unref (packet);
 
   VALENT_TEST_CHECK ("Plugin responds to a request to Go Next");
@@ -137,154 +215,121 @@ test_mpris_plugin_handle_request (ValentTestFixture *fixture,
   valent_test_fixture_handle_packet (fixture, packet);
 
   /* Expect Track 2 */
-  packet = valent_test_fixture_expect_packet (fixture);
-  v_assert_packet_type (packet, "kdeconnect.mpris");
-
-  v_assert_packet_cmpstr (packet, "player", ==, "Mock Player");
-  v_assert_packet_true (packet, "canPause");
-  v_assert_packet_true (packet, "canGoNext");
-  v_assert_packet_true (packet, "canGoPrevious");
-  v_assert_packet_true (packet, "canSeek");
-  v_assert_packet_true (packet, "isPlaying");
-  v_assert_packet_cmpstr (packet, "loopStatus", ==, "None");
-  v_assert_packet_false (packet, "shuffle");
-
-  v_assert_packet_cmpstr (packet, "artist", ==, "Test Artist");
-  v_assert_packet_cmpstr (packet, "title", ==, "Track 2");
-  v_assert_packet_cmpstr (packet, "album", ==, "Test Album");
-  v_assert_packet_cmpint (packet, "length", ==, 180000);
-  json_node_unref (packet);
+  expect_player_update (fixture, state, VALENT_STRV_INIT ("canGoPrevious",
+                                                          "title"));
+  v_assert_packet_true (state, "canPause");
+  v_assert_packet_true (state, "canGoNext");
+  v_assert_packet_true (state, "canGoPrevious");
+  v_assert_packet_true (state, "canSeek");
+  v_assert_packet_true (state, "isPlaying");
+  v_assert_packet_cmpstr (state, "loopStatus", ==, "None");
+  v_assert_packet_false (state, "shuffle");
+
+  v_assert_packet_cmpstr (state, "artist", ==, "Test Artist");
+  v_assert_packet_cmpstr (state, "title", ==, "Track 2");
+  v_assert_packet_cmpstr (state, "album", ==, "Test Album");
+  v_assert_packet_cmpint (state, "length", ==, 180000);
 
   VALENT_TEST_CHECK ("Plugin responds to a request to Go Previous");
   packet = valent_test_fixture_lookup_packet (fixture, "request-previous");
   valent_test_fixture_handle_packet (fixture, packet);
 
   /* Expect Track 1 */
-  packet = valent_test_fixture_expect_packet (fixture);
-  v_assert_packet_type (packet, "kdeconnect.mpris");
-
-  v_assert_packet_cmpstr (packet, "player", ==, "Mock Player");
-  v_assert_packet_true (packet, "canPause");
-  v_assert_packet_true (packet, "canGoNext");
-  v_assert_packet_false (packet, "canGoPrevious");
-  v_assert_packet_true (packet, "canSeek");
-  v_assert_packet_true (packet, "isPlaying");
-  v_assert_packet_cmpstr (packet, "loopStatus", ==, "None");
-  v_assert_packet_false (packet, "shuffle");
-
-  v_assert_packet_cmpstr (packet, "artist", ==, "Test Artist");
-  v_assert_packet_cmpstr (packet, "title", ==, "Track 1");
-  v_assert_packet_cmpstr (packet, "album", ==, "Test Album");
-  v_assert_packet_cmpint (packet, "length", ==, 180000);
-  json_node_unref (packet);
+  expect_player_update (fixture, state, VALENT_STRV_INIT ("canGoPrevious",
+                                                          "title"));
+  v_assert_packet_true (state, "canPause");
+  v_assert_packet_true (state, "canGoNext");
+  v_assert_packet_false (state, "canGoPrevious");
+  v_assert_packet_true (state, "canSeek");
+  v_assert_packet_true (state, "isPlaying");
+  v_assert_packet_cmpstr (state, "loopStatus", ==, "None");
+  v_assert_packet_false (state, "shuffle");
+
+  v_assert_packet_cmpstr (state, "artist", ==, "Test Artist");
+  v_assert_packet_cmpstr (state, "title", ==, "Track 1");
+  v_assert_packet_cmpstr (state, "album", ==, "Test Album");
+  v_assert_packet_cmpint (state, "length", ==, 180000);
 
   VALENT_TEST_CHECK ("Plugin responds to a request to Pause");
   packet = valent_test_fixture_lookup_packet (fixture, "request-pause");
   valent_test_fixture_handle_packet (fixture, packet);
 
   /* Expect paused state */
-  packet = valent_test_fixture_expect_packet (fixture);
-  v_assert_packet_type (packet, "kdeconnect.mpris");
-
-  v_assert_packet_cmpstr (packet, "player", ==, "Mock Player");
-  v_assert_packet_false (packet, "canPause");
-  v_assert_packet_true (packet, "canPlay");
-  v_assert_packet_true (packet, "canSeek");
-  v_assert_packet_false (packet, "isPlaying");
-  v_assert_packet_cmpstr (packet, "loopStatus", ==, "None");
-  v_assert_packet_false (packet, "shuffle");
-
-  v_assert_packet_cmpstr (packet, "artist", ==, "Test Artist");
-  v_assert_packet_cmpstr (packet, "title", ==, "Track 1");
-  v_assert_packet_cmpstr (packet, "album", ==, "Test Album");
-  v_assert_packet_cmpint (packet, "length", ==, 180000);
-  json_node_unref (packet);
+  expect_player_update (fixture, state, VALENT_STRV_INIT ("isPlaying",
+                                                          "canPause"));
+  v_assert_packet_false (state, "canPause");
+  v_assert_packet_true (state, "canPlay");
+  v_assert_packet_true (state, "canSeek");
+  v_assert_packet_false (state, "isPlaying");
+  v_assert_packet_cmpstr (state, "loopStatus", ==, "None");
+  v_assert_packet_false (state, "shuffle");
+
+  v_assert_packet_cmpstr (state, "artist", ==, "Test Artist");
+  v_assert_packet_cmpstr (state, "title", ==, "Track 1");
+  v_assert_packet_cmpstr (state, "album", ==, "Test Album");
+  v_assert_packet_cmpint (state, "length", ==, 180000);
 
   VALENT_TEST_CHECK ("Plugin responds to a request to Seek");
   packet = valent_test_fixture_lookup_packet (fixture, "request-seek");
   valent_test_fixture_handle_packet (fixture, packet);
 
   /* Expect position of 1s */
-  packet = valent_test_fixture_expect_packet (fixture);
-  v_assert_packet_type (packet, "kdeconnect.mpris");
-
-  v_assert_packet_cmpstr (packet, "player", ==, "Mock Player");
-  v_assert_packet_cmpint (packet, "pos", ==, 1000);
-  json_node_unref (packet);
+  expect_player_update (fixture, state, VALENT_STRV_INIT ("pos"));
+  v_assert_packet_cmpint (state, "pos", ==, 1000);
 
   VALENT_TEST_CHECK ("Plugin responds to a request to Stop");
   packet = valent_test_fixture_lookup_packet (fixture, "request-stop");
   valent_test_fixture_handle_packet (fixture, packet);
 
-  VALENT_TEST_CHECK ("Plugin responds with an update that the position is reset");
-  packet = valent_test_fixture_expect_packet (fixture);
-  v_assert_packet_type (packet, "kdeconnect.mpris");
-  v_assert_packet_cmpstr (packet, "player", ==, "Mock Player");
-  v_assert_packet_cmpint (packet, "pos", ==, 0);
-  json_node_unref (packet);
-
   VALENT_TEST_CHECK ("Plugin responds with an update that the player is quiescent");
-  packet = valent_test_fixture_expect_packet (fixture);
-  v_assert_packet_type (packet, "kdeconnect.mpris");
-
-  v_assert_packet_cmpstr (packet, "player", ==, "Mock Player");
-  v_assert_packet_false (packet, "canPause");
-  v_assert_packet_true (packet, "canPlay");
-  v_assert_packet_false (packet, "canGoNext");
-  v_assert_packet_false (packet, "canGoPrevious");
-  v_assert_packet_false (packet, "canSeek");
-  v_assert_packet_false (packet, "isPlaying");
-  v_assert_packet_cmpstr (packet, "loopStatus", ==, "None");
-  v_assert_packet_false (packet, "shuffle");
-
-  v_assert_packet_no_field (packet, "artist");
-  v_assert_packet_no_field (packet, "title");
-  v_assert_packet_no_field (packet, "album");
-  v_assert_packet_no_field (packet, "length");
-  json_node_unref (packet);
+  expect_player_update (fixture, state, VALENT_STRV_INIT ("pos",
+                                                          "canSeek",
+                                                          "title"));
+  v_assert_packet_cmpint (state, "pos", ==, 0);
+  v_assert_packet_false (state, "canPause");
+  v_assert_packet_true (state, "canPlay");
+  v_assert_packet_false (state, "canGoNext");
+  v_assert_packet_false (state, "canGoPrevious");
+  v_assert_packet_false (state, "canSeek");
+  v_assert_packet_false (state, "isPlaying");
+  v_assert_packet_cmpstr (state, "loopStatus", ==, "None");
+  v_assert_packet_false (state, "shuffle");
+
+  v_assert_packet_cmpstr (state, "artist", ==, "");
+  v_assert_packet_cmpstr (state, "title", ==, "");
+  v_assert_packet_cmpstr (state, "album", ==, "");
+  v_assert_packet_cmpint (state, "length", ==, 0);
 
   VALENT_TEST_CHECK ("Plugin responds to a request to change Loop Status");
   packet = valent_test_fixture_lookup_packet (fixture, "request-repeat");
   valent_test_fixture_handle_packet (fixture, packet);
 
   /* Expect repeat change */
-  packet = valent_test_fixture_expect_packet (fixture);
-  v_assert_packet_type (packet, "kdeconnect.mpris");
-  v_assert_packet_cmpstr (packet, "player", ==, "Mock Player");
-  v_assert_packet_cmpstr (packet, "loopStatus", ==, "Track");
-  json_node_unref (packet);
+  expect_player_update (fixture, state, VALENT_STRV_INIT ("loopStatus"));
+  v_assert_packet_cmpstr (state, "loopStatus", ==, "Track");
 
   VALENT_TEST_CHECK ("Plugin responds to a request to change Shuffle");
   packet = valent_test_fixture_lookup_packet (fixture, "request-shuffle");
   valent_test_fixture_handle_packet (fixture, packet);
 
   /* Expect shuffle change */
-  packet = valent_test_fixture_expect_packet (fixture);
-  v_assert_packet_type (packet, "kdeconnect.mpris");
-  v_assert_packet_cmpstr (packet, "player", ==, "Mock Player");
-  v_assert_packet_true (packet, "shuffle");
-  json_node_unref (packet);
+  expect_player_update (fixture, state, VALENT_STRV_INIT ("shuffle"));
+  v_assert_packet_true (state, "shuffle");
 
   VALENT_TEST_CHECK ("Plugin responds to a request to change Volume");
   packet = valent_test_fixture_lookup_packet (fixture, "request-volume");
   valent_test_fixture_handle_packet (fixture, packet);
 
   /* Expect volume change */
-  packet = valent_test_fixture_expect_packet (fixture);
-  v_assert_packet_type (packet, "kdeconnect.mpris");
-  v_assert_packet_cmpstr (packet, "player", ==, "Mock Player");
-  v_assert_packet_cmpint (packet, "volume", ==, 50);
-  json_node_unref (packet);
+  expect_player_update (fixture, state, VALENT_STRV_INIT ("volume"));
+  v_assert_packet_cmpint (state, "volume", ==, 50);
 
   VALENT_TEST_CHECK ("Plugin send updates for Album Art");
   valent_mock_media_player_update_art (VALENT_MOCK_MEDIA_PLAYER (player),
                                        "resource:///tests/image.png");
 
-  packet = valent_test_fixture_expect_packet (fixture);
-  v_assert_packet_type (packet, "kdeconnect.mpris");
-  v_assert_packet_cmpstr (packet, "player", ==, "Mock Player");
-  v_assert_packet_cmpstr (packet, "albumArtUrl", ==, "resource:///tests/image.png");
-  json_node_unref (packet);
+  expect_player_update (fixture, state, VALENT_STRV_INIT ("albumArtUrl"));
+  v_assert_packet_cmpstr (state, "albumArtUrl", ==, "resource:///tests/image.png");
 
   VALENT_TEST_CHECK ("Plugin responds to a request to transfer Album Art");
   packet = create_albumart_request ("resource:///tests/image.png");
@@ -351,6 +396,7 @@ test_mpris_plugin_handle_player (ValentTestFixture *fixture,
 {
   g_autoptr (GDBusConnection) connection = NULL;
   g_autoptr (GFile) file = NULL;
+  g_autoptr (GFile) art = NULL;
   unsigned int watch_id;
   JsonNode *packet;
   GError *error = NULL;
@@ -436,6 +482,12 @@ test_mpris_plugin_handle_player (ValentTestFixture *fixture,
   g_clear_pointer (&artist, g_free);
   g_clear_pointer (&metadata, g_variant_unref);
 
+  VALENT_TEST_CHECK ("Plugin stores Album Art in the shared cache");
+  art = valent_mpris_art_cache_lookup ("resource:///tests/image.png");
+  g_assert_true (G_IS_FILE (art));
+  g_assert_true (g_file_query_exists (art, NULL));
+  g_clear_object (&art);
+
   VALENT_TEST_CHECK ("Plugin forwards request to Play");
   valent_media_player_play (fixture->data);
   packet = valent_test_fixture_expect_packet (fixture);
@@ -534,6 +586,256 @@ test_mpris_plugin_handle_player (ValentTestFixture *fixture,
   g_dbus_connection_signal_unsubscribe (connection, watch_id);
 }
 
+static void
+test_mpris_plugin_send_updates (ValentTestFixture *fixture,
+                                gconstpointer      user_data)
+{
+  ValentMediaAdapter *adapter;
+  g_autoptr (ValentMediaPlayer) player = NULL;
+  g_autoptr (ValentMediaPlayer) removed = NULL;
+  JsonNode *packet;
+  JsonArray *player_list;
+  unsigned int n_packets = 0;
+
+  adapter = valent_test_await_adapter (valent_media_get_default ());
+  player = g_object_new (VALENT_TYPE_MOCK_MEDIA_PLAYER, NULL);
+  removed = g_object_new (VALENT_TYPE_MOCK_MEDIA_PLAYER, NULL);
+  valent_media_adapter_player_added (adapter, player);
+
+  valent_test_fixture_connect (fixture, TRUE);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.mpris.request");
+  json_node_unref (packet);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_field (packet, "playerList");
+  json_node_unref (packet);
+
+  /* A fixed sequence of changes, with a volume change to mark the end */
+  valent_media_player_play (player);
+  valent_test_await_pending ();
+
+  for (unsigned int i = 0; i < 60; i++)
+    {
+      g_object_notify (G_OBJECT (player), "position");
+      valent_test_await_pending ();
+    }
+
+  valent_media_player_next (player);
+  valent_test_await_pending ();
+  valent_media_player_next (player);
+  valent_test_await_pending ();
+  valent_media_player_previous (player);
+  valent_test_await_pending ();
+  valent_media_player_pause (player);
+  valent_test_await_pending ();
+  valent_media_player_set_volume (player, 0.5);
+  valent_test_await_pending ();
+
+  VALENT_TEST_CHECK ("Plugin sends one packet for each change to a player");
+  do
+    {
+      packet = valent_test_fixture_expect_packet (fixture);
+      v_assert_packet_type (packet, "kdeconnect.mpris");
+      n_packets++;
+
+      /* Changing tracks on the same album only changes the title */
+      if (n_packets == 2)
+        {
+          v_assert_packet_cmpstr (packet, "title", ==, "Track 2");
+          v_assert_packet_no_field (packet, "artist");
+          v_assert_packet_no_field (packet, "album");
+          v_assert_packet_no_field (packet, "length");
+          v_assert_packet_no_field (packet, "albumArtUrl");
+        }
+
+      if (json_object_has_member (valent_packet_get_body (packet), "volume") &&
+          json_object_get_int_member (valent_packet_get_body (packet), "volume") == 50)
+        {
+          json_node_unref (packet);
+          break;
+        }
+
+      json_node_unref (packet);
+    }
+  while (TRUE);
+
+  g_assert_cmpuint (n_packets, ==, 6);
+
+  VALENT_TEST_CHECK ("Plugin keeps the state of other players when one is removed");
+  valent_media_adapter_player_added (adapter, removed);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  player_list = json_object_get_array_member (valent_packet_get_body (packet),
+                                              "playerList");
+  g_assert_cmpuint (json_array_get_length (player_list), ==, 2);
+  json_node_unref (packet);
+
+  valent_media_player_play (removed);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_true (packet, "isPlaying");
+  v_assert_packet_field (packet, "volume");
+  json_node_unref (packet);
+
+  valent_media_adapter_player_removed (adapter, removed);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  player_list = json_object_get_array_member (valent_packet_get_body (packet),
+                                              "playerList");
+  g_assert_cmpuint (json_array_get_length (player_list), ==, 1);
+  json_node_unref (packet);
+
+  /* Changes to the removed player are no longer sent */
+  valent_media_player_pause (removed);
+  valent_test_await_pending ();
+
+  valent_media_player_set_volume (player, 0.25);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_cmpint (packet, "volume", ==, 25);
+  v_assert_packet_no_field (packet, "isPlaying");
+  v_assert_packet_no_field (packet, "canPause");
+  v_assert_packet_no_field (packet, "title");
+  json_node_unref (packet);
+
+  valent_media_adapter_player_removed (adapter, player);
+}
+
+static GFile *
+add_art (const char   *url,
+         const void   *data,
+         size_t        size)
+{
+  g_autoptr (GFile) download = NULL;
+  GFile *file;
+  GError *error = NULL;
+
+  download = valent_mpris_art_cache_create_download ();
+  g_file_replace_contents (download, data, size,
+                           NULL, FALSE, G_FILE_CREATE_NONE, NULL,
+                           NULL, &error);
+  g_assert_no_error (error);
+
+  file = valent_mpris_art_cache_add (url, download, &error);
+  g_assert_no_error (error);
+  g_assert_true (G_IS_FILE (file));
+
+  return file;
+}
+
+static void
+fill_art_cache (const char *prefix)
+{
+  for (unsigned int i = 0; i < 129; i++)
+    {
+      g_autofree char *url = NULL;
+      g_autoptr (GFile) file = NULL;
+
+      url = g_strdup_printf ("https://example.com/%s/%u.png", prefix, i);
+      file = add_art (url, url, strlen (url));
+    }
+}
+
+static void
+prepare_upload_cb (GObject      *object,
+                   GAsyncResult *result,
+                   gpointer      user_data)
+{
+  GFile **file = user_data;
+  GError *error = NULL;
+
+  *file = valent_mpris_art_cache_prepare_upload_finish (result, &error);
+  g_assert_no_error (error);
+}
+
+static void
+test_mpris_plugin_art_cache (void)
+{
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GdkPixbuf) pixbuf = NULL;
+  g_autoptr (GFile) source = NULL;
+  g_autoptr (GFile) scaled = NULL;
+  g_autoptr (GFile) cached = NULL;
+  g_autofree char *source_path = NULL;
+  g_autofree char *scaled_path = NULL;
+  g_autofree uint8_t *data = NULL;
+  size_t size = 12 * 1024 * 1024;
+  GError *error = NULL;
+
+  VALENT_TEST_CHECK ("Cache evicts the least recently used art over the item limit");
+  fill_art_cache ("items");
+
+  file = valent_mpris_art_cache_lookup ("https://example.com/items/0.png");
+  g_assert_null (file);
+  file = valent_mpris_art_cache_lookup ("https://example.com/items/1.png");
+  g_assert_true (G_IS_FILE (file));
+  g_clear_object (&file);
+  file = valent_mpris_art_cache_lookup ("https://example.com/items/128.png");
+  g_assert_true (G_IS_FILE (file));
+  g_clear_object (&file);
+
+  VALENT_TEST_CHECK ("Cache evicts the least recently used art over the size limit");
+  data = g_malloc0 (size);
+
+  data[0] = 'a';
+  file = add_art ("https://example.com/size/a.png", data, size);
+  g_clear_object (&file);
+  data[0] = 'b';
+  file = add_art ("https://example.com/size/b.png", data, size);
+  g_clear_object (&file);
+  data[0] = 'c';
+  file = add_art ("https://example.com/size/c.png", data, size);
+  g_clear_object (&file);
+  g_clear_pointer (&data, g_free);
+
+  file = valent_mpris_art_cache_lookup ("https://example.com/size/a.png");
+  g_assert_null (file);
+  file = valent_mpris_art_cache_lookup ("https://example.com/size/b.png");
+  g_assert_true (G_IS_FILE (file));
+  g_clear_object (&file);
+  file = valent_mpris_art_cache_lookup ("https://example.com/size/c.png");
+  g_assert_true (G_IS_FILE (file));
+  g_clear_object (&file);
+
+  VALENT_TEST_CHECK ("Cache downscales large album art for upload");
+  pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 1024, 768);
+  gdk_pixbuf_fill (pixbuf, 0xff0000ff);
+  source_path = g_build_filename (g_get_user_cache_dir (), "art.png", NULL);
+  gdk_pixbuf_save (pixbuf, source_path, "png", &error, NULL);
+  g_assert_no_error (error);
+  g_clear_object (&pixbuf);
+
+  source = g_file_new_for_path (source_path);
+  valent_mpris_art_cache_prepare_upload (source, NULL, prepare_upload_cb, &scaled);
+  valent_test_await_pointer (&scaled);
+  g_assert_false (g_file_equal (scaled, source));
+
+  scaled_path = g_file_get_path (scaled);
+  pixbuf = gdk_pixbuf_new_from_file (scaled_path, &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (gdk_pixbuf_get_width (pixbuf), ==, 512);
+  g_assert_cmpint (gdk_pixbuf_get_height (pixbuf), ==, 384);
+  g_clear_object (&pixbuf);
+
+  VALENT_TEST_CHECK ("Cache reuses downscaled album art");
+  valent_mpris_art_cache_prepare_upload (source, NULL, prepare_upload_cb, &cached);
+  valent_test_await_pointer (&cached);
+  g_assert_true (g_file_equal (scaled, cached));
+  valent_mpris_art_cache_release (g_steal_pointer (&cached));
+
+  VALENT_TEST_CHECK ("Cache does not evict art with an upload in progress");
+  fill_art_cache ("pinned");
+  g_assert_true (g_file_query_exists (scaled, NULL));
+
+  valent_mpris_art_cache_release (g_object_ref (scaled));
+  fill_art_cache ("released");
+  g_assert_false (g_file_query_exists (scaled, NULL));
+
+  g_file_delete (source, NULL, NULL);
+}
+
 static const char *schemas[] = {
   "/tests/kdeconnect.mpris.json",
   "/tests/kdeconnect.mpris.request.json",
@@ -571,6 +873,15 @@ main (int   argc,
               test_mpris_plugin_handle_player,
               text_mpris_plugin_fixture_clear);
 
+  g_test_add ("/plugins/mpris/send-updates",
+              ValentTestFixture, path,
+              valent_test_fixture_init,
+              test_mpris_plugin_send_updates,
+              text_mpris_plugin_fixture_clear);
+
+  g_test_add_func ("/plugins/mpris/art-cache",
+                   test_mpris_plugin_art_cache);
+
   g_test_add ("/plugins/mpris/fuzz",
               ValentTestFixture, path,
               valent_test_fixture_init,
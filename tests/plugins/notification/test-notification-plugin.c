@@ -6,6 +6,7 @@
 #include <valent.h>
 #include <libvalent-test.h>
 
+#include "valent-notification-upload.h"
 
 static ValentNotificationsAdapter *adapter = NULL;
 
@@ -97,6 +98,10 @@ test_notification_plugin_send_notification (ValentTestFixture *fixture,
   g_autoptr (GBytes) bytes = NULL;
   g_autoptr (GFile) file = NULL;
   g_autoptr (GIcon) icon = NULL;
+  g_autoptr (GFileIOStream) stream = NULL;
+  g_autofree char *payload_hash = NULL;
+  const char *cached_hash = NULL;
+  unsigned int cache_hits = 0;
   GError *error = NULL;
 
   /* TODO: Send when active */
@@ -139,6 +144,25 @@ test_notification_plugin_send_notification (ValentTestFixture *fixture,
   v_assert_packet_cmpstr (packet, "ticker", ==, "Test Title: Test Body");
   json_node_unref (packet);
 
+  VALENT_TEST_CHECK ("Plugin filters notifications from denied applications");
+  g_settings_set_strv (fixture->settings,
+                       "forward-deny",
+                       VALENT_STRV_INIT ("Denied Application", "Blocked*"));
+
+  valent_notification_set_application (notification, "Denied Application");
+  valent_notifications_adapter_notification_added (adapter, notification);
+  valent_notification_set_application (notification, "Blocked Application");
+  valent_notifications_adapter_notification_added (adapter, notification);
+  valent_notification_set_application (notification, "Test Application");
+  valent_notifications_adapter_notification_added (adapter, notification);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.notification");
+  v_assert_packet_cmpstr (packet, "appName", ==, "Test Application");
+  json_node_unref (packet);
+
+  g_settings_reset (fixture->settings, "forward-deny");
+
   VALENT_TEST_CHECK ("Plugin forwards notifications with themed icons");
   icon = g_themed_icon_new ("dialog-information-symbolic");
   valent_notification_set_icon (notification, icon);
@@ -194,11 +218,79 @@ test_notification_plugin_send_notification (ValentTestFixture *fixture,
   v_assert_packet_cmpstr (packet, "title", ==, "Test Title");
   v_assert_packet_cmpstr (packet, "body", ==, "Test Body");
   v_assert_packet_cmpstr (packet, "ticker", ==, "Test Title: Test Body");
+  v_assert_packet_field (packet, "payloadHash");
+  g_assert_true (valent_packet_has_payload (packet));
+
+  valent_packet_get_string (packet, "payloadHash", &cached_hash);
+  payload_hash = g_strdup (cached_hash);
+  valent_test_fixture_download (fixture, packet, NULL);
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin reuses encoded icons from the cache");
+  cache_hits = valent_notification_upload_get_cache_hits ();
+  g_clear_object (&icon);
+  icon = g_bytes_icon_new (bytes);
+  valent_notification_set_icon (notification, icon);
+  valent_notifications_adapter_notification_added (adapter, notification);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.notification");
+  v_assert_packet_cmpstr (packet, "payloadHash", ==, payload_hash);
   g_assert_true (valent_packet_has_payload (packet));
+  g_assert_cmpuint (valent_notification_upload_get_cache_hits (), ==, cache_hits + 1);
+
+  valent_test_fixture_download (fixture, packet, NULL);
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin re-encodes file icons that were rewritten in place");
+  g_clear_object (&file);
+  g_clear_object (&icon);
+  g_clear_pointer (&payload_hash, g_free);
+  file = g_file_new_tmp ("valent-icon-XXXXXX.png", &stream, &error);
+  g_assert_no_error (error);
+  g_file_replace_contents (file,
+                           g_bytes_get_data (bytes, NULL),
+                           g_bytes_get_size (bytes),
+                           NULL, FALSE, G_FILE_CREATE_NONE, NULL,
+                           NULL, &error);
+  g_assert_no_error (error);
+
+  icon = g_file_icon_new (file);
+  valent_notification_set_icon (notification, icon);
+  valent_notifications_adapter_notification_added (adapter, notification);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  valent_packet_get_string (packet, "payloadHash", &cached_hash);
+  payload_hash = g_strdup (cached_hash);
+  valent_test_fixture_download (fixture, packet, NULL);
+  json_node_unref (packet);
+
+  cache_hits = valent_notification_upload_get_cache_hits ();
+  valent_notifications_adapter_notification_added (adapter, notification);
 
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_cmpstr (packet, "payloadHash", ==, payload_hash);
+  g_assert_cmpuint (valent_notification_upload_get_cache_hits (), ==, cache_hits + 1);
   valent_test_fixture_download (fixture, packet, NULL);
   json_node_unref (packet);
 
+  g_file_replace_contents (file,
+                           "not an image", strlen ("not an image"),
+                           NULL, FALSE, G_FILE_CREATE_NONE, NULL,
+                           NULL, &error);
+  g_assert_no_error (error);
+
+  cache_hits = valent_notification_upload_get_cache_hits ();
+  valent_notifications_adapter_notification_added (adapter, notification);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_cmpstr (packet, "payloadHash", !=, payload_hash);
+  g_assert_cmpuint (valent_notification_upload_get_cache_hits (), ==, cache_hits);
+  valent_test_fixture_download (fixture, packet, NULL);
+  json_node_unref (packet);
+
+  g_file_delete (file, NULL, NULL);
+
   VALENT_TEST_CHECK ("Plugin forwards notification removals");
   valent_notifications_adapter_notification_removed (adapter, "test-id");
 
@@ -2,6 +2,7 @@
 // SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
 
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 #include <valent.h>
 #include <libvalent-test.h>
 
@@ -101,6 +102,184 @@ test_runcommand_plugin_send_request (ValentTestFixture *fixture,
   valent_test_fixture_handle_packet (fixture, packet);
 }
 
+static unsigned int
+count_lines (const char *path)
+{
+  g_autofree char *contents = NULL;
+  unsigned int n_lines = 0;
+
+  if (!g_file_get_contents (path, &contents, NULL, NULL))
+    return 0;
+
+  for (const char *p = contents; *p != '\0'; p++)
+    {
+      if (*p == '\n')
+        n_lines++;
+    }
+
+  return n_lines;
+}
+
+/*
+ * The log each queued command appends to, in the isolated cache directory.
+ */
+static char *
+queue_log_path (void)
+{
+  return g_build_filename (g_get_user_cache_dir (), "runcommand-queue.log", NULL);
+}
+
+static void
+queue_fixture_clear (ValentTestFixture *fixture,
+                     gconstpointer      user_data)
+{
+  g_autofree char *path = queue_log_path ();
+
+  g_unlink (path);
+  valent_test_fixture_clear (fixture, user_data);
+}
+
+/*
+ * Set `command1` to run @prefix and @suffix, joined by the quoted log path.
+ */
+static void
+set_queue_command (ValentTestFixture *fixture,
+                   const char        *prefix,
+                   const char        *suffix)
+{
+  g_autofree char *path = queue_log_path ();
+  g_autofree char *path_quoted = g_shell_quote (path);
+  g_autofree char *command_line = NULL;
+  GVariantDict dict;
+  GVariant *command, *commands;
+
+  command_line = g_strconcat (prefix, path_quoted, suffix, NULL);
+
+  g_variant_dict_init (&dict, NULL);
+  g_variant_dict_insert (&dict, "name", "s", "Test Command");
+  g_variant_dict_insert (&dict, "command", "s", command_line);
+  command = g_variant_dict_end (&dict);
+
+  g_variant_dict_init (&dict, NULL);
+  g_variant_dict_insert_value (&dict, "command1", command);
+  commands = g_variant_dict_end (&dict);
+
+  g_settings_set_value (fixture->settings, "commands", commands);
+}
+
+static void
+test_runcommand_plugin_queue (ValentTestFixture *fixture,
+                              gconstpointer      user_data)
+{
+  g_autofree char *path = queue_log_path ();
+  JsonNode *packet;
+
+  /* Each command records that it started, then outlives its timeout */
+  set_queue_command (fixture, "echo started; echo started >> ", "; sleep 10");
+  g_settings_set_uint (fixture->settings, "max-concurrent", 2);
+  g_settings_set_uint (fixture->settings, "timeout", 1);
+  g_settings_set_boolean (fixture->settings, "send-output", TRUE);
+
+  valent_test_fixture_connect (fixture, TRUE);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.runcommand");
+  v_assert_packet_field (packet, "commandList");
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin queues requests in excess of `max-concurrent`");
+  packet = valent_test_fixture_lookup_packet (fixture, "command-execute");
+
+  for (unsigned int i = 0; i < 3; i++)
+    valent_test_fixture_handle_packet (fixture, packet);
+
+  valent_test_await_timeout (500);
+  g_assert_cmpuint (count_lines (path), ==, 2);
+
+  VALENT_TEST_CHECK ("Plugin stops commands that exceed `timeout`, and sends "
+                     "the captured output");
+  for (unsigned int i = 0; i < 3; i++)
+    {
+      packet = valent_test_fixture_expect_packet (fixture);
+      v_assert_packet_type (packet, "kdeconnect.runcommand");
+      v_assert_packet_cmpstr (packet, "key", ==, "command1");
+      v_assert_packet_cmpstr (packet, "output", ==, "started\n");
+      v_assert_packet_cmpint (packet, "exitStatus", ==, -1);
+      json_node_unref (packet);
+    }
+
+  VALENT_TEST_CHECK ("Plugin runs queued requests as others finish");
+  g_assert_cmpuint (count_lines (path), ==, 3);
+}
+
+static void
+test_runcommand_plugin_queue_limit (ValentTestFixture *fixture,
+                                    gconstpointer      user_data)
+{
+  g_autofree char *path = queue_log_path ();
+  JsonNode *packet;
+
+  /* Each command records that it started, then holds its slot briefly */
+  set_queue_command (fixture, "echo started >> ", "; sleep 0.1");
+  g_settings_set_uint (fixture->settings, "max-concurrent", 1);
+
+  valent_test_fixture_connect (fixture, TRUE);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.runcommand");
+  v_assert_packet_field (packet, "commandList");
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin drops requests when the queue is full, and "
+                     "reports them once per burst");
+  g_test_expect_message ("valent-runcommand-plugin",
+                         G_LOG_LEVEL_MESSAGE,
+                         "*too many pending commands*");
+  g_test_expect_message ("valent-runcommand-plugin",
+                         G_LOG_LEVEL_MESSAGE,
+                         "*dropped 2 command requests*");
+
+  /* One running, sixteen pending and two dropped */
+  packet = valent_test_fixture_lookup_packet (fixture, "command-execute");
+
+  for (unsigned int i = 0; i < 19; i++)
+    valent_test_fixture_handle_packet (fixture, packet);
+
+  while (count_lines (path) < 17)
+    valent_test_await_timeout (100);
+
+  g_test_assert_expected_messages ();
+  g_assert_cmpuint (count_lines (path), ==, 17);
+}
+
+static void
+test_runcommand_plugin_slots (ValentTestFixture *fixture,
+                              gconstpointer      user_data)
+{
+  g_autofree char *path = queue_log_path ();
+  JsonNode *packet;
+
+  /* Each command records that it started, and leaves a child running */
+  set_queue_command (fixture, "echo started >> ", "; sleep 2 >/dev/null 2>&1 &");
+  g_settings_set_uint (fixture->settings, "max-concurrent", 1);
+
+  valent_test_fixture_connect (fixture, TRUE);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.runcommand");
+  v_assert_packet_field (packet, "commandList");
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin frees a slot when the launched process exits");
+  packet = valent_test_fixture_lookup_packet (fixture, "command-execute");
+
+  for (unsigned int i = 0; i < 3; i++)
+    valent_test_fixture_handle_packet (fixture, packet);
+
+  valent_test_await_timeout (500);
+  g_assert_cmpuint (count_lines (path), ==, 3);
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -127,5 +306,23 @@ main (int   argc,
               test_runcommand_plugin_send_request,
               valent_test_fixture_clear);
 
+  g_test_add ("/plugins/runcommand/queue",
+              ValentTestFixture, path,
+              valent_test_fixture_init,
+              test_runcommand_plugin_queue,
+              queue_fixture_clear);
+
+  g_test_add ("/plugins/runcommand/queue-limit",
+              ValentTestFixture, path,
+              valent_test_fixture_init,
+              test_runcommand_plugin_queue_limit,
+              queue_fixture_clear);
+
+  g_test_add ("/plugins/runcommand/slots",
+              ValentTestFixture, path,
+              valent_test_fixture_init,
+              test_runcommand_plugin_slots,
+              queue_fixture_clear);
+
   return g_test_run ();
 }
@@ -2,9 +2,127 @@
 // SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
 
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 #include <valent.h>
 #include <libvalent-test.h>
 
+static char *path_orig = NULL;
+
+
+/*
+ * A stub `ssh-add` that logs its arguments, and an ssh-agent that lists the
+ * key once it's been added, until the agent file is removed.
+ */
+static const char ssh_add_stub[] =
+  "#!/bin/sh\n"
+  "echo \"$*\" >> \"$(dirname \"$0\")/ssh-add.log\"\n"
+  "if [ \"$1\" = \"-l\" ]; then\n"
+  "  cat \"$(dirname \"$0\")/ssh-agent\" 2>/dev/null && exit 0\n"
+  "  echo \"The agent has no identities.\"\n"
+  "  exit 1\n"
+  "fi\n"
+  "echo \"256 SHA256:test $1 (RSA)\" > \"$(dirname \"$0\")/ssh-agent\"\n";
+
+static char *
+ssh_stub_path (const char *name)
+{
+  return g_build_filename (g_get_user_cache_dir (), "bin", name, NULL);
+}
+
+static unsigned int
+ssh_add_count (void)
+{
+  g_autofree char *path = ssh_stub_path ("ssh-add.log");
+  g_autofree char *contents = NULL;
+  unsigned int n_lines = 0;
+
+  if (!g_file_get_contents (path, &contents, NULL, NULL))
+    return 0;
+
+  for (const char *p = contents; *p != '\0'; p++)
+    {
+      if (*p == '\n')
+        n_lines++;
+    }
+
+  return n_lines;
+}
+
+static void
+ssh_add_await (unsigned int n_lines)
+{
+  while (ssh_add_count () < n_lines)
+    valent_test_await_timeout (10);
+
+  /* Allow the mount operation to fail */
+  valent_test_await_timeout (250);
+}
+
+static void
+sftp_fixture_init (ValentTestFixture *fixture,
+                   gconstpointer      user_data)
+{
+  g_autofree char *bindir = NULL;
+  g_autofree char *ssh_add = NULL;
+  g_autofree char *path = NULL;
+  GError *error = NULL;
+
+  valent_test_fixture_init (fixture, user_data);
+
+  bindir = g_build_filename (g_get_user_cache_dir (), "bin", NULL);
+  g_assert_no_errno (g_mkdir_with_parents (bindir, 0700));
+
+  ssh_add = ssh_stub_path ("ssh-add");
+  g_file_set_contents (ssh_add, ssh_add_stub, -1, &error);
+  g_assert_no_error (error);
+  g_assert_no_errno (g_chmod (ssh_add, 0700));
+
+  path = g_strconcat (bindir, G_SEARCHPATH_SEPARATOR_S, path_orig, NULL);
+  g_setenv ("PATH", path, TRUE);
+}
+
+static void
+sftp_fixture_clear (ValentTestFixture *fixture,
+                    gconstpointer      user_data)
+{
+  const char * const names[] = { "ssh-add", "ssh-add.log", "ssh-agent" };
+
+  g_setenv ("PATH", path_orig, TRUE);
+
+  for (unsigned int i = 0; i < G_N_ELEMENTS (names); i++)
+    {
+      g_autofree char *path = ssh_stub_path (names[i]);
+
+      g_remove (path);
+    }
+
+  valent_test_fixture_clear (fixture, user_data);
+}
+
+/*
+ * Replace the closed channel pair, as the device does when it reconnects.
+ */
+static void
+sftp_fixture_reconnect (ValentTestFixture *fixture)
+{
+  g_autofree ValentChannel **channels = NULL;
+  JsonNode *identity;
+
+  valent_test_fixture_connect (fixture, FALSE);
+
+  valent_channel_close (fixture->endpoint, NULL, NULL);
+  v_await_finalize_object (fixture->endpoint);
+  valent_channel_close (fixture->channel, NULL, NULL);
+  v_await_finalize_object (fixture->channel);
+
+  identity = valent_test_fixture_lookup_packet (fixture, "identity");
+  channels = valent_test_channel_pair (identity, identity);
+  fixture->channel = g_steal_pointer (&channels[0]);
+  fixture->endpoint = g_steal_pointer (&channels[1]);
+
+  valent_test_fixture_connect (fixture, TRUE);
+}
+
 
 static void
 test_sftp_plugin_basic (ValentTestFixture *fixture,
@@ -54,6 +172,94 @@ test_sftp_plugin_send_request (ValentTestFixture *fixture,
   json_node_unref (packet);
 }
 
+static void
+test_sftp_plugin_auto_mount (ValentTestFixture *fixture,
+                             gconstpointer      user_data)
+{
+  g_autofree char *agent = ssh_stub_path ("ssh-agent");
+  JsonNode *packet;
+
+  g_settings_set_boolean (fixture->settings, "auto-mount", TRUE);
+
+  VALENT_TEST_CHECK ("Plugin requests an SFTP session when connected, if "
+                     "`auto-mount` is enabled");
+  valent_test_fixture_connect (fixture, TRUE);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.sftp.request");
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin adds the private key to the ssh-agent before "
+                     "mounting");
+  packet = valent_test_fixture_lookup_packet (fixture, "sftp-mount");
+  valent_test_fixture_handle_packet (fixture, packet);
+
+  ssh_add_await (2);
+  g_assert_cmpuint (ssh_add_count (), ==, 2);
+
+  VALENT_TEST_CHECK ("Plugin remounts a cached session when reconnected, "
+                     "without adding the key again");
+  sftp_fixture_reconnect (fixture);
+
+  VALENT_TEST_CHECK ("Plugin requests a new SFTP session if the cached "
+                     "session fails to mount");
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.sftp.request");
+  json_node_unref (packet);
+
+  g_assert_cmpuint (ssh_add_count (), ==, 3);
+
+  VALENT_TEST_CHECK ("Plugin adds the private key again, if the ssh-agent "
+                     "no longer holds it");
+  g_remove (agent);
+
+  packet = valent_test_fixture_lookup_packet (fixture, "sftp-mount");
+  valent_test_fixture_handle_packet (fixture, packet);
+
+  ssh_add_await (5);
+  g_assert_cmpuint (ssh_add_count (), ==, 5);
+}
+
+static void
+test_sftp_plugin_remount (ValentTestFixture *fixture,
+                          gconstpointer      user_data)
+{
+  GActionGroup *actions = G_ACTION_GROUP (fixture->device);
+  JsonNode *packet;
+
+  g_settings_set_boolean (fixture->settings, "auto-mount", FALSE);
+  valent_test_fixture_connect (fixture, TRUE);
+
+  g_action_group_activate_action (actions, "sftp.browse", NULL);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.sftp.request");
+  json_node_unref (packet);
+
+  packet = valent_test_fixture_lookup_packet (fixture, "sftp-mount");
+  valent_test_fixture_handle_packet (fixture, packet);
+
+  ssh_add_await (2);
+  g_assert_cmpuint (ssh_add_count (), ==, 2);
+
+  VALENT_TEST_CHECK ("Plugin does not remount a cached session when "
+                     "reconnected, if `auto-mount` is disabled");
+  sftp_fixture_reconnect (fixture);
+
+  valent_test_await_timeout (250);
+  g_assert_cmpuint (ssh_add_count (), ==, 2);
+
+  VALENT_TEST_CHECK ("Plugin action `sftp.browse` remounts a cached session, "
+                     "then requests a new session if that fails");
+  g_action_group_activate_action (actions, "sftp.browse", NULL);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.sftp.request");
+  json_node_unref (packet);
+
+  g_assert_cmpuint (ssh_add_count (), ==, 3);
+}
+
 static const char *schemas[] = {
   "/tests/kdeconnect.sftp.json",
   "/tests/kdeconnect.sftp.request.json",
@@ -79,6 +285,8 @@ main (int   argc,
 
   valent_test_init (&argc, &argv, NULL);
 
+  path_orig = g_strdup (g_getenv ("PATH"));
+
   g_test_add ("/plugins/sftp/basic",
               ValentTestFixture, path,
               valent_test_fixture_init,
@@ -91,6 +299,18 @@ main (int   argc,
               test_sftp_plugin_send_request,
               valent_test_fixture_clear);
 
+  g_test_add ("/plugins/sftp/auto-mount",
+              ValentTestFixture, path,
+              sftp_fixture_init,
+              test_sftp_plugin_auto_mount,
+              sftp_fixture_clear);
+
+  g_test_add ("/plugins/sftp/remount",
+              ValentTestFixture, path,
+              sftp_fixture_init,
+              test_sftp_plugin_remount,
+              sftp_fixture_clear);
+
   g_test_add ("/plugins/sftp/fuzz",
               ValentTestFixture, path,
               valent_test_fixture_init,
@@ -0,0 +1,232 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#include <gdk/gdk.h>
+#include <valent.h>
+#include <libvalent-test.h>
+
+#include "test-sms-common.h"
+#include "valent-sms-store.h"
+#include "valent-sms-utils.h"
+
+#define N_CONTACTS 1000
+#define N_LOOKUPS  100
+#define N_MESSAGES 10000
+#define N_SEARCHES 100
+#define N_THREADS  100
+
+
+static void
+add_messages_cb (ValentSmsStore *store,
+                 GAsyncResult   *result,
+                 gboolean       *done)
+{
+  g_autoptr (GError) error = NULL;
+
+  valent_sms_store_add_messages_finish (store, result, &error);
+  g_assert_no_error (error);
+
+  *done = TRUE;
+}
+
+static void
+find_messages_cb (ValentSmsStore  *store,
+                  GAsyncResult    *result,
+                  GPtrArray      **messages)
+{
+  g_autoptr (GError) error = NULL;
+
+  *messages = valent_sms_store_find_messages_finish (store, result, &error);
+  g_assert_no_error (error);
+}
+
+static void
+add_contacts_cb (ValentContactStore *store,
+                 GAsyncResult       *result,
+                 gboolean           *done)
+{
+  g_autoptr (GError) error = NULL;
+
+  valent_contact_store_add_contacts_finish (store, result, &error);
+  g_assert_no_error (error);
+
+  *done = TRUE;
+}
+
+static void
+contact_from_phone_cb (ValentContactStore  *store,
+                       GAsyncResult        *result,
+                       EContact           **contact)
+{
+  g_autoptr (GError) error = NULL;
+
+  *contact = valent_sms_contact_from_phone_finish (store, result, &error);
+  g_assert_no_error (error);
+}
+
+static GPtrArray *
+generate_messages (void)
+{
+  GPtrArray *messages;
+
+  messages = g_ptr_array_new_full (N_MESSAGES, g_object_unref);
+
+  for (unsigned int i = 0; i < N_MESSAGES; i++)
+    {
+      g_autofree char *address = NULL;
+      g_autofree char *text = NULL;
+      GVariant *metadata;
+      unsigned int thread_id = (i % N_THREADS) + 1;
+
+      address = g_strdup_printf ("+1-555-%07u", thread_id);
+      text = g_strdup_printf ("Thread %u, Message %u", thread_id, i + 1);
+      metadata = g_variant_new_parsed ("{'addresses': <[{'address': <%s>}]>}",
+                                       address);
+      g_ptr_array_add (messages,
+                       g_object_new (VALENT_TYPE_MESSAGE,
+                                     "box",       (i % 2)
+                                                    ? VALENT_MESSAGE_BOX_SENT
+                                                    : VALENT_MESSAGE_BOX_INBOX,
+                                     "date",      (int64_t)i + 1,
+                                     "id",        (int64_t)i + 1,
+                                     "metadata",  metadata,
+                                     "read",      TRUE,
+                                     "sender",    (i % 2) ? NULL : address,
+                                     "text",      text,
+                                     "thread-id", (int64_t)thread_id,
+                                     NULL));
+    }
+
+  return messages;
+}
+
+static void
+bench_sms_store (void)
+{
+  g_autoptr (ValentContext) context = NULL;
+  g_autoptr (ValentSmsStore) store = NULL;
+  g_autoptr (GPtrArray) messages = NULL;
+  gboolean done = FALSE;
+  double elapsed;
+
+  context = g_object_new (VALENT_TYPE_CONTEXT,
+                          "domain", "device",
+                          "id",     "bench-device",
+                          NULL);
+  store = valent_sms_store_new (context);
+  messages = generate_messages ();
+
+  VALENT_TEST_CHECK ("Store can have messages added in bulk");
+  g_test_timer_start ();
+  valent_sms_store_add_messages (store,
+                                 messages,
+                                 NULL,
+                                 (GAsyncReadyCallback)add_messages_cb,
+                                 &done);
+  valent_test_await_boolean (&done);
+  elapsed = g_test_timer_elapsed ();
+
+  valent_test_benchmark ("bulk insert rate", "messages/s",
+                         N_MESSAGES / elapsed,
+                         TRUE);
+
+  VALENT_TEST_CHECK ("Store can have messages searched");
+  g_test_timer_start ();
+
+  for (unsigned int i = 0; i < N_SEARCHES; i++)
+    {
+      g_autoptr (GPtrArray) results = NULL;
+      g_autofree char *query = NULL;
+
+      query = g_strdup_printf ("Thread %u,", (i % N_THREADS) + 1);
+      valent_sms_store_find_messages (store,
+                                      query,
+                                      NULL,
+                                      (GAsyncReadyCallback)find_messages_cb,
+                                      &results);
+      valent_test_await_pointer (&results);
+      g_assert_cmpuint (results->len, >, 0);
+    }
+
+  elapsed = g_test_timer_elapsed ();
+
+  valent_test_benchmark ("search latency", "ms/query",
+                         elapsed * 1000 / N_SEARCHES,
+                         FALSE);
+}
+
+static void
+bench_sms_contact_from_phone (void)
+{
+  ValentContactStore *store = NULL;
+  g_autoptr (GSList) contacts = NULL;
+  gboolean done = FALSE;
+  double elapsed;
+
+  store = valent_contacts_ensure_store (valent_contacts_get_default (),
+                                        "bench-device",
+                                        "Benchmark Device");
+
+  for (unsigned int i = 0; i < N_CONTACTS; i++)
+    {
+      g_autofree char *uid = NULL;
+      g_autofree char *vcard = NULL;
+
+      uid = g_strdup_printf ("bench-contact%u", i);
+      vcard = g_strdup_printf ("BEGIN:VCARD\n"
+                               "VERSION:2.1\n"
+                               "FN:Contact %u\n"
+                               "TEL;CELL:+1-555-%07u\n"
+                               "END:VCARD",
+                               i, i);
+      contacts = g_slist_prepend (contacts,
+                                  e_contact_new_from_vcard_with_uid (vcard, uid));
+    }
+
+  valent_contact_store_add_contacts (store,
+                                     contacts,
+                                     NULL,
+                                     (GAsyncReadyCallback)add_contacts_cb,
+                                     &done);
+  valent_test_await_boolean (&done);
+  g_slist_foreach (contacts, (GFunc)g_object_unref, NULL);
+
+  VALENT_TEST_CHECK ("Function `valent_sms_contact_from_phone()` performance");
+  g_test_timer_start ();
+
+  for (unsigned int i = 0; i < N_LOOKUPS; i++)
+    {
+      g_autoptr (EContact) contact = NULL;
+      g_autofree char *number = NULL;
+
+      /* Format the number differently than the vCard, to force normalization */
+      number = g_strdup_printf ("1555%07u", (i * 7) % N_CONTACTS);
+      valent_sms_contact_from_phone (store,
+                                     number,
+                                     NULL,
+                                     (GAsyncReadyCallback)contact_from_phone_cb,
+                                     &contact);
+      valent_test_await_pointer (&contact);
+    }
+
+  elapsed = g_test_timer_elapsed ();
+
+  valent_test_benchmark ("phone lookup latency", "ms/lookup",
+                         elapsed * 1000 / N_LOOKUPS,
+                         FALSE);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  valent_test_ui_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/plugins/sms/store",
+                   bench_sms_store);
+
+  g_test_add_func ("/plugins/sms/contact-from-phone",
+                   bench_sms_contact_from_phone);
+
+  return g_test_run ();
+}
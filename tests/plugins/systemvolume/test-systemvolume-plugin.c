@@ -160,15 +160,19 @@ test_systemvolume_plugin_handle_request (ValentTestFixture *fixture,
   valent_test_await_boolean (&watch);
   g_assert_true (valent_mixer_adapter_get_default_output (info->adapter) == info->sink2);
 
+  VALENT_TEST_CHECK ("Plugin sends an update for the previous and current default output");
   packet = valent_test_fixture_expect_packet (fixture);
   v_assert_packet_type (packet, "kdeconnect.systemvolume");
-  v_assert_packet_field (packet, "sinkList");
-  g_assert_true (valent_packet_get_array (packet, "sinkList", &sink_list));
-  g_assert_cmpuint (json_array_get_length (sink_list), ==, 2);
-  sink_info = json_array_get_object_element (sink_list, 0);
-  g_assert_cmpstr (json_object_get_string_member (sink_info, "name"), ==, "test_sink1");
-  sink_info = json_array_get_object_element (sink_list, 1);
-  g_assert_cmpstr (json_object_get_string_member (sink_info, "name"), ==, "test_sink2");
+  v_assert_packet_no_field (packet, "sinkList");
+  v_assert_packet_cmpstr (packet, "name", ==, "test_sink1");
+  v_assert_packet_false (packet, "enabled");
+  json_node_unref (packet);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.systemvolume");
+  v_assert_packet_no_field (packet, "sinkList");
+  v_assert_packet_cmpstr (packet, "name", ==, "test_sink2");
+  v_assert_packet_true (packet, "enabled");
   json_node_unref (packet);
 
   VALENT_TEST_CHECK ("Plugin handles a request to change the default output");
@@ -180,13 +184,14 @@ test_systemvolume_plugin_handle_request (ValentTestFixture *fixture,
 
   packet = valent_test_fixture_expect_packet (fixture);
   v_assert_packet_type (packet, "kdeconnect.systemvolume");
-  v_assert_packet_field (packet, "sinkList");
-  g_assert_true (valent_packet_get_array (packet, "sinkList", &sink_list));
-  g_assert_cmpuint (json_array_get_length (sink_list), ==, 2);
-  sink_info = json_array_get_object_element (sink_list, 0);
-  g_assert_cmpstr (json_object_get_string_member (sink_info, "name"), ==, "test_sink1");
-  sink_info = json_array_get_object_element (sink_list, 1);
-  g_assert_cmpstr (json_object_get_string_member (sink_info, "name"), ==, "test_sink2");
+  v_assert_packet_cmpstr (packet, "name", ==, "test_sink1");
+  v_assert_packet_true (packet, "enabled");
+  json_node_unref (packet);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.systemvolume");
+  v_assert_packet_cmpstr (packet, "name", ==, "test_sink2");
+  v_assert_packet_false (packet, "enabled");
   json_node_unref (packet);
 
   VALENT_TEST_CHECK ("Plugin sends the sink list when a stream is removed");
@@ -219,6 +224,79 @@ test_systemvolume_plugin_handle_request (ValentTestFixture *fixture,
   valent_test_watch_clear (info->sink1, &watch_muted);
 }
 
+static void
+test_systemvolume_plugin_send_update (ValentTestFixture *fixture,
+                                      gconstpointer      user_data)
+{
+  MixerInfo *info = fixture->data;
+  g_autoptr (GPtrArray) sinks = NULL;
+  JsonNode *packet;
+  JsonArray *sink_list;
+  g_autofree char *data = NULL;
+  size_t sinklist_size = 0;
+  size_t update_size = 0;
+  unsigned int n_updates = 0;
+  int64_t volume = 0;
+
+  /* Sixteen outputs, so the sink list is much larger than an update */
+  sinks = g_ptr_array_new_with_free_func (g_object_unref);
+  valent_mixer_adapter_stream_added (info->adapter, info->sink1);
+  valent_mixer_adapter_stream_added (info->adapter, info->sink2);
+
+  for (unsigned int i = 3; i <= 16; i++)
+    {
+      g_autofree char *name = g_strdup_printf ("test_sink%u", i);
+      ValentMixerStream *sink = NULL;
+
+      sink = g_object_new (VALENT_TYPE_MIXER_STREAM,
+                           "name",        name,
+                           "description", "Test Output",
+                           "direction",   VALENT_MIXER_OUTPUT,
+                           "level",       100,
+                           "muted",       FALSE,
+                           NULL);
+      valent_mixer_adapter_stream_added (info->adapter, sink);
+      g_ptr_array_add (sinks, sink);
+    }
+
+  valent_test_fixture_connect (fixture, TRUE);
+
+  packet = valent_test_fixture_expect_packet (fixture);
+  v_assert_packet_type (packet, "kdeconnect.systemvolume");
+  g_assert_true (valent_packet_get_array (packet, "sinkList", &sink_list));
+  g_assert_cmpuint (json_array_get_length (sink_list), ==, 16);
+  data = valent_packet_serialize (packet);
+  sinklist_size = strlen (data);
+  g_clear_pointer (&data, g_free);
+  json_node_unref (packet);
+
+  VALENT_TEST_CHECK ("Plugin sends rate-limited deltas while a volume slider is dragged");
+  for (unsigned int level = 0; level <= 100; level++)
+    {
+      valent_mixer_stream_set_level (info->sink2, level);
+      g_main_context_iteration (NULL, FALSE);
+    }
+
+  while (volume != 100)
+    {
+      packet = valent_test_fixture_expect_packet (fixture);
+      v_assert_packet_type (packet, "kdeconnect.systemvolume");
+      v_assert_packet_no_field (packet, "sinkList");
+      v_assert_packet_cmpstr (packet, "name", ==, "test_sink2");
+      g_assert_true (valent_packet_get_int (packet, "volume", &volume));
+
+      data = valent_packet_serialize (packet);
+      update_size = MAX (update_size, strlen (data));
+      g_clear_pointer (&data, g_free);
+      n_updates++;
+      json_node_unref (packet);
+    }
+
+  /* Each update is independent of the number of sinks */
+  g_assert_cmpuint (n_updates, <, 101);
+  g_assert_cmpuint (update_size * 8, <, sinklist_size);
+}
+
 int
 main (int   argc,
       char *argv[])
@@ -233,5 +311,11 @@ main (int   argc,
               test_systemvolume_plugin_handle_request,
               valent_test_fixture_clear);
 
+  g_test_add ("/plugins/systemvolume/send-update",
+              ValentTestFixture, path,
+              systemvolume_plugin_fixture_set_up,
+              test_systemvolume_plugin_send_update,
+              valent_test_fixture_clear);
+
   return g_test_run ();
 }
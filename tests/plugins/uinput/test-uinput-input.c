@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// SPDX-FileCopyrightText: Andy Holmes <andrew.g.r.holmes@gmail.com>
+
+#include <string.h>
+#include <unistd.h>
+
+#include <valent.h>
+#include <libvalent-test.h>
+#include <xkbcommon/xkbcommon-keysyms.h>
+
+#include "valent-uinput-input.h"
+
+#define UINPUT_DEVICE_NAME "Valent Virtual Input"
+#define N_EVENTS (1000)
+
+
+static gboolean
+input_device_exists (void)
+{
+  g_autofree char *devices = NULL;
+
+  if (!g_file_get_contents ("/proc/bus/input/devices", &devices, NULL, NULL))
+    return FALSE;
+
+  return strstr (devices, UINPUT_DEVICE_NAME) != NULL;
+}
+
+static void
+test_uinput_input_adapter (void)
+{
+  g_autoptr (ValentInputAdapter) adapter = NULL;
+  ValentPluginState state;
+  int64_t begin, elapsed;
+  g_autoptr (GError) error = NULL;
+
+  /* The virtual device injects real events into the running session */
+  if (g_getenv ("VALENT_TEST_UINPUT") == NULL)
+    {
+      g_test_skip ("Set VALENT_TEST_UINPUT to inject events with /dev/uinput");
+      return;
+    }
+
+  if (access ("/dev/uinput", W_OK) != 0)
+    {
+      g_test_skip ("/dev/uinput is not writable");
+      return;
+    }
+
+  VALENT_TEST_CHECK ("Adapter creates a virtual device");
+  adapter = g_initable_new (VALENT_TYPE_UINPUT_INPUT, NULL, &error, NULL);
+  g_assert_no_error (error);
+
+  state = valent_extension_plugin_state_check (VALENT_EXTENSION (adapter), NULL);
+  g_assert_cmpuint (state, ==, VALENT_PLUGIN_STATE_ACTIVE);
+  g_assert_true (input_device_exists ());
+
+  VALENT_TEST_CHECK ("Adapter can emit keyboard events");
+  valent_input_adapter_keyboard_keysym (adapter, XKB_KEY_a, TRUE);
+  valent_input_adapter_keyboard_keysym (adapter, XKB_KEY_a, FALSE);
+  valent_input_adapter_keyboard_keysym (adapter, XKB_KEY_A, TRUE);
+  valent_input_adapter_keyboard_keysym (adapter, XKB_KEY_A, FALSE);
+
+  VALENT_TEST_CHECK ("Adapter ignores keysyms missing from the keymap");
+  valent_input_adapter_keyboard_keysym (adapter, 0x10fffff, TRUE);
+  valent_input_adapter_keyboard_keysym (adapter, 0x10fffff, FALSE);
+
+  VALENT_TEST_CHECK ("Adapter can emit pointer events");
+  valent_input_adapter_pointer_axis (adapter, 0.0, 1.0);
+  valent_input_adapter_pointer_axis (adapter, 0.5, -0.5);
+  valent_input_adapter_pointer_button (adapter, VALENT_POINTER_PRIMARY, TRUE);
+  valent_input_adapter_pointer_button (adapter, VALENT_POINTER_PRIMARY, FALSE);
+  valent_input_adapter_pointer_motion (adapter, 1.0, 1.0);
+  valent_input_adapter_pointer_motion (adapter, 0.5, -0.5);
+
+  VALENT_TEST_CHECK ("Adapter emits events with low latency");
+  begin = g_get_monotonic_time ();
+  for (unsigned int i = 0; i < N_EVENTS; i++)
+    valent_input_adapter_pointer_motion (adapter, 1.0, 0.0);
+  elapsed = g_get_monotonic_time () - begin;
+
+  g_test_minimized_result ((double)elapsed / N_EVENTS,
+                           "%.2fµs per pointer motion event",
+                           (double)elapsed / N_EVENTS);
+
+  VALENT_TEST_CHECK ("Adapter removes the virtual device when destroyed");
+  valent_object_destroy (VALENT_OBJECT (adapter));
+  g_assert_false (input_device_exists ());
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  valent_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/plugins/uinput/input-adapter",
+                   test_uinput_input_adapter);
+
+  return g_test_run ();
+}